@@ -51,6 +51,33 @@ chech_use_crypt(){
   fi
 }
 
+# Read options of luksFormat chosen by installer into $LUKS_OPTS.
+# Defaults of cryptsetup are used if they are not set.
+get_luks_opts(){
+  local cipher=$(installer_get DI_CRYPT_CIPHER)
+  local key_size=$(installer_get DI_CRYPT_KEY_SIZE)
+  local pbkdf=$(installer_get DI_CRYPT_PBKDF)
+  local memory=$(installer_get DI_CRYPT_PBKDF_MEMORY)
+  local parallel=$(installer_get DI_CRYPT_PBKDF_PARALLEL)
+  local iterations=$(installer_get DI_CRYPT_PBKDF_ITERATIONS)
+  local iter_time=$(installer_get DI_CRYPT_ITER_TIME)
+
+  LUKS_OPTS=()
+  if [ -n "$cipher" ]; then
+    LUKS_OPTS+=(--cipher "$cipher" --key-size "$key_size")
+  fi
+  if [ -n "$pbkdf" ]; then
+    # argon2 is supported by LUKS2 only.
+    LUKS_OPTS+=(--type luks2 --pbkdf "$pbkdf" --pbkdf-memory "$memory" \
+                --pbkdf-parallel "$parallel")
+    if ((iterations > 0)); then
+      LUKS_OPTS+=(--pbkdf-force-iterations "$iterations")
+    else
+      LUKS_OPTS+=(--iter-time "$iter_time")
+    fi
+  fi
+}
+
 # Flush kernel message.
 flush_message(){
   udevadm settle --timeout=5
@@ -277,8 +304,11 @@ create_part(){
       installer_set DI_CRYPT_PARTITION "$part_path"
       installer_set DI_CRYPT_TARGET "$mapper_name"
 
+      get_luks_opts
+      echo "luksFormat options: ${LUKS_OPTS[*]}"
       {
-        echo -n "$DI_CRYPT_PASSWD" | cryptsetup -v luksFormat "$part_path" &&\
+        echo -n "$DI_CRYPT_PASSWD" |\
+          cryptsetup -v luksFormat "${LUKS_OPTS[@]}" "$part_path" &&\
         echo -n "$DI_CRYPT_PASSWD" | cryptsetup open "$part_path" "$mapper_name"
       } || error "Failed to create luks partition($part_path)!"
 
@@ -127,3 +127,52 @@ is_arm64() {
       ;;
   esac
 }
+
+# Files used to generate initramfs only once in installation.
+# Paths are relative to root of target system.
+INITRAMFS_DIRTY_FILE=/var/lib/deepin-installer/initramfs_dirty
+INITRAMFS_HASH_FILE=/var/lib/deepin-installer/initramfs_inputs.sha256
+
+# Print root folder of target system, which is empty in chroot env.
+target_root() {
+  if [ -d /target/etc ]; then
+    echo /target
+  fi
+}
+
+# Mark initramfs to be regenerated in after_chroot/50_update_initramfs.job,
+# instead of calling update-initramfs in each hook.
+# If kernel versions are specified, new initramfs is created for them.
+initramfs_mark_dirty() {
+  local file="$(target_root)${INITRAMFS_DIRTY_FILE}"
+  mkdir -p "$(dirname "${file}")"
+  if [ $# -eq 0 ]; then
+    echo "all" >> "${file}"
+  else
+    local version
+    for version in "$@"; do
+      echo "${version}" >> "${file}"
+    done
+  fi
+}
+
+# Print a hash of files which affect content of initramfs in target system.
+initramfs_inputs_hash() {
+  local root="$(target_root)"
+  {
+    ls "${root}/lib/modules"
+    find "${root}/etc/initramfs-tools" "${root}/usr/share/initramfs-tools" \
+      "${root}/etc/modprobe.d" "${root}"/lib/modules/*/modules.dep \
+      "${root}/etc/crypttab" "${root}/etc/plymouth" \
+      "${root}/etc/default/keyboard" "${root}/etc/default/console-setup" \
+      "${root}/etc/console-setup" -type f 2>/dev/null | sort | \
+      xargs -r sha256sum 2>/dev/null | sed "s|${root}/|/|"
+    # Firmware and plymouth themes are too large to be read, their names,
+    # sizes and modification times are used instead.
+    find "${root}/lib/firmware" "${root}/usr/share/plymouth" \
+      -printf "%p %s %T@\n" 2>/dev/null | sort | sed "s|${root}/|/|"
+    # Only filesystem type of root, /usr and swap entries are used in initramfs.
+    awk '$2 == "/" || $2 == "/usr" || $3 == "swap" {print $2, $3}' \
+      "${root}/etc/fstab" 2>/dev/null
+  } | sha256sum | awk '{print $1}'
+}
@@ -36,10 +36,7 @@ CONF_FILE=/etc/deepin-installer.conf
 
 # Check whether btrfs filesystem is used in machine.
 detect_btrfs() {
-  for i in $(lsblk -o FSTYPE | sed '/^$/d' | uniq); do
-    [ "${i}" = "btrfs" ] && return 0
-  done
-  return 1
+  lsblk -no FSTYPE | grep -qx btrfs
 }
 
 # Purge installer package
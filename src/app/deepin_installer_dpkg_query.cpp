@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// deepin-installer-dpkg-query
+// Query packages in dpkg status database in one pass.
+// Usage:
+// * deepin-installer-dpkg-query pattern...
+// Names of present packages matching any of patterns are printed to stdout,
+// one package per line. Shell wildcards are supported in patterns.
+
+#include <stdio.h>
+
+#include <QCoreApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QFile>
+
+#include "sysinfo/dpkg_status.h"
+
+namespace {
+
+const char kAppVersion[] = "0.0.1";
+const char kAppDesc[] = "Query packages in dpkg status database.";
+
+const int kExitErr = 1;
+const int kExitOk = 0;
+
+const char kDefaultStatusFile[] = "/var/lib/dpkg/status";
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  app.setApplicationVersion(kAppVersion);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(kAppDesc);
+  parser.addHelpOption();
+  parser.addVersionOption();
+  const QCommandLineOption status_option(
+      "status-file", "read dpkg status from <file>",
+      "file", kDefaultStatusFile);
+  parser.addOption(status_option);
+  const QCommandLineOption show_version_option(
+      "show-version", "print version of package after its name");
+  parser.addOption(show_version_option);
+  parser.addPositionalArgument("pattern",
+                               "Package name, wildcards are supported",
+                               "pattern...");
+
+  if (!parser.parse(app.arguments())) {
+    // Show help and exit.
+    parser.showHelp(kExitErr);
+  }
+
+  const QStringList patterns = parser.positionalArguments();
+  if (patterns.isEmpty()) {
+    parser.showHelp(kExitErr);
+  }
+
+  const QString status_file = parser.value(status_option);
+  if (!QFile::exists(status_file)) {
+    fprintf(stderr, "File not found! %s\n", status_file.toStdString().c_str());
+    return kExitErr;
+  }
+
+  const installer::DpkgPackageList packages =
+      installer::ReadDpkgStatus(status_file);
+  const QStringList names = installer::MatchDpkgPackages(packages, patterns);
+  const bool show_version = parser.isSet(show_version_option);
+  for (const QString& name : names) {
+    if (show_version) {
+      for (const installer::DpkgPackage& package : packages) {
+        if (package.name == name && package.present()) {
+          fprintf(stdout, "%s %s\n", name.toStdString().c_str(),
+                  package.version.toStdString().c_str());
+          break;
+        }
+      }
+    } else {
+      fprintf(stdout, "%s\n", name.toStdString().c_str());
+    }
+  }
+
+  return kExitOk;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Generate fstab of filesystems mounted at root folder and of active swaps,
+// same as `genfstab -p -U`. fstab is printed to stdout.
+// If crypttab entry of root partition is required, use --crypttab option.
+
+#include <stdio.h>
+
+#include <QCoreApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+
+#include "base/file_util.h"
+#include "sysinfo/fstab.h"
+
+namespace {
+
+const char kAppName[] = "deepin-installer-genfstab";
+const char kAppDesc[] = "Tool to generate fstab and crypttab";
+const char kAppVersion[] = "0.0.1";
+
+const int kExitOk = 0;
+const int kExitErr = 1;
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  app.setApplicationName(kAppName);
+  app.setApplicationVersion(kAppVersion);
+
+  QCommandLineParser parser;
+  const QCommandLineOption crypttab_option(
+      "crypttab", "append crypttab entry to <file>", "file", "");
+  parser.addOption(crypttab_option);
+  const QCommandLineOption target_option(
+      "crypt-target", "name of device mapper target", "target", "");
+  parser.addOption(target_option);
+  const QCommandLineOption partition_option(
+      "crypt-partition", "path to LUKS partition", "partition", "");
+  parser.addOption(partition_option);
+  const QCommandLineOption options_option(
+      "crypt-options", "options of crypttab entry", "options", "luks");
+  parser.addOption(options_option);
+  parser.setApplicationDescription(kAppDesc);
+  parser.addHelpOption();
+  parser.addVersionOption();
+  parser.addPositionalArgument("root", "root folder of target system");
+
+  if (!parser.parse(app.arguments())) {
+    parser.showHelp(kExitErr);
+  }
+
+  if (parser.isSet("version") || parser.isSet("help")) {
+    // Show help and exit.
+    parser.showHelp(kExitOk);
+  }
+
+  const QStringList positional_args = parser.positionalArguments();
+  if (positional_args.length() != 1) {
+    fprintf(stderr, "Expect one root folder!\n");
+    parser.showHelp(kExitErr);
+  }
+
+  // Mount table and devices are read only once for both files.
+  const installer::FstabInput input = installer::ReadFstabInput();
+  const QString root = QFileInfo(positional_args.at(0)).absoluteFilePath();
+  QString fstab;
+  if (!installer::GenerateFstab(input, root, fstab)) {
+    fprintf(stderr, "%s is not a mountpoint\n",
+            root.toLocal8Bit().constData());
+    return kExitErr;
+  }
+  fprintf(stdout, "%s", fstab.toLocal8Bit().constData());
+
+  const QString crypttab_file = parser.value(crypttab_option);
+  if (!crypttab_file.isEmpty()) {
+    // Devices in /dev/disk/ are indexed by canonical path.
+    const QString partition =
+        QFileInfo(parser.value(partition_option)).canonicalFilePath();
+    const QString crypttab = installer::GenerateCrypttab(
+        input, parser.value(target_option), partition,
+        parser.value(options_option));
+    QString content;
+    if (QFile::exists(crypttab_file)) {
+      content = installer::ReadFile(crypttab_file);
+    }
+    if (crypttab.isEmpty() ||
+        !installer::WriteTextFile(crypttab_file, content + crypttab)) {
+      fprintf(stderr, "Failed to write crypttab: %s\n",
+              crypttab_file.toLocal8Bit().constData());
+      return kExitErr;
+    }
+  }
+
+  return kExitOk;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Create swap file without fallocate, dd or mkswap. Blocks are allocated in
+// the way supported by swapon() on target filesystem, and copy-on-write is
+// disabled on btrfs.
+// If progress is required, use --progress option.
+
+#include <stdio.h>
+
+#include <QCoreApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+
+#include "partman/swap_file.h"
+
+namespace {
+
+const char kAppName[] = "deepin-installer-swap-file";
+const char kAppDesc[] = "Tool to create swap file";
+const char kAppVersion[] = "0.0.1";
+
+const int kExitOk = 0;
+const int kExitErr = 1;
+
+const qint64 kMebiByte = 1024 * 1024;
+
+// File descriptor of progress file.
+FILE* g_progress_fd = nullptr;
+
+// Write progress value to file.
+void WriteProgress(int progress) {
+  if (g_progress_fd) {
+    fseek(g_progress_fd, 0, SEEK_SET);
+    fprintf(g_progress_fd, "%d", progress);
+    fflush(g_progress_fd);
+  } else {
+    fprintf(stdout, "\r%d", progress);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  app.setApplicationName(kAppName);
+  app.setApplicationVersion(kAppVersion);
+
+  QCommandLineParser parser;
+  const QCommandLineOption size_option(
+      "size", "size of swap file in MiB", "size", "");
+  parser.addOption(size_option);
+  const QCommandLineOption progress_option(
+      "progress", "print progress info to <file>", "file", "");
+  parser.addOption(progress_option);
+  parser.setApplicationDescription(kAppDesc);
+  parser.addHelpOption();
+  parser.addVersionOption();
+  parser.addPositionalArgument("file", "path to swap file");
+
+  if (!parser.parse(app.arguments())) {
+    parser.showHelp(kExitErr);
+  }
+
+  if (parser.isSet("version") || parser.isSet("help")) {
+    // Show help and exit.
+    parser.showHelp(kExitOk);
+  }
+
+  const QStringList positional_args = parser.positionalArguments();
+  if (positional_args.length() != 1) {
+    fprintf(stderr, "Expect one swap file!\n");
+    parser.showHelp(kExitErr);
+  }
+
+  bool ok = false;
+  const qint64 size = parser.value(size_option).toLongLong(&ok);
+  if (!ok || size <= 0) {
+    fprintf(stderr, "Invalid swap file size: %s\n",
+            parser.value(size_option).toLocal8Bit().constData());
+    parser.showHelp(kExitErr);
+  }
+
+  const QString progress_file = parser.value(progress_option);
+  if (!progress_file.isEmpty()) {
+    g_progress_fd = fopen(progress_file.toLocal8Bit().constData(), "w");
+    if (g_progress_fd == nullptr) {
+      perror("fopen() Failed to open progress file");
+    }
+  }
+
+  const QString path = positional_args.at(0);
+  ok = installer::CreateSwapFile(path, size * kMebiByte,
+                                 WriteProgress);
+  if (!ok) {
+    fprintf(stderr, "Failed to create swap file: %s\n",
+            path.toLocal8Bit().constData());
+  }
+
+  if (g_progress_fd) {
+    fclose(g_progress_fd);
+  }
+
+  return ok ? kExitOk : kExitErr;
+}
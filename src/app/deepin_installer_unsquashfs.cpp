@@ -422,6 +422,9 @@ int main(int argc, char* argv[]) {
   app.setApplicationName(kAppName);
   app.setApplicationVersion(kAppVersion);
 
+  // Only mount and umount are called, no event loop is needed.
+  installer::SetCommandLauncher(installer::CommandLauncher::PosixSpawn);
+
   QCommandLineParser parser;
   const QCommandLineOption dest_option(
       "dest", "extract to <pathname>, default \"squashfs-root\"",
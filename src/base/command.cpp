@@ -21,9 +21,78 @@
 #include <QDir>
 #include <QProcess>
 #include <QThread>
+#include <atomic>
+
+#include "base/output_buffer.h"
+#include "base/spawn_process.h"
 
 namespace installer {
 
+namespace {
+
+std::atomic<CommandLauncher> g_launcher(CommandLauncher::QtProcess);
+
+// Run |cmd| with posix_spawn launcher and returns its exit code.
+// Content of stdout and stderr is appended to |output| and |err|.
+int PosixSpawnCmd(const QString& cmd, const QStringList& args,
+                  const QStringList& env,
+                  QByteArray& output, QByteArray& err) {
+  SpawnOptions options;
+  options.env = env;
+  options.on_stdout = [&output](const QByteArray& data) {
+    output.append(data);
+  };
+  options.on_stderr = [&err](const QByteArray& data) {
+    err.append(data);
+  };
+  return SpawnProcess(cmd, args, options);
+}
+
+// Size of head and tail kept by SpawnCmdStreamed().
+const int kStreamedHeadSize = 4 * 1024;
+const int kStreamedTailSize = 16 * 1024;
+
+// Run |cmd| and write its output to log line by line.
+// Returns exit code of |cmd|.
+int StreamCmd(const QString& cmd, const QStringList& args,
+              BoundedOutputBuffer& out_buf, BoundedOutputBuffer& err_buf,
+              const std::function<void(const QByteArray& data)>& on_stdout) {
+  const QString name = QFileInfo(cmd).fileName();
+  LineSplitter out_lines([&name](const QString& line) {
+    qDebug().noquote() << name << "OUT:" << line;
+  });
+  LineSplitter err_lines([&name](const QString& line) {
+    qDebug().noquote() << name << "ERR:" << line;
+  });
+
+  SpawnOptions options;
+  options.on_stdout = [&](const QByteArray& data) {
+    out_buf.append(data);
+    out_lines.append(data);
+    if (on_stdout) {
+      on_stdout(data);
+    }
+  };
+  options.on_stderr = [&](const QByteArray& data) {
+    err_buf.append(data);
+    err_lines.append(data);
+  };
+  const int exit_code = SpawnProcess(cmd, args, options);
+  out_lines.flush();
+  err_lines.flush();
+  return exit_code;
+}
+
+}  // namespace
+
+void SetCommandLauncher(CommandLauncher launcher) {
+  g_launcher = launcher;
+}
+
+CommandLauncher GetCommandLauncher() {
+  return g_launcher;
+}
+
 bool RunScriptFile(const QStringList& args) {
   Q_ASSERT(!args.isEmpty());
   if (args.isEmpty()) {
@@ -61,7 +130,31 @@ bool RunScriptFile(const QStringList& args, QString& output, QString& err) {
   return SpawnCmd("/bin/bash", args, output, err);
 }
 
+bool RunScriptFileStreamed(const QStringList& args,
+                           QString& output, QString& err) {
+  Q_ASSERT(!args.isEmpty());
+  if (args.isEmpty()) {
+    qCritical() << "RunScriptFileStreamed() arg is empty!";
+    return false;
+  }
+
+  // Change working directory.
+  const QString current_dir(QFileInfo(args.at(0)).absolutePath());
+  if (!QDir::setCurrent(current_dir)) {
+    qCritical() << "Failed to change working directory:" << current_dir;
+    return false;
+  }
+
+  return SpawnCmdStreamed("/bin/bash", args, output, err);
+}
+
 bool SpawnCmd(const QString& cmd, const QStringList& args) {
+  if (g_launcher == CommandLauncher::PosixSpawn) {
+    SpawnOptions options;
+    options.forward_channels = true;
+    return SpawnProcess(cmd, args, options) == 0;
+  }
+
   QProcess process;
   process.setProgram(cmd);
   process.setArguments(args);
@@ -81,29 +174,71 @@ bool SpawnCmd(const QString& cmd, const QStringList& args, QString& output) {
 
 bool SpawnCmd(const QString& cmd, const QStringList& args,
               QString& output, QString& err) {
+  return SpawnCmd(cmd, args, QStringList(), output, err);
+}
 
-    uint loop_num = 0;
-    QProcess process;
-    process.setProgram(cmd);
-    process.setArguments(args);
-
-    // try 2
-    while (loop_num++ < 2) {
-        process.start();
-        // Wait for process to finish without timeout.
-        process.waitForFinished(-1);
-        output += process.readAllStandardOutput();
-        err += process.readAllStandardError();
-
-        if (process.exitStatus() == QProcess::NormalExit && process.exitCode() == 0) {
-            return true;
-        }
-        qDebug() << err;
-        qDebug() << "try again!!!!!";
-        QThread::sleep(1);
+bool SpawnCmd(const QString& cmd, const QStringList& args,
+              const QStringList& env, QString& output, QString& err) {
+  // Try twice.
+  uint loop_num = 0;
+  while (loop_num++ < 2) {
+    bool ok;
+    if (g_launcher == CommandLauncher::PosixSpawn) {
+      QByteArray out_data;
+      QByteArray err_data;
+      const int exit_code = PosixSpawnCmd(cmd, args, env, out_data, err_data);
+      output += QString::fromUtf8(out_data);
+      err += QString::fromUtf8(err_data);
+      ok = (exit_code == 0);
+    } else {
+      QProcess process;
+      process.setProgram(cmd);
+      process.setArguments(args);
+      process.setEnvironment(env);
+      process.start();
+      // Wait for process to finish without timeout.
+      process.waitForFinished(-1);
+      output += process.readAllStandardOutput();
+      err += process.readAllStandardError();
+      ok = (process.exitStatus() == QProcess::NormalExit &&
+            process.exitCode() == 0);
+    }
+    if (ok) {
+      return true;
     }
+    qWarning() << "SpawnCmd() failed:" << cmd << err;
+    QThread::sleep(1);
+  }
 
-    return false;
+  return false;
+}
+
+bool SpawnCmdStreamed(const QString& cmd, const QStringList& args,
+                      QString& output, QString& err) {
+  return SpawnCmdStreamed(cmd, args, output, err, nullptr);
+}
+
+bool SpawnCmdStreamed(
+    const QString& cmd, const QStringList& args,
+    QString& output, QString& err,
+    const std::function<void(const QByteArray& data)>& on_stdout) {
+  // Same retry policy as SpawnCmd().
+  uint loop_num = 0;
+  while (loop_num++ < 2) {
+    BoundedOutputBuffer out_buf(kStreamedHeadSize, kStreamedTailSize);
+    BoundedOutputBuffer err_buf(kStreamedHeadSize, kStreamedTailSize);
+    const int exit_code = StreamCmd(cmd, args, out_buf, err_buf, on_stdout);
+    output = out_buf.toString();
+    err = err_buf.toString();
+    if (exit_code == 0) {
+      return true;
+    }
+    qWarning() << "SpawnCmdStreamed() failed:" << cmd
+               << "exit code:" << exit_code;
+    QThread::sleep(1);
+  }
+
+  return false;
 }
 
 }  // namespace installer
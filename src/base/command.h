@@ -18,10 +18,25 @@
 #ifndef INSTALLER_BASE_COMMAND_H
 #define INSTALLER_BASE_COMMAND_H
 
+#include <functional>
 #include <QStringList>
 
 namespace installer {
 
+// Backend used to start external commands.
+enum class CommandLauncher {
+  // QProcess, requires nothing special, output is read when process exits.
+  QtProcess,
+  // posix_spawnp() + waitid(), no event dispatcher is needed and
+  // output is read from pipes while process is running.
+  PosixSpawn,
+};
+
+// Set launcher used by RunScriptFile() and SpawnCmd() in current process.
+// Default is CommandLauncher::QtProcess.
+void SetCommandLauncher(CommandLauncher launcher);
+CommandLauncher GetCommandLauncher();
+
 // Run a script file in bash, no matter it is executable or not.
 // First argument in |args| is the path to script file.
 // Current working directory is changed to folder of |args[0]|.
@@ -35,6 +50,25 @@ bool SpawnCmd(const QString& cmd, const QStringList& args);
 bool SpawnCmd(const QString& cmd, const QStringList& args, QString& output);
 bool SpawnCmd(const QString& cmd, const QStringList& args, QString& output,
               QString& err);
+// |env| is environment of |cmd|, in "KEY=VALUE" form. If it is empty,
+// environment of current process is inherited.
+bool SpawnCmd(const QString& cmd, const QStringList& args,
+              const QStringList& env, QString& output, QString& err);
+
+// Like SpawnCmd() and RunScriptFile(), but stdout and stderr of |cmd| are
+// written to log line by line while it is running, and only head and tail
+// of them are kept in |output| and |err|. Use these for verbose commands,
+// memory usage does not grow with the amount of output.
+bool SpawnCmdStreamed(const QString& cmd, const QStringList& args,
+                      QString& output, QString& err);
+// |on_stdout| is also called with each chunk of stdout as soon as it is read,
+// which is used to parse progress of |cmd|.
+bool SpawnCmdStreamed(
+    const QString& cmd, const QStringList& args,
+    QString& output, QString& err,
+    const std::function<void(const QByteArray& data)>& on_stdout);
+bool RunScriptFileStreamed(const QStringList& args,
+                           QString& output, QString& err);
 
 }  // namespace installer
 
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measure spawn latency of short commands under each command launcher.
+// Usage: command-benchmark [count]
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include "base/command.h"
+
+namespace {
+
+const int kDefaultCount = 1000;
+
+void RunBenchmark(installer::CommandLauncher launcher, const char* name,
+                  int count) {
+  installer::SetCommandLauncher(launcher);
+  QElapsedTimer timer;
+  timer.start();
+  int failed = 0;
+  for (int i = 0; i < count; ++i) {
+    QString output;
+    QString err;
+    if (!installer::SpawnCmd("true", {}, output, err)) {
+      failed ++;
+    }
+  }
+  const qint64 elapsed = timer.nsecsElapsed();
+  qDebug() << name << "count:" << count
+           << "failed:" << failed
+           << "total(ms):" << elapsed / 1000000
+           << "avg(us):" << elapsed / 1000 / count;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  int count = kDefaultCount;
+  if (argc > 1) {
+    count = qMax(1, QString(argv[1]).toInt());
+  }
+
+  RunBenchmark(installer::CommandLauncher::QtProcess, "QProcess", count);
+  RunBenchmark(installer::CommandLauncher::PosixSpawn, "posix_spawn", count);
+  return 0;
+}
@@ -38,5 +38,52 @@ TEST(CommandTest, SpawnCmd) {
   EXPECT_GT(output.indexOf("root"), 0);
 }
 
+TEST(CommandTest, SpawnCmdPosixSpawn) {
+  SetCommandLauncher(CommandLauncher::PosixSpawn);
+  QString output;
+  QString err;
+  EXPECT_TRUE(SpawnCmd("ls", {"-h", "/"}, output, err));
+  EXPECT_GT(output.indexOf("root"), 0);
+
+  output.clear();
+  err.clear();
+  EXPECT_TRUE(SpawnCmd("sh", {"-c", "echo out; echo err >&2"}, output, err));
+  EXPECT_EQ(output, "out\n");
+  EXPECT_EQ(err, "err\n");
+
+  EXPECT_FALSE(SpawnCmd("installer-command-not-found", {}, output, err));
+  SetCommandLauncher(CommandLauncher::QtProcess);
+}
+
+TEST(CommandTest, SpawnCmdEnv) {
+  for (CommandLauncher launcher : {CommandLauncher::QtProcess,
+                                   CommandLauncher::PosixSpawn}) {
+    SetCommandLauncher(launcher);
+    QString output;
+    QString err;
+    EXPECT_TRUE(SpawnCmd("/bin/sh", {"-c", "echo $DI_COMMAND_TEST"},
+                         {"DI_COMMAND_TEST=installer"}, output, err));
+    EXPECT_EQ(output, "installer\n");
+  }
+  SetCommandLauncher(CommandLauncher::QtProcess);
+}
+
+TEST(CommandTest, SpawnCmdStreamed) {
+  QString output;
+  QString err;
+  EXPECT_TRUE(SpawnCmdStreamed("seq", {"1", "100000"}, output, err));
+  EXPECT_TRUE(output.startsWith("1\n2\n"));
+  EXPECT_TRUE(output.endsWith("99999\n100000\n"));
+  EXPECT_LT(output.length(), 64 * 1024);
+
+  // All of stdout is passed to handler, even if it is not kept in |output|.
+  int size = 0;
+  EXPECT_TRUE(SpawnCmdStreamed("seq", {"1", "100000"}, output, err,
+                               [&size](const QByteArray& data) {
+    size += data.size();
+  }));
+  EXPECT_EQ(size, 588895);
+}
+
 }  // namespace
 }  // namespace installer
\ No newline at end of file
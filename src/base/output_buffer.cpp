@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/output_buffer.h"
+
+namespace installer {
+
+BoundedOutputBuffer::BoundedOutputBuffer(int head_size, int tail_size)
+    : head_size_(head_size),
+      tail_size_(tail_size),
+      head_(),
+      tail_(),
+      omitted_(0) {
+}
+
+void BoundedOutputBuffer::append(const QByteArray& data) {
+  int offset = 0;
+  if (head_.size() < head_size_) {
+    offset = qMin(head_size_ - head_.size(), data.size());
+    head_.append(data.constData(), offset);
+  }
+  if (offset >= data.size()) {
+    return;
+  }
+
+  tail_.append(data.constData() + offset, data.size() - offset);
+  // Trim tail when it grows to twice of its limit, so that memmove() is
+  // not called on each append.
+  if (tail_.size() > tail_size_ * 2) {
+    const int overflow = tail_.size() - tail_size_;
+    tail_.remove(0, overflow);
+    omitted_ += overflow;
+  }
+}
+
+QString BoundedOutputBuffer::toString() const {
+  QByteArray tail = tail_;
+  qint64 omitted = omitted_;
+  if (tail.size() > tail_size_) {
+    omitted += tail.size() - tail_size_;
+    tail = tail.right(tail_size_);
+  }
+
+  QString result = QString::fromUtf8(head_);
+  if (omitted > 0) {
+    result += QString("\n... [%1 bytes omitted] ...\n").arg(omitted);
+  }
+  result += QString::fromUtf8(tail);
+  return result;
+}
+
+LineSplitter::LineSplitter(const LineHandler& handler, int max_line_size)
+    : handler_(handler),
+      max_line_size_(max_line_size),
+      pending_() {
+}
+
+void LineSplitter::append(const QByteArray& data) {
+  pending_.append(data);
+  int start = 0;
+  while (start < pending_.size()) {
+    int end = pending_.indexOf('\n', start);
+    if (end == -1) {
+      if (pending_.size() - start < max_line_size_) {
+        break;
+      }
+      end = start + max_line_size_;
+      handler_(QString::fromUtf8(pending_.constData() + start,
+                                 end - start));
+      start = end;
+    } else {
+      handler_(QString::fromUtf8(pending_.constData() + start,
+                                 end - start));
+      start = end + 1;
+    }
+  }
+  pending_.remove(0, start);
+}
+
+void LineSplitter::flush() {
+  if (!pending_.isEmpty()) {
+    handler_(QString::fromUtf8(pending_));
+    pending_.clear();
+  }
+}
+
+}  // namespace installer
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_BASE_OUTPUT_BUFFER_H
+#define INSTALLER_BASE_OUTPUT_BUFFER_H
+
+#include <QByteArray>
+#include <QString>
+#include <functional>
+
+namespace installer {
+
+// Keeps the first |head_size| bytes and the last |tail_size| bytes of a
+// stream, so that memory usage is bounded no matter how much data is
+// appended.
+class BoundedOutputBuffer {
+ public:
+  BoundedOutputBuffer(int head_size, int tail_size);
+
+  void append(const QByteArray& data);
+
+  // Number of bytes dropped between head and tail.
+  qint64 omitted() const { return omitted_; }
+
+  // Returns head and tail of stream, with a marker in between if some
+  // bytes are omitted.
+  QString toString() const;
+
+ private:
+  const int head_size_;
+  const int tail_size_;
+  QByteArray head_;
+  QByteArray tail_;
+  qint64 omitted_;
+};
+
+// Splits stream into lines and pass each complete line to |handler|.
+// Lines longer than |max_line_size| are split.
+class LineSplitter {
+ public:
+  typedef std::function<void(const QString& line)> LineHandler;
+
+  explicit LineSplitter(const LineHandler& handler,
+                        int max_line_size = 4096);
+
+  void append(const QByteArray& data);
+
+  // Pass the remaining partial line to handler.
+  void flush();
+
+ private:
+  LineHandler handler_;
+  const int max_line_size_;
+  QByteArray pending_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_BASE_OUTPUT_BUFFER_H
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/output_buffer.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(OutputBufferTest, BoundedOutputBuffer) {
+  BoundedOutputBuffer small(4, 4);
+  small.append("abc");
+  small.append("def");
+  EXPECT_EQ(small.toString(), "abcdef");
+  EXPECT_EQ(small.omitted(), 0);
+
+  BoundedOutputBuffer buffer(4, 8);
+  for (int i = 0; i < 10000; ++i) {
+    buffer.append("0123456789");
+  }
+  const QString result = buffer.toString();
+  EXPECT_TRUE(result.startsWith("0123"));
+  EXPECT_TRUE(result.endsWith("23456789"));
+  EXPECT_GT(result.indexOf("bytes omitted"), 0);
+  EXPECT_LT(result.length(), 64);
+}
+
+TEST(OutputBufferTest, LineSplitter) {
+  QStringList lines;
+  LineSplitter splitter([&lines](const QString& line) {
+    lines.append(line);
+  }, 8);
+  splitter.append("hello\nwor");
+  splitter.append("ld\n0123456789abc");
+  EXPECT_EQ(lines, QStringList({"hello", "world", "01234567"}));
+  splitter.flush();
+  EXPECT_EQ(lines.last(), "89abc");
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/spawn_process.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QVector>
+
+extern char** environ;
+
+namespace installer {
+
+namespace {
+
+// Size of buffer used to read from pipes.
+const int kReadBufSize = 16 * 1024;
+
+void ClosePipe(int fds[2]) {
+  for (int i = 0; i < 2; ++i) {
+    if (fds[i] != -1) {
+      close(fds[i]);
+      fds[i] = -1;
+    }
+  }
+}
+
+// Convert |list| to a null-terminated char* array. |storage| holds the
+// encoded strings and shall live longer than returned array.
+QVector<char*> ToCharArray(const QStringList& list,
+                           QList<QByteArray>& storage) {
+  QVector<char*> result;
+  for (const QString& item : list) {
+    storage.append(item.toLocal8Bit());
+  }
+  for (QByteArray& item : storage) {
+    result.append(item.data());
+  }
+  result.append(nullptr);
+  return result;
+}
+
+// Read from stdout and stderr pipes of child process until both of them
+// are closed.
+void ReadPipes(int out_fd, int err_fd, const SpawnOptions& options) {
+  struct pollfd fds[2] = {
+      {out_fd, POLLIN, 0},
+      {err_fd, POLLIN, 0},
+  };
+  char buf[kReadBufSize];
+  int opened = 2;
+  while (opened > 0) {
+    const int ret = poll(fds, 2, -1);
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      qCritical() << "SpawnProcess() poll() failed:" << strerror(errno);
+      break;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+      if (fds[i].fd == -1 || fds[i].revents == 0) {
+        continue;
+      }
+      const ssize_t num_read = read(fds[i].fd, buf, sizeof(buf));
+      if (num_read > 0) {
+        const SpawnOutputCallback& callback =
+            (i == 0) ? options.on_stdout : options.on_stderr;
+        if (callback) {
+          callback(QByteArray(buf, int(num_read)));
+        }
+      } else if (num_read == 0 || errno != EINTR) {
+        // EOF or read error, stop polling this pipe.
+        fds[i].fd = -1;
+        opened --;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int SpawnProcess(const QString& cmd,
+                 const QStringList& args,
+                 const SpawnOptions& options) {
+  int out_pipe[2] = {-1, -1};
+  int err_pipe[2] = {-1, -1};
+  if (!options.forward_channels) {
+    if (pipe2(out_pipe, O_CLOEXEC) == -1 || pipe2(err_pipe, O_CLOEXEC) == -1) {
+      qCritical() << "SpawnProcess() pipe2() failed:" << strerror(errno);
+      ClosePipe(out_pipe);
+      ClosePipe(err_pipe);
+      return -1;
+    }
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                   O_RDONLY, 0);
+  if (!options.forward_channels) {
+    // dup2() clears FD_CLOEXEC on new descriptors, the original pipe ends
+    // are closed automatically on exec.
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+  }
+
+  // Do not leak signal mask and handlers of current thread to child process.
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t mask;
+  sigemptyset(&mask);
+  posix_spawnattr_setsigmask(&attr, &mask);
+  sigset_t default_signals;
+  sigemptyset(&default_signals);
+  sigaddset(&default_signals, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &default_signals);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+                                  POSIX_SPAWN_SETSIGDEF);
+
+  QList<QByteArray> argv_storage;
+  QVector<char*> argv = ToCharArray(QStringList(cmd) + args, argv_storage);
+  QList<QByteArray> env_storage;
+  QVector<char*> envp = ToCharArray(options.env, env_storage);
+
+  pid_t pid = -1;
+  const int spawn_ret = posix_spawnp(&pid,
+                                     argv.first(),
+                                     &actions,
+                                     &attr,
+                                     argv.data(),
+                                     options.env.isEmpty() ? environ :
+                                                             envp.data());
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+
+  if (!options.forward_channels) {
+    // Close write ends in parent process, so that EOF is received on exit.
+    close(out_pipe[1]);
+    out_pipe[1] = -1;
+    close(err_pipe[1]);
+    err_pipe[1] = -1;
+  }
+
+  if (spawn_ret != 0) {
+    qCritical() << "SpawnProcess() failed to start" << cmd
+                << strerror(spawn_ret);
+    ClosePipe(out_pipe);
+    ClosePipe(err_pipe);
+    return -1;
+  }
+
+  if (!options.forward_channels) {
+    ReadPipes(out_pipe[0], err_pipe[0], options);
+    ClosePipe(out_pipe);
+    ClosePipe(err_pipe);
+  }
+
+  siginfo_t info;
+  memset(&info, 0, sizeof(info));
+  while (waitid(P_PID, id_t(pid), &info, WEXITED) == -1) {
+    if (errno != EINTR) {
+      qCritical() << "SpawnProcess() waitid() failed:" << strerror(errno);
+      return -1;
+    }
+  }
+
+  if (info.si_code == CLD_EXITED) {
+    return info.si_status;
+  }
+  qWarning() << cmd << "terminated by signal" << info.si_status;
+  return -1;
+}
+
+}  // namespace installer
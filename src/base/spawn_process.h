@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_BASE_SPAWN_PROCESS_H
+#define INSTALLER_BASE_SPAWN_PROCESS_H
+
+#include <QByteArray>
+#include <QStringList>
+#include <functional>
+
+namespace installer {
+
+// Receives a chunk of data read from stdout or stderr of child process.
+typedef std::function<void(const QByteArray& data)> SpawnOutputCallback;
+
+struct SpawnOptions {
+  // Environment of child process, in "KEY=VALUE" form.
+  // If empty, environment of current process is inherited.
+  QStringList env;
+
+  // If true, stdout and stderr of child process are connected to those of
+  // current process, and callbacks below are never called.
+  bool forward_channels = false;
+
+  // Called each time data is available, as soon as it is read from pipe.
+  SpawnOutputCallback on_stdout;
+  SpawnOutputCallback on_stderr;
+};
+
+// Run |cmd| with |args| with posix_spawnp() and wait for it to exit.
+// |cmd| is searched in $PATH if it does not contain a slash.
+// Unlike QProcess, no event loop is required, so it is safe to call
+// in any thread. stdin of child process is redirected to /dev/null.
+// Returns exit code of child process, or -1 if it failed to start or was
+// terminated by a signal.
+int SpawnProcess(const QString& cmd,
+                 const QStringList& args,
+                 const SpawnOptions& options);
+
+}  // namespace installer
+
+#endif  // INSTALLER_BASE_SPAWN_PROCESS_H
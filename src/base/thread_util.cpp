@@ -17,10 +17,33 @@
 
 #include "base/thread_util.h"
 
+#include <QList>
 #include <QThread>
+#include <atomic>
 
 namespace installer {
 
+namespace {
+
+// Runs |func| in background thread.
+class FunctionThread : public QThread {
+ public:
+  explicit FunctionThread(const std::function<void()>& func)
+      : QThread(),
+        func_(func) {
+  }
+
+ protected:
+  void run() override {
+    func_();
+  }
+
+ private:
+  std::function<void()> func_;
+};
+
+}  // namespace
+
 void QuitThread(QThread* thread) {
   Q_ASSERT(thread);
   if (thread) {
@@ -32,4 +55,37 @@ void QuitThread(QThread* thread) {
   }
 }
 
-}  // namespace installer
\ No newline at end of file
+void ParallelFor(int count, int max_threads,
+                 const std::function<void(int index)>& task) {
+  if (count <= 0) {
+    return;
+  }
+  const int num_threads = qMin(count, max_threads);
+  if (num_threads < 2) {
+    for (int i = 0; i < count; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  // Each thread takes next index until all tasks are taken.
+  std::atomic<int> next_index(0);
+  const std::function<void()> worker = [&]() {
+    for (int i = next_index++; i < count; i = next_index++) {
+      task(i);
+    }
+  };
+
+  QList<FunctionThread*> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    FunctionThread* thread = new FunctionThread(worker);
+    thread->start();
+    threads.append(thread);
+  }
+  for (FunctionThread* thread : threads) {
+    thread->wait();
+    delete thread;
+  }
+}
+
+}  // namespace installer
@@ -18,6 +18,8 @@
 #ifndef INSTALLER_BASE_THREAD_UTIL_H
 #define INSTALLER_BASE_THREAD_UTIL_H
 
+#include <functional>
+
 class QThread;
 
 namespace installer {
@@ -26,6 +28,12 @@ namespace installer {
 // If it is still running, terminate it.
 void QuitThread(QThread* thread);
 
+// Call |task| with index from 0 to |count| - 1, in at most |max_threads|
+// threads, and wait for all of them to finish.
+// Tasks are run in current thread if |max_threads| is less than 2.
+void ParallelFor(int count, int max_threads,
+                 const std::function<void(int index)>& task);
+
 }  // namespace installer
 
 #endif  // INSTALLER_BASE_THREAD_UTIL_H
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/thread_util.h"
+
+#include <QVector>
+#include <atomic>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(ThreadUtilTest, ParallelFor) {
+  const int kCount = 100;
+  QVector<int> results(kCount, 0);
+  std::atomic<int> calls(0);
+  ParallelFor(kCount, 4, [&](int index) {
+    results[index] = index * 2;
+    calls++;
+  });
+  EXPECT_EQ(calls, kCount);
+  for (int i = 0; i < kCount; ++i) {
+    EXPECT_EQ(results.at(i), i * 2);
+  }
+
+  // Run in current thread.
+  int sum = 0;
+  ParallelFor(10, 1, [&sum](int index) {
+    sum += index;
+  });
+  EXPECT_EQ(sum, 45);
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,572 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/auto_part.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QTemporaryFile>
+
+#include "base/command.h"
+#include "base/file_util.h"
+#include "partman/libparted_util.h"
+#include "partman/partition_format.h"
+#include "partman/structs.h"
+
+namespace installer {
+
+namespace {
+
+const char kBootMountPoint[] = "/boot";
+const char kRootMountPoint[] = "/";
+const char kSwapSizeRule[] = "swap-size";
+const char kCryptFsName[] = "crypto_luks";
+
+// Volume group created in LUKS partition, as VG_NAME in auto_part.sh.
+const char kVolumeGroupName[] = "vg0";
+const char kMapperDir[] = "/dev/mapper";
+
+// Partition with this label is used as pure data storage, all users in
+// group sudo have all permissions on it.
+const char kDataPartitionLabel[] = "_dde_data";
+const char kDataPartitionAclRules[] = "g:sudo:rwx";
+const char kDataPartitionMountPoint[] = "/tmp/deepin-installer-dde-data";
+
+// Size of partition table area reserved at the beginning of disk, and of
+// EBR reserved before each logical partition, in MiB.
+const qint64 kReservedSize = 1;
+
+// Swap partition size used if DI_SWAP_SIZE is not set, in MiB.
+const qint64 kDefaultSwapSize = 1024;
+
+// Parse partition size of |rule|, with |available| MiB left on disk.
+// Returns -1 if size is invalid.
+qint64 ParseRuleSize(const AutoPartRule& rule,
+                     qint64 available,
+                     int swap_size) {
+  bool ok = false;
+  qint64 size = -1;
+  if (rule.size.endsWith('%')) {
+    const qint64 percent = rule.size.left(rule.size.length() - 1)
+        .toLongLong(&ok);
+    if (ok) {
+      size = available * percent / 100;
+    }
+  } else if (rule.size == kSwapSizeRule) {
+    size = (swap_size > 0) ? swap_size * kKibiByte : kDefaultSwapSize;
+  } else {
+    size = rule.size.toLongLong(&ok);
+    if (!ok) {
+      size = -1;
+    }
+  }
+  return size;
+}
+
+bool IsLargeDisk(const AutoPartPolicy& policy, qint64 device_size) {
+  return device_size > policy.large_disk_threshold * kKibiByte;
+}
+
+// Keep root partition of large disks in range of
+// partition_full_disk_large_root_part_range.
+qint64 LimitRootSize(const AutoPartPolicy& policy,
+                     bool large,
+                     const AutoPartRule& rule,
+                     qint64 size) {
+  if (large && rule.mount_point == kRootMountPoint && policy.root_max > 0) {
+    size = qMax(size, policy.root_min * kKibiByte);
+    size = qMin(size, policy.root_max * kKibiByte);
+  }
+  return size;
+}
+
+// Format |partition| with LUKS and open it as |target| in /dev/mapper.
+// Passphrase is passed in a key file, as there is no stdin of SpawnCmd().
+bool SetupLuksPartition(const QString& partition,
+                        const QString& target,
+                        const AutoPartPolicy& policy) {
+  // Temporary file is readable by owner only.
+  QTemporaryFile key_file;
+  if (!key_file.open() ||
+      key_file.write(policy.crypt_password.toUtf8()) < 0 ||
+      !key_file.flush()) {
+    qCritical() << "Failed to write LUKS key file:" << key_file.fileName();
+    return false;
+  }
+
+  const QStringList luks_args = GetLuksFormatArgs(policy.luks);
+  qDebug() << "luksFormat options:" << luks_args;
+  QString out, err;
+  if (!SpawnCmd("cryptsetup", QStringList({"-v", "--batch-mode",
+                                           "luksFormat"}) +
+                              luks_args +
+                              QStringList({"--key-file", key_file.fileName(),
+                                           partition}),
+                out, err)) {
+    qCritical() << "cryptsetup luksFormat failed:" << partition << err;
+    return false;
+  }
+  if (!SpawnCmd("cryptsetup", {"open", "--key-file", key_file.fileName(),
+                               partition, target}, out, err)) {
+    qCritical() << "cryptsetup open failed:" << partition << err;
+    return false;
+  }
+  return true;
+}
+
+// Create volume group on |pv_path|, as auto_part.sh does.
+bool CreateVolumeGroup(const QString& pv_path) {
+  QString out, err;
+  if (!SpawnCmd("pvcreate", {"-ffy", pv_path}, out, err) ||
+      !SpawnCmd("vgcreate", {kVolumeGroupName, pv_path}, out, err)) {
+    qCritical() << "Failed to create volume group:" << kVolumeGroupName
+                << pv_path << err;
+    return false;
+  }
+  return true;
+}
+
+// Read free space and extent size of volume group, in bytes.
+bool ReadVolumeGroupSpace(qint64& vg_free, qint64& extent_size) {
+  QString out, err;
+  if (!SpawnCmd("vgs", {"--noheadings", "--nosuffix", "--units", "b",
+                        "-o", "vg_free,vg_extent_size", kVolumeGroupName},
+                out, err)) {
+    qCritical() << "vgs failed:" << kVolumeGroupName << err;
+    return false;
+  }
+  const QStringList items = out.simplified().split(' ');
+  bool free_ok = false;
+  bool extent_ok = false;
+  if (items.length() == 2) {
+    vg_free = items.at(0).toLongLong(&free_ok);
+    extent_size = items.at(1).toLongLong(&extent_ok);
+  }
+  if (!free_ok || !extent_ok) {
+    qCritical() << "Invalid output of vgs:" << out;
+    return false;
+  }
+  return true;
+}
+
+// Create and format logical volumes in the LUKS partition |entry| of
+// |device|, with the same filesystem options as partitions.
+// Volumes created are appended to |partitions|.
+bool CreateVolumes(const Device::Ptr device,
+                   const AutoPartPolicy& policy,
+                   const AutoPartEntry& entry,
+                   const FormatOptions& format_options,
+                   PartitionList& partitions) {
+  qint64 vg_free = 0;
+  qint64 extent_size = 0;
+  AutoPartVolumeList volumes;
+  if (!ReadVolumeGroupSpace(vg_free, extent_size) ||
+      !PlanAutoPartVolumes(policy, device->getByteLength() / kMebiByte,
+                           entry.volumes, vg_free, extent_size, volumes)) {
+    return false;
+  }
+
+  PartitionList new_partitions;
+  for (const AutoPartVolume& volume : volumes) {
+    QString out, err;
+    if (!SpawnCmd("lvcreate", {"--yes", "-n", volume.name,
+                               "-L", QString("%1m").arg(volume.size),
+                               kVolumeGroupName}, out, err)) {
+      qCritical() << "lvcreate failed:" << volume.name << volume.size << err;
+      return false;
+    }
+
+    // Logical volumes are formatted as partitions of |device|, so that
+    // format profile of the physical device is used.
+    Partition::Ptr partition(new Partition);
+    partition->device_path = device->path;
+    partition->path = QString("/dev/%1/%2").arg(kVolumeGroupName,
+                                                volume.name);
+    partition->status = PartitionStatus::New;
+    partition->fs = volume.fs;
+    partition->label = volume.label;
+    if (volume.fs != FsType::LinuxSwap) {
+      partition->mount_point = volume.mount_point;
+    }
+    new_partitions.append(partition);
+  }
+
+  // Wait for device nodes of logical volumes.
+  SettleDevice(5);
+  if (!MkfsParallel(new_partitions, format_options)) {
+    qCritical() << "Failed to format logical volumes";
+    return false;
+  }
+  partitions.append(new_partitions);
+  return true;
+}
+
+// Set permissions of data partition at |path|.
+bool SetDataPartitionAcl(const QString& path) {
+  if (!CreateDirs(kDataPartitionMountPoint)) {
+    qCritical() << "Failed to create dir:" << kDataPartitionMountPoint;
+    return false;
+  }
+  QString out, err;
+  if (!SpawnCmd("mount", {path, kDataPartitionMountPoint}, out, err)) {
+    qCritical() << "Failed to mount data partition:" << path << err;
+    return false;
+  }
+
+  // Also set the rules as default rules so that the subdirectories created
+  // will inherit the rules.
+  const bool ok =
+      SpawnCmd("setfacl", {"-m", kDataPartitionAclRules,
+                           kDataPartitionMountPoint}, out, err) &&
+      SpawnCmd("setfacl", {"-d", "-m", kDataPartitionAclRules,
+                           kDataPartitionMountPoint}, out, err);
+  if (!ok) {
+    qCritical() << "setfacl failed:" << path << err;
+  }
+
+  SpawnCmd("umount", {"-l", kDataPartitionMountPoint});
+  QDir().rmdir(kDataPartitionMountPoint);
+  return ok;
+}
+
+}  // namespace
+
+QString GetFullDiskPolicyName(bool large, bool efi, bool crypt) {
+  QString name = "partition_full_disk";
+  name += large ? "_large" : "_small";
+  name += efi ? "_uefi" : "_legacy";
+  if (crypt) {
+    name += "_crypt";
+  }
+  return name;
+}
+
+AutoPartRuleList ParseAutoPartRules(const QString& policy,
+                                    const QString& labels) {
+  const QStringList items = policy.split(';', QString::SkipEmptyParts);
+  const QStringList label_items = labels.split(';', QString::SkipEmptyParts);
+
+  AutoPartRuleList rules;
+  for (int index = 0; index < items.length(); ++index) {
+    const QStringList parts = items.at(index).split(':');
+    if (parts.length() != 4) {
+      qCritical() << "ParseAutoPartRules() bad partition info:"
+                  << items.at(index);
+      return AutoPartRuleList();
+    }
+    AutoPartRule rule;
+    rule.mount_point = parts.at(0);
+    rule.fs = parts.at(1);
+    rule.start = parts.at(2);
+    rule.size = parts.at(3);
+    rule.label = label_items.value(index);
+    rules.append(rule);
+  }
+  return rules;
+}
+
+bool IsNativeAutoPartSupported(const AutoPartRuleList& rules) {
+  int crypt_index = -1;
+  for (int index = 0; index < rules.length(); ++index) {
+    const AutoPartRule& rule = rules.at(index);
+    if (rule.fs == kCryptFsName) {
+      if (crypt_index != -1) {
+        return false;
+      }
+      crypt_index = index;
+    } else if (crypt_index != -1 &&
+               GetFsTypeByName(rule.fs) == FsType::EFI) {
+      return false;
+    }
+  }
+  return crypt_index == -1 || crypt_index < rules.length() - 1;
+}
+
+bool PlanAutoPart(const AutoPartPolicy& policy,
+                  qint64 device_size,
+                  AutoPartLayout& layout) {
+  layout.clear();
+  if (device_size < policy.minimum_disk_space * kKibiByte) {
+    qCritical() << "PlanAutoPart() at least" << policy.minimum_disk_space
+                << "GiB is required, device size:" << device_size;
+    return false;
+  }
+  const bool large = IsLargeDisk(policy, device_size);
+  const AutoPartRuleList& rules = large ? policy.large_rules :
+                                          policy.small_rules;
+  if (rules.isEmpty()) {
+    qCritical() << "PlanAutoPart() partitioning policy is empty";
+    return false;
+  }
+  if (!IsNativeAutoPartSupported(rules)) {
+    qCritical() << "PlanAutoPart() unsupported LUKS partition";
+    return false;
+  }
+
+  bool has_boot = false;
+  for (const AutoPartRule& rule : rules) {
+    if (rule.mount_point == kBootMountPoint) {
+      has_boot = true;
+    }
+  }
+
+  // Mirrors PART_NUM, LAST_END and PART_TYPE in auto_part.sh.
+  int part_num = 0;
+  qint64 last_end = kReservedSize;
+  PartitionType part_type = PartitionType::Normal;
+  for (int index = 0; index < rules.length(); ++index) {
+    const AutoPartRule& rule = rules.at(index);
+    part_num ++;
+    if (part_num == 4 && !policy.efi) {
+      // Only 3 primary partitions are created on msdos table, others are
+      // placed in an extended partition which uses the rest of disk.
+      AutoPartEntry extended;
+      extended.type = PartitionType::Extended;
+      extended.start = last_end;
+      extended.end = -1;
+      layout.append(extended);
+      part_num ++;
+      part_type = PartitionType::Logical;
+    }
+
+    AutoPartEntry entry;
+    entry.type = part_type;
+    entry.mount_point = rule.mount_point;
+    entry.label = rule.label;
+    if (rule.fs == kCryptFsName) {
+      // Filesystem is created by cryptsetup, and the rest rules are
+      // logical volumes in it.
+      entry.crypt = true;
+      entry.volumes = rules.mid(index + 1);
+    } else {
+      entry.fs = GetFsTypeByName(rule.fs);
+      if (entry.fs == FsType::Unknown || entry.fs == FsType::Empty) {
+        qCritical() << "PlanAutoPart() invalid filesystem:" << rule.fs;
+        return false;
+      }
+    }
+
+    if (rule.start.isEmpty()) {
+      entry.start = (part_type == PartitionType::Logical) ?
+                    last_end + kReservedSize : last_end;
+    } else {
+      bool ok = false;
+      entry.start = rule.start.toLongLong(&ok);
+      if (!ok) {
+        qCritical() << "PlanAutoPart() invalid start:" << rule.start;
+        return false;
+      }
+    }
+
+    const qint64 available = device_size - kReservedSize - entry.start;
+    qint64 size = ParseRuleSize(rule, available, policy.swap_size);
+    if (size <= 0) {
+      qCritical() << "PlanAutoPart() invalid size:" << rule.size
+                  << "available:" << available;
+      return false;
+    }
+    size = LimitRootSize(policy, large, rule, size);
+    entry.end = entry.start + size;
+
+    if (entry.fs == FsType::EFI) {
+      entry.flags.append(PartitionFlag::ESP);
+    } else if (!policy.efi) {
+      // Set boot flag of /boot, or of / if /boot is not used.
+      if ((rule.mount_point == kBootMountPoint) ||
+          (rule.mount_point == kRootMountPoint && !has_boot)) {
+        entry.flags.append(PartitionFlag::Boot);
+      }
+    }
+
+    layout.append(entry);
+    last_end = entry.end;
+    if (entry.crypt) {
+      break;
+    }
+  }
+
+  return true;
+}
+
+bool PlanAutoPartVolumes(const AutoPartPolicy& policy,
+                         qint64 device_size,
+                         const AutoPartRuleList& rules,
+                         qint64 vg_free,
+                         qint64 extent_size,
+                         AutoPartVolumeList& volumes) {
+  volumes.clear();
+  if (extent_size <= 0) {
+    qCritical() << "PlanAutoPartVolumes() invalid extent size:" << extent_size;
+    return false;
+  }
+  const bool large = IsLargeDisk(policy, device_size);
+  for (const AutoPartRule& rule : rules) {
+    AutoPartVolume volume;
+    volume.fs = GetFsTypeByName(rule.fs);
+    if (volume.fs == FsType::Unknown || volume.fs == FsType::Empty ||
+        volume.fs == FsType::EFI) {
+      qCritical() << "PlanAutoPartVolumes() invalid filesystem:" << rule.fs;
+      return false;
+    }
+    // Volumes are named by their labels. auto_part.sh names unlabeled ones
+    // "LVM_NUM" literally, which fails on the second one, so they are named
+    // after their index instead.
+    volume.name = rule.label.isEmpty() ?
+                  QString("lvm%1").arg(volumes.length() + 1) : rule.label;
+    volume.mount_point = rule.mount_point;
+    volume.label = rule.label;
+
+    // Free space is read in MiB, rounded down, as `vgs --units m` does.
+    const qint64 available = vg_free / kMebiByte;
+    qint64 size = ParseRuleSize(rule, available, policy.swap_size);
+    if (size <= 0) {
+      qCritical() << "PlanAutoPartVolumes() invalid size:" << rule.size
+                  << "available:" << available;
+      return false;
+    }
+    size = LimitRootSize(policy, large, rule, size);
+    // lvcreate rounds size up to whole extents.
+    const qint64 extents = (size * kMebiByte + extent_size - 1) / extent_size;
+    if (extents * extent_size > vg_free) {
+      qCritical() << "PlanAutoPartVolumes() not enough space for"
+                  << rule.mount_point << size << "available:" << available;
+      return false;
+    }
+    vg_free -= extents * extent_size;
+    volume.size = size;
+    volumes.append(volume);
+  }
+  return true;
+}
+
+OperationList AutoPartOperations(const Device::Ptr device,
+                                 PartitionTableType table,
+                                 const AutoPartLayout& layout) {
+  OperationList operations;
+  Device::Ptr new_device(new Device(*device));
+  new_device->partitions.clear();
+  new_device->table = table;
+  operations.append(Operation(new_device));
+
+  const qint64 mebi_sectors = kMebiByte / device->sector_size;
+  for (const AutoPartEntry& entry : layout) {
+    Partition::Ptr unallocated(new Partition);
+    unallocated->device_path = device->path;
+    unallocated->sector_size = device->sector_size;
+    unallocated->type = PartitionType::Unallocated;
+    unallocated->start_sector = entry.start * mebi_sectors;
+    // End of partition is the last sector before |entry.end|, as parted
+    // does with MiB units.
+    unallocated->end_sector = (entry.end == -1) ?
+                              device->length - 1 :
+                              entry.end * mebi_sectors - 1;
+
+    Partition::Ptr new_partition(new Partition(*unallocated));
+    new_partition->status = PartitionStatus::New;
+    new_partition->type = entry.type;
+    new_partition->fs = entry.fs;
+    new_partition->label = entry.label;
+    new_partition->flags = entry.flags;
+    // Mount point of LUKS partition is its mapper name.
+    if (entry.fs != FsType::LinuxSwap && !entry.crypt) {
+      new_partition->mount_point = entry.mount_point;
+    }
+    operations.append(Operation(OperationType::Create,
+                                unallocated,
+                                new_partition));
+  }
+
+  return operations;
+}
+
+bool AutoPartDevice(const Device::Ptr device,
+                    const AutoPartPolicy& policy,
+                    const FormatOptions& format_options,
+                    AutoPartResult& result) {
+  const qint64 device_size = device->getByteLength() / kMebiByte;
+  AutoPartLayout layout;
+  if (!PlanAutoPart(policy, device_size, layout)) {
+    return false;
+  }
+  // LUKS partition is always the last one planned.
+  if (!layout.isEmpty() && layout.last().crypt &&
+      policy.crypt_password.isEmpty()) {
+    qCritical() << "AutoPartDevice() passphrase of LUKS partition is empty";
+    return false;
+  }
+
+  const PartitionTableType table = policy.efi ? PartitionTableType::GPT :
+                                                PartitionTableType::MsDos;
+  OperationList operations = AutoPartOperations(device, table, layout);
+  qDebug() << "AutoPartDevice()" << device->path << "size:" << device_size
+           << "operations:" << operations;
+  if (!ApplyOperations(operations, format_options)) {
+    qCritical() << "AutoPartDevice() failed to apply operations";
+    return false;
+  }
+
+  // Partitions and logical volumes with filesystems, in order of rules.
+  PartitionList partitions;
+  for (int index = 0; index < layout.length(); ++index) {
+    // The first operation is NewPartTable, see AutoPartOperations().
+    const Partition::Ptr partition = operations.at(index + 1).new_partition;
+    const AutoPartEntry& entry = layout.at(index);
+    if (entry.crypt) {
+      const QString& target = entry.mount_point;
+      if (!SetupLuksPartition(partition->path, target, policy) ||
+          !CreateVolumeGroup(QDir(kMapperDir).absoluteFilePath(target)) ||
+          !CreateVolumes(device, policy, entry, format_options, partitions)) {
+        qCritical() << "AutoPartDevice() failed to setup LUKS partition:"
+                    << partition->path;
+        return false;
+      }
+      result.crypt_partition = partition->path;
+      result.crypt_target = target;
+    } else if (partition->type != PartitionType::Extended) {
+      partitions.append(partition);
+    }
+  }
+
+  result.root_disk = device->path;
+  result.bootloader = device->path;
+  QStringList mount_points;
+  for (const Partition::Ptr partition : partitions) {
+    // Mount point of swap partition is "swap".
+    const QString mount_point = (partition->fs == FsType::LinuxSwap) ?
+                                "swap" : partition->mount_point;
+    if (partition->fs == FsType::EFI) {
+      result.bootloader = partition->path;
+    } else if (!mount_point.isEmpty()) {
+      mount_points.append(QString("%1=%2").arg(partition->path,
+                                               mount_point));
+    }
+
+    if (mount_point == kRootMountPoint) {
+      result.root_partition = partition->path;
+    }
+
+    if (partition->fs == FsType::Ext4 &&
+        partition->label == kDataPartitionLabel &&
+        !SetDataPartitionAcl(partition->path)) {
+      return false;
+    }
+  }
+  result.mount_points = mount_points.join(';');
+  return true;
+}
+
+}  // namespace installer
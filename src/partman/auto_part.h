@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_PARTMAN_AUTO_PART_H
+#define INSTALLER_PARTMAN_AUTO_PART_H
+
+#include <QList>
+#include <QString>
+
+#include "partman/device.h"
+#include "partman/luks_tuning.h"
+#include "partman/operation.h"
+
+namespace installer {
+
+struct FormatOptions;
+
+// In-process implementation of hooks/auto_part.sh, which partitions a whole
+// disk based on partition_full_disk_*_policy settings.
+// Like auto_part.sh, rules after the crypto_luks rule are created as logical
+// volumes of volume group "vg0" in the LUKS partition.
+
+// An item of partition policy, in the form of "mount-point:fs:start:size",
+// together with its filesystem label.
+struct AutoPartRule {
+  QString mount_point;
+  QString fs;  // Filesystem name, "efi" or "crypto_luks".
+  QString start;  // In MiB. Empty to follow the previous partition.
+  QString size;  // In MiB, "N%" of available space, or "swap-size".
+  QString label;
+};
+typedef QList<AutoPartRule> AutoPartRuleList;
+
+// Auto partitioning settings. These are read from settings by PartitionModel,
+// as partman does not access settings itself.
+struct AutoPartPolicy {
+  // DI_FULLDISK_DEVICE, or "auto_max" to use the largest device.
+  QString device_path;
+  bool efi = false;
+  int swap_size = 0;  // DI_SWAP_SIZE, in GiB.
+  int minimum_disk_space = 0;  // In GiB.
+  int large_disk_threshold = 0;  // In GiB.
+  // Size range of root partition on large disks, in GiB.
+  int root_min = 0;
+  int root_max = 0;
+  AutoPartRuleList small_rules;
+  AutoPartRuleList large_rules;
+  // DI_CRYPT_PASSWD, passphrase of LUKS partition.
+  QString crypt_password;
+  // Options of `cryptsetup luksFormat`, see GetLuksFormatArgs().
+  LuksTuning luks;
+};
+
+// A partition planned by PlanAutoPart().
+struct AutoPartEntry {
+  PartitionType type = PartitionType::Normal;
+  FsType fs = FsType::Empty;
+  QString mount_point;
+  QString label;
+  qint64 start = 0;  // In MiB.
+  qint64 end = 0;  // In MiB, exclusive. -1 means end of device.
+  PartitionFlags flags;
+  // Whether this is the LUKS partition. If so, |fs| is empty, |mount_point|
+  // is its mapper name, and |volumes| are rules of logical volumes in it.
+  bool crypt = false;
+  AutoPartRuleList volumes;
+};
+typedef QList<AutoPartEntry> AutoPartLayout;
+
+// A logical volume planned by PlanAutoPartVolumes().
+struct AutoPartVolume {
+  QString name;  // Name in volume group, like "Root".
+  FsType fs = FsType::Empty;
+  QString mount_point;
+  QString label;
+  qint64 size = 0;  // In MiB.
+};
+typedef QList<AutoPartVolume> AutoPartVolumeList;
+
+// Settings written to installer config file after auto partitioning.
+struct AutoPartResult {
+  QString root_disk;
+  QString root_partition;
+  QString bootloader;
+  QString mount_points;  // Items are separated by ';'.
+  // Path and mapper name of LUKS partition. Both are empty if not used.
+  QString crypt_partition;
+  QString crypt_target;
+};
+
+// Get base name of full disk policy settings, like
+// "partition_full_disk_large_uefi". Append "_policy" or "_label" to it
+// to get the settings key.
+QString GetFullDiskPolicyName(bool large, bool efi, bool crypt);
+
+// Parse |policy| and |labels|, items are separated by ';'.
+// Empty items are skipped, as word splitting does in auto_part.sh.
+AutoPartRuleList ParseAutoPartRules(const QString& policy,
+                                    const QString& labels);
+
+// Returns false if |rules| can only be handled by auto_part.sh, that is,
+// more than one crypto_luks rule is used, or the LUKS partition is the last
+// one or holds an EFI partition.
+bool IsNativeAutoPartSupported(const AutoPartRuleList& rules);
+
+// Calculate partition layout of a disk with |device_size| MiB, with the same
+// arithmetic as auto_part.sh. Returns false if disk is too small or any rule
+// is invalid. Logical volumes are planned later with PlanAutoPartVolumes(),
+// as their sizes depend on the volume group.
+bool PlanAutoPart(const AutoPartPolicy& policy,
+                  qint64 device_size,
+                  AutoPartLayout& layout);
+
+// Calculate logical volumes of |rules| in a volume group with |vg_free| bytes
+// of free space and extents of |extent_size| bytes, on a disk with
+// |device_size| MiB. Like auto_part.sh, percentage sizes are based on free
+// space left by previous volumes. Returns false if space is not enough or
+// any rule is invalid.
+bool PlanAutoPartVolumes(const AutoPartPolicy& policy,
+                         qint64 device_size,
+                         const AutoPartRuleList& rules,
+                         qint64 vg_free,
+                         qint64 extent_size,
+                         AutoPartVolumeList& volumes);
+
+// Convert |layout| to operations on |device|: a NewPartTable operation
+// followed by a Create operation for each partition.
+OperationList AutoPartOperations(const Device::Ptr device,
+                                 PartitionTableType table,
+                                 const AutoPartLayout& layout);
+
+// Partition and format |device| based on |policy|, with one partition table
+// commit. Filesystems are created with |format_options|. If LUKS partition
+// is used, it is formatted and left open, with logical volumes active.
+// Settings to be saved are stored in |result|.
+// Note that this method shall be called in the background thread.
+bool AutoPartDevice(const Device::Ptr device,
+                    const AutoPartPolicy& policy,
+                    const FormatOptions& format_options,
+                    AutoPartResult& result);
+
+}  // namespace installer
+
+#endif  // INSTALLER_PARTMAN_AUTO_PART_H
@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compare partitions created by AutoPartDevice() with those created by
+// parted commands of auto_part.sh, on loop devices. Crypt policies also
+// create LUKS partition and volume group "vg0", so they fail if "vg0" exists
+// on this machine.
+
+#include "partman/auto_part.h"
+
+#include <QDir>
+
+#include "base/command.h"
+#include "partman/loop_device_util.h"
+#include "partman/partition_format.h"
+#include "partman/partition_manager.h"
+#include "partman/structs.h"
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kImageDir[] = "/tmp/deepin-installer-auto-part-test";
+const char kVolumeGroup[] = "vg0";
+const char kCryptTarget[] = "luks_crypt";
+
+// Create a sparse image with |size| MiB and attach it to a loop device.
+// Returns path to loop device, or an empty string on error.
+QString AttachImage(const QString& name, qint64 size) {
+  return AttachLoopDevice(QDir(kImageDir).absoluteFilePath(name),
+                          size * kMebiByte);
+}
+
+// Create partitions in |layout| with parted, as auto_part.sh does.
+bool RunPartedCommands(const QString& device_path,
+                       bool efi,
+                       const AutoPartLayout& layout) {
+  if (!SpawnCmd("parted", {"-s", device_path, "mktable",
+                           efi ? "gpt" : "msdos"})) {
+    return false;
+  }
+  for (const AutoPartEntry& entry : layout) {
+    QStringList args = {"-s", device_path, "mkpart"};
+    const QString start = QString("%1Mib").arg(entry.start);
+    if (entry.type == PartitionType::Extended) {
+      args << "extended" << start << "100%";
+    } else {
+      args << (entry.type == PartitionType::Logical ? "logical" : "primary");
+      // No filesystem type is set for LUKS partition.
+      if (!entry.crypt) {
+        args << (entry.fs == FsType::EFI ? "fat32" : GetFsTypeName(entry.fs));
+      }
+      args << start << QString("%1Mib").arg(entry.end);
+    }
+    if (!SpawnCmd("parted", args)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns partitions of device at |device_path|, without unallocated ones.
+PartitionList ReadPartitions(const QString& device_path) {
+  PartitionList partitions;
+  const DeviceList devices = ScanDevices({device_path}, false);
+  if (!devices.isEmpty()) {
+    for (const Partition::Ptr partition : devices.first()->partitions) {
+      if (partition->type != PartitionType::Unallocated) {
+        partitions.append(partition);
+      }
+    }
+  }
+  return partitions;
+}
+
+// Check that partitions at |native_path| and |script_path| both match
+// |layout|.
+void ExpectSameLayout(const QString& native_path,
+                      const QString& script_path,
+                      const AutoPartLayout& layout) {
+  const PartitionList native_partitions = ReadPartitions(native_path);
+  const PartitionList script_partitions = ReadPartitions(script_path);
+  ASSERT_EQ(native_partitions.length(), layout.length());
+  ASSERT_EQ(native_partitions.length(), script_partitions.length());
+  for (int index = 0; index < native_partitions.length(); ++index) {
+    const Partition::Ptr native = native_partitions.at(index);
+    const Partition::Ptr script = script_partitions.at(index);
+    EXPECT_EQ(native->partition_number, script->partition_number);
+    EXPECT_EQ(native->type, script->type);
+    EXPECT_EQ(native->start_sector, script->start_sector);
+    EXPECT_EQ(native->end_sector, script->end_sector);
+    EXPECT_EQ(native->flags.contains(PartitionFlag::Boot),
+              layout.at(index).flags.contains(PartitionFlag::Boot));
+    if (layout.at(index).fs != FsType::EFI && !layout.at(index).crypt &&
+        native->type != PartitionType::Extended) {
+      EXPECT_EQ(native->fs, layout.at(index).fs);
+    }
+  }
+}
+
+void CompareWithAutoPartScript(bool efi, qint64 device_size) {
+  AutoPartPolicy policy;
+  policy.efi = efi;
+  policy.swap_size = 1;
+  policy.minimum_disk_space = 16;
+  policy.large_disk_threshold = 64;
+  policy.root_min = 20;
+  policy.root_max = 150;
+  if (efi) {
+    policy.small_rules = ParseAutoPartRules(
+        "/boot/efi:efi:1:300;swap:linux-swap:301:swap-size;/:ext4::100%",
+        "EFI;Swap;Root");
+    policy.large_rules = ParseAutoPartRules(
+        "/boot/efi:efi:1:300;swap:linux-swap:301:swap-size;/:ext4::20%;"
+        "/home:ext4::50%;:ext4::100%",
+        "EFI;Swap;Root;Home;_dde_data");
+  } else {
+    policy.small_rules = ParseAutoPartRules(
+        "swap:linux-swap:1:swap-size;/:ext4::100%", "Swap;Root");
+    policy.large_rules = ParseAutoPartRules(
+        "swap:linux-swap:1:swap-size;/:ext4::20%;/home:ext4::50%;"
+        ":ext4::100%",
+        "Swap;Root;Home;_dde_data");
+  }
+
+  const QString native_path = AttachImage("native.img", device_size);
+  const QString script_path = AttachImage("script.img", device_size);
+  ASSERT_FALSE(native_path.isEmpty());
+  ASSERT_FALSE(script_path.isEmpty());
+
+  const DeviceList devices = ScanDevices({native_path}, false);
+  ASSERT_EQ(devices.length(), 1);
+  AutoPartResult result;
+  FormatOptions format_options;
+  format_options.jobs_per_device = 2;
+  format_options.profile = FormatProfile::Fast;
+  EXPECT_TRUE(AutoPartDevice(devices.first(), policy, format_options,
+                             result));
+  EXPECT_EQ(result.root_disk, native_path);
+  EXPECT_FALSE(result.root_partition.isEmpty());
+  EXPECT_TRUE(result.mount_points.contains(result.root_partition + "=/"));
+
+  AutoPartLayout layout;
+  ASSERT_TRUE(PlanAutoPart(policy, device_size, layout));
+  EXPECT_TRUE(RunPartedCommands(script_path, efi, layout));
+  ExpectSameLayout(native_path, script_path, layout);
+
+  DetachLoopDevice(native_path);
+  DetachLoopDevice(script_path);
+}
+
+// Returns type of filesystem at |path| reported by blkid.
+QString ReadFsType(const QString& path) {
+  QString out;
+  SpawnCmd("blkid", {"-s", "TYPE", "-o", "value", path}, out);
+  return out.trimmed();
+}
+
+void CompareCryptWithAutoPartScript(bool efi, qint64 device_size) {
+  // Do not touch volume group of this machine.
+  ASSERT_FALSE(SpawnCmd("vgs", {kVolumeGroup}));
+
+  AutoPartPolicy policy;
+  policy.efi = efi;
+  policy.swap_size = 1;
+  policy.minimum_disk_space = 2;
+  policy.large_disk_threshold = 64;
+  policy.root_min = 20;
+  policy.root_max = 150;
+  if (efi) {
+    policy.small_rules = ParseAutoPartRules(
+        "/boot/efi:efi:1:300;/boot:ext4:301:1836;"
+        "luks_crypt:crypto_luks::100%;swap:linux-swap::swap-size;"
+        "/:ext4::100%",
+        "EFI;Boot;CRYPT;Swap;Root");
+  } else {
+    policy.small_rules = ParseAutoPartRules(
+        "/boot:ext4:1:1536;luks_crypt:crypto_luks::100%;"
+        "swap:linux-swap::swap-size;/:ext4::100%",
+        "Boot;CRYPT;Swap;Root");
+  }
+  policy.crypt_password = "deepin installer";
+  // Cheap key derivation to keep this test fast.
+  policy.luks.pbkdf = "argon2id";
+  policy.luks.pbkdf_memory = 32768;
+  policy.luks.pbkdf_parallel = 1;
+  policy.luks.pbkdf_iterations = 4;
+
+  const QString native_path = AttachImage("native.img", device_size);
+  const QString script_path = AttachImage("script.img", device_size);
+  ASSERT_FALSE(native_path.isEmpty());
+  ASSERT_FALSE(script_path.isEmpty());
+
+  const DeviceList devices = ScanDevices({native_path}, false);
+  ASSERT_EQ(devices.length(), 1);
+  AutoPartResult result;
+  FormatOptions format_options;
+  format_options.jobs_per_device = 2;
+  format_options.profile = FormatProfile::Fast;
+  EXPECT_TRUE(AutoPartDevice(devices.first(), policy, format_options,
+                             result));
+
+  const QString crypt_partition =
+      QString("%1p%2").arg(native_path).arg(efi ? 3 : 2);
+  EXPECT_EQ(result.root_disk, native_path);
+  EXPECT_EQ(result.crypt_partition, crypt_partition);
+  EXPECT_EQ(result.crypt_target, kCryptTarget);
+  EXPECT_TRUE(SpawnCmd("cryptsetup", {"isLuks", crypt_partition}));
+  EXPECT_EQ(result.root_partition, "/dev/vg0/Root");
+  EXPECT_TRUE(result.mount_points.contains("/dev/vg0/Swap=swap"));
+  EXPECT_TRUE(result.mount_points.contains("/dev/vg0/Root=/"));
+  EXPECT_EQ(ReadFsType("/dev/vg0/Swap"), "swap");
+  EXPECT_EQ(ReadFsType("/dev/vg0/Root"), "ext4");
+
+  // Swap volume has DI_SWAP_SIZE, root volume uses the rest of volume group.
+  QString out;
+  EXPECT_TRUE(SpawnCmd("lvs", {"--noheadings", "--nosuffix", "--units", "m",
+                               "-o", "lv_size", "vg0/Swap"}, out));
+  EXPECT_EQ(out.trimmed(), "1024.00");
+  EXPECT_TRUE(SpawnCmd("vgs", {"--noheadings", "--nosuffix", "--units", "m",
+                               "-o", "vg_free", kVolumeGroup}, out));
+  EXPECT_EQ(out.trimmed(), "0");
+
+  AutoPartLayout layout;
+  ASSERT_TRUE(PlanAutoPart(policy, device_size, layout));
+  EXPECT_TRUE(RunPartedCommands(script_path, efi, layout));
+  ExpectSameLayout(native_path, script_path, layout);
+
+  SpawnCmd("vgchange", {"-an", kVolumeGroup});
+  SpawnCmd("cryptsetup", {"close", kCryptTarget});
+  DetachLoopDevice(native_path);
+  DetachLoopDevice(script_path);
+}
+
+TEST(AutoPartRoot, SmallLegacy) {
+  ASSERT_TRUE(QDir().mkpath(kImageDir));
+  CompareWithAutoPartScript(false, 30 * kKibiByte);
+  QDir(kImageDir).removeRecursively();
+}
+
+TEST(AutoPartRoot, SmallUEFI) {
+  ASSERT_TRUE(QDir().mkpath(kImageDir));
+  CompareWithAutoPartScript(true, 30 * kKibiByte);
+  QDir(kImageDir).removeRecursively();
+}
+
+TEST(AutoPartRoot, LargeLegacy) {
+  ASSERT_TRUE(QDir().mkpath(kImageDir));
+  CompareWithAutoPartScript(false, 200 * kKibiByte);
+  QDir(kImageDir).removeRecursively();
+}
+
+TEST(AutoPartRoot, LargeUEFI) {
+  ASSERT_TRUE(QDir().mkpath(kImageDir));
+  CompareWithAutoPartScript(true, 200 * kKibiByte);
+  QDir(kImageDir).removeRecursively();
+}
+
+TEST(AutoPartRoot, SmallLegacyCrypt) {
+  ASSERT_TRUE(QDir().mkpath(kImageDir));
+  CompareCryptWithAutoPartScript(false, 4 * kKibiByte);
+  QDir(kImageDir).removeRecursively();
+}
+
+TEST(AutoPartRoot, SmallUEFICrypt) {
+  ASSERT_TRUE(QDir().mkpath(kImageDir));
+  CompareCryptWithAutoPartScript(true, 6 * kKibiByte);
+  QDir(kImageDir).removeRecursively();
+}
+
+}  // namespace
+}  // namespace installer
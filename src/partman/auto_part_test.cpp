@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/auto_part.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+// Policies in default_settings.ini.
+const char kSmallLegacyPolicy[] = "swap:linux-swap:1:swap-size;/:ext4::100%";
+const char kSmallLegacyLabel[] = "Swap;Root";
+const char kSmallUEFIPolicy[] =
+    "/boot/efi:efi:1:300;swap:linux-swap:301:swap-size;/:ext4::100%";
+const char kSmallUEFILabel[] = "EFI;Swap;Root";
+const char kLargeLegacyPolicy[] =
+    "swap:linux-swap:1:swap-size;/:ext4::20%;/home:ext4::50%;:ext4::100%";
+const char kLargeLegacyLabel[] = "Swap;Root;Home;_dde_data";
+const char kLargeUEFIPolicy[] =
+    "/boot/efi:efi:1:300;swap:linux-swap:301:swap-size;/:ext4::20%;"
+    "/home:ext4::50%;:ext4::100%";
+const char kLargeUEFILabel[] = "EFI;Swap;Root;Home;_dde_data";
+const char kSmallLegacyCryptPolicy[] =
+    "/boot:ext4:1:1536;luks_crypt:crypto_luks::100%;"
+    "swap:linux-swap::swap-size;/:ext4::100%";
+const char kSmallLegacyCryptLabel[] = "Boot;CRYPT;Swap;Root";
+const char kLargeUEFICryptPolicy[] =
+    "/boot/efi:efi:1:300;/boot:ext4:301:1836;luks_crypt:crypto_luks::100%;"
+    "swap:linux-swap::swap-size;/:ext4::20%;/home:ext4::50%;:ext4::100%";
+const char kLargeUEFICryptLabel[] = "EFI;Boot;CRYPT;Swap;Root;Home;_dde_data";
+
+AutoPartPolicy NewPolicy(bool efi, int swap_size) {
+  AutoPartPolicy policy;
+  policy.efi = efi;
+  policy.swap_size = swap_size;
+  policy.minimum_disk_space = 16;
+  policy.large_disk_threshold = 64;
+  policy.root_min = 20;
+  policy.root_max = 150;
+  if (efi) {
+    policy.small_rules = ParseAutoPartRules(kSmallUEFIPolicy, kSmallUEFILabel);
+    policy.large_rules = ParseAutoPartRules(kLargeUEFIPolicy, kLargeUEFILabel);
+  } else {
+    policy.small_rules =
+        ParseAutoPartRules(kSmallLegacyPolicy, kSmallLegacyLabel);
+    policy.large_rules =
+        ParseAutoPartRules(kLargeLegacyPolicy, kLargeLegacyLabel);
+  }
+  return policy;
+}
+
+void ExpectEntry(const AutoPartEntry& entry, PartitionType type, FsType fs,
+                 const QString& mount_point, qint64 start, qint64 end) {
+  EXPECT_EQ(entry.type, type);
+  EXPECT_EQ(entry.fs, fs);
+  EXPECT_EQ(entry.mount_point, mount_point);
+  EXPECT_EQ(entry.start, start);
+  EXPECT_EQ(entry.end, end);
+}
+
+TEST(AutoPart, GetFullDiskPolicyName) {
+  EXPECT_EQ(GetFullDiskPolicyName(false, false, false),
+            "partition_full_disk_small_legacy");
+  EXPECT_EQ(GetFullDiskPolicyName(true, true, true),
+            "partition_full_disk_large_uefi_crypt");
+}
+
+TEST(AutoPart, ParseAutoPartRules) {
+  AutoPartRuleList rules =
+      ParseAutoPartRules(kLargeLegacyPolicy, kLargeLegacyLabel);
+  ASSERT_EQ(rules.length(), 4);
+  EXPECT_EQ(rules.at(0).mount_point, "swap");
+  EXPECT_EQ(rules.at(0).fs, "linux-swap");
+  EXPECT_EQ(rules.at(0).start, "1");
+  EXPECT_EQ(rules.at(0).size, "swap-size");
+  EXPECT_TRUE(rules.at(3).mount_point.isEmpty());
+  EXPECT_EQ(rules.at(3).label, "_dde_data");
+  EXPECT_TRUE(IsNativeAutoPartSupported(rules));
+
+  // Empty labels are dropped as auto_part.sh does.
+  rules = ParseAutoPartRules(
+      "/boot:ext4:1:1536;luks_crypt:crypto_luks::100%;/:ext4::100%",
+      "Boot;;CRYPT;Root");
+  ASSERT_EQ(rules.length(), 3);
+  EXPECT_EQ(rules.at(1).label, "CRYPT");
+  EXPECT_TRUE(IsNativeAutoPartSupported(rules));
+
+  // LUKS partition shall hold logical volumes other than ESP.
+  EXPECT_FALSE(IsNativeAutoPartSupported(ParseAutoPartRules(
+      "/:ext4:1:1536;luks_crypt:crypto_luks::100%", "")));
+  EXPECT_FALSE(IsNativeAutoPartSupported(ParseAutoPartRules(
+      "luks_crypt:crypto_luks:1:100%;/boot/efi:efi::300;/:ext4::100%", "")));
+  EXPECT_FALSE(IsNativeAutoPartSupported(ParseAutoPartRules(
+      "a:crypto_luks:1:50%;b:crypto_luks::100%;/:ext4::100%", "")));
+
+  EXPECT_TRUE(ParseAutoPartRules("/:ext4:100%", "Root").isEmpty());
+}
+
+TEST(AutoPart, PlanSmallDisk) {
+  AutoPartLayout layout;
+  // Disk is too small.
+  EXPECT_FALSE(PlanAutoPart(NewPolicy(false, 4), 15360, layout));
+
+  ASSERT_TRUE(PlanAutoPart(NewPolicy(false, 4), 30720, layout));
+  ASSERT_EQ(layout.length(), 2);
+  ExpectEntry(layout.at(0), PartitionType::Normal, FsType::LinuxSwap,
+              "swap", 1, 4097);
+  ExpectEntry(layout.at(1), PartitionType::Normal, FsType::Ext4,
+              "/", 4097, 30719);
+  EXPECT_EQ(layout.at(1).label, "Root");
+  EXPECT_TRUE(layout.at(1).flags.contains(PartitionFlag::Boot));
+
+  // Default swap size is used if DI_SWAP_SIZE is not set.
+  ASSERT_TRUE(PlanAutoPart(NewPolicy(true, 0), 30720, layout));
+  ASSERT_EQ(layout.length(), 3);
+  ExpectEntry(layout.at(0), PartitionType::Normal, FsType::EFI,
+              "/boot/efi", 1, 301);
+  EXPECT_TRUE(layout.at(0).flags.contains(PartitionFlag::ESP));
+  ExpectEntry(layout.at(1), PartitionType::Normal, FsType::LinuxSwap,
+              "swap", 301, 1325);
+  ExpectEntry(layout.at(2), PartitionType::Normal, FsType::Ext4,
+              "/", 1325, 30719);
+  EXPECT_TRUE(layout.at(2).flags.isEmpty());
+
+  // Disk at threshold is not large.
+  ASSERT_TRUE(PlanAutoPart(NewPolicy(false, 4), 65536, layout));
+  EXPECT_EQ(layout.length(), 2);
+}
+
+TEST(AutoPart, PlanLargeDisk) {
+  AutoPartLayout layout;
+  ASSERT_TRUE(PlanAutoPart(NewPolicy(false, 4), 204800, layout));
+  ASSERT_EQ(layout.length(), 5);
+  ExpectEntry(layout.at(0), PartitionType::Normal, FsType::LinuxSwap,
+              "swap", 1, 4097);
+  ExpectEntry(layout.at(1), PartitionType::Normal, FsType::Ext4,
+              "/", 4097, 44237);
+  EXPECT_TRUE(layout.at(1).flags.contains(PartitionFlag::Boot));
+  ExpectEntry(layout.at(2), PartitionType::Normal, FsType::Ext4,
+              "/home", 44237, 124518);
+  ExpectEntry(layout.at(3), PartitionType::Extended, FsType::Empty,
+              "", 124518, -1);
+  ExpectEntry(layout.at(4), PartitionType::Logical, FsType::Ext4,
+              "", 124519, 204799);
+  EXPECT_EQ(layout.at(4).label, "_dde_data");
+
+  // Root partition is limited to 150GiB.
+  ASSERT_TRUE(PlanAutoPart(NewPolicy(true, 8), 1048576, layout));
+  ASSERT_EQ(layout.length(), 5);
+  ExpectEntry(layout.at(1), PartitionType::Normal, FsType::LinuxSwap,
+              "swap", 301, 8493);
+  ExpectEntry(layout.at(2), PartitionType::Normal, FsType::Ext4,
+              "/", 8493, 162093);
+  ExpectEntry(layout.at(3), PartitionType::Normal, FsType::Ext4,
+              "/home", 162093, 605334);
+  ExpectEntry(layout.at(4), PartitionType::Normal, FsType::Ext4,
+              "", 605334, 1048575);
+
+  // Root partition is at least 20GiB.
+  ASSERT_TRUE(PlanAutoPart(NewPolicy(false, 2), 71680, layout));
+  ASSERT_EQ(layout.length(), 5);
+  ExpectEntry(layout.at(1), PartitionType::Normal, FsType::Ext4,
+              "/", 2049, 22529);
+  ExpectEntry(layout.at(2), PartitionType::Normal, FsType::Ext4,
+              "/home", 22529, 47104);
+  ExpectEntry(layout.at(4), PartitionType::Logical, FsType::Ext4,
+              "", 47105, 71679);
+}
+
+TEST(AutoPart, PlanCryptDisk) {
+  AutoPartPolicy policy = NewPolicy(false, 4);
+  policy.small_rules =
+      ParseAutoPartRules(kSmallLegacyCryptPolicy, kSmallLegacyCryptLabel);
+  AutoPartLayout layout;
+  ASSERT_TRUE(PlanAutoPart(policy, 30720, layout));
+  ASSERT_EQ(layout.length(), 2);
+  ExpectEntry(layout.at(0), PartitionType::Normal, FsType::Ext4,
+              "/boot", 1, 1537);
+  EXPECT_TRUE(layout.at(0).flags.contains(PartitionFlag::Boot));
+  EXPECT_FALSE(layout.at(0).crypt);
+  ExpectEntry(layout.at(1), PartitionType::Normal, FsType::Empty,
+              "luks_crypt", 1537, 30719);
+  EXPECT_TRUE(layout.at(1).crypt);
+  EXPECT_TRUE(layout.at(1).flags.isEmpty());
+  ASSERT_EQ(layout.at(1).volumes.length(), 2);
+  EXPECT_EQ(layout.at(1).volumes.at(0).mount_point, "swap");
+  EXPECT_EQ(layout.at(1).volumes.at(1).label, "Root");
+
+  // Rules after LUKS partition are planned as logical volumes.
+  policy = NewPolicy(true, 8);
+  policy.large_rules =
+      ParseAutoPartRules(kLargeUEFICryptPolicy, kLargeUEFICryptLabel);
+  ASSERT_TRUE(PlanAutoPart(policy, 204800, layout));
+  ASSERT_EQ(layout.length(), 3);
+  ExpectEntry(layout.at(1), PartitionType::Normal, FsType::Ext4,
+              "/boot", 301, 2137);
+  EXPECT_TRUE(layout.at(1).flags.isEmpty());
+  ExpectEntry(layout.at(2), PartitionType::Normal, FsType::Empty,
+              "luks_crypt", 2137, 204799);
+  EXPECT_EQ(layout.at(2).volumes.length(), 4);
+}
+
+TEST(AutoPart, PlanAutoPartVolumes) {
+  AutoPartPolicy policy = NewPolicy(true, 8);
+  AutoPartRuleList rules =
+      ParseAutoPartRules(kLargeUEFICryptPolicy, kLargeUEFICryptLabel).mid(3);
+  AutoPartVolumeList volumes;
+  const qint64 extent = 4 * kMebiByte;
+  ASSERT_TRUE(PlanAutoPartVolumes(policy, 204800, rules,
+                                  201000 * kMebiByte, extent, volumes));
+  ASSERT_EQ(volumes.length(), 4);
+  EXPECT_EQ(volumes.at(0).name, "Swap");
+  EXPECT_EQ(volumes.at(0).fs, FsType::LinuxSwap);
+  EXPECT_EQ(volumes.at(0).size, 8192);
+  EXPECT_EQ(volumes.at(1).name, "Root");
+  EXPECT_EQ(volumes.at(1).mount_point, "/");
+  EXPECT_EQ(volumes.at(1).size, 38561);
+  // Percentage is based on free space left by previous volumes, whose
+  // sizes are rounded up to extents.
+  EXPECT_EQ(volumes.at(2).name, "Home");
+  EXPECT_EQ(volumes.at(2).mount_point, "/home");
+  EXPECT_EQ(volumes.at(2).size, 77122);
+  EXPECT_EQ(volumes.at(3).name, "_dde_data");
+  EXPECT_EQ(volumes.at(3).label, "_dde_data");
+  EXPECT_EQ(volumes.at(3).size, 77120);
+
+  // Sizes are rounded up to extents, and free space is rounded down to MiB.
+  rules = ParseAutoPartRules(":ext4::1;/:ext4::100%", "");
+  ASSERT_TRUE(PlanAutoPartVolumes(policy, 30720, rules,
+                                  100 * kMebiByte + 1024, extent, volumes));
+  ASSERT_EQ(volumes.length(), 2);
+  EXPECT_EQ(volumes.at(0).name, "lvm1");
+  EXPECT_EQ(volumes.at(0).size, 1);
+  EXPECT_EQ(volumes.at(1).name, "lvm2");
+  EXPECT_EQ(volumes.at(1).size, 96);
+
+  // Root volume is at least 20GiB on large disks.
+  rules = ParseAutoPartRules("/:ext4::100%", "Root");
+  EXPECT_FALSE(PlanAutoPartVolumes(policy, 204800, rules,
+                                   10240 * kMebiByte, extent, volumes));
+  EXPECT_FALSE(PlanAutoPartVolumes(policy, 204800, rules,
+                                   204800 * kMebiByte, 0, volumes));
+  rules = ParseAutoPartRules("/boot/efi:efi::300", "EFI");
+  EXPECT_FALSE(PlanAutoPartVolumes(policy, 204800, rules,
+                                   10240 * kMebiByte, extent, volumes));
+}
+
+TEST(AutoPart, AutoPartOperations) {
+  Device::Ptr device(new Device);
+  device->path = "/dev/sdz";
+  device->sector_size = 512;
+  device->length = 204800LL * 2048;
+  AutoPartLayout layout;
+  ASSERT_TRUE(PlanAutoPart(NewPolicy(false, 4), 204800, layout));
+
+  const OperationList operations =
+      AutoPartOperations(device, PartitionTableType::MsDos, layout);
+  ASSERT_EQ(operations.length(), 6);
+  EXPECT_EQ(operations.at(0).type, OperationType::NewPartTable);
+  EXPECT_EQ(operations.at(0).device->table, PartitionTableType::MsDos);
+
+  const Partition::Ptr swap = operations.at(1).new_partition;
+  EXPECT_EQ(operations.at(1).type, OperationType::Create);
+  EXPECT_EQ(swap->start_sector, 2048);
+  EXPECT_EQ(swap->end_sector, 4097 * 2048 - 1);
+  EXPECT_TRUE(swap->mount_point.isEmpty());
+
+  const Partition::Ptr extended = operations.at(4).new_partition;
+  EXPECT_EQ(extended->type, PartitionType::Extended);
+  EXPECT_EQ(extended->end_sector, device->length - 1);
+
+  const Partition::Ptr data = operations.at(5).new_partition;
+  EXPECT_EQ(data->type, PartitionType::Logical);
+  EXPECT_EQ(data->start_sector, 124519 * 2048);
+  EXPECT_EQ(data->label, "_dde_data");
+  EXPECT_EQ(data->device_path, "/dev/sdz");
+
+  // Mapper name is not used as mount point of LUKS partition.
+  AutoPartPolicy policy = NewPolicy(false, 4);
+  policy.large_rules =
+      ParseAutoPartRules(kSmallLegacyCryptPolicy, kSmallLegacyCryptLabel);
+  ASSERT_TRUE(PlanAutoPart(policy, 204800, layout));
+  const OperationList crypt_operations =
+      AutoPartOperations(device, PartitionTableType::MsDos, layout);
+  ASSERT_EQ(crypt_operations.length(), 3);
+  const Partition::Ptr crypt = crypt_operations.at(2).new_partition;
+  EXPECT_EQ(crypt->fs, FsType::Empty);
+  EXPECT_TRUE(crypt->mount_point.isEmpty());
+  EXPECT_EQ(crypt->end_sector, 204799 * 2048 - 1);
+}
+
+}  // namespace
+}  // namespace installer
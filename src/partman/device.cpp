@@ -87,6 +87,44 @@ int DeviceIndex(const DeviceList& devices, const QString& device_path) {
   return -1;
 }
 
+bool DeviceListDiff::isEmpty() const {
+  return added.isEmpty() && changed.isEmpty() && removed.isEmpty();
+}
+
+QDebug& operator<<(QDebug& debug, const DeviceListDiff& diff) {
+  debug << "DeviceListDiff: {"
+        << "added:" << diff.added
+        << "changed:" << diff.changed
+        << "removed:" << diff.removed
+        << "}";
+  return debug;
+}
+
+void ApplyDeviceListDiff(DeviceList& devices, const DeviceListDiff& diff) {
+  for (const QString& path : diff.removed) {
+    const int index = DeviceIndex(devices, path);
+    if (index != -1) {
+      devices.removeAt(index);
+    }
+  }
+  for (const Device::Ptr& device : diff.changed) {
+    const int index = DeviceIndex(devices, device->path);
+    if (index == -1) {
+      devices.append(device);
+    } else {
+      devices[index] = device;
+    }
+  }
+  for (const Device::Ptr& device : diff.added) {
+    const int index = DeviceIndex(devices, device->path);
+    if (index == -1) {
+      devices.append(device);
+    } else {
+      devices[index] = device;
+    }
+  }
+}
+
 bool Device::operator==(const Device &device) {
     return path == device.path;
 }
@@ -21,6 +21,7 @@
 #include <QDebug>
 #include <QList>
 #include <QSharedPointer>
+#include <QStringList>
 
 #include "partman/partition.h"
 
@@ -60,6 +61,20 @@ typedef QList<Device::Ptr> DeviceList;
 // Get index of device object with |device_path|. Returns -1 if not found.
 int DeviceIndex(const DeviceList& devices, const QString& device_path);
 
+// Changes of device list since last scan.
+struct DeviceListDiff {
+  DeviceList added;
+  DeviceList changed;
+  QStringList removed;  // Path to removed devices.
+
+  bool isEmpty() const;
+};
+QDebug& operator<<(QDebug& debug, const DeviceListDiff& diff);
+
+// Apply |diff| to |devices|. Changed devices are replaced in place and
+// added devices are appended, so that order of other devices is kept.
+void ApplyDeviceListDiff(DeviceList& devices, const DeviceListDiff& diff);
+
 }  // namespace installer
 
 #endif  // INSTALLER_PARTMAN_DEVICE_H
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/format_profile.h"
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include "base/file_util.h"
+
+namespace installer {
+
+namespace {
+
+const char kSysBlockDir[] = "/sys/block";
+
+}  // namespace
+
+QDebug& operator<<(QDebug& debug, const FormatProfile& profile) {
+  switch (profile) {
+    case FormatProfile::Default: {
+      debug << "Default";
+      break;
+    }
+    case FormatProfile::Fast: {
+      debug << "Fast";
+      break;
+    }
+    case FormatProfile::Auto: {
+      debug << "Auto";
+      break;
+    }
+  }
+  return debug;
+}
+
+FormatProfile ParseFormatProfile(const QString& name) {
+  const QString profile = name.trimmed().toLower();
+  if (profile == "fast") {
+    return FormatProfile::Fast;
+  }
+  if (profile == "auto") {
+    return FormatProfile::Auto;
+  }
+  if (profile != "default") {
+    qWarning() << "Unknown format profile:" << name;
+  }
+  return FormatProfile::Default;
+}
+
+DeviceQueueInfo GetDeviceQueueInfo(const QString& device_path) {
+  // Resolve symbolic links like /dev/disk/by-id/xxx.
+  QString real_path = QFileInfo(device_path).canonicalFilePath();
+  if (real_path.isEmpty()) {
+    real_path = device_path;
+  }
+  const QString name = QFileInfo(real_path).fileName();
+  return ReadDeviceQueueInfo(
+      QDir(kSysBlockDir).absoluteFilePath(name + "/queue"));
+}
+
+DeviceQueueInfo ReadDeviceQueueInfo(const QString& queue_dir) {
+  const QDir dir(queue_dir);
+  DeviceQueueInfo info;
+  QString content;
+  if (ReadTextFile(dir.absoluteFilePath("rotational"), content)) {
+    info.rotational = (content.trimmed() != "0");
+  }
+  if (ReadTextFile(dir.absoluteFilePath("discard_max_bytes"), content)) {
+    info.discard = (content.trimmed().toLongLong() > 0);
+  }
+  return info;
+}
+
+FormatProfile ResolveFormatProfile(FormatProfile profile,
+                                   const DeviceQueueInfo& info) {
+  if (profile != FormatProfile::Auto) {
+    return profile;
+  }
+  if (!info.rotational && info.discard) {
+    return FormatProfile::Fast;
+  } else {
+    return FormatProfile::Default;
+  }
+}
+
+QStringList GetMkfsProfileArgs(FsType fs, FormatProfile profile) {
+  if (profile != FormatProfile::Fast) {
+    return QStringList();
+  }
+
+  switch (fs) {
+    case FsType::Btrfs: {
+      return {"-K"};
+    }
+    case FsType::Ext2: {
+      // ext2 has no journal.
+      return {"-E", "nodiscard,lazy_itable_init=1"};
+    }
+    case FsType::Ext3:
+    case FsType::Ext4: {
+      return {"-E", "nodiscard,lazy_itable_init=1,lazy_journal_init=1"};
+    }
+    case FsType::F2fs: {
+      return {"-t", "0"};
+    }
+    case FsType::Xfs: {
+      return {"-K"};
+    }
+    default: {
+      // Other mkfs tools do not discard blocks or zero tables.
+      return QStringList();
+    }
+  }
+}
+
+bool DiscardDevice(const QString& device_path) {
+  const int fd = open(device_path.toLocal8Bit().constData(), O_WRONLY);
+  if (fd == -1) {
+    qCritical() << "DiscardDevice() failed to open" << device_path;
+    return false;
+  }
+
+  bool ok = false;
+  uint64_t size = 0;
+  if (ioctl(fd, BLKGETSIZE64, &size) == 0) {
+    QElapsedTimer timer;
+    timer.start();
+    uint64_t range[2] = { 0, size };
+    ok = (ioctl(fd, BLKDISCARD, &range) == 0);
+    if (ok) {
+      qDebug() << "DiscardDevice()" << device_path << size << "bytes"
+               << timer.elapsed() << "ms";
+    } else {
+      qWarning() << "DiscardDevice() BLKDISCARD failed:" << device_path;
+    }
+  } else {
+    qCritical() << "DiscardDevice() failed to get size of" << device_path;
+  }
+
+  close(fd);
+  return ok;
+}
+
+}  // namespace installer
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_PARTMAN_FORMAT_PROFILE_H
+#define INSTALLER_PARTMAN_FORMAT_PROFILE_H
+
+#include <QString>
+#include <QStringList>
+
+#include "partman/fs.h"
+
+namespace installer {
+
+// Options passed to mkfs.
+enum class FormatProfile {
+  // Use default options of mkfs.
+  Default,
+  // Do not discard blocks in mkfs and initialize inode tables and journal
+  // lazily. The whole device is discarded once before its partition table is
+  // created, if supported.
+  Fast,
+  // Use Fast on non-rotational devices which support discard, and Default on
+  // other devices.
+  Auto,
+};
+QDebug& operator<<(QDebug& debug, const FormatProfile& profile);
+
+// Parse profile name in settings, "default", "fast" or "auto".
+// Returns Default if |name| is unknown.
+FormatProfile ParseFormatProfile(const QString& name);
+
+// Properties of request queue of a block device.
+struct DeviceQueueInfo {
+  bool rotational = true;
+  // Device supports BLKDISCARD.
+  bool discard = false;
+};
+
+// Read properties of device at |device_path| from /sys/block/*/queue/.
+DeviceQueueInfo GetDeviceQueueInfo(const QString& device_path);
+
+// Read queue properties from sysfs |queue_dir|.
+DeviceQueueInfo ReadDeviceQueueInfo(const QString& queue_dir);
+
+// Returns Default or Fast. |profile| is resolved with |info| if it is Auto.
+FormatProfile ResolveFormatProfile(FormatProfile profile,
+                                   const DeviceQueueInfo& info);
+
+// Get extra arguments of mkfs to create |fs| with |profile|.
+QStringList GetMkfsProfileArgs(FsType fs, FormatProfile profile);
+
+// Discard all blocks of device at |device_path| with BLKDISCARD.
+// All data on that device is lost.
+bool DiscardDevice(const QString& device_path);
+
+}  // namespace installer
+
+#endif  // INSTALLER_PARTMAN_FORMAT_PROFILE_H
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/format_profile.h"
+
+#include <QDir>
+
+#include "base/file_util.h"
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kTestQueueDir[] = "/tmp/deepin-installer-format-profile-test";
+
+TEST(FormatProfileTest, ParseFormatProfile) {
+  EXPECT_EQ(ParseFormatProfile("fast"), FormatProfile::Fast);
+  EXPECT_EQ(ParseFormatProfile(" Auto "), FormatProfile::Auto);
+  EXPECT_EQ(ParseFormatProfile("default"), FormatProfile::Default);
+  EXPECT_EQ(ParseFormatProfile("unknown"), FormatProfile::Default);
+}
+
+TEST(FormatProfileTest, ReadDeviceQueueInfo) {
+  QDir(kTestQueueDir).removeRecursively();
+  const QString queue_dir(kTestQueueDir);
+
+  // Defaults to rotational device without discard.
+  DeviceQueueInfo info = ReadDeviceQueueInfo(queue_dir);
+  EXPECT_TRUE(info.rotational);
+  EXPECT_FALSE(info.discard);
+
+  ASSERT_TRUE(CreateDirs(queue_dir));
+  ASSERT_TRUE(WriteTextFile(queue_dir + "/rotational", "0\n"));
+  ASSERT_TRUE(WriteTextFile(queue_dir + "/discard_max_bytes",
+                            "2199023255040\n"));
+  info = ReadDeviceQueueInfo(queue_dir);
+  EXPECT_FALSE(info.rotational);
+  EXPECT_TRUE(info.discard);
+
+  ASSERT_TRUE(WriteTextFile(queue_dir + "/discard_max_bytes", "0\n"));
+  info = ReadDeviceQueueInfo(queue_dir);
+  EXPECT_FALSE(info.discard);
+
+  QDir(queue_dir).removeRecursively();
+}
+
+TEST(FormatProfileTest, ResolveFormatProfile) {
+  DeviceQueueInfo ssd;
+  ssd.rotational = false;
+  ssd.discard = true;
+  DeviceQueueInfo hdd;
+
+  EXPECT_EQ(ResolveFormatProfile(FormatProfile::Auto, ssd),
+            FormatProfile::Fast);
+  EXPECT_EQ(ResolveFormatProfile(FormatProfile::Auto, hdd),
+            FormatProfile::Default);
+  EXPECT_EQ(ResolveFormatProfile(FormatProfile::Fast, hdd),
+            FormatProfile::Fast);
+  EXPECT_EQ(ResolveFormatProfile(FormatProfile::Default, ssd),
+            FormatProfile::Default);
+}
+
+TEST(FormatProfileTest, GetMkfsProfileArgs) {
+  EXPECT_TRUE(GetMkfsProfileArgs(FsType::Ext4,
+                                 FormatProfile::Default).isEmpty());
+  EXPECT_EQ(GetMkfsProfileArgs(FsType::Ext4, FormatProfile::Fast),
+            QStringList({"-E",
+                         "nodiscard,lazy_itable_init=1,lazy_journal_init=1"}));
+  EXPECT_EQ(GetMkfsProfileArgs(FsType::Xfs, FormatProfile::Fast),
+            QStringList({"-K"}));
+  EXPECT_EQ(GetMkfsProfileArgs(FsType::F2fs, FormatProfile::Fast),
+            QStringList({"-t", "0"}));
+  EXPECT_TRUE(GetMkfsProfileArgs(FsType::Fat32,
+                                 FormatProfile::Fast).isEmpty());
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,872 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/fs_superblock.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <QByteArray>
+#include <QDebug>
+#include <QCryptographicHash>
+#include <QList>
+#include <QMap>
+#include <QtAlgorithms>
+#include <QtEndian>
+
+namespace installer {
+
+namespace {
+
+// Size of each read when scanning FAT table or NTFS cluster bitmap.
+const qint64 kScanChunkSize = 1024 * 1024;
+
+// ext2/3/4
+const qint64 kExtSuperblockOffset = 1024;
+const int kExtSuperblockSize = 1024;
+const quint16 kExtMagic = 0xEF53;
+const quint32 kExtFeatureIncompat64Bit = 0x80;
+
+// FAT
+const int kFatBootSectorSize = 512;
+const quint32 kFatMinClusters = 4085;  // FAT12 has fewer clusters.
+const quint32 kFat32MinClusters = 65525;
+const quint32 kFsInfoLeadSig = 0x41615252;
+const quint32 kFsInfoStrucSig = 0x61417272;
+const quint32 kFsInfoUnknown = 0xFFFFFFFF;
+const int kFatDirEntrySize = 32;
+const uchar kFatAttrLongName = 0x0F;
+const uchar kFatAttrDirectory = 0x10;
+// Limit size of directories read, a broken FAT may contain loops.
+const int kFatMaxDirClusters = 64;
+// Short name of EFI/ folder on ESP.
+const char kFatEfiDirName[] = "EFI        ";
+
+// NTFS
+const int kNTFSBootSectorSize = 512;
+const char kNTFSOemId[] = "NTFS    ";
+const int kNTFSLogFileRecord = 2;  // $LogFile is the 3rd MFT record.
+const int kNTFSBitmapRecord = 6;  // $Bitmap is the 7th MFT record.
+const quint32 kNTFSAttrData = 0x80;
+const quint32 kNTFSAttrEnd = 0xFFFFFFFF;
+const int kNTFSFixupSectorSize = 512;
+const int kNTFSMaxLogPageSize = 65536;
+
+// btrfs
+const qint64 kBtrfsSuperblockOffset = 0x10000;
+const int kBtrfsSuperblockSize = 4096;
+const char kBtrfsMagic[] = "_BHRfS_M";
+
+// xfs
+const int kXfsSuperblockSize = 512;
+const char kXfsMagic[] = "XFSB";
+
+// swap, signature is at the end of the first page, which is 4KiB to 64KiB.
+const int kSwapMinPageSize = 4096;
+const int kSwapMaxPageSize = 65536;
+const int kSwapSignatureSize = 10;
+const char kSwapSignature[] = "SWAPSPACE2";
+const char kSwapOldSignature[] = "SWAP-SPACE";
+
+// LUKS1 and LUKS2
+const char kLuksMagic[] = "LUKS\xBA\xBE";
+const int kLuksMagicSize = 6;
+
+// LVM2 physical volume, its label is in one of the first 4 sectors.
+const int kLvmLabelSectors = 4;
+const int kLvmSectorSize = 512;
+const char kLvmLabelId[] = "LABELONE";
+const char kLvmLabelType[] = "LVM2 001";
+
+// Linux software RAID member
+const quint32 kMdMagic = 0xA92B4EFC;
+const qint64 kMd090ReservedSize = 65536;
+const qint64 kMdSectorSize = 512;
+
+inline quint16 Le16(const char* p) {
+  return qFromLittleEndian<quint16>(reinterpret_cast<const uchar*>(p));
+}
+
+inline quint32 Le32(const char* p) {
+  return qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(p));
+}
+
+inline quint64 Le64(const char* p) {
+  return qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(p));
+}
+
+inline quint32 Be32(const char* p) {
+  return qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(p));
+}
+
+inline quint64 Be64(const char* p) {
+  return qFromBigEndian<quint64>(reinterpret_cast<const uchar*>(p));
+}
+
+inline bool IsPowerOfTwo(quint64 value) {
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+// Count entries with value 0 in FAT table, of cluster 2 to |clusters| + 1.
+bool CountFatFreeClusters(const BlockReader& reader,
+                          qint64 fat_offset,
+                          quint32 clusters,
+                          bool is_fat32,
+                          qint64& free_clusters) {
+  const int entry_size = is_fat32 ? 4 : 2;
+  const qint64 entries = qint64(clusters) + 2;
+  const qint64 entries_per_chunk = kScanChunkSize / entry_size;
+  QByteArray chunk;
+  free_clusters = 0;
+  for (qint64 index = 0; index < entries; index += entries_per_chunk) {
+    const qint64 count = qMin(entries_per_chunk, entries - index);
+    chunk.resize(int(count * entry_size));
+    if (!reader(fat_offset + index * entry_size, chunk.data(),
+                chunk.size())) {
+      return false;
+    }
+    const char* data = chunk.constData();
+    for (qint64 i = 0; i < count; ++i) {
+      if (index + i < 2) {
+        // First two entries are reserved.
+        continue;
+      }
+      const quint32 value = is_fat32 ?
+          (Le32(data + i * 4) & 0x0FFFFFFF) :
+          Le16(data + i * 2);
+      if (value == 0) {
+        free_clusters ++;
+      }
+    }
+  }
+  return true;
+}
+
+// Decode a little-endian integer of |size| bytes. If |is_signed| is true,
+// it is sign extended.
+qint64 DecodeRunValue(const char* p, int size, bool is_signed) {
+  quint64 value = 0;
+  for (int i = 0; i < size; ++i) {
+    value |= quint64(uchar(p[i])) << (i * 8);
+  }
+  if (is_signed && size > 0 && size < 8 && (uchar(p[size - 1]) & 0x80)) {
+    value |= ~quint64(0) << (size * 8);
+  }
+  return qint64(value);
+}
+
+// Count clear bits of NTFS cluster bitmap in |data|, which starts at bit
+// |first_bit|. Bits after |total_bits| are ignored.
+qint64 CountClearBits(const char* data, qint64 size,
+                      qint64 first_bit, qint64 total_bits) {
+  qint64 result = 0;
+  for (qint64 i = 0; i < size; ++i) {
+    const qint64 bit = first_bit + i * 8;
+    if (bit >= total_bits) {
+      break;
+    }
+    uchar byte = uchar(~data[i]);
+    if (total_bits - bit < 8) {
+      byte &= uchar((1 << (total_bits - bit)) - 1);
+    }
+    result += qPopulationCount(byte);
+  }
+  return result;
+}
+
+// Apply update sequence array of NTFS MFT |record|.
+bool ApplyNTFSFixup(QByteArray& record) {
+  char* data = record.data();
+  const int usa_offset = Le16(data + 4);
+  const int usa_count = Le16(data + 6);
+  if (usa_count == 0 || usa_offset + usa_count * 2 > record.size()) {
+    return false;
+  }
+  const quint16 usn = Le16(data + usa_offset);
+  for (int i = 1; i < usa_count; ++i) {
+    const int pos = i * kNTFSFixupSectorSize - 2;
+    if (pos + 2 > record.size() || Le16(data + pos) != usn) {
+      return false;
+    }
+    memcpy(data + pos, data + usa_offset + i * 2, 2);
+  }
+  return true;
+}
+
+// Layout of FAT16 or FAT32 filesystem, read from its boot sector.
+struct FatLayout {
+  qint64 bytes_per_sector = 0;
+  qint64 cluster_size = 0;
+  qint64 reserved_sectors = 0;
+  qint64 fat_offset = 0;
+  qint64 root_dir_offset = 0;  // Root directory region of FAT16.
+  qint64 root_dir_size = 0;
+  qint64 data_offset = 0;  // Offset of cluster 2.
+  quint32 clusters = 0;
+  quint32 root_cluster = 0;  // First cluster of root directory of FAT32.
+  quint32 fs_info_sector = 0;
+  bool is_fat32 = false;
+};
+
+// Parse boot sector of FAT filesystem. FAT12 is not supported.
+bool ReadFatLayout(const BlockReader& reader, FatLayout& layout) {
+  char bs[kFatBootSectorSize];
+  if (!reader(0, bs, sizeof(bs)) ||
+      uchar(bs[510]) != 0x55 || uchar(bs[511]) != 0xAA) {
+    return false;
+  }
+
+  const quint32 bytes_per_sector = Le16(bs + 11);
+  const quint32 sectors_per_cluster = uchar(bs[13]);
+  const quint32 reserved_sectors = Le16(bs + 14);
+  const quint32 num_fats = uchar(bs[16]);
+  const quint32 root_entries = Le16(bs + 17);
+  quint32 total_sectors = Le16(bs + 19);
+  if (total_sectors == 0) {
+    total_sectors = Le32(bs + 32);
+  }
+  quint32 fat_size = Le16(bs + 22);
+  if (fat_size == 0) {
+    fat_size = Le32(bs + 36);
+  }
+  if (bytes_per_sector < 512 || bytes_per_sector > 4096 ||
+      !IsPowerOfTwo(bytes_per_sector) ||
+      !IsPowerOfTwo(sectors_per_cluster) ||
+      reserved_sectors == 0 || num_fats == 0 ||
+      fat_size == 0 || total_sectors == 0) {
+    return false;
+  }
+
+  const quint32 root_dir_sectors =
+      (root_entries * 32 + bytes_per_sector - 1) / bytes_per_sector;
+  const quint64 root_dir_start =
+      quint64(reserved_sectors) + quint64(num_fats) * fat_size;
+  const quint64 data_start = root_dir_start + root_dir_sectors;
+  if (data_start >= total_sectors) {
+    return false;
+  }
+  const quint32 clusters =
+      quint32((total_sectors - data_start) / sectors_per_cluster);
+  if (clusters < kFatMinClusters) {
+    // FAT12 is not supported.
+    return false;
+  }
+
+  layout.bytes_per_sector = bytes_per_sector;
+  layout.cluster_size = qint64(bytes_per_sector) * sectors_per_cluster;
+  layout.reserved_sectors = reserved_sectors;
+  layout.fat_offset = qint64(reserved_sectors) * bytes_per_sector;
+  layout.root_dir_offset = qint64(root_dir_start) * bytes_per_sector;
+  layout.root_dir_size = qint64(root_entries) * kFatDirEntrySize;
+  layout.data_offset = qint64(data_start) * bytes_per_sector;
+  layout.clusters = clusters;
+  layout.is_fat32 = (clusters >= kFat32MinClusters);
+  layout.root_cluster = Le32(bs + 44);
+  layout.fs_info_sector = Le16(bs + 48);
+  return true;
+}
+
+// Read FSInfo sector of FAT32 into |info|.
+bool ReadFatFsInfo(const BlockReader& reader, const FatLayout& layout,
+                   char* info) {
+  return layout.is_fat32 && layout.fs_info_sector != 0 &&
+         layout.fs_info_sector < layout.reserved_sectors &&
+         reader(qint64(layout.fs_info_sector) * layout.bytes_per_sector,
+                info, kFatBootSectorSize) &&
+         Le32(info) == kFsInfoLeadSig &&
+         Le32(info + 484) == kFsInfoStrucSig;
+}
+
+// Read entries of directory starting at |first_cluster| into |data|.
+// Cluster 0 refers to root directory region of FAT16.
+bool ReadFatDirectory(const BlockReader& reader, const FatLayout& layout,
+                      quint32 first_cluster, QByteArray& data) {
+  data.clear();
+  if (first_cluster == 0) {
+    if (layout.is_fat32) {
+      return false;
+    }
+    data.resize(int(layout.root_dir_size));
+    return reader(layout.root_dir_offset, data.data(), data.size());
+  }
+
+  const int entry_size = layout.is_fat32 ? 4 : 2;
+  const quint32 end_of_chain = layout.is_fat32 ? 0x0FFFFFF8 : 0xFFF8;
+  quint32 cluster = first_cluster;
+  for (int count = 0; count < kFatMaxDirClusters; ++count) {
+    if (cluster < 2 || cluster > layout.clusters + 1) {
+      return false;
+    }
+    const int size = data.size();
+    data.resize(int(size + layout.cluster_size));
+    if (!reader(layout.data_offset + (cluster - 2) * layout.cluster_size,
+                data.data() + size, layout.cluster_size)) {
+      return false;
+    }
+
+    char entry[4];
+    if (!reader(layout.fat_offset + qint64(cluster) * entry_size,
+                entry, entry_size)) {
+      return false;
+    }
+    cluster = layout.is_fat32 ? (Le32(entry) & 0x0FFFFFFF) : Le16(entry);
+    if (cluster >= end_of_chain) {
+      break;
+    }
+  }
+  return true;
+}
+
+// Returns first cluster of sub directories in directory |data|, keyed by
+// their 8.3 short names, like "EFI        ". "." and ".." are skipped.
+QMap<QByteArray, quint32> ListFatSubDirs(const QByteArray& data,
+                                         bool is_fat32) {
+  QMap<QByteArray, quint32> result;
+  for (int pos = 0; pos + kFatDirEntrySize <= data.size();
+       pos += kFatDirEntrySize) {
+    const char* entry = data.constData() + pos;
+    const uchar first = uchar(entry[0]);
+    if (first == 0x00) {
+      // No more entries.
+      break;
+    }
+    const uchar attr = uchar(entry[11]);
+    if (first == 0xE5 || first == '.' || attr == kFatAttrLongName ||
+        !(attr & kFatAttrDirectory)) {
+      continue;
+    }
+    // High word of cluster is only used in FAT32.
+    quint32 cluster = Le16(entry + 26);
+    if (is_fat32) {
+      cluster |= quint32(Le16(entry + 20)) << 16;
+    }
+    result.insert(QByteArray(entry, 11), cluster);
+  }
+  return result;
+}
+
+// Layout of NTFS, read from its boot sector.
+struct NTFSLayout {
+  qint64 cluster_size = 0;
+  qint64 total_clusters = 0;
+  qint64 mft_lcn = 0;
+  qint64 record_size = 0;
+};
+
+bool ReadNTFSLayout(const BlockReader& reader, NTFSLayout& layout) {
+  char bs[kNTFSBootSectorSize];
+  if (!reader(0, bs, sizeof(bs)) || memcmp(bs + 3, kNTFSOemId, 8) != 0) {
+    return false;
+  }
+
+  const quint32 bytes_per_sector = Le16(bs + 0x0B);
+  const quint32 spc_raw = uchar(bs[0x0D]);
+  // Values larger than 0x80 mean 2^(256 - value) sectors per cluster.
+  quint32 sectors_per_cluster = spc_raw;
+  if (spc_raw > 0x80) {
+    if (256 - spc_raw > 16) {
+      return false;
+    }
+    sectors_per_cluster = 1u << (256 - spc_raw);
+  }
+  if (bytes_per_sector < 256 || bytes_per_sector > 4096 ||
+      !IsPowerOfTwo(bytes_per_sector) || sectors_per_cluster == 0) {
+    return false;
+  }
+  const qint64 cluster_size = qint64(bytes_per_sector) * sectors_per_cluster;
+  const qint64 total_clusters = qint64(Le64(bs + 0x28) / sectors_per_cluster);
+  const qint64 mft_lcn = qint64(Le64(bs + 0x30));
+
+  // Negative value means 2^(-value) bytes per record.
+  const qint8 record_raw = qint8(bs[0x40]);
+  qint64 record_size = 0;
+  if (record_raw > 0) {
+    record_size = record_raw * cluster_size;
+  } else if (record_raw > -31) {
+    record_size = qint64(1) << (-record_raw);
+  }
+  if (record_size < kNTFSFixupSectorSize || record_size > 65536 ||
+      total_clusters <= 0 || mft_lcn <= 0) {
+    return false;
+  }
+
+  layout.cluster_size = cluster_size;
+  layout.total_clusters = total_clusters;
+  layout.mft_lcn = mft_lcn;
+  layout.record_size = record_size;
+  return true;
+}
+
+// Read MFT record |index|, one of the first system files, into |record|,
+// and find its unnamed non-resident $DATA attribute. Runlist of that
+// attribute is in [|run_begin|, |run_end|) of |record|.
+bool ReadNTFSDataRuns(const BlockReader& reader, const NTFSLayout& layout,
+                      int index, QByteArray& record,
+                      int& run_begin, int& run_end) {
+  // First records of MFT are always contiguous.
+  record.fill(0, int(layout.record_size));
+  if (!reader(layout.mft_lcn * layout.cluster_size +
+              index * layout.record_size,
+              record.data(), layout.record_size) ||
+      !record.startsWith("FILE") ||
+      !ApplyNTFSFixup(record)) {
+    return false;
+  }
+
+  const char* data = record.constData();
+  int attr_offset = Le16(data + 0x14);
+  while (attr_offset + 8 <= record.size()) {
+    const quint32 type = Le32(data + attr_offset);
+    if (type == kNTFSAttrEnd) {
+      break;
+    }
+    const int attr_len = int(Le32(data + attr_offset + 4));
+    if (attr_len <= 0 || attr_offset + attr_len > record.size()) {
+      return false;
+    }
+    if (type == kNTFSAttrData && data[attr_offset + 8] != 0 &&
+        data[attr_offset + 9] == 0) {
+      if (attr_len < 0x40) {
+        return false;
+      }
+      run_begin = attr_offset + Le16(data + attr_offset + 0x20);
+      run_end = attr_offset + attr_len;
+      return true;
+    }
+    attr_offset += attr_len;
+  }
+  return false;
+}
+
+// Decode one run at |pos| of runlist in |data|, and move |pos| to next run.
+// |lcn| is relative to the previous run. Returns false at end of runlist
+// or if it is invalid.
+bool DecodeNTFSRun(const char* data, int& pos, int run_end,
+                   qint64& run_len, qint64& lcn) {
+  if (pos >= run_end) {
+    return false;
+  }
+  const uchar header = uchar(data[pos]);
+  if (header == 0) {
+    return false;
+  }
+  const int len_size = header & 0x0F;
+  const int offset_size = header >> 4;
+  pos ++;
+  if (len_size == 0 || len_size > 8 || offset_size == 0 ||
+      offset_size > 8 || pos + len_size + offset_size > run_end) {
+    return false;
+  }
+  run_len = DecodeRunValue(data + pos, len_size, false);
+  lcn += DecodeRunValue(data + pos + len_size, offset_size, true);
+  pos += len_size + offset_size;
+  return (run_len > 0 && lcn >= 0);
+}
+
+// Read current LSN in restart page of NTFS $LogFile at |offset|.
+bool ReadNTFSRestartLsn(const BlockReader& reader, qint64 offset,
+                        int page_size, quint64& lsn) {
+  QByteArray page(page_size, 0);
+  if (!reader(offset, page.data(), page_size) ||
+      !(page.startsWith("RSTR") || page.startsWith("CHKD")) ||
+      !ApplyNTFSFixup(page)) {
+    return false;
+  }
+  const int area_offset = Le16(page.constData() + 0x18);
+  if (area_offset + 8 > page_size) {
+    return false;
+  }
+  lsn = Le64(page.constData() + area_offset);
+  return true;
+}
+
+bool ReadFull(int fd, qint64 offset, char* buf, qint64 size) {
+  while (size > 0) {
+    const ssize_t num = pread(fd, buf, size_t(size), off_t(offset));
+    if (num == -1 && errno == EINTR) {
+      continue;
+    }
+    if (num <= 0) {
+      return false;
+    }
+    buf += num;
+    offset += num;
+    size -= num;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ReadBtrfsSuperblockUsage(const BlockReader& reader,
+                              qint64& freespace, qint64& total) {
+  char sb[kBtrfsSuperblockSize];
+  if (!reader(kBtrfsSuperblockOffset, sb, sizeof(sb)) ||
+      memcmp(sb + 0x40, kBtrfsMagic, 8) != 0) {
+    return false;
+  }
+
+  // Size of this device is read from dev_item, like `btrfs filesystem show`.
+  const quint64 bytes_used = Le64(sb + 0x78);
+  quint64 device_bytes = Le64(sb + 0xD1);
+  if (device_bytes == 0) {
+    device_bytes = Le64(sb + 0x70);
+  }
+  if (device_bytes == 0) {
+    return false;
+  }
+  total = qint64(device_bytes);
+  freespace = qMax(qint64(0), total - qint64(bytes_used));
+  return true;
+}
+
+bool ReadExt2SuperblockUsage(const BlockReader& reader,
+                             qint64& freespace, qint64& total) {
+  char sb[kExtSuperblockSize];
+  if (!reader(kExtSuperblockOffset, sb, sizeof(sb)) ||
+      Le16(sb + 0x38) != kExtMagic) {
+    return false;
+  }
+
+  const quint32 log_block_size = Le32(sb + 0x18);
+  if (log_block_size > 6) {
+    return false;
+  }
+  const qint64 block_size = qint64(1024) << log_block_size;
+  quint64 total_blocks = Le32(sb + 0x04);
+  quint64 free_blocks = Le32(sb + 0x0C);
+  if (Le32(sb + 0x60) & kExtFeatureIncompat64Bit) {
+    total_blocks |= quint64(Le32(sb + 0x150)) << 32;
+    free_blocks |= quint64(Le32(sb + 0x158)) << 32;
+  }
+  if (total_blocks == 0 || free_blocks > total_blocks) {
+    return false;
+  }
+
+  total = qint64(total_blocks) * block_size;
+  freespace = qint64(free_blocks) * block_size;
+  return true;
+}
+
+bool ReadFatSuperblockUsage(const BlockReader& reader,
+                            qint64& freespace, qint64& total) {
+  FatLayout layout;
+  if (!ReadFatLayout(reader, layout)) {
+    return false;
+  }
+
+  // Free cluster count of FAT32 is cached in FSInfo sector.
+  qint64 free_clusters = -1;
+  char info[kFatBootSectorSize];
+  if (ReadFatFsInfo(reader, layout, info)) {
+    const quint32 count = Le32(info + 488);
+    if (count != kFsInfoUnknown && count <= layout.clusters) {
+      free_clusters = count;
+    }
+  }
+
+  if (free_clusters < 0 &&
+      !CountFatFreeClusters(reader, layout.fat_offset, layout.clusters,
+                            layout.is_fat32, free_clusters)) {
+    return false;
+  }
+
+  total = qint64(layout.clusters) * layout.cluster_size;
+  freespace = free_clusters * layout.cluster_size;
+  return true;
+}
+
+bool ReadNTFSSuperblockUsage(const BlockReader& reader,
+                             qint64& freespace, qint64& total) {
+  NTFSLayout layout;
+  QByteArray record;
+  int pos = 0;
+  int run_end = 0;
+  if (!ReadNTFSLayout(reader, layout) ||
+      !ReadNTFSDataRuns(reader, layout, kNTFSBitmapRecord, record,
+                        pos, run_end)) {
+    return false;
+  }
+
+  // Walk through runlist of cluster bitmap.
+  const char* data = record.constData();
+  const qint64 cluster_size = layout.cluster_size;
+  const qint64 total_clusters = layout.total_clusters;
+  const qint64 bitmap_size = (total_clusters + 7) / 8;
+  qint64 bitmap_read = 0;
+  qint64 run_len = 0;
+  qint64 lcn = 0;
+  qint64 free_clusters = 0;
+  QByteArray chunk;
+  while (bitmap_read < bitmap_size &&
+         DecodeNTFSRun(data, pos, run_end, run_len, lcn)) {
+    const qint64 run_bytes = qMin(run_len * cluster_size,
+                                  bitmap_size - bitmap_read);
+    for (qint64 done = 0; done < run_bytes; done += kScanChunkSize) {
+      const qint64 size = qMin(kScanChunkSize, run_bytes - done);
+      chunk.resize(int(size));
+      if (!reader(lcn * cluster_size + done, chunk.data(), size)) {
+        return false;
+      }
+      free_clusters += CountClearBits(chunk.constData(), size,
+                                      (bitmap_read + done) * 8,
+                                      total_clusters);
+    }
+    bitmap_read += run_bytes;
+  }
+  if (bitmap_read < bitmap_size) {
+    return false;
+  }
+
+  total = total_clusters * cluster_size;
+  freespace = free_clusters * cluster_size;
+  return true;
+}
+
+bool ReadXfsSuperblockUsage(const BlockReader& reader,
+                            qint64& freespace, qint64& total) {
+  char sb[kXfsSuperblockSize];
+  if (!reader(0, sb, sizeof(sb)) || memcmp(sb, kXfsMagic, 4) != 0) {
+    return false;
+  }
+
+  const quint32 block_size = Be32(sb + 4);
+  const quint64 total_blocks = Be64(sb + 8);
+  const quint64 free_blocks = Be64(sb + 144);
+  if (block_size < 512 || block_size > 65536 || !IsPowerOfTwo(block_size) ||
+      total_blocks == 0 || free_blocks > total_blocks) {
+    return false;
+  }
+
+  total = qint64(total_blocks) * block_size;
+  freespace = qint64(free_blocks) * block_size;
+  return true;
+}
+
+bool ReadBtrfsGeneration(const BlockReader& reader, QString& generation) {
+  char sb[kBtrfsSuperblockSize];
+  if (!reader(kBtrfsSuperblockOffset, sb, sizeof(sb)) ||
+      memcmp(sb + 0x40, kBtrfsMagic, 8) != 0) {
+    return false;
+  }
+  // Generation of superblock is increased by each transaction.
+  generation = QString("btrfs:%1").arg(Le64(sb + 0x48));
+  return true;
+}
+
+bool ReadExt2Generation(const BlockReader& reader, QString& generation) {
+  char sb[kExtSuperblockSize];
+  if (!reader(kExtSuperblockOffset, sb, sizeof(sb)) ||
+      Le16(sb + 0x38) != kExtMagic) {
+    return false;
+  }
+  // Write time, mount time and lifetime kilobytes written, all of them are
+  // updated when filesystem is mounted read-write or unmounted.
+  generation = QString("ext:%1:%2:%3").arg(Le32(sb + 0x30))
+                                      .arg(Le32(sb + 0x2C))
+                                      .arg(Le64(sb + 0x178));
+  return true;
+}
+
+bool ReadFatGeneration(const BlockReader& reader, QString& generation) {
+  FatLayout layout;
+  if (!ReadFatLayout(reader, layout)) {
+    return false;
+  }
+
+  QCryptographicHash hash(QCryptographicHash::Md5);
+  // Free cluster count and next free cluster hint.
+  char info[kFatBootSectorSize];
+  if (ReadFatFsInfo(reader, layout, info)) {
+    hash.addData(info + 488, 8);
+  }
+
+  // Boot loaders are found in root directory and EFI/<vendor>/. Entries of
+  // them contain file size, first cluster and modification time.
+  QByteArray dir;
+  if (!ReadFatDirectory(reader, layout,
+                        layout.is_fat32 ? layout.root_cluster : 0, dir)) {
+    return false;
+  }
+  hash.addData(dir);
+  const QMap<QByteArray, quint32> root_dirs =
+      ListFatSubDirs(dir, layout.is_fat32);
+  const QByteArray efi_name(kFatEfiDirName);
+  if (root_dirs.contains(efi_name)) {
+    if (!ReadFatDirectory(reader, layout, root_dirs.value(efi_name), dir)) {
+      return false;
+    }
+    hash.addData(dir);
+    for (const quint32 cluster : ListFatSubDirs(dir, layout.is_fat32)) {
+      QByteArray vendor_dir;
+      if (!ReadFatDirectory(reader, layout, cluster, vendor_dir)) {
+        return false;
+      }
+      hash.addData(vendor_dir);
+    }
+  }
+
+  generation = QString("fat:%1").arg(QString(hash.result().toHex()));
+  return true;
+}
+
+bool ReadNTFSGeneration(const BlockReader& reader, QString& generation) {
+  NTFSLayout layout;
+  QByteArray record;
+  int pos = 0;
+  int run_end = 0;
+  qint64 run_len = 0;
+  qint64 lcn = 0;
+  if (!ReadNTFSLayout(reader, layout) ||
+      !ReadNTFSDataRuns(reader, layout, kNTFSLogFileRecord, record,
+                        pos, run_end) ||
+      !DecodeNTFSRun(record.constData(), pos, run_end, run_len, lcn)) {
+    return false;
+  }
+
+  // $LogFile starts with two restart pages, which are written in turn.
+  // Current LSN in them grows with each change of metadata.
+  const qint64 offset = lcn * layout.cluster_size;
+  char header[kNTFSFixupSectorSize];
+  if (!reader(offset, header, sizeof(header))) {
+    return false;
+  }
+  const quint32 page_size = Le32(header + 0x10);
+  if (page_size < kNTFSFixupSectorSize || page_size > kNTFSMaxLogPageSize ||
+      !IsPowerOfTwo(page_size) ||
+      run_len * layout.cluster_size < 2 * qint64(page_size)) {
+    return false;
+  }
+  quint64 lsn = 0;
+  quint64 page_lsn = 0;
+  bool found = false;
+  for (int page = 0; page < 2; ++page) {
+    if (ReadNTFSRestartLsn(reader, offset + page * qint64(page_size),
+                           int(page_size), page_lsn)) {
+      lsn = qMax(lsn, page_lsn);
+      found = true;
+    }
+  }
+  // ntfs-3g fills $LogFile with 0xFF when it is mounted read-write, no LSN
+  // can be read then.
+  if (!found) {
+    return false;
+  }
+  generation = QString("ntfs:%1").arg(lsn);
+  return true;
+}
+
+QString ReadContentType(const BlockReader& reader, qint64 size) {
+  char buf[kLvmSectorSize];
+  if (reader(0, buf, kLuksMagicSize) &&
+      memcmp(buf, kLuksMagic, kLuksMagicSize) == 0) {
+    return "crypto_LUKS";
+  }
+
+  for (int sector = 0; sector < kLvmLabelSectors; ++sector) {
+    if (reader(sector * kLvmSectorSize, buf, kLvmSectorSize) &&
+        memcmp(buf, kLvmLabelId, 8) == 0 &&
+        memcmp(buf + 0x18, kLvmLabelType, 8) == 0) {
+      return "LVM2_member";
+    }
+  }
+
+  for (int page_size = kSwapMinPageSize; page_size <= kSwapMaxPageSize;
+       page_size *= 2) {
+    if (reader(page_size - kSwapSignatureSize, buf, kSwapSignatureSize) &&
+        (memcmp(buf, kSwapSignature, kSwapSignatureSize) == 0 ||
+         memcmp(buf, kSwapOldSignature, kSwapSignatureSize) == 0)) {
+      return "swap";
+    }
+  }
+
+  // Superblock of metadata 1.1 is at the start, 1.2 is at 4KiB, 1.0 is 8KiB
+  // to 12KiB before the end, and 0.90 is in the last 64KiB aligned block.
+  // Magic number of 0.90 is in host byte order, which is little endian on
+  // supported architectures.
+  QList<qint64> md_offsets = {0, 4096};
+  if (size >= 2 * kMd090ReservedSize) {
+    md_offsets.append(((size / kMdSectorSize - 16) & ~qint64(7)) *
+                      kMdSectorSize);
+    md_offsets.append((size & ~(kMd090ReservedSize - 1)) -
+                      kMd090ReservedSize);
+  }
+  for (const qint64 offset : md_offsets) {
+    if (reader(offset, buf, 4) && Le32(buf) == kMdMagic) {
+      return "linux_raid_member";
+    }
+  }
+
+  if (reader(0, buf, 4) && memcmp(buf, kXfsMagic, 4) == 0) {
+    return "xfs";
+  }
+  return QString();
+}
+
+bool ReadSuperblockUsage(const QString& partition_path,
+                         FsType fs_type,
+                         qint64& freespace,
+                         qint64& total) {
+  typedef bool (*UsageParser)(const BlockReader&, qint64&, qint64&);
+  UsageParser parser = nullptr;
+  switch (fs_type) {
+    case FsType::Btrfs: {
+      parser = ReadBtrfsSuperblockUsage;
+      break;
+    }
+    case FsType::Ext2:
+    case FsType::Ext3:
+    case FsType::Ext4: {
+      parser = ReadExt2SuperblockUsage;
+      break;
+    }
+    case FsType::EFI:
+    case FsType::Fat16:
+    case FsType::Fat32: {
+      parser = ReadFatSuperblockUsage;
+      break;
+    }
+    case FsType::NTFS: {
+      parser = ReadNTFSSuperblockUsage;
+      break;
+    }
+    case FsType::Xfs: {
+      parser = ReadXfsSuperblockUsage;
+      break;
+    }
+    default: {
+      return false;
+    }
+  }
+
+  const int fd = open(partition_path.toLocal8Bit().constData(),
+                      O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    qWarning() << "ReadSuperblockUsage() failed to open" << partition_path
+               << strerror(errno);
+    return false;
+  }
+  const BlockReader reader = [fd](qint64 offset, char* buf, qint64 size) {
+    return ReadFull(fd, offset, buf, size);
+  };
+  const bool ok = parser(reader, freespace, total);
+  close(fd);
+  return ok;
+}
+
+}  // namespace installer
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_PARTMAN_FS_SUPERBLOCK_H
+#define INSTALLER_PARTMAN_FS_SUPERBLOCK_H
+
+#include <QString>
+#include <functional>
+
+#include "partman/fs.h"
+
+namespace installer {
+
+// Reads |size| bytes at |offset| of a block device into |buf|.
+// Returns false if failed to read all of them.
+typedef std::function<bool(qint64 offset, char* buf, qint64 size)>
+    BlockReader;
+
+// Parse superblock or metadata of a filesystem read by |reader|, and get
+// its usage. Only a few KiB are read, except that FAT table or NTFS cluster
+// bitmap is scanned if free cluster count is not recorded in superblock.
+// Returns false if magic number does not match or metadata is invalid.
+bool ReadBtrfsSuperblockUsage(const BlockReader& reader,
+                              qint64& freespace, qint64& total);
+bool ReadExt2SuperblockUsage(const BlockReader& reader,
+                             qint64& freespace, qint64& total);
+bool ReadFatSuperblockUsage(const BlockReader& reader,
+                            qint64& freespace, qint64& total);
+bool ReadNTFSSuperblockUsage(const BlockReader& reader,
+                             qint64& freespace, qint64& total);
+bool ReadXfsSuperblockUsage(const BlockReader& reader,
+                            qint64& freespace, qint64& total);
+
+// Read a value of filesystem read by |reader| which changes each time it
+// is modified, with its type as prefix, like "btrfs:1234":
+//   * btrfs: generation of superblock;
+//   * ext2/3/4: write time, mount time and kilobytes written;
+//   * FAT: FSInfo and entries of root, EFI/ and EFI/<vendor>/ directories;
+//   * NTFS: current LSN in restart pages of $LogFile.
+// Returns false if magic number does not match or no such value is found.
+bool ReadBtrfsGeneration(const BlockReader& reader, QString& generation);
+bool ReadExt2Generation(const BlockReader& reader, QString& generation);
+bool ReadFatGeneration(const BlockReader& reader, QString& generation);
+bool ReadNTFSGeneration(const BlockReader& reader, QString& generation);
+
+// Detect content of a partition read by |reader| which is either never
+// mounted, or needs extra options to be mounted without writing to it.
+// Returns its type named as blkid does: "swap", "crypto_LUKS",
+// "LVM2_member", "linux_raid_member" or "xfs", or an empty string for other
+// types. |size| is size of that partition in bytes, RAID superblocks of
+// metadata 0.90 and 1.0 are near its end.
+QString ReadContentType(const BlockReader& reader, qint64 size);
+
+// Read usage of filesystem on |partition_path| with |fs_type| directly,
+// without spawning filesystem tools.
+// Returns false if |fs_type| is not supported or failed to parse it.
+bool ReadSuperblockUsage(const QString& partition_path,
+                         FsType fs_type,
+                         qint64& freespace,
+                         qint64& total);
+
+}  // namespace installer
+
+#endif  // INSTALLER_PARTMAN_FS_SUPERBLOCK_H
@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/fs_superblock.h"
+
+#include <string.h>
+#include <QByteArray>
+#include <QtEndian>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+// Read from an in-memory filesystem image.
+BlockReader ImageReader(const QByteArray& image) {
+  return [image](qint64 offset, char* buf, qint64 size) {
+    if (offset < 0 || offset + size > image.size()) {
+      return false;
+    }
+    memcpy(buf, image.constData() + offset, size_t(size));
+    return true;
+  };
+}
+
+template <typename T>
+void PutLe(QByteArray& image, int offset, T value) {
+  qToLittleEndian<T>(value, reinterpret_cast<uchar*>(image.data() + offset));
+}
+
+template <typename T>
+void PutBe(QByteArray& image, int offset, T value) {
+  qToBigEndian<T>(value, reinterpret_cast<uchar*>(image.data() + offset));
+}
+
+// Write a restart page of NTFS $LogFile with |lsn| at |offset|.
+void PutNTFSRestartPage(QByteArray& image, int offset, quint64 lsn) {
+  memcpy(image.data() + offset, "RSTR", 4);
+  PutLe<quint16>(image, offset + 4, 0x1E);
+  PutLe<quint16>(image, offset + 6, 9);
+  PutLe<quint16>(image, offset + 0x1E, 1);
+  for (int sector = 1; sector <= 8; ++sector) {
+    PutLe<quint16>(image, offset + sector * 512 - 2, 1);
+  }
+  PutLe<quint32>(image, offset + 0x10, 4096);
+  PutLe<quint16>(image, offset + 0x18, 0x40);
+  PutLe<quint64>(image, offset + 0x40, lsn);
+}
+
+TEST(FsSuperblockTest, ReadExt2SuperblockUsage) {
+  QByteArray image(2048, 0);
+  PutLe<quint16>(image, 1024 + 0x38, 0xEF53);
+  PutLe<quint32>(image, 1024 + 0x04, 1000);
+  PutLe<quint32>(image, 1024 + 0x0C, 250);
+  PutLe<quint32>(image, 1024 + 0x18, 2);
+  qint64 freespace = 0;
+  qint64 total = 0;
+  EXPECT_TRUE(ReadExt2SuperblockUsage(ImageReader(image), freespace, total));
+  EXPECT_EQ(total, 1000 * 4096);
+  EXPECT_EQ(freespace, 250 * 4096);
+
+  // 64bit feature.
+  PutLe<quint32>(image, 1024 + 0x60, 0x80);
+  PutLe<quint32>(image, 1024 + 0x150, 1);
+  EXPECT_TRUE(ReadExt2SuperblockUsage(ImageReader(image), freespace, total));
+  EXPECT_EQ(total, ((qint64(1) << 32) + 1000) * 4096);
+
+  // Invalid magic number.
+  PutLe<quint16>(image, 1024 + 0x38, 0);
+  EXPECT_FALSE(ReadExt2SuperblockUsage(ImageReader(image), freespace, total));
+}
+
+TEST(FsSuperblockTest, ReadFat16SuperblockUsage) {
+  QByteArray image(512 + 40 * 512, 0);
+  PutLe<quint16>(image, 11, 512);
+  image[13] = 4;
+  PutLe<quint16>(image, 14, 1);
+  image[16] = 2;
+  PutLe<quint16>(image, 17, 512);
+  PutLe<quint16>(image, 22, 40);
+  PutLe<quint32>(image, 32, 40000);
+  image[510] = char(0x55);
+  image[511] = char(0xAA);
+  // Cluster 2 to 11 are used.
+  for (int cluster = 0; cluster < 12; ++cluster) {
+    PutLe<quint16>(image, 512 + cluster * 2, 0xFFFF);
+  }
+
+  const qint64 clusters = (40000 - (1 + 2 * 40 + 32)) / 4;
+  qint64 freespace = 0;
+  qint64 total = 0;
+  EXPECT_TRUE(ReadFatSuperblockUsage(ImageReader(image), freespace, total));
+  EXPECT_EQ(total, clusters * 2048);
+  EXPECT_EQ(freespace, (clusters - 10) * 2048);
+}
+
+TEST(FsSuperblockTest, ReadFat32SuperblockUsage) {
+  QByteArray image(1024, 0);
+  PutLe<quint16>(image, 11, 512);
+  image[13] = 8;
+  PutLe<quint16>(image, 14, 32);
+  image[16] = 2;
+  PutLe<quint32>(image, 32, 1000000);
+  PutLe<quint32>(image, 36, 1000);
+  PutLe<quint16>(image, 48, 1);
+  image[510] = char(0x55);
+  image[511] = char(0xAA);
+  // FSInfo sector.
+  PutLe<quint32>(image, 512, 0x41615252);
+  PutLe<quint32>(image, 512 + 484, 0x61417272);
+  PutLe<quint32>(image, 512 + 488, 100000);
+
+  const qint64 clusters = (1000000 - (32 + 2 * 1000)) / 8;
+  qint64 freespace = 0;
+  qint64 total = 0;
+  EXPECT_TRUE(ReadFatSuperblockUsage(ImageReader(image), freespace, total));
+  EXPECT_EQ(total, clusters * 4096);
+  EXPECT_EQ(freespace, 100000 * 4096);
+}
+
+TEST(FsSuperblockTest, ReadNTFSSuperblockUsage) {
+  const int kClusterSize = 4096;
+  const int kRecordOffset = 4 * kClusterSize + 6 * 1024;
+  const int kBitmapOffset = 10 * kClusterSize;
+  QByteArray image(kBitmapOffset + kClusterSize, 0);
+  memcpy(image.data() + 3, "NTFS    ", 8);
+  PutLe<quint16>(image, 0x0B, 512);
+  image[0x0D] = 8;
+  PutLe<quint64>(image, 0x28, 100 * 8);  // 100 clusters
+  PutLe<quint64>(image, 0x30, 4);  // MFT at cluster 4
+  image[0x40] = char(0xF6);  // 1024 bytes per record
+
+  // MFT record of $Bitmap, with update sequence number 1.
+  memcpy(image.data() + kRecordOffset, "FILE", 4);
+  PutLe<quint16>(image, kRecordOffset + 4, 0x30);
+  PutLe<quint16>(image, kRecordOffset + 6, 3);
+  PutLe<quint16>(image, kRecordOffset + 0x30, 1);
+  PutLe<quint16>(image, kRecordOffset + 510, 1);
+  PutLe<quint16>(image, kRecordOffset + 1022, 1);
+  PutLe<quint16>(image, kRecordOffset + 0x14, 0x38);
+  // Non-resident $DATA attribute, with one run at cluster 10.
+  const int attr = kRecordOffset + 0x38;
+  PutLe<quint32>(image, attr, 0x80);
+  PutLe<quint32>(image, attr + 4, 0x48);
+  image[attr + 8] = 1;
+  PutLe<quint16>(image, attr + 0x20, 0x40);
+  image[attr + 0x40] = 0x11;
+  image[attr + 0x41] = 1;
+  image[attr + 0x42] = 10;
+  PutLe<quint32>(image, attr + 0x48, 0xFFFFFFFF);
+
+  // 24 clusters are used, bits after cluster 100 are ignored.
+  image[kBitmapOffset] = char(0xFF);
+  image[kBitmapOffset + 1] = char(0xFF);
+  image[kBitmapOffset + 2] = char(0xFF);
+  image[kBitmapOffset + 12] = char(0xF0);
+
+  qint64 freespace = 0;
+  qint64 total = 0;
+  EXPECT_TRUE(ReadNTFSSuperblockUsage(ImageReader(image), freespace, total));
+  EXPECT_EQ(total, 100 * kClusterSize);
+  EXPECT_EQ(freespace, 76 * kClusterSize);
+}
+
+TEST(FsSuperblockTest, ReadBtrfsSuperblockUsage) {
+  QByteArray image(0x10000 + 4096, 0);
+  memcpy(image.data() + 0x10000 + 0x40, "_BHRfS_M", 8);
+  PutLe<quint64>(image, 0x10000 + 0x78, quint64(1) << 30);
+  PutLe<quint64>(image, 0x10000 + 0xD1, quint64(10) << 30);
+  qint64 freespace = 0;
+  qint64 total = 0;
+  EXPECT_TRUE(ReadBtrfsSuperblockUsage(ImageReader(image), freespace, total));
+  EXPECT_EQ(total, qint64(10) << 30);
+  EXPECT_EQ(freespace, qint64(9) << 30);
+}
+
+TEST(FsSuperblockTest, ReadXfsSuperblockUsage) {
+  QByteArray image(512, 0);
+  memcpy(image.data(), "XFSB", 4);
+  PutBe<quint32>(image, 4, 4096);
+  PutBe<quint64>(image, 8, 1000);
+  PutBe<quint64>(image, 144, 600);
+  qint64 freespace = 0;
+  qint64 total = 0;
+  EXPECT_TRUE(ReadXfsSuperblockUsage(ImageReader(image), freespace, total));
+  EXPECT_EQ(total, 1000 * 4096);
+  EXPECT_EQ(freespace, 600 * 4096);
+}
+
+TEST(FsSuperblockTest, ReadExt2Generation) {
+  QByteArray image(2048, 0);
+  PutLe<quint16>(image, 1024 + 0x38, 0xEF53);
+  PutLe<quint32>(image, 1024 + 0x30, 1500000000);
+  PutLe<quint64>(image, 1024 + 0x178, 1000);
+  QString generation;
+  EXPECT_TRUE(ReadExt2Generation(ImageReader(image), generation));
+  EXPECT_TRUE(generation.startsWith("ext:"));
+
+  // Kilobytes written is increased.
+  QString new_generation;
+  PutLe<quint64>(image, 1024 + 0x178, 1024);
+  EXPECT_TRUE(ReadExt2Generation(ImageReader(image), new_generation));
+  EXPECT_NE(generation, new_generation);
+
+  PutLe<quint16>(image, 1024 + 0x38, 0);
+  EXPECT_FALSE(ReadExt2Generation(ImageReader(image), generation));
+}
+
+TEST(FsSuperblockTest, ReadBtrfsGeneration) {
+  QByteArray image(0x10000 + 4096, 0);
+  memcpy(image.data() + 0x10000 + 0x40, "_BHRfS_M", 8);
+  PutLe<quint64>(image, 0x10000 + 0x48, 42);
+  QString generation;
+  EXPECT_TRUE(ReadBtrfsGeneration(ImageReader(image), generation));
+  EXPECT_EQ(generation, "btrfs:42");
+}
+
+TEST(FsSuperblockTest, ReadFatGeneration) {
+  // FAT16 with root directory at sector 81 and cluster 2 at sector 113.
+  const int kRootOffset = 81 * 512;
+  const int kDataOffset = 113 * 512;
+  const int kClusterSize = 2048;
+  QByteArray image(kDataOffset + 3 * kClusterSize, 0);
+  PutLe<quint16>(image, 11, 512);
+  image[13] = 4;
+  PutLe<quint16>(image, 14, 1);
+  image[16] = 2;
+  PutLe<quint16>(image, 17, 512);
+  PutLe<quint16>(image, 22, 40);
+  PutLe<quint32>(image, 32, 40000);
+  image[510] = char(0x55);
+  image[511] = char(0xAA);
+  // Cluster 2 and 3 are directories of one cluster.
+  PutLe<quint16>(image, 512 + 2 * 2, 0xFFFF);
+  PutLe<quint16>(image, 512 + 3 * 2, 0xFFFF);
+
+  // EFI/ at cluster 2, EFI/debian/ at cluster 3.
+  memcpy(image.data() + kRootOffset, "EFI        ", 11);
+  image[kRootOffset + 11] = 0x10;
+  PutLe<quint16>(image, kRootOffset + 26, 2);
+  memcpy(image.data() + kDataOffset, ".          ", 11);
+  image[kDataOffset + 11] = 0x10;
+  memcpy(image.data() + kDataOffset + 32, "DEBIAN     ", 11);
+  image[kDataOffset + 32 + 11] = 0x10;
+  PutLe<quint16>(image, kDataOffset + 32 + 26, 3);
+  const int kLoaderEntry = kDataOffset + kClusterSize;
+  memcpy(image.data() + kLoaderEntry, "GRUBX64 EFI", 11);
+  image[kLoaderEntry + 11] = 0x20;
+  PutLe<quint32>(image, kLoaderEntry + 28, 1000);
+
+  QString generation;
+  EXPECT_TRUE(ReadFatGeneration(ImageReader(image), generation));
+  EXPECT_TRUE(generation.startsWith("fat:"));
+
+  // Content of files is not read.
+  QString new_generation;
+  image[kDataOffset + 2 * kClusterSize] = 'x';
+  EXPECT_TRUE(ReadFatGeneration(ImageReader(image), new_generation));
+  EXPECT_EQ(generation, new_generation);
+
+  // Boot loader is replaced.
+  PutLe<quint32>(image, kLoaderEntry + 28, 2000);
+  EXPECT_TRUE(ReadFatGeneration(ImageReader(image), new_generation));
+  EXPECT_NE(generation, new_generation);
+
+  // Boot loader is removed.
+  generation = new_generation;
+  image[kLoaderEntry] = char(0xE5);
+  EXPECT_TRUE(ReadFatGeneration(ImageReader(image), new_generation));
+  EXPECT_NE(generation, new_generation);
+}
+
+TEST(FsSuperblockTest, ReadNTFSGeneration) {
+  const int kClusterSize = 4096;
+  const int kRecordOffset = 4 * kClusterSize + 2 * 1024;
+  const int kLogFileOffset = 10 * kClusterSize;
+  QByteArray image(kLogFileOffset + 2 * kClusterSize, 0);
+  memcpy(image.data() + 3, "NTFS    ", 8);
+  PutLe<quint16>(image, 0x0B, 512);
+  image[0x0D] = 8;
+  PutLe<quint64>(image, 0x28, 100 * 8);  // 100 clusters
+  PutLe<quint64>(image, 0x30, 4);  // MFT at cluster 4
+  image[0x40] = char(0xF6);  // 1024 bytes per record
+
+  // MFT record of $LogFile, with update sequence number 1.
+  memcpy(image.data() + kRecordOffset, "FILE", 4);
+  PutLe<quint16>(image, kRecordOffset + 4, 0x30);
+  PutLe<quint16>(image, kRecordOffset + 6, 3);
+  PutLe<quint16>(image, kRecordOffset + 0x30, 1);
+  PutLe<quint16>(image, kRecordOffset + 510, 1);
+  PutLe<quint16>(image, kRecordOffset + 1022, 1);
+  PutLe<quint16>(image, kRecordOffset + 0x14, 0x38);
+  // Non-resident $DATA attribute, with 2 clusters at cluster 10.
+  const int attr = kRecordOffset + 0x38;
+  PutLe<quint32>(image, attr, 0x80);
+  PutLe<quint32>(image, attr + 4, 0x48);
+  image[attr + 8] = 1;
+  PutLe<quint16>(image, attr + 0x20, 0x40);
+  image[attr + 0x40] = 0x11;
+  image[attr + 0x41] = 2;
+  image[attr + 0x42] = 10;
+  PutLe<quint32>(image, attr + 0x48, 0xFFFFFFFF);
+
+  PutNTFSRestartPage(image, kLogFileOffset, 100);
+  PutNTFSRestartPage(image, kLogFileOffset + 4096, 200);
+  QString generation;
+  EXPECT_TRUE(ReadNTFSGeneration(ImageReader(image), generation));
+  EXPECT_EQ(generation, "ntfs:200");
+
+  PutNTFSRestartPage(image, kLogFileOffset, 300);
+  EXPECT_TRUE(ReadNTFSGeneration(ImageReader(image), generation));
+  EXPECT_EQ(generation, "ntfs:300");
+
+  // $LogFile is reset by ntfs-3g.
+  memset(image.data() + kLogFileOffset, 0xFF, 2 * kClusterSize);
+  EXPECT_FALSE(ReadNTFSGeneration(ImageReader(image), generation));
+}
+
+TEST(FsSuperblockTest, ReadContentType) {
+  const int kSize = 256 * 1024;
+  QByteArray image(kSize, 0);
+  EXPECT_TRUE(ReadContentType(ImageReader(image), kSize).isEmpty());
+
+  // Swap with 4KiB and 16KiB pages.
+  memcpy(image.data() + 4096 - 10, "SWAPSPACE2", 10);
+  EXPECT_EQ(ReadContentType(ImageReader(image), kSize), "swap");
+  image.fill(0);
+  memcpy(image.data() + 16384 - 10, "SWAPSPACE2", 10);
+  EXPECT_EQ(ReadContentType(ImageReader(image), kSize), "swap");
+
+  image.fill(0);
+  memcpy(image.data(), "LUKS\xBA\xBE", 6);
+  EXPECT_EQ(ReadContentType(ImageReader(image), kSize), "crypto_LUKS");
+
+  image.fill(0);
+  memcpy(image.data() + 512, "LABELONE", 8);
+  memcpy(image.data() + 512 + 0x18, "LVM2 001", 8);
+  EXPECT_EQ(ReadContentType(ImageReader(image), kSize), "LVM2_member");
+
+  // RAID metadata 1.2, 1.0 and 0.90.
+  for (const int offset : {4096, kSize - 8192, kSize - 65536}) {
+    image.fill(0);
+    PutLe<quint32>(image, offset, 0xA92B4EFC);
+    EXPECT_EQ(ReadContentType(ImageReader(image), kSize),
+              "linux_raid_member");
+  }
+
+  image.fill(0);
+  memcpy(image.data(), "XFSB", 4);
+  EXPECT_EQ(ReadContentType(ImageReader(image), kSize), "xfs");
+}
+
+}  // namespace
+}  // namespace installer
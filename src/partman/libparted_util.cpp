@@ -18,7 +18,9 @@
 #include "partman/libparted_util.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <atomic>
 
 #include "base/command.h"
 
@@ -74,10 +76,187 @@ PedFileSystemType* GetPedFsType(const Partition::Ptr partition) {
   }
 }
 
+// Number of ped_disk_commit() calls and time spent in `udevadm settle`.
+std::atomic<int> g_commit_count(0);
+std::atomic<int> g_settle_count(0);
+std::atomic<qint64> g_settle_time(0);
+
+PedPartitionType GetPedPartitionType(PartitionType type) {
+  switch (type) {
+    case PartitionType::Normal: {
+      return PED_PARTITION_NORMAL;
+    }
+    case PartitionType::Logical: {
+      return PED_PARTITION_LOGICAL;
+    }
+    case PartitionType::Extended: {
+      return PED_PARTITION_EXTENDED;
+    }
+    default: {
+      return PED_PARTITION_FREESPACE;
+    }
+  }
+}
+
+// Find partition object in |lp_disk| defined in |partition|.
+PedPartition* FindPedPartition(PedDisk* lp_disk,
+                               const Partition::Ptr partition) {
+  if (partition->type == PartitionType::Extended) {
+    return ped_disk_extended_partition(lp_disk);
+  } else {
+    return ped_disk_get_partition_by_sector(lp_disk, partition->getSector());
+  }
+}
+
+// Functions below only change partition table in memory.
+
+bool AddPedPartition(PedDevice* lp_device,
+                     PedDisk* lp_disk,
+                     const Partition::Ptr partition) {
+  bool ok = false;
+  PedFileSystemType* fs_type = GetPedFsType(partition);
+  PedPartition* lp_partition =
+      ped_partition_new(lp_disk,
+                        GetPedPartitionType(partition->type),
+                        fs_type,
+                        partition->start_sector,
+                        partition->end_sector);
+  if (lp_partition) {
+    PedConstraint* constraint = nullptr;
+    PedGeometry* geom = ped_geometry_new(lp_device,
+                                         partition->start_sector,
+                                         partition->getSectorLength());
+    if (geom) {
+      // Create a relatively loose constraint,
+      // leaving other things to libparted.
+      constraint = ped_constraint_exact(geom);
+    } else {
+      qCritical() << "CreatePartition() geom is nullptr";
+    }
+
+    if (!constraint) {
+      // try again for ped_constraint_new_from_max when ped_constraint_exact failed.
+      constraint = ped_constraint_new_from_max(geom);
+      qWarning() << "ped_constraint_exact failed";
+    }
+
+    if (constraint) {
+      // TODO(xushaohua): Change constraint.min_size.
+      // PrintPedConstraintInfo(constraint);
+      ok = bool(ped_disk_add_partition(lp_disk, lp_partition, constraint));
+      if (!ok) {
+        qCritical() << "CreatePartition() ped_disk_add_partition() failed";
+      }
+      ped_geometry_destroy(geom);
+      ped_constraint_destroy(constraint);
+    } else {
+      qCritical() << "CreatePartition() constraint is nullptr";
+    }
+  } else {
+    qCritical() << "CreatePartition() ped_partition_new() returns nullptr"
+                << partition;
+  }
+  return ok;
+}
+
+bool DeletePedPartition(PedDisk* lp_disk, const Partition::Ptr partition) {
+  PedPartition* lp_partition = FindPedPartition(lp_disk, partition);
+  if (!lp_partition) {
+    qCritical() << "DeletePartition() lp_partition is nullptr";
+    return false;
+  }
+  if (!ped_disk_delete_partition(lp_disk, lp_partition)) {
+    qCritical() << "DeletePartition ped_disk_delete_partition() failed";
+    return false;
+  }
+  return true;
+}
+
+bool ResizeMovePedPartition(PedDevice* lp_device,
+                            PedDisk* lp_disk,
+                            const Partition::Ptr partition) {
+  bool ok = false;
+  PedPartition* lp_partition = FindPedPartition(lp_disk, partition);
+  if (lp_partition) {
+    PedGeometry* geom = ped_geometry_new(lp_device, partition->start_sector,
+                                         partition->getSectorLength());
+    PedConstraint* constraint = nullptr;
+    if (geom) {
+      constraint = ped_constraint_exact(geom);
+    }
+    if (constraint) {
+      ok = bool(ped_disk_set_partition_geom(lp_disk, lp_partition, constraint,
+                                            partition->start_sector,
+                                            partition->end_sector));
+      ped_geometry_destroy(geom);
+      ped_constraint_destroy(constraint);
+    }
+  }
+  return ok;
+}
+
+bool SetPedPartitionFlag(PedDisk* lp_disk,
+                         const Partition::Ptr partition,
+                         PedPartitionFlag flag,
+                         bool is_set) {
+  PedPartition* lp_partition =
+      ped_disk_get_partition_by_sector(lp_disk, partition->getSector());
+  if (lp_partition) {
+    return bool(ped_partition_set_flag(lp_partition, flag, is_set ? 1 : 0));
+  }
+  return false;
+}
+
+bool SetPedPartitionType(PedDisk* lp_disk, const Partition::Ptr partition) {
+  bool ok = false;
+  PedFileSystemType* fs_type = GetPedFsType(partition);
+  PedPartition* lp_partition =
+      ped_disk_get_partition_by_sector(lp_disk, partition->getSector());
+
+  if (fs_type && lp_partition) {
+    ok = bool(ped_partition_set_system(lp_partition, fs_type));
+    if (!ok) {
+      qCritical() << "SetPartitionType() ped_partition_set_system() failed";
+    }
+  } else {
+    qCritical() << "SetPartitionType() ped_disk_get_partition_by_sector() "
+                << "failed";
+  }
+  return ok;
+}
+
+bool ReadPedPartitionNumber(PedDisk* lp_disk, Partition::Ptr partition) {
+  PedPartition* lp_partition = FindPedPartition(lp_disk, partition);
+  if (lp_partition) {
+    partition->partition_number = lp_partition->num;
+    partition->path = GetPartitionPath(lp_partition);
+    return true;
+  } else {
+    qCritical() << "UpdatePartitionNumber() lp_partition is nullptr";
+    return false;
+  }
+}
+
+PedDiskType* GetPedDiskType(PartitionTableType table) {
+  switch (table) {
+    case PartitionTableType::GPT: {
+      return ped_disk_type_get(kPartitionTableGPT);
+    }
+    case PartitionTableType::MsDos: {
+      return ped_disk_type_get(kPartitionTableMsDos);
+    }
+    default: {
+      qCritical() << "CreatePartitionTable() Unsupported partition table.";
+      return NULL;
+    }
+  }
+}
+
 }  // namespace
 
 bool Commit(PedDisk* lp_disk) {
   const bool success = (bool)ped_disk_commit(lp_disk);
+  g_commit_count ++;
 
   SettleDevice(5);
   return success;
@@ -85,13 +264,7 @@ bool Commit(PedDisk* lp_disk) {
 
 bool CommitUdevEvent(const QString& dev_path) {
   SettleDevice(5);
-  for (int i = 0; !QFileInfo::exists(dev_path) && i < 50; ++i) {
-    // Wait for 10ms.
-    struct timespec rqtp = { 0, 10 * 1000 * 1000 };
-    (void) nanosleep(&rqtp, NULL);
-  }
-
-  return QFileInfo::exists(dev_path);
+  return WaitForDevicePath(dev_path);
 }
 
 bool CreatePartition(const Partition::Ptr partition) {
@@ -100,69 +273,9 @@ bool CreatePartition(const Partition::Ptr partition) {
   PedDevice* lp_device = nullptr;
   PedDisk* lp_disk = nullptr;
   if (GetDeviceAndDisk(partition->device_path, lp_device, lp_disk)) {
-    PedPartitionType type;
-
-    switch (partition->type) {
-      case PartitionType::Normal: {
-        type = PED_PARTITION_NORMAL;
-        break;
-      }
-      case PartitionType::Logical: {
-        type = PED_PARTITION_LOGICAL;
-        break;
-      }
-      case PartitionType::Extended: {
-        type = PED_PARTITION_EXTENDED;
-        break;
-      }
-      default: {
-        type = PED_PARTITION_FREESPACE;
-        break;
-      }
-    }
-
-    PedFileSystemType* fs_type = GetPedFsType(partition);
-    PedPartition* lp_partition = ped_partition_new(lp_disk,
-                                                   type,
-                                                   fs_type,
-                                                   partition->start_sector,
-                                                   partition->end_sector);
-    if (lp_partition) {
-      PedConstraint* constraint = nullptr;
-      PedGeometry* geom = ped_geometry_new(lp_device,
-                                           partition->start_sector,
-                                           partition->getSectorLength());
-      if (geom) {
-        // Create a relatively loose constraint,
-        // leaving other things to libparted.
-        constraint = ped_constraint_exact(geom);
-      } else {
-        qCritical() << "CreatePartition() geom is nullptr";
-      }
-
-      if (!constraint) {
-        // try again for ped_constraint_new_from_max when ped_constraint_exact failed.
-        constraint = ped_constraint_new_from_max(geom);
-        qWarning() << "ped_constraint_exact failed";
-      }
-
-      if (constraint) {
-        // TODO(xushaohua): Change constraint.min_size.
-        // PrintPedConstraintInfo(constraint);
-        ok = bool(ped_disk_add_partition(lp_disk, lp_partition, constraint));
-        if (ok) {
-          ok = Commit(lp_disk);
-        } else {
-          qCritical() << "CreatePartition() ped_disk_add_partition() failed";
-        }
-        ped_geometry_destroy(geom);
-        ped_constraint_destroy(constraint);
-      } else {
-        qCritical() << "CreatePartition() constraint is nullptr";
-      }
-    } else {
-      qCritical() << "CreatePartition() ped_partition_new() returns nullptr"
-                  << partition;
+    ok = AddPedPartition(lp_device, lp_disk, partition);
+    if (ok) {
+      ok = Commit(lp_disk);
     }
     DestroyDeviceAndDisk(lp_device, lp_disk);
   } else {
@@ -175,23 +288,7 @@ bool CreatePartition(const Partition::Ptr partition) {
 
 bool CreatePartitionTable(const QString& device_path,
                           PartitionTableType table) {
-  PedDiskType* disk_type = NULL;
-  switch (table) {
-    case PartitionTableType::GPT: {
-      disk_type = ped_disk_type_get(kPartitionTableGPT);
-      break;
-    }
-    case PartitionTableType::MsDos: {
-      disk_type = ped_disk_type_get(kPartitionTableMsDos);
-      break;
-    }
-
-    default: {
-      qCritical() << "CreatePartitionTable() Unsupported partition table.";
-      return false;
-    }
-  }
-
+  PedDiskType* disk_type = GetPedDiskType(table);
   if (disk_type == NULL) {
     qCritical() << "CreatePartitionTable() Failed to get disk type";
     return false;
@@ -229,23 +326,9 @@ bool DeletePartition(const Partition::Ptr partition) {
   PedDevice* lp_device = nullptr;
   PedDisk* lp_disk = nullptr;
   if (GetDeviceAndDisk(partition->device_path, lp_device, lp_disk)) {
-    PedPartition* lp_partition = nullptr;
-    if (partition->type == PartitionType::Extended) {
-      lp_partition = ped_disk_extended_partition(lp_disk);
-    } else {
-      lp_partition = ped_disk_get_partition_by_sector(lp_disk,
-                                                      partition->getSector());
-    }
-    if (lp_partition) {
-      ok = bool(ped_disk_delete_partition(lp_disk, lp_partition));
-    } else {
-      qCritical() << "DeletePartition() lp_partition is nullptr";
-    }
-
+    ok = DeletePedPartition(lp_disk, partition);
     if (ok) {
       ok = Commit(lp_disk);
-    } else {
-      qCritical() << "DeletePartition ped_disk_delete_partition() failed";
     }
 
     DestroyDeviceAndDisk(lp_device, lp_disk);
@@ -319,30 +402,9 @@ bool ResizeMovePartition(const Partition::Ptr partition) {
   PedDevice* lp_device = nullptr;
   PedDisk* lp_disk = nullptr;
   if (GetDeviceAndDisk(partition->device_path, lp_device, lp_disk)) {
-    PedPartition* lp_partition = nullptr;
-    if (partition->type == PartitionType::Extended) {
-      lp_partition = ped_disk_extended_partition(lp_disk);
-    } else {
-      lp_partition = ped_disk_get_partition_by_sector(lp_disk,
-                                                      partition->getSector());
-    }
-    if (lp_partition) {
-      PedGeometry* geom = ped_geometry_new(lp_device, partition->start_sector,
-                                           partition->getSectorLength());
-      PedConstraint* constraint = nullptr;
-      if (geom) {
-        constraint = ped_constraint_exact(geom);
-      }
-      if (constraint) {
-        ok = bool(ped_disk_set_partition_geom(lp_disk, lp_partition, constraint,
-                                              partition->start_sector,
-                                              partition->end_sector));
-        if (ok) {
-          ok = Commit(lp_disk);
-        }
-        ped_geometry_destroy(geom);
-        ped_constraint_destroy(constraint);
-      }
+    ok = ResizeMovePedPartition(lp_device, lp_disk, partition);
+    if (ok) {
+      ok = Commit(lp_disk);
     }
     DestroyDeviceAndDisk(lp_device, lp_disk);
   }
@@ -357,12 +419,7 @@ bool SetPartitionFlag(const Partition::Ptr partition,
   PedDisk* lp_disk = nullptr;
   bool ok = false;
   if (GetDeviceAndDisk(partition->device_path, lp_device, lp_disk)) {
-    PedPartition* lp_partition =
-        ped_disk_get_partition_by_sector(lp_disk, partition->getSector());
-    if (lp_partition) {
-      ok = bool(ped_partition_set_flag(lp_partition, flag, is_set ? 1 : 0));
-    }
-
+    ok = SetPedPartitionFlag(lp_disk, partition, flag, is_set);
     if (ok) {
       ok = Commit(lp_disk);
     }
@@ -389,23 +446,9 @@ bool SetPartitionType(const Partition::Ptr partition) {
   PedDisk* lp_disk = nullptr;
   bool ok = false;
   if (GetDeviceAndDisk(partition->device_path, lp_device, lp_disk)) {
-    const QString fs_name = GetPedFsName(partition->fs);
-
-    PedFileSystemType* fs_type = GetPedFsType(partition);
-    PedPartition* lp_partition =
-        ped_disk_get_partition_by_sector(lp_disk, partition->getSector());
-
-    if (fs_type && lp_partition) {
-      ok = bool(ped_partition_set_system(lp_partition, fs_type));
-    } else {
-      qCritical() << "SetPartitionType() ped_disk_get_partition_by_sector() "
-                  << "failed";
-    }
-
+    ok = SetPedPartitionType(lp_disk, partition);
     if (ok) {
       ok = Commit(lp_disk);
-    } else {
-      qCritical() << "SetPartitionType() ped_partition_set_system() failed";
     }
 
     DestroyDeviceAndDisk(lp_device, lp_disk);
@@ -418,7 +461,11 @@ bool SetPartitionType(const Partition::Ptr partition) {
 }
 
 void SettleDevice(int timeout) {
+  QElapsedTimer timer;
+  timer.start();
   SpawnCmd("udevadm", {"settle", QString("--timeout=%1").arg(timeout)});
+  g_settle_count ++;
+  g_settle_time += timer.elapsed();
 }
 
 bool UpdatePartitionNumber(Partition::Ptr partition) {
@@ -426,21 +473,7 @@ bool UpdatePartitionNumber(Partition::Ptr partition) {
   PedDevice* lp_device = nullptr;
   PedDisk* lp_disk = nullptr;
   if (GetDeviceAndDisk(partition->device_path, lp_device, lp_disk)) {
-    PedPartition* lp_partition = nullptr;
-    if (partition->type == PartitionType::Extended) {
-      lp_partition = ped_disk_extended_partition(lp_disk);
-    } else {
-      lp_partition = ped_disk_get_partition_by_sector(lp_disk,
-                                                      partition->getSector());
-    }
-    if (lp_partition) {
-      partition->partition_number = lp_partition->num;
-      partition->path = GetPartitionPath(lp_partition);
-      ok = true;
-    } else {
-      qCritical() << "UpdatePartitionNumber() lp_partition is nullptr";
-    }
-
+    ok = ReadPedPartitionNumber(lp_disk, partition);
     DestroyDeviceAndDisk(lp_device, lp_disk);
   } else {
     qCritical() << "UpdatePartitionNumber() failed to get lp disk object"
@@ -450,4 +483,164 @@ bool UpdatePartitionNumber(Partition::Ptr partition) {
   return ok;
 }
 
+bool WaitForDevicePath(const QString& dev_path) {
+  for (int i = 0; !QFileInfo::exists(dev_path) && i < 50; ++i) {
+    // Wait for 10ms.
+    struct timespec rqtp = { 0, 10 * 1000 * 1000 };
+    (void) nanosleep(&rqtp, NULL);
+  }
+
+  return QFileInfo::exists(dev_path);
+}
+
+void ResetCommitStats() {
+  g_commit_count = 0;
+  g_settle_count = 0;
+  g_settle_time = 0;
+}
+
+CommitStats GetCommitStats() {
+  CommitStats stats;
+  stats.commits = g_commit_count;
+  stats.settles = g_settle_count;
+  stats.settle_time = g_settle_time;
+  return stats;
+}
+
+DiskTransaction::DiskTransaction(const QString& device_path)
+    : device_path_(device_path) {
+  lp_device_ = ped_device_get(device_path.toLocal8Bit().constData());
+  if (lp_device_ == nullptr) {
+    qCritical() << "DiskTransaction failed to get device:" << device_path;
+    return;
+  }
+  // Device without partition table is allowed, as long as a new table is
+  // created first.
+  if (ped_disk_probe(lp_device_) != nullptr) {
+    lp_disk_ = ped_disk_new(lp_device_);
+  }
+}
+
+DiskTransaction::~DiskTransaction() {
+  DestroyDeviceAndDisk(lp_device_, lp_disk_);
+}
+
+bool DiskTransaction::isValid() const {
+  return lp_device_ != nullptr;
+}
+
+bool DiskTransaction::createPartitionTable(PartitionTableType table) {
+  qDebug() << "DiskTransaction::createPartitionTable()" << device_path_;
+  if (lp_device_ == nullptr) {
+    return false;
+  }
+  PedDiskType* disk_type = GetPedDiskType(table);
+  if (disk_type == NULL) {
+    return false;
+  }
+  PedDisk* lp_disk = ped_disk_new_fresh(lp_device_, disk_type);
+  if (lp_disk == nullptr) {
+    qCritical() << "CreatePartitionTable() Failed to create new disk"
+                << device_path_;
+    return false;
+  }
+  if (lp_disk_ != nullptr) {
+    ped_disk_destroy(lp_disk_);
+  }
+  lp_disk_ = lp_disk;
+  dirty_ = true;
+  return true;
+}
+
+bool DiskTransaction::createPartition(Partition::Ptr partition) {
+  qDebug() << "DiskTransaction::createPartition()" << partition;
+  if (lp_disk_ == nullptr || !AddPedPartition(lp_device_, lp_disk_,
+                                              partition)) {
+    return false;
+  }
+  dirty_ = true;
+  // Partition number is allocated when it is added to disk.
+  return ReadPedPartitionNumber(lp_disk_, partition);
+}
+
+bool DiskTransaction::deletePartition(const Partition::Ptr partition) {
+  qDebug() << "DiskTransaction::deletePartition()" << partition;
+  if (lp_disk_ == nullptr || !DeletePedPartition(lp_disk_, partition)) {
+    return false;
+  }
+  dirty_ = true;
+  return true;
+}
+
+bool DiskTransaction::resizeMovePartition(const Partition::Ptr partition) {
+  qDebug() << "DiskTransaction::resizeMovePartition()" << partition;
+  if (lp_disk_ == nullptr ||
+      !ResizeMovePedPartition(lp_device_, lp_disk_, partition)) {
+    return false;
+  }
+  dirty_ = true;
+  return true;
+}
+
+bool DiskTransaction::setPartitionType(const Partition::Ptr partition) {
+  qDebug() << "DiskTransaction::setPartitionType()" << partition;
+  if (lp_disk_ == nullptr || !SetPedPartitionType(lp_disk_, partition)) {
+    return false;
+  }
+  dirty_ = true;
+  return true;
+}
+
+bool DiskTransaction::setPartitionFlags(const Partition::Ptr partition) {
+  if (lp_disk_ == nullptr) {
+    return false;
+  }
+  for (PartitionFlag flag : partition->flags) {
+    if (!SetPedPartitionFlag(lp_disk_, partition,
+                             static_cast<PedPartitionFlag>(flag), true)) {
+      qCritical() << "DiskTransaction::setPartitionFlags() failed:"
+                  << partition << flag;
+      return false;
+    }
+    dirty_ = true;
+  }
+  return true;
+}
+
+bool DiskTransaction::updatePartitionNumber(Partition::Ptr partition) {
+  if (lp_disk_ == nullptr) {
+    return false;
+  }
+  return ReadPedPartitionNumber(lp_disk_, partition);
+}
+
+bool DiskTransaction::hasPartition(const Partition::Ptr partition) const {
+  if (lp_disk_ == nullptr) {
+    return false;
+  }
+  PedPartition* lp_partition = FindPedPartition(lp_disk_, partition);
+  // Free space is returned if no partition is found at that sector.
+  return (lp_partition != nullptr) &&
+         (lp_partition->num > 0) &&
+         (lp_partition->num == partition->partition_number) &&
+         (GetPartitionPath(lp_partition) == partition->path);
+}
+
+bool DiskTransaction::commit() {
+  if (!dirty_) {
+    return true;
+  }
+  if (lp_disk_ == nullptr) {
+    return false;
+  }
+  qDebug() << "DiskTransaction::commit()" << device_path_;
+  const bool ok = Commit(lp_disk_);
+  if (ok) {
+    dirty_ = false;
+  } else {
+    qCritical() << "DiskTransaction::commit() failed:" << device_path_;
+  }
+  return ok;
+}
+
 }  // namespace installer
@@ -20,11 +20,20 @@
 
 #include <parted/parted.h>
 #include <QString>
+#include <QtGlobal>
 
 #include "partman/partition.h"
 
 namespace installer {
 
+// Counters of partition table commits and udev settles.
+struct CommitStats {
+  int commits = 0;
+  int settles = 0;
+  // Total time spent in SettleDevice(), in milliseconds.
+  qint64 settle_time = 0;
+};
+
 // Commit changes to disk.
 bool Commit(PedDisk* lp_disk);
 
@@ -56,9 +65,16 @@ bool GetDeviceAndDisk(const QString& device_path,
                       PedDevice*& lp_device,
                       PedDisk*& lp_disk);
 
+// Read counters of Commit() and SettleDevice() since last call of
+// ResetCommitStats().
+CommitStats GetCommitStats();
+
 // Get |partition| path, might be empty.
 QString GetPartitionPath(PedPartition* lp_partition);
 
+// Reset counters returned by GetCommitStats().
+void ResetCommitStats();
+
 // Resize/Move partition specified with |partition|.
 // If |partition| is NormalPartition or LogicalPartition, remember to re-format
 // it.
@@ -89,6 +105,51 @@ void SettleDevice(int timeout);
 // This partition number and path is read from real device.
 bool UpdatePartitionNumber(Partition::Ptr partition);
 
+// Wait at most 500ms for |dev_path| to be created by udev.
+// Call SettleDevice() before this.
+bool WaitForDevicePath(const QString& dev_path);
+
+// Collects partition table changes of one device in memory, and writes
+// them to disk with a single commit.
+// Partition number and path of newly created partitions are updated
+// immediately, but their device nodes only exist after commit().
+class DiskTransaction {
+ public:
+  explicit DiskTransaction(const QString& device_path);
+  ~DiskTransaction();
+
+  // Returns false if device at |device_path| is not found.
+  bool isValid() const;
+
+  const QString& devicePath() const { return device_path_; }
+
+  // Replace partition table in memory with an empty |table|.
+  bool createPartitionTable(PartitionTableType table);
+
+  bool createPartition(Partition::Ptr partition);
+  bool deletePartition(const Partition::Ptr partition);
+  bool resizeMovePartition(const Partition::Ptr partition);
+  bool setPartitionType(const Partition::Ptr partition);
+  bool setPartitionFlags(const Partition::Ptr partition);
+  bool updatePartitionNumber(Partition::Ptr partition);
+
+  // Returns true if a partition is found at sectors of |partition| in
+  // partition table in memory, with the same partition number and path.
+  bool hasPartition(const Partition::Ptr partition) const;
+
+  // Write partition table to disk and wait for udev events once.
+  // Does nothing if partition table is not changed.
+  bool commit();
+
+ private:
+  QString device_path_;
+  PedDevice* lp_device_ = nullptr;
+  PedDisk* lp_disk_ = nullptr;
+  bool dirty_ = false;
+
+  Q_DISABLE_COPY(DiskTransaction)
+};
+
 }  // namespace installer
 
 #endif  // INSTALLER_PARTMAN_LIBPARTED_UTIL_H
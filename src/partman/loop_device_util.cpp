@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/loop_device_util.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include "base/command.h"
+
+namespace installer {
+
+QString AttachLoopDevice(const QString& image, qint64 size) {
+  QFile file(image);
+  if (!file.open(QIODevice::WriteOnly) || !file.resize(size)) {
+    qCritical() << "AttachLoopDevice() failed to create image:" << image;
+    return QString();
+  }
+  file.close();
+
+  QString out, err;
+  if (!SpawnCmd("losetup", {"--find", "--show", "--partscan", image},
+                out, err)) {
+    qCritical() << "AttachLoopDevice() losetup failed:" << err;
+    return QString();
+  }
+  return out.trimmed();
+}
+
+bool DetachLoopDevice(const QString& device_path) {
+  return SpawnCmd("losetup", {"--detach", device_path});
+}
+
+}  // namespace installer
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_PARTMAN_LOOP_DEVICE_UTIL_H
+#define INSTALLER_PARTMAN_LOOP_DEVICE_UTIL_H
+
+#include <QString>
+
+namespace installer {
+
+// Loop devices used by root tests and partman-benchmark.
+
+// Create a sparse image file at |image| with |size| bytes, and attach it to
+// a free loop device with partition scanning enabled.
+// Returns path to loop device, or an empty string on error.
+QString AttachLoopDevice(const QString& image, qint64 size);
+
+// Detach loop device at |device_path|. Its image file is kept.
+bool DetachLoopDevice(const QString& device_path);
+
+}  // namespace installer
+
+#endif  // INSTALLER_PARTMAN_LOOP_DEVICE_UTIL_H
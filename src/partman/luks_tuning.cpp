@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/luks_tuning.h"
+
+#include <QRegExp>
+#include <QStringList>
+#include <QThread>
+
+#include "base/command.h"
+#include "base/file_util.h"
+#include "sysinfo/proc_meminfo.h"
+
+namespace installer {
+
+namespace {
+
+const char kCpuInfoFile[] = "/proc/cpuinfo";
+
+const char kPbkdf[] = "argon2id";
+
+// Range of argon2 memory cost, in KiB. 1GiB is the default maximum value
+// of cryptsetup.
+const int kPbkdfMinMemory = 32 * 1024;
+const int kPbkdfMaxMemory = 1024 * 1024;
+
+// Disk is unlocked in initramfs, so only a small part of physical memory
+// is used by argon2.
+const int kPbkdfMemoryDivisor = 8;
+
+// Maximum number of argon2 threads, same as cryptsetup.
+const int kPbkdfMaxParallel = 4;
+
+// Cipher candidates, cipher used on CPUs with AES instructions is the first
+// one. Adiantum is designed for CPUs without AES instructions, and is
+// supported since linux 5.0.
+struct CipherCandidate {
+  const char* cipher;
+  const char* name;  // Name shown in output of `cryptsetup benchmark`.
+  int key_size;
+};
+const CipherCandidate kCipherCandidates[] = {
+    { "aes-xts-plain64", "aes-xts", 512 },
+    { "xchacha12,aes-adiantum-plain64", "xchacha12,aes-adiantum", 256 },
+    { "xchacha20,aes-adiantum-plain64", "xchacha20,aes-adiantum", 256 },
+};
+
+}  // namespace
+
+QDebug& operator<<(QDebug& debug, const LuksTuning& tuning) {
+  debug << "LuksTuning: {"
+        << "cipher:" << tuning.cipher
+        << "key size:" << tuning.key_size
+        << "pbkdf:" << tuning.pbkdf
+        << "memory:" << tuning.pbkdf_memory
+        << "parallel:" << tuning.pbkdf_parallel
+        << "iterations:" << tuning.pbkdf_iterations
+        << "iter time:" << tuning.iter_time
+        << "}";
+  return debug;
+}
+
+CipherBenchmarkList ParseCipherBenchmark(const QString& output) {
+  // Like "        aes-xts        512b      1625.3 MiB/s      1619.1 MiB/s".
+  // Speed is "N/A" if cipher is not supported.
+  const QRegExp pattern("^\\s*(\\S+)\\s+(\\d+)b\\s+([\\d.]+) MiB/s\\s+"
+                        "([\\d.]+) MiB/s");
+  CipherBenchmarkList benchmarks;
+  for (const QString& line : output.split('\n')) {
+    if (pattern.indexIn(line) == -1) {
+      continue;
+    }
+    CipherBenchmark benchmark;
+    benchmark.cipher = pattern.cap(1);
+    benchmark.key_size = pattern.cap(2).toInt();
+    benchmark.encryption = pattern.cap(3).toDouble();
+    benchmark.decryption = pattern.cap(4).toDouble();
+    benchmarks.append(benchmark);
+  }
+  return benchmarks;
+}
+
+bool ParsePbkdfBenchmark(const QString& output, PbkdfBenchmark& benchmark) {
+  // Like "argon2id      4 iterations, 1048576 memory, 4 parallel threads
+  // (CPUs) for 256-bit key (requested 2000 ms time)".
+  const QRegExp pattern("^(argon2i|argon2id)\\s+(\\d+) iterations, "
+                        "(\\d+) memory, (\\d+) parallel threads");
+  for (const QString& line : output.split('\n')) {
+    if (pattern.indexIn(line) != -1) {
+      benchmark.pbkdf = pattern.cap(1);
+      benchmark.iterations = pattern.cap(2).toInt();
+      benchmark.memory = pattern.cap(3).toInt();
+      benchmark.parallel = pattern.cap(4).toInt();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HasAesInstructions(const QString& cpuinfo) {
+  // "flags" on x86, "Features" on arm.
+  for (const QString& line : cpuinfo.split('\n')) {
+    if (!line.startsWith("flags") && !line.startsWith("Features")) {
+      continue;
+    }
+    const int index = line.indexOf(':');
+    if (index == -1) {
+      continue;
+    }
+    const QStringList flags = line.mid(index + 1).split(
+        QRegExp("\\s+"), QString::SkipEmptyParts);
+    if (flags.contains("aes")) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int GetPbkdfMemoryLimit(qint64 mem_total) {
+  const qint64 memory = mem_total / kPbkdfMemoryDivisor / 1024;
+  return int(qBound(qint64(kPbkdfMinMemory), memory,
+                    qint64(kPbkdfMaxMemory)));
+}
+
+LuksTuning ChooseLuksTuning(bool has_aes,
+                            const CipherBenchmarkList& ciphers,
+                            const PbkdfBenchmark& pbkdf,
+                            int memory_limit,
+                            int iter_time) {
+  LuksTuning tuning;
+  if (has_aes) {
+    tuning.cipher = kCipherCandidates[0].cipher;
+    tuning.key_size = kCipherCandidates[0].key_size;
+  } else {
+    // Use the fastest one, both encryption and decryption are considered.
+    double max_speed = 0;
+    for (const CipherCandidate& candidate : kCipherCandidates) {
+      for (const CipherBenchmark& benchmark : ciphers) {
+        const double speed = qMin(benchmark.encryption, benchmark.decryption);
+        if (benchmark.cipher == candidate.name &&
+            benchmark.key_size == candidate.key_size &&
+            speed > max_speed) {
+          max_speed = speed;
+          tuning.cipher = candidate.cipher;
+          tuning.key_size = candidate.key_size;
+        }
+      }
+    }
+  }
+
+  // Key derivation options of cryptsetup are kept unless the benchmark
+  // succeeded.
+  tuning.iter_time = iter_time;
+  if (pbkdf.iterations > 0 && pbkdf.memory > 0) {
+    // Memory cost may be reduced by cryptsetup if it is too slow.
+    tuning.pbkdf = kPbkdf;
+    tuning.pbkdf_iterations = pbkdf.iterations;
+    tuning.pbkdf_memory = qMin(pbkdf.memory, memory_limit);
+    tuning.pbkdf_parallel = pbkdf.parallel;
+  }
+  return tuning;
+}
+
+QStringList GetLuksFormatArgs(const LuksTuning& tuning) {
+  QStringList args;
+  if (!tuning.cipher.isEmpty()) {
+    args << "--cipher" << tuning.cipher
+         << "--key-size" << QString::number(tuning.key_size);
+  }
+  if (!tuning.pbkdf.isEmpty()) {
+    // argon2 is supported by LUKS2 only.
+    args << "--type" << "luks2"
+         << "--pbkdf" << tuning.pbkdf
+         << "--pbkdf-memory" << QString::number(tuning.pbkdf_memory)
+         << "--pbkdf-parallel" << QString::number(tuning.pbkdf_parallel);
+    if (tuning.pbkdf_iterations > 0) {
+      args << "--pbkdf-force-iterations"
+           << QString::number(tuning.pbkdf_iterations);
+    } else {
+      args << "--iter-time" << QString::number(tuning.iter_time);
+    }
+  }
+  return args;
+}
+
+LuksTuning TuneLuks(int iter_time) {
+  const bool has_aes = HasAesInstructions(ReadFile(kCpuInfoFile));
+  const MemInfo mem_info = GetMemInfo();
+  const int memory_limit = GetPbkdfMemoryLimit(mem_info.mem_total);
+  const int parallel =
+      qBound(1, QThread::idealThreadCount(), kPbkdfMaxParallel);
+  qDebug() << "TuneLuks() aes instructions:" << has_aes
+           << "mem total:" << mem_info.mem_total
+           << "memory limit:" << memory_limit;
+
+  QString out, err;
+  CipherBenchmarkList ciphers;
+  if (!has_aes) {
+    // aes-xts is the best choice if AES instructions are available, so
+    // ciphers are benchmarked only if not.
+    for (const CipherCandidate& candidate : kCipherCandidates) {
+      if (SpawnCmd("cryptsetup", {"benchmark",
+                                  "--cipher", candidate.cipher,
+                                  "--key-size",
+                                  QString::number(candidate.key_size)},
+                   out, err)) {
+        ciphers.append(ParseCipherBenchmark(out));
+      } else {
+        qWarning() << "cryptsetup benchmark failed:" << candidate.cipher
+                   << err;
+      }
+    }
+    for (const CipherBenchmark& benchmark : ciphers) {
+      qDebug() << "TuneLuks() cipher:" << benchmark.cipher
+               << benchmark.key_size << "encryption:" << benchmark.encryption
+               << "decryption:" << benchmark.decryption;
+    }
+  }
+
+  // Iterations are calculated by cryptsetup so that key derivation takes
+  // |iter_time| milliseconds with |memory_limit|.
+  PbkdfBenchmark pbkdf;
+  if (!SpawnCmd("cryptsetup", {"benchmark",
+                               "--pbkdf", kPbkdf,
+                               "--pbkdf-memory",
+                               QString::number(memory_limit),
+                               "--pbkdf-parallel", QString::number(parallel),
+                               "--iter-time", QString::number(iter_time)},
+                out, err) ||
+      !ParsePbkdfBenchmark(out, pbkdf)) {
+    qWarning() << "cryptsetup pbkdf benchmark failed:" << err;
+  }
+
+  const LuksTuning tuning =
+      ChooseLuksTuning(has_aes, ciphers, pbkdf, memory_limit, iter_time);
+  qDebug() << "TuneLuks()" << tuning;
+  return tuning;
+}
+
+}  // namespace installer
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_PARTMAN_LUKS_TUNING_H
+#define INSTALLER_PARTMAN_LUKS_TUNING_H
+
+#include <QDebug>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+namespace installer {
+
+// Choose LUKS options of full disk encryption for this machine. Defaults of
+// cryptsetup use aes-xts, which is slow on CPUs without AES instructions,
+// and argon2 memory cost which may be too large for machines with little RAM.
+
+// Speed of a cipher reported by `cryptsetup benchmark`.
+struct CipherBenchmark {
+  QString cipher;  // Cipher and mode, like "aes-xts".
+  int key_size = 0;  // In bits.
+  double encryption = 0;  // In MiB/s.
+  double decryption = 0;  // In MiB/s.
+};
+typedef QList<CipherBenchmark> CipherBenchmarkList;
+
+// Cost of key derivation function reported by `cryptsetup benchmark`.
+struct PbkdfBenchmark {
+  QString pbkdf;
+  int iterations = 0;
+  int memory = 0;  // In KiB.
+  int parallel = 0;
+};
+
+// Options passed to `cryptsetup luksFormat`.
+struct LuksTuning {
+  // Cipher specification, like "aes-xts-plain64".
+  // Empty to use default cipher of cryptsetup.
+  QString cipher;
+  int key_size = 0;  // In bits.
+  QString pbkdf;
+  int pbkdf_memory = 0;  // In KiB.
+  int pbkdf_parallel = 0;
+  // 0 to let cryptsetup benchmark iterations with |iter_time|.
+  int pbkdf_iterations = 0;
+  int iter_time = 0;  // Expected unlock time, in milliseconds.
+};
+QDebug& operator<<(QDebug& debug, const LuksTuning& tuning);
+
+// Parse cipher items in output of `cryptsetup benchmark`.
+// Ciphers not supported by kernel are ignored.
+CipherBenchmarkList ParseCipherBenchmark(const QString& output);
+
+// Parse argon2 item in output of `cryptsetup benchmark --pbkdf`.
+// Returns false if not found.
+bool ParsePbkdfBenchmark(const QString& output, PbkdfBenchmark& benchmark);
+
+// Returns true if CPU supports AES instructions, based on |cpuinfo|, the
+// content of /proc/cpuinfo.
+bool HasAesInstructions(const QString& cpuinfo);
+
+// Returns maximum argon2 memory cost in KiB, for a machine with |mem_total|
+// bytes of physical memory.
+int GetPbkdfMemoryLimit(qint64 mem_total);
+
+// Choose cipher based on |ciphers| and |has_aes|, and key derivation
+// options based on |pbkdf|. If |pbkdf| is empty, as benchmark failed,
+// |pbkdf| of result is empty too and defaults of cryptsetup are used.
+LuksTuning ChooseLuksTuning(bool has_aes,
+                            const CipherBenchmarkList& ciphers,
+                            const PbkdfBenchmark& pbkdf,
+                            int memory_limit,
+                            int iter_time);
+
+// Convert |tuning| to arguments of `cryptsetup luksFormat`, as get_luks_opts
+// in auto_part.sh does. Defaults of cryptsetup are used for empty options.
+QStringList GetLuksFormatArgs(const LuksTuning& tuning);
+
+// Benchmark ciphers and key derivation on this machine and choose LUKS
+// options, so that disk is unlocked in about |iter_time| milliseconds.
+// Note that this method shall be called in the background thread.
+LuksTuning TuneLuks(int iter_time);
+
+}  // namespace installer
+
+#endif  // INSTALLER_PARTMAN_LUKS_TUNING_H
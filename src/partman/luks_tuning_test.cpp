@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/luks_tuning.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kCipherOutput[] =
+    "# Tests are approximate using memory only (no storage IO).\n"
+    "#     Algorithm |       Key |      Encryption |      Decryption\n"
+    "        aes-xts        512b        95.2 MiB/s       96.8 MiB/s\n";
+
+const char kAdiantumOutput[] =
+    "# Tests are approximate using memory only (no storage IO).\n"
+    "#            Algorithm |       Key |      Encryption |      Decryption\n"
+    "xchacha12,aes-adiantum        256b       310.5 MiB/s      305.1 MiB/s\n";
+
+const char kUnsupportedOutput[] =
+    "#            Algorithm |       Key |      Encryption |      Decryption\n"
+    "xchacha20,aes-adiantum        256b             N/A             N/A\n";
+
+const char kPbkdfOutput[] =
+    "# Tests are approximate using memory only (no storage IO).\n"
+    "argon2id      5 iterations, 131072 memory, 2 parallel threads (CPUs) "
+    "for 256-bit key (requested 2000 ms time)\n";
+
+TEST(LuksTuning, ParseCipherBenchmark) {
+  CipherBenchmarkList benchmarks = ParseCipherBenchmark(kCipherOutput);
+  ASSERT_EQ(benchmarks.length(), 1);
+  EXPECT_EQ(benchmarks.at(0).cipher, "aes-xts");
+  EXPECT_EQ(benchmarks.at(0).key_size, 512);
+  EXPECT_DOUBLE_EQ(benchmarks.at(0).encryption, 95.2);
+  EXPECT_DOUBLE_EQ(benchmarks.at(0).decryption, 96.8);
+
+  benchmarks = ParseCipherBenchmark(kAdiantumOutput);
+  ASSERT_EQ(benchmarks.length(), 1);
+  EXPECT_EQ(benchmarks.at(0).cipher, "xchacha12,aes-adiantum");
+
+  EXPECT_TRUE(ParseCipherBenchmark(kUnsupportedOutput).isEmpty());
+}
+
+TEST(LuksTuning, ParsePbkdfBenchmark) {
+  PbkdfBenchmark benchmark;
+  ASSERT_TRUE(ParsePbkdfBenchmark(kPbkdfOutput, benchmark));
+  EXPECT_EQ(benchmark.pbkdf, "argon2id");
+  EXPECT_EQ(benchmark.iterations, 5);
+  EXPECT_EQ(benchmark.memory, 131072);
+  EXPECT_EQ(benchmark.parallel, 2);
+  EXPECT_FALSE(ParsePbkdfBenchmark(kCipherOutput, benchmark));
+}
+
+TEST(LuksTuning, HasAesInstructions) {
+  EXPECT_TRUE(HasAesInstructions(
+      "processor\t: 0\nflags\t\t: fpu vme sse2 aes avx\n"));
+  EXPECT_TRUE(HasAesInstructions(
+      "processor\t: 0\nFeatures\t: fp asimd evtstrm aes pmull sha1\n"));
+  EXPECT_FALSE(HasAesInstructions(
+      "processor\t: 0\nflags\t\t: fpu vme sse2 aes_ni avx\n"));
+  EXPECT_FALSE(HasAesInstructions("system type\t\t: loongson3\n"));
+}
+
+TEST(LuksTuning, GetPbkdfMemoryLimit) {
+  const qint64 kGibiByte = 1024LL * 1024 * 1024;
+  EXPECT_EQ(GetPbkdfMemoryLimit(0), 32 * 1024);
+  EXPECT_EQ(GetPbkdfMemoryLimit(2 * kGibiByte), 256 * 1024);
+  EXPECT_EQ(GetPbkdfMemoryLimit(64 * kGibiByte), 1024 * 1024);
+}
+
+TEST(LuksTuning, ChooseLuksTuning) {
+  CipherBenchmarkList ciphers = ParseCipherBenchmark(kCipherOutput);
+  ciphers.append(ParseCipherBenchmark(kAdiantumOutput));
+  PbkdfBenchmark pbkdf;
+  ASSERT_TRUE(ParsePbkdfBenchmark(kPbkdfOutput, pbkdf));
+
+  // aes-xts is used if AES instructions are available.
+  LuksTuning tuning = ChooseLuksTuning(true, ciphers, pbkdf, 65536, 2000);
+  EXPECT_EQ(tuning.cipher, "aes-xts-plain64");
+  EXPECT_EQ(tuning.key_size, 512);
+  EXPECT_EQ(tuning.pbkdf, "argon2id");
+  EXPECT_EQ(tuning.pbkdf_iterations, 5);
+  EXPECT_EQ(tuning.pbkdf_memory, 65536);
+  EXPECT_EQ(tuning.pbkdf_parallel, 2);
+
+  // Otherwise the fastest one.
+  tuning = ChooseLuksTuning(false, ciphers, pbkdf, 262144, 2000);
+  EXPECT_EQ(tuning.cipher, "xchacha12,aes-adiantum-plain64");
+  EXPECT_EQ(tuning.key_size, 256);
+  EXPECT_EQ(tuning.pbkdf_memory, 131072);
+
+  // Default cipher of cryptsetup is used if cipher benchmark failed.
+  tuning = ChooseLuksTuning(false, {}, pbkdf, 262144, 3000);
+  EXPECT_TRUE(tuning.cipher.isEmpty());
+  EXPECT_EQ(tuning.pbkdf, "argon2id");
+  EXPECT_EQ(tuning.iter_time, 3000);
+}
+
+TEST(LuksTuning, ChooseLuksTuningBenchmarkFailed) {
+  // Default key derivation options of cryptsetup are used if pbkdf
+  // benchmark failed or its output is not parsed.
+  LuksTuning tuning =
+      ChooseLuksTuning(true, {}, PbkdfBenchmark(), 262144, 3000);
+  EXPECT_EQ(tuning.cipher, "aes-xts-plain64");
+  EXPECT_TRUE(tuning.pbkdf.isEmpty());
+  EXPECT_EQ(tuning.pbkdf_iterations, 0);
+  EXPECT_EQ(tuning.pbkdf_memory, 0);
+  EXPECT_EQ(tuning.pbkdf_parallel, 0);
+  EXPECT_EQ(GetLuksFormatArgs(tuning).join(' '),
+            "--cipher aes-xts-plain64 --key-size 512");
+
+  tuning = ChooseLuksTuning(false, {}, PbkdfBenchmark(), 262144, 3000);
+  EXPECT_TRUE(tuning.cipher.isEmpty());
+  EXPECT_TRUE(tuning.pbkdf.isEmpty());
+  EXPECT_TRUE(GetLuksFormatArgs(tuning).isEmpty());
+}
+
+TEST(LuksTuning, GetLuksFormatArgs) {
+  LuksTuning tuning;
+  EXPECT_TRUE(GetLuksFormatArgs(tuning).isEmpty());
+
+  tuning.pbkdf = "argon2id";
+  tuning.pbkdf_memory = 65536;
+  tuning.pbkdf_parallel = 2;
+  tuning.iter_time = 2000;
+  EXPECT_EQ(GetLuksFormatArgs(tuning).join(' '),
+            "--type luks2 --pbkdf argon2id --pbkdf-memory 65536 "
+            "--pbkdf-parallel 2 --iter-time 2000");
+
+  tuning.cipher = "aes-xts-plain64";
+  tuning.key_size = 512;
+  tuning.pbkdf_iterations = 5;
+  EXPECT_EQ(GetLuksFormatArgs(tuning).join(' '),
+            "--cipher aes-xts-plain64 --key-size 512 --type luks2 "
+            "--pbkdf argon2id --pbkdf-memory 65536 --pbkdf-parallel 2 "
+            "--pbkdf-force-iterations 5");
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/native_os_prober.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QVector>
+
+#include "base/command.h"
+#include "base/file_util.h"
+#include "base/thread_util.h"
+#include "partman/fs_superblock.h"
+#include "sysinfo/system_snapshot.h"
+
+namespace installer {
+
+namespace {
+
+// Results are kept here between runs of installer.
+const char kOsProbeCacheFile[] = "/tmp/deepin-installer-os-probe.cache";
+
+// Minimum number of threads used to probe partitions, most of time is spent
+// on mounting filesystems.
+const int kMinProbeThreads = 4;
+
+// Linux boot loaders in EFI/<vendor>/ of EFI system partition. Other
+// vendors, like Dell and HP, only put firmware tools there.
+const char* const kLinuxEfiLoaders[] = {
+  "grub*.efi", "shim*.efi", "systemd-boot*.efi",
+};
+
+// Prefix of devices which never contain an installed system.
+const char* const kIgnoredDevices[] = {
+  "/dev/loop", "/dev/ram", "/dev/sr", "/dev/zram",
+};
+
+// Content types of partitions which are never mounted, see
+// ReadContentType().
+const char* const kUnmountableTypes[] = {
+  "swap", "crypto_LUKS", "LVM2_member", "linux_raid_member",
+};
+
+// Serializes access to cache file.
+QMutex g_cache_mutex;
+
+// Find |relative_path| in |root| ignoring case, as files in ntfs and vfat
+// may be saved with different cases, like "EFI/Microsoft/Boot/BOOTMGFW.EFI".
+// Returns absolute path, or an empty string if not found.
+QString FindPathNoCase(const QString& root, const QString& relative_path) {
+  QString current = root;
+  for (const QString& name : relative_path.split('/',
+                                                QString::SkipEmptyParts)) {
+    const QStringList entries = QDir(current).entryList(
+        QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden |
+        QDir::System);
+    QString found;
+    for (const QString& entry : entries) {
+      if (entry.compare(name, Qt::CaseInsensitive) == 0) {
+        found = entry;
+        break;
+      }
+    }
+    if (found.isEmpty()) {
+      return QString();
+    }
+    current = QString("%1/%2").arg(current, found);
+  }
+  return current;
+}
+
+// Remove version name in brackets, like "Debian GNU/Linux 9 (stretch)".
+QString StripVersionName(const QString& description) {
+  const int left_bracket_index = description.indexOf('(');
+  if (left_bracket_index > -1) {
+    return description.left(left_bracket_index).trimmed();
+  }
+  return description;
+}
+
+// Read distribution info from os-release file in |root|.
+bool ReadOsRelease(const QString& root, QString& name, QString& pretty_name) {
+  // /etc/os-release is usually a symbolic link to /usr/lib/os-release.
+  // It is skipped, since absolute link points to file in current system.
+  for (const char* file : {"etc/os-release", "usr/lib/os-release"}) {
+    const QString filepath = QString("%1/%2").arg(root, file);
+    const QFileInfo info(filepath);
+    if (!info.isFile() || info.isSymLink()) {
+      continue;
+    }
+
+    for (const QString& line : ReadFile(filepath).split('\n')) {
+      const int index = line.indexOf('=');
+      if (index < 1) {
+        continue;
+      }
+      const QString key = line.left(index).trimmed();
+      QString value = line.mid(index + 1).trimmed();
+      if (value.length() >= 2 &&
+          (value.startsWith('"') || value.startsWith('\'')) &&
+          value.endsWith(value.at(0))) {
+        value = value.mid(1, value.length() - 2);
+      }
+      if (key == "NAME") {
+        name = value;
+      } else if (key == "PRETTY_NAME") {
+        pretty_name = value;
+      }
+    }
+    if (!name.isEmpty() || !pretty_name.isEmpty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Read content type of partition at |path|, see ReadContentType().
+QString ReadPartitionContentType(const QString& path) {
+  const int fd = open(path.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return QString();
+  }
+  const qint64 size = lseek(fd, 0, SEEK_END);
+  const BlockReader reader = [fd](qint64 offset, char* buf, qint64 size) {
+    return pread(fd, buf, size_t(size), off_t(offset)) == size;
+  };
+  const QString type = ReadContentType(reader, qMax(size, qint64(0)));
+  close(fd);
+  return type;
+}
+
+// Get options to mount filesystem with |content_type| and |generation|
+// read-only. Journal of ext3/ext4 and xfs, and log tree of btrfs, are
+// replayed by default, which writes to disk even if filesystem is mounted
+// read-only.
+QString GetReadOnlyMountOptions(const QString& content_type,
+                                const QString& generation) {
+  if (generation.startsWith("ext:")) {
+    return "ro,noload";
+  }
+  if (generation.startsWith("btrfs:")) {
+    return "ro,nologreplay";
+  }
+  if (content_type == "xfs") {
+    return "ro,norecovery";
+  }
+  return "ro";
+}
+
+// Mount |path| with |options| to a temporary folder and detect os in it.
+OsProberItems ProbeUnmountedPartition(const QString& path,
+                                      const QString& options) {
+  QByteArray dir_template("/tmp/deepin-installer-os-probe-XXXXXX");
+  if (mkdtemp(dir_template.data()) == nullptr) {
+    qWarning() << "ProbeOsItems() failed to create mount point";
+    return OsProberItems();
+  }
+  const QString mount_point = QString::fromLocal8Bit(dir_template);
+
+  OsProberItems items;
+  QString out, err;
+  if (SpawnCmd("mount", {"-o", options, path, mount_point}, out, err)) {
+    items = DetectOsInDir(path, mount_point);
+    if (!SpawnCmd("umount", {mount_point}, out, err)) {
+      qWarning() << "ProbeOsItems() failed to umount" << path << err;
+    }
+  }
+  rmdir(dir_template.constData());
+  return items;
+}
+
+}  // namespace
+
+OsProberItems DetectOsInDir(const QString& path, const QString& root) {
+  OsProberItems items;
+
+  // Windows system partition, or boot partition of legacy mode.
+  if (!FindPathNoCase(root, "Windows/System32/ntoskrnl.exe").isEmpty()) {
+    items.append({path, "Windows", "Windows", OsType::Windows});
+  } else if (!FindPathNoCase(root, "bootmgr").isEmpty() &&
+             !FindPathNoCase(root, "Boot/BCD").isEmpty()) {
+    items.append({path, "Windows Boot Manager", "Windows", OsType::Windows});
+  }
+
+  // Boot loaders in EFI system partition, except the fallback one in
+  // EFI/BOOT/. Windows Boot Manager is listed first.
+  const QString efi_dir = FindPathNoCase(root, "EFI");
+  if (!efi_dir.isEmpty()) {
+    if (!FindPathNoCase(efi_dir, "Microsoft/Boot/bootmgfw.efi").isEmpty()) {
+      items.append({path, "Windows Boot Manager", "Windows", OsType::Windows});
+    }
+    const QStringList vendors = QDir(efi_dir).entryList(
+        QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name | QDir::IgnoreCase);
+    for (const QString& vendor : vendors) {
+      if (vendor.compare("BOOT", Qt::CaseInsensitive) == 0 ||
+          vendor.compare("Microsoft", Qt::CaseInsensitive) == 0) {
+        continue;
+      }
+      QDir vendor_dir(efi_dir + "/" + vendor);
+      if (vendor.compare("Apple", Qt::CaseInsensitive) == 0) {
+        if (!vendor_dir.entryList({"*.efi"}, QDir::Files).isEmpty()) {
+          items.append({path, "macOS", "macOS", OsType::Mac});
+        }
+        continue;
+      }
+      QStringList filters;
+      for (const char* filter : kLinuxEfiLoaders) {
+        filters.append(filter);
+      }
+      // Name filters of QDir are case insensitive by default.
+      if (!vendor_dir.entryList(filters, QDir::Files).isEmpty()) {
+        items.append({path, vendor, vendor, OsType::Linux});
+      }
+    }
+  }
+
+  QString name, pretty_name;
+  if (ReadOsRelease(root, name, pretty_name)) {
+    const QString description = pretty_name.isEmpty() ? name : pretty_name;
+    items.append({path, StripVersionName(description),
+                  name.isEmpty() ? description : name, OsType::Linux});
+  }
+
+  if (QFile::exists(
+      root + "/System/Library/CoreServices/SystemVersion.plist")) {
+    items.append({path, "macOS", "macOS", OsType::Mac});
+  }
+
+  return items;
+}
+
+QString ReadSuperblockGeneration(const QString& path) {
+  const int fd = open(path.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return QString();
+  }
+  const BlockReader reader = [fd](qint64 offset, char* buf, qint64 size) {
+    return pread(fd, buf, size_t(size), off_t(offset)) == size;
+  };
+  typedef bool (*GenerationParser)(const BlockReader&, QString&);
+  QString generation;
+  // NTFS and FAT are checked first, their boot sectors may contain any
+  // bytes at offsets of other magic numbers.
+  for (GenerationParser parser : {ReadNTFSGeneration, ReadFatGeneration,
+                      ReadExt2Generation, ReadBtrfsGeneration}) {
+    if (parser(reader, generation)) {
+      break;
+    }
+  }
+  close(fd);
+  return generation;
+}
+
+OsProbeCache ParseOsProbeCache(const QString& content) {
+  // Each line contains: uuid, generation, os type, distro name, description.
+  // Partitions without os have only one line with empty os type.
+  OsProbeCache cache;
+  for (const QString& line : content.split('\n')) {
+    const QStringList fields = line.split('\t');
+    if (fields.length() != 5) {
+      continue;
+    }
+    const QString uuid = fields.at(0);
+    OsProbeCacheItem& cache_item = cache[uuid];
+    cache_item.generation = fields.at(1);
+    if (!fields.at(2).isEmpty()) {
+      const OsType type = static_cast<OsType>(fields.at(2).toInt());
+      cache_item.items.append({QString(), fields.at(4), fields.at(3), type});
+    }
+  }
+  return cache;
+}
+
+QString DumpOsProbeCache(const OsProbeCache& cache) {
+  QStringList keys = cache.keys();
+  keys.sort();
+  QString content;
+  for (const QString& uuid : keys) {
+    const OsProbeCacheItem cache_item = cache.value(uuid);
+    if (cache_item.items.isEmpty()) {
+      content.append(QString("%1\t%2\t\t\t\n")
+                         .arg(uuid, cache_item.generation));
+    }
+    for (const OsProberItem& item : cache_item.items) {
+      content.append(QString("%1\t%2\t%3\t%4\t%5\n")
+                         .arg(uuid, cache_item.generation)
+                         .arg(static_cast<int>(item.type))
+                         .arg(item.distro_name, item.description));
+    }
+  }
+  return content;
+}
+
+OsProberItems ProbeOsItems() {
+  QMutexLocker locker(&g_cache_mutex);
+  QElapsedTimer timer;
+  timer.start();
+
+  const SystemSnapshot::Ptr snapshot = SystemSnapshot::Current();
+  // Canonical path of partition => filesystem uuid.
+  const UUIDItems& uuid_items = snapshot->uuids();
+
+  QStringList paths;
+  for (const QString& path : uuid_items.keys()) {
+    bool ignored = false;
+    for (const char* prefix : kIgnoredDevices) {
+      if (path.startsWith(prefix)) {
+        ignored = true;
+        break;
+      }
+    }
+    // Skip root filesystem of current system.
+    if (!ignored && snapshot->mountPoint(path) != "/") {
+      paths.append(path);
+    }
+  }
+  paths.sort();
+
+  OsProbeCache cache;
+  if (QFile::exists(kOsProbeCacheFile)) {
+    cache = ParseOsProbeCache(ReadFile(kOsProbeCacheFile));
+  }
+  QVector<OsProbeCacheItem> results(paths.length());
+  QVector<bool> cached(paths.length(), false);
+  const int max_threads = qMax(kMinProbeThreads, QThread::idealThreadCount());
+  ParallelFor(paths.length(), max_threads, [&](int index) {
+    const QString& path = paths.at(index);
+    // Superblock of a mounted filesystem is not updated while it is being
+    // written, so it is always probed and never cached.
+    const QString mount_point = snapshot->mountPoint(path);
+    if (!mount_point.isEmpty()) {
+      results[index].items = DetectOsInDir(path, mount_point);
+      return;
+    }
+
+    // Swap, LUKS, LVM and RAID members are skipped. Their type is cached as
+    // generation, so that they are never mounted.
+    const QString content_type = ReadPartitionContentType(path);
+    for (const char* type : kUnmountableTypes) {
+      if (content_type == type) {
+        results[index].generation = content_type;
+        return;
+      }
+    }
+
+    const QString generation = ReadSuperblockGeneration(path);
+    // Only const methods of |cache| are called in worker threads.
+    const OsProbeCacheItem cache_item = cache.value(uuid_items.value(path));
+    if (!generation.isEmpty() && cache_item.generation == generation) {
+      results[index] = cache_item;
+      cached[index] = true;
+      return;
+    }
+
+    results[index].generation = generation;
+    results[index].items = ProbeUnmountedPartition(
+        path, GetReadOnlyMountOptions(content_type, generation));
+  });
+
+  OsProberItems items;
+  OsProbeCache new_cache;
+  int num_cached = 0;
+  for (int index = 0; index < paths.length(); ++index) {
+    // Filesystems without generation, like xfs, are probed each time.
+    if (!results.at(index).generation.isEmpty()) {
+      new_cache.insert(uuid_items.value(paths.at(index)), results.at(index));
+    }
+    if (cached.at(index)) {
+      num_cached ++;
+    }
+    for (OsProberItem item : results.at(index).items) {
+      item.path = paths.at(index);
+      items.append(item);
+    }
+  }
+  if (!WriteTextFile(kOsProbeCacheFile, DumpOsProbeCache(new_cache))) {
+    qWarning() << "ProbeOsItems() failed to write cache file";
+  }
+
+  qDebug() << "ProbeOsItems() partitions:" << paths.length()
+           << "cached:" << num_cached
+           << "elapsed(ms):" << timer.elapsed();
+  return items;
+}
+
+}  // namespace installer
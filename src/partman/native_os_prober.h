@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_PARTMAN_NATIVE_OS_PROBER_H
+#define INSTALLER_PARTMAN_NATIVE_OS_PROBER_H
+
+#include <QHash>
+
+#include "partman/os_prober.h"
+
+namespace installer {
+
+// Result of probing one filesystem.
+struct OsProbeCacheItem {
+  QString generation;  // Generation of filesystem when it is probed.
+  OsProberItems items;  // |path| of each item is not used.
+};
+
+// Cached results, keyed by UUID of filesystem.
+typedef QHash<QString, OsProbeCacheItem> OsProbeCache;
+
+// Detect operating systems in filesystem of partition |path| which is
+// mounted at |root|. Windows system and boot partitions, EFI loaders on ESP,
+// Linux (os-release) and macOS are recognized.
+OsProberItems DetectOsInDir(const QString& path, const QString& root);
+
+// Read generation of filesystem at |path|, see ReadExt2Generation() and
+// others in fs_superblock.h. It changes each time that filesystem is written
+// and unmounted, so that cached result can be discarded.
+// Returns an empty string on error or if filesystem is not supported.
+QString ReadSuperblockGeneration(const QString& path);
+
+OsProbeCache ParseOsProbeCache(const QString& content);
+QString DumpOsProbeCache(const OsProbeCache& cache);
+
+// Probe all partitions with filesystem UUID in parallel, without running
+// `os-prober`. Partitions are mounted read-only if they are not mounted yet,
+// without replaying journals. Swap, LUKS, LVM and RAID members are skipped.
+// Results are cached in a file, keyed by UUID and superblock generation.
+OsProberItems ProbeOsItems();
+
+}  // namespace installer
+
+#endif  // INSTALLER_PARTMAN_NATIVE_OS_PROBER_H
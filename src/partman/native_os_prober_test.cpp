@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/native_os_prober.h"
+
+#include <QDir>
+
+#include "base/file_util.h"
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kTestRoot[] = "/tmp/deepin-installer-native-os-prober-test";
+
+bool WriteTestFile(const QString& path, const QString& content) {
+  return CreateParentDirs(path) && WriteTextFile(path, content);
+}
+
+TEST(NativeOsProberTest, DetectOsInDir) {
+  QDir(kTestRoot).removeRecursively();
+  const QString root(kTestRoot);
+
+  // Empty filesystem.
+  ASSERT_TRUE(CreateDirs(root));
+  EXPECT_TRUE(DetectOsInDir("/dev/sda1", root).isEmpty());
+
+  // EFI system partition with Windows and debian loaders.
+  ASSERT_TRUE(WriteTestFile(root + "/EFI/BOOT/BOOTX64.EFI", "x"));
+  ASSERT_TRUE(WriteTestFile(root + "/EFI/Microsoft/Boot/BOOTMGFW.EFI", "x"));
+  ASSERT_TRUE(WriteTestFile(root + "/EFI/debian/grubx64.efi", "x"));
+  // Firmware tools of vendors are not boot loaders.
+  ASSERT_TRUE(WriteTestFile(root + "/EFI/Dell/Bin/diags.efi", "x"));
+  ASSERT_TRUE(WriteTestFile(root + "/EFI/HP/SystemDiags.efi", "x"));
+  OsProberItems items = DetectOsInDir("/dev/sda1", root);
+  ASSERT_EQ(items.length(), 2);
+  EXPECT_EQ(items.at(0).type, OsType::Windows);
+  EXPECT_EQ(items.at(0).path, "/dev/sda1");
+  EXPECT_EQ(items.at(1).type, OsType::Linux);
+  EXPECT_EQ(items.at(1).distro_name, "debian");
+  QDir(root).removeRecursively();
+
+  // Linux root filesystem.
+  ASSERT_TRUE(WriteTestFile(root + "/usr/lib/os-release",
+                            "PRETTY_NAME=\"Deepin 15.11 (stable)\"\n"
+                            "NAME=\"Deepin\"\n"
+                            "VERSION_ID=\"15.11\"\n"));
+  items = DetectOsInDir("/dev/sda2", root);
+  ASSERT_EQ(items.length(), 1);
+  EXPECT_EQ(items.at(0).type, OsType::Linux);
+  EXPECT_EQ(items.at(0).description, "Deepin 15.11");
+  EXPECT_EQ(items.at(0).distro_name, "Deepin");
+  QDir(root).removeRecursively();
+
+  // Windows system partition, case of file names differs.
+  ASSERT_TRUE(WriteTestFile(root + "/WINDOWS/system32/ntoskrnl.exe", "x"));
+  items = DetectOsInDir("/dev/sda3", root);
+  ASSERT_EQ(items.length(), 1);
+  EXPECT_EQ(items.at(0).type, OsType::Windows);
+  QDir(root).removeRecursively();
+}
+
+TEST(NativeOsProberTest, OsProbeCache) {
+  OsProbeCache cache;
+  cache["1234-ABCD"].generation = "gen1";
+  cache["1234-ABCD"].items.append(
+      {QString(), "Windows Boot Manager", "Windows", OsType::Windows});
+  cache["f2a1"].generation = "gen2";
+
+  const OsProbeCache result = ParseOsProbeCache(DumpOsProbeCache(cache));
+  ASSERT_EQ(result.size(), 2);
+  EXPECT_EQ(result.value("1234-ABCD").generation, "gen1");
+  ASSERT_EQ(result.value("1234-ABCD").items.length(), 1);
+  EXPECT_EQ(result.value("1234-ABCD").items.at(0).type, OsType::Windows);
+  EXPECT_EQ(result.value("1234-ABCD").items.at(0).description,
+            "Windows Boot Manager");
+  EXPECT_EQ(result.value("f2a1").generation, "gen2");
+  EXPECT_TRUE(result.value("f2a1").items.isEmpty());
+}
+
+}  // namespace
+}  // namespace installer
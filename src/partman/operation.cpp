@@ -18,6 +18,12 @@
 #include "partman/operation.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
 #include <memory>
 
 #include "partman/libparted_util.h"
@@ -26,6 +32,162 @@
 
 namespace installer {
 
+namespace {
+
+// Identify partition by its position on device.
+QString PartitionKey(const Partition::Ptr partition) {
+  return QString("%1:%2:%3").arg(partition->device_path)
+                            .arg(partition->start_sector)
+                            .arg(partition->end_sector);
+}
+
+// Returns true if flags of |operation| are written to disk.
+bool CanSetFlags(const Operation& operation) {
+  switch (operation.type) {
+    case OperationType::Create:
+    case OperationType::Format: {
+      return (operation.new_partition->type != PartitionType::Extended) &&
+             (operation.new_partition->fs != FsType::Empty);
+    }
+    case OperationType::MountPoint: {
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+// Fold |later| into |earlier|. Filesystem, label and mount point of |later|
+// are used, and flags of both are kept.
+void FoldOperation(Operation& earlier, const Operation& later) {
+  // Partition object may be shared with operation list in delegates.
+  Partition::Ptr partition(new Partition(*earlier.new_partition));
+  if (later.type == OperationType::Format) {
+    partition->fs = later.new_partition->fs;
+    partition->label = later.new_partition->label;
+  }
+  partition->mount_point = later.new_partition->mount_point;
+  for (PartitionFlag flag : later.new_partition->flags) {
+    if (!partition->flags.contains(flag)) {
+      partition->flags.append(flag);
+    }
+  }
+  earlier.new_partition = partition;
+}
+
+// Returns indexes of Create, Format and MountPoint operations in |operations|
+// whose partition is deleted later, or whose device gets a new partition
+// table later. Filesystems of these partitions are never used.
+QSet<int> FindOverriddenOperations(const OperationList& operations) {
+  QSet<int> result;
+  for (int index = 0; index < operations.length(); ++index) {
+    const Operation& operation = operations.at(index);
+    if (operation.type != OperationType::Create &&
+        operation.type != OperationType::Format &&
+        operation.type != OperationType::MountPoint) {
+      continue;
+    }
+    const QString key = PartitionKey(operation.new_partition);
+    for (int later = index + 1; later < operations.length(); ++later) {
+      const Operation& later_operation = operations.at(later);
+      if ((later_operation.type == OperationType::Delete &&
+           PartitionKey(later_operation.orig_partition) == key) ||
+          (later_operation.type == OperationType::NewPartTable &&
+           later_operation.device->path ==
+               operation.new_partition->device_path)) {
+        result.insert(index);
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+// Share of steps before mkfs in overall progress of ApplyOperations(), if
+// there are partitions to format.
+const int kTableStepsShare = 20;
+
+}  // namespace
+
+OperationProgressReporter::OperationProgressReporter(
+    const OperationProgressHandler& handler,
+    int total,
+    int table_steps,
+    int mkfs_jobs)
+    : handler_(handler),
+      total_(total),
+      table_steps_(table_steps),
+      done_steps_(0),
+      step_start_(0),
+      mkfs_percents_(mkfs_jobs, 0),
+      mkfs_starts_(mkfs_jobs, 0) {
+  timer_.start();
+}
+
+void OperationProgressReporter::startStep(int index,
+                                          OperationPhase phase,
+                                          const QString& path) {
+  QMutexLocker locker(&mutex_);
+  step_start_ = timer_.elapsed();
+  this->report(index, phase, path, 0, 0);
+}
+
+void OperationProgressReporter::finishStep(int index,
+                                           OperationPhase phase,
+                                           const QString& path) {
+  QMutexLocker locker(&mutex_);
+  done_steps_ ++;
+  this->report(index, phase, path, 100, timer_.elapsed() - step_start_);
+}
+
+void OperationProgressReporter::updateMkfs(int job,
+                                           int index,
+                                           const QString& path,
+                                           int percent) {
+  QMutexLocker locker(&mutex_);
+  if (percent == 0) {
+    mkfs_starts_[job] = timer_.elapsed();
+  }
+  mkfs_percents_[job] = percent;
+  this->report(index, OperationPhase::Mkfs, path, percent,
+               timer_.elapsed() - mkfs_starts_[job]);
+}
+
+int OperationProgressReporter::overall() const {
+  if (mkfs_percents_.isEmpty()) {
+    return (table_steps_ > 0) ? (100 * done_steps_ / table_steps_) : 100;
+  }
+  const int table_share = (table_steps_ > 0) ? kTableStepsShare : 0;
+  int value = (table_steps_ > 0) ?
+              (table_share * done_steps_ / table_steps_) : 0;
+  int sum = 0;
+  for (int percent : mkfs_percents_) {
+    sum += percent;
+  }
+  value += (100 - table_share) * sum / (100 * mkfs_percents_.size());
+  return value;
+}
+
+void OperationProgressReporter::report(int index,
+                                       OperationPhase phase,
+                                       const QString& path,
+                                       int percent,
+                                       qint64 elapsed) const {
+  if (!handler_) {
+    return;
+  }
+  OperationProgress progress;
+  progress.index = index;
+  progress.total = total_;
+  progress.phase = phase;
+  progress.path = path;
+  progress.percent = percent;
+  progress.elapsed = elapsed;
+  progress.overall = this->overall();
+  handler_(progress);
+}
+
 QDebug& operator<<(QDebug& debug, const OperationType& op_type) {
   QString type;
   switch (op_type) {
@@ -78,43 +240,21 @@ Operation::Operation(OperationType type,
 Operation::~Operation() {
 }
 
-bool Operation::applyToDisk() {
+bool Operation::applyToTable(DiskTransaction& transaction) {
   switch (type) {
     case OperationType::Create: {
-      // Filters filesystem type.
       if (new_partition->fs == FsType::Unknown) {
         qCritical() << "OperationCreate unknown fs" << new_partition;
         return false;
       }
-
-      // Create new partition in disk partition table.
-      if (!CreatePartition(new_partition)) {
+      // Partition number and path are updated too.
+      if (!transaction.createPartition(new_partition)) {
         qCritical() << "CreatePartition() failed" << new_partition;
         return false;
       }
-
-      // Update partition number and path.
-      if (!UpdatePartitionNumber(new_partition)) {
-        qCritical() << "OperationCreate UpdatePartitionNumber() failed:"
-                    << new_partition;
-        return false;
-      }
-
-      if (!CommitUdevEvent(new_partition->path)) {
-        qCritical() << "No device found:" << new_partition->path;
-      }
-
-      // Ignores extended partition. And check filesystem type.
       if ((new_partition->type != PartitionType::Extended) &&
           (new_partition->fs != FsType::Empty)) {
-        // Create new filesystem on new_partition.
-        if (!Mkfs(new_partition)) {
-          qCritical() << "OperationCreate Mkfs() failed:" << new_partition;
-          return false;
-        }
-
-        // Set flags on new_partition.
-        if (!SetPartitionFlags(new_partition)) {
+        if (!transaction.setPartitionFlags(new_partition)) {
           qCritical() << "OperationCreate SetPartitionFlags() failed:"
                       << new_partition;
           return false;
@@ -124,51 +264,35 @@ bool Operation::applyToDisk() {
     }
 
     case OperationType::Delete: {
-      // Delete partition from disk partition table.
-      if (!DeletePartition(orig_partition)) {
+      if (!transaction.deletePartition(orig_partition)) {
         qCritical() << "DeletePartition() failed:" << orig_partition;
         return false;
-      } else {
-        return true;
       }
+      return true;
     }
 
     case OperationType::Format: {
-      // Filters filesystem type.
       if (new_partition->fs == FsType::Unknown) {
         qCritical() << "OperationFormat unknown fs" << new_partition;
         return false;
       }
-
-      // Update filesystem type in partition table.
-      if (!SetPartitionType(new_partition)) {
+      if (!transaction.setPartitionType(new_partition)) {
         qCritical() << "OperationFormat SetPartitionType() failed:"
                     << new_partition;
         return false;
       }
-
-      // Update partition number and path.
-      if (!UpdatePartitionNumber(new_partition)) {
+      if (!transaction.updatePartitionNumber(new_partition)) {
         qCritical() << "OperationFormat UpdatePartitionNumber() failed:"
                     << new_partition;
         return false;
       }
-
       if (new_partition->fs != FsType::Empty) {
-        // Create new filesystem.
-        if (!Mkfs(new_partition)) {
-          qCritical() << "OperationFormat Mkfs() failed:" << new_partition;
-          return false;
-        }
-
-        // Set flags of new_partition.
-        if (!SetPartitionFlags(new_partition)) {
+        if (!transaction.setPartitionFlags(new_partition)) {
           qCritical() << "OperationFormat SetPartitionFlags() failed:"
                       << new_partition;
           return false;
         }
       }
-
       return true;
     }
 
@@ -178,32 +302,27 @@ bool Operation::applyToDisk() {
     }
 
     case OperationType::MountPoint: {
-      // Update flags of new_partition.
-      if (!SetPartitionFlags(new_partition)) {
+      if (!transaction.setPartitionFlags(new_partition)) {
         qCritical() << "SetPartitionFlags() failed:" << new_partition;
         return false;
-      } else {
-        return true;
       }
+      return true;
     }
 
     case OperationType::NewPartTable: {
-      if (!CreatePartitionTable(device->path, device->table)) {
+      if (!transaction.createPartitionTable(device->table)) {
         qCritical() << "CreatePartitionTable() failed:" << device.data();
         return false;
-      } else {
-        return true;
       }
+      return true;
     }
 
     case OperationType::Resize: {
-      // Resize extended partition.
-      if (!ResizeMovePartition(new_partition)) {
+      if (!transaction.resizeMovePartition(new_partition)) {
         qCritical() << "ResizeMovePartition() failed:" << new_partition;
         return false;
-      } else {
-        return true;
       }
+      return true;
     }
 
     default: {
@@ -213,6 +332,21 @@ bool Operation::applyToDisk() {
   }
 }
 
+bool Operation::needsFormat() const {
+  return ((type == OperationType::Create) ||
+          (type == OperationType::Format)) &&
+         (new_partition->type != PartitionType::Extended) &&
+         (new_partition->fs != FsType::Empty);
+}
+
+QString Operation::devicePath() const {
+  if (type == OperationType::NewPartTable) {
+    return device->path;
+  } else {
+    return orig_partition->device_path;
+  }
+}
+
 void Operation::applyToVisual(const Device::Ptr device) const {
   PartitionList& partitions = device->partitions;
   switch (type) {
@@ -412,6 +546,40 @@ void Operation::substitute(PartitionList& partitions) const {
   }
 }
 
+QDebug& operator<<(QDebug& debug, const OperationPhase& phase) {
+  switch (phase) {
+    case OperationPhase::Discard: {
+      debug << "Discard";
+      break;
+    }
+    case OperationPhase::Commit: {
+      debug << "Commit";
+      break;
+    }
+    case OperationPhase::Settle: {
+      debug << "Settle";
+      break;
+    }
+    case OperationPhase::Mkfs: {
+      debug << "Mkfs";
+      break;
+    }
+  }
+  return debug;
+}
+
+QDebug& operator<<(QDebug& debug, const OperationProgress& progress) {
+  debug << "OperationProgress: {"
+        << "index:" << progress.index << "/" << progress.total
+        << "phase:" << progress.phase
+        << "path:" << progress.path
+        << "percent:" << progress.percent
+        << "elapsed:" << progress.elapsed
+        << "overall:" << progress.overall
+        << "}";
+  return debug;
+}
+
 QDebug& operator<<(QDebug& debug, const Operation& operation) {
     debug << "Operation: {" << endl
     << "    type: " << operation.type << endl
@@ -421,6 +589,278 @@ QDebug& operator<<(QDebug& debug, const Operation& operation) {
     return debug;
 }
 
+bool ApplyOperations(OperationList& operations,
+                     const FormatOptions& format_options,
+                     const OperationProgressHandler& progress) {
+  ResetCommitStats();
+  ResetMkfsRecords();
+  QElapsedTimer timer;
+  timer.start();
+
+  // Deleted partition may be formatted in advanced mode first, and its
+  // partition number may be taken by another new partition.
+  const QSet<int> overridden = FindOverriddenOperations(operations);
+  for (int index : overridden) {
+    qWarning() << "ApplyOperations() skip overridden operation:"
+               << operations.at(index);
+  }
+
+  // Group operations by device, keeping their order.
+  QStringList device_paths;
+  // Index of the last operation on each device.
+  QList<int> last_indexes;
+  int settle_steps = 0;
+  int mkfs_jobs = 0;
+  for (int index = 0; index < operations.length(); ++index) {
+    const Operation& operation = operations.at(index);
+    const int device_index = device_paths.indexOf(operation.devicePath());
+    if (device_index == -1) {
+      device_paths.append(operation.devicePath());
+      last_indexes.append(index);
+    } else {
+      last_indexes[device_index] = index;
+    }
+    if (operation.type == OperationType::Create &&
+        !overridden.contains(index)) {
+      settle_steps ++;
+    }
+    if (operation.needsFormat() && !overridden.contains(index)) {
+      mkfs_jobs ++;
+    }
+  }
+
+  // All data on these devices is dropped, so discard them once here instead of
+  // letting each mkfs discard its own partition.
+  QList<int> discard_indexes;
+  for (int index = 0; index < operations.length(); ++index) {
+    const Operation& operation = operations.at(index);
+    if (operation.type == OperationType::NewPartTable) {
+      const DeviceQueueInfo info = GetDeviceQueueInfo(operation.device->path);
+      if (info.discard &&
+          ResolveFormatProfile(format_options.profile, info) ==
+              FormatProfile::Fast) {
+        discard_indexes.append(index);
+      }
+    }
+  }
+
+  OperationProgressReporter reporter(progress, operations.length(),
+                                     discard_indexes.length() +
+                                     device_paths.length() + settle_steps,
+                                     mkfs_jobs);
+
+  for (int index : discard_indexes) {
+    const QString& device_path = operations.at(index).device->path;
+    reporter.startStep(index, OperationPhase::Discard, device_path);
+    DiscardDevice(device_path);
+    reporter.finishStep(index, OperationPhase::Discard, device_path);
+  }
+
+  for (int device_index = 0; device_index < device_paths.length();
+       ++device_index) {
+    const QString& device_path = device_paths.at(device_index);
+    const int last_index = last_indexes.at(device_index);
+    reporter.startStep(last_index, OperationPhase::Commit, device_path);
+    DiskTransaction transaction(device_path);
+    if (!transaction.isValid()) {
+      qCritical() << "ApplyOperations() failed to open device:"
+                  << device_path;
+      return false;
+    }
+    for (int index = 0; index < operations.length(); ++index) {
+      Operation& operation = operations[index];
+      if (operation.devicePath() != device_path) {
+        continue;
+      }
+      // Partition of overridden Create is still added, so that it can be
+      // deleted later.
+      if (overridden.contains(index) &&
+          operation.type != OperationType::Create) {
+        continue;
+      }
+      if (!operation.applyToTable(transaction)) {
+        return false;
+      }
+    }
+    // Make sure that partitions to format are still in partition table, and
+    // each of them is formatted once, before anything is written to disk.
+    // Logical partitions are renumbered when an earlier one is deleted.
+    QStringList format_paths;
+    for (int index = 0; index < operations.length(); ++index) {
+      const Operation& operation = operations.at(index);
+      if (operation.devicePath() != device_path ||
+          !operation.needsFormat() || overridden.contains(index)) {
+        continue;
+      }
+      if (!transaction.updatePartitionNumber(operation.new_partition) ||
+          !transaction.hasPartition(operation.new_partition)) {
+        qCritical() << "ApplyOperations() partition to format not found:"
+                    << operation.new_partition;
+        return false;
+      }
+      const QString& path = operation.new_partition->path;
+      if (format_paths.contains(path)) {
+        qCritical() << "ApplyOperations() partition is formatted twice:"
+                    << path;
+        return false;
+      }
+      format_paths.append(path);
+    }
+    if (!transaction.commit()) {
+      return false;
+    }
+    reporter.finishStep(last_index, OperationPhase::Commit, device_path);
+  }
+
+  // Partitions are created by kernel after commit().
+  for (int index = 0; index < operations.length(); ++index) {
+    const Operation& operation = operations.at(index);
+    if (operation.type == OperationType::Create &&
+        !overridden.contains(index)) {
+      const QString& path = operation.new_partition->path;
+      reporter.startStep(index, OperationPhase::Settle, path);
+      if (!WaitForDevicePath(path)) {
+        qCritical() << "No device found:" << path;
+        return false;
+      }
+      reporter.finishStep(index, OperationPhase::Settle, path);
+    }
+  }
+
+  const CommitStats stats = GetCommitStats();
+  qDebug() << "ApplyOperations() operations:" << operations.length()
+           << "devices:" << device_paths.length()
+           << "commits:" << stats.commits
+           << "settle ms:" << stats.settle_time
+           << "table ms:" << timer.elapsed();
+
+  // Partition paths are final now.
+  PartitionList partitions;
+  QList<int> mkfs_indexes;
+  for (int index = 0; index < operations.length(); ++index) {
+    const Operation& operation = operations.at(index);
+    if (!operation.needsFormat() || overridden.contains(index)) {
+      continue;
+    }
+    partitions.append(operation.new_partition);
+    mkfs_indexes.append(index);
+  }
+  timer.restart();
+  const bool ok = MkfsParallel(partitions, format_options,
+                               [&](int job, int percent) {
+    reporter.updateMkfs(job, mkfs_indexes.at(job), partitions.at(job)->path,
+                        percent);
+  });
+  qDebug() << "ApplyOperations() formatted" << partitions.length()
+           << "partitions, jobs per device:" << format_options.jobs_per_device
+           << "profile:" << format_options.profile
+           << "format ms:" << timer.elapsed();
+  return ok;
+}
+
+OperationList OptimizeOperations(const OperationList& operations) {
+  OperationList plan;
+  // Partition key of each operation in |plan|.
+  QStringList keys;
+  QList<bool> dropped;
+  // Partition key => index of the last operation on it in |plan|.
+  QHash<QString, int> last_ops;
+  // Partition key => index of Create operation in |plan|.
+  QHash<QString, int> created;
+
+  for (const Operation& operation : operations) {
+    if (operation.type == OperationType::NewPartTable) {
+      // All partitions on this device are removed.
+      const QString prefix = operation.device->path + ":";
+      for (const QString& key : last_ops.keys()) {
+        if (key.startsWith(prefix)) {
+          last_ops.remove(key);
+          created.remove(key);
+        }
+      }
+      plan.append(operation);
+      keys.append(QString());
+      dropped.append(false);
+      continue;
+    }
+
+    if (operation.type == OperationType::Delete) {
+      const QString key = PartitionKey(operation.orig_partition);
+      last_ops.remove(key);
+      if (created.contains(key)) {
+        // Partition is created in this plan, drop all operations on it.
+        for (int i = created.take(key); i < plan.length(); ++i) {
+          if (keys.at(i) == key) {
+            dropped[i] = true;
+          }
+        }
+        continue;
+      }
+      // Existing partition may be formatted or mounted before it is deleted,
+      // drop these operations.
+      for (int i = 0; i < plan.length(); ++i) {
+        if (keys.at(i) == key &&
+            (plan.at(i).type == OperationType::Format ||
+             plan.at(i).type == OperationType::MountPoint)) {
+          dropped[i] = true;
+        }
+      }
+      plan.append(operation);
+      keys.append(key);
+      dropped.append(false);
+      continue;
+    }
+
+    if (operation.type == OperationType::Format ||
+        operation.type == OperationType::MountPoint) {
+      const QString key = PartitionKey(operation.new_partition);
+      const int index = last_ops.value(key, -1);
+      if (index != -1 && CanSetFlags(plan.at(index))) {
+        const OperationType earlier_type = plan.at(index).type;
+        bool can_fold;
+        if (operation.type == OperationType::Format) {
+          // Keep the last mkfs only if it really runs.
+          can_fold = (earlier_type != OperationType::MountPoint) &&
+                     (operation.new_partition->fs != FsType::Empty);
+        } else {
+          can_fold = true;
+        }
+        if (can_fold) {
+          FoldOperation(plan[index], operation);
+          continue;
+        }
+      }
+    }
+
+    plan.append(operation);
+    dropped.append(false);
+    if (operation.type == OperationType::Resize ||
+        operation.type == OperationType::Invalid) {
+      keys.append(QString());
+      continue;
+    }
+    const QString key = PartitionKey(operation.new_partition);
+    keys.append(key);
+    last_ops.insert(key, plan.length() - 1);
+    if (operation.type == OperationType::Create) {
+      created.insert(key, plan.length() - 1);
+    }
+  }
+
+  OperationList result;
+  for (int i = 0; i < plan.length(); ++i) {
+    if (!dropped.at(i)) {
+      result.append(plan.at(i));
+    }
+  }
+
+  qDebug() << "OptimizeOperations() plan:" << operations.length()
+           << "operations, optimized plan:" << result.length() << "operations";
+  qDebug() << "plan:" << operations;
+  qDebug() << "optimized plan:" << result;
+  return result;
+}
+
 void MergeOperations(OperationList& operations, const Operation& operation) {
   Q_UNUSED(operations);
   Q_UNUSED(operation);
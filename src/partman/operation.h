@@ -18,13 +18,20 @@
 #ifndef INSTALLER_PARTMAN_OPERATION_H
 #define INSTALLER_PARTMAN_OPERATION_H
 
+#include <functional>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QList>
+#include <QMutex>
+#include <QVector>
 
 #include "partman/device.h"
 
 namespace installer {
 
+class DiskTransaction;
+struct FormatOptions;
+
 enum class OperationType {
   Create,
   Delete,
@@ -58,9 +65,16 @@ class Operation {
   Partition::Ptr orig_partition;
   Partition::Ptr new_partition;
 
-  // Apply changes to disk. Returns operation status.
-  // Note that this method shall be called in the background thread.
-  bool applyToDisk();
+  // Apply partition table part of this operation to |transaction|, without
+  // writing to disk. Partition number and path of |new_partition| are updated.
+  bool applyToTable(DiskTransaction& transaction);
+
+  // Returns true if filesystem of |new_partition| shall be created after
+  // partition table is committed.
+  bool needsFormat() const;
+
+  // Path of device touched by this operation.
+  QString devicePath() const;
 
   // Apply operation by updating device properties.
   void applyToVisual(const Device::Ptr device) const;
@@ -84,9 +98,107 @@ QDebug& operator<<(QDebug& debug, const Operation& operation);
 
 typedef QList<Operation> OperationList;
 
+// Steps of ApplyOperations().
+enum class OperationPhase {
+  Discard,  // Discard device which gets a new partition table.
+  Commit,  // Write partition table of device, flags are written too.
+  Settle,  // Wait for kernel to create device file of new partition.
+  Mkfs,  // Create filesystem on partition.
+};
+QDebug& operator<<(QDebug& debug, const OperationPhase& phase);
+
+// Progress of one step in ApplyOperations().
+struct OperationProgress {
+  // Index of operation in operation list, and length of that list.
+  int index = -1;
+  int total = 0;
+  OperationPhase phase = OperationPhase::Commit;
+  // Device path or partition path of this step.
+  QString path;
+  // Percentage of this step.
+  int percent = 0;
+  // Time used by this step, in milliseconds.
+  qint64 elapsed = 0;
+  // Percentage of all steps.
+  int overall = 0;
+};
+QDebug& operator<<(QDebug& debug, const OperationProgress& progress);
+
+typedef std::function<void(const OperationProgress& progress)>
+    OperationProgressHandler;
+
+// Tracks steps of ApplyOperations() and passes their progress to handler.
+// Steps before mkfs are counted one by one, mkfs jobs by their percentage.
+// Its methods may be called from multiple threads.
+class OperationProgressReporter {
+ public:
+  // |total| is length of operation list, |table_steps| is number of steps
+  // before mkfs and |mkfs_jobs| is number of partitions to format.
+  OperationProgressReporter(const OperationProgressHandler& handler,
+                            int total,
+                            int table_steps,
+                            int mkfs_jobs);
+
+  void startStep(int index, OperationPhase phase, const QString& path);
+  void finishStep(int index, OperationPhase phase, const QString& path);
+
+  // Update |percent| of mkfs |job|, which formats partition at |path| for
+  // operation at |index|.
+  void updateMkfs(int job, int index, const QString& path, int percent);
+
+  // Returns percentage of all steps. Steps before mkfs take 20% if there
+  // are partitions to format.
+  int overall() const;
+
+ private:
+  void report(int index, OperationPhase phase, const QString& path,
+              int percent, qint64 elapsed) const;
+
+  OperationProgressHandler handler_;
+  const int total_;
+  const int table_steps_;
+  int done_steps_;
+  qint64 step_start_;
+  QVector<int> mkfs_percents_;
+  QVector<qint64> mkfs_starts_;
+  QElapsedTimer timer_;
+  QMutex mutex_;
+};
+
+// Apply |operations| to disk. Partition table changes of each device are
+// written with one commit, then filesystems are created with
+// |format_options|, see MkfsParallel().
+// Devices which get a new partition table are discarded first if the Fast
+// profile is used on them.
+// Format and MountPoint operations on partitions which are deleted later,
+// or on devices which get a new partition table later, are skipped, and
+// so is mkfs of such Create operations.
+// Returns false without writing the partition table of a device if any
+// partition on it would be formatted twice.
+// |progress| is called when each step starts and finishes, and when mkfs
+// reports its percentage. It may be called in worker threads of
+// MkfsParallel(), but never at the same time.
+// Note that this method shall be called in the background thread.
+bool ApplyOperations(OperationList& operations,
+                     const FormatOptions& format_options,
+                     const OperationProgressHandler& progress = nullptr);
+
 // Merge |operation| in |operations|.
 void MergeOperations(OperationList& operations, const Operation& operation);
 
+// Returns a copy of |operations| with redundant edits removed, which results
+// in the same partition layout with fewer commits and mkfs runs:
+//  * Create and later Delete of the same partition are both dropped,
+//    together with operations on that partition between them;
+//  * Format and MountPoint of an existing partition are dropped if it is
+//    deleted later;
+//  * Format is folded into earlier Create or Format of the same partition,
+//    unless it is formatted to Empty, which keeps the earlier mkfs;
+//  * MountPoint is folded into earlier Create, Format or MountPoint of the
+//    same partition.
+// Flags are merged when folding, as they are only set, never cleared, on disk.
+OperationList OptimizeOperations(const OperationList& operations);
+
 // Merge unallocated partitions.
 void MergeUnallocatedPartitions(PartitionList& partitions);
 
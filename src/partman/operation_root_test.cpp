@@ -15,184 +15,266 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+// Apply operations to partition table of loop devices.
+
 #include "partman/operation.h"
 
+#include <QDir>
+
+#include "partman/loop_device_util.h"
+#include "partman/partition_format.h"
+#include "partman/partition_manager.h"
+#include "partman/structs.h"
 #include "third_party/googletest/include/gtest/gtest.h"
 
-namespace partman {
+namespace installer {
 namespace {
 
+const char kImageDir[] = "/tmp/deepin-installer-operation-test";
 const char kLongLabel[] = "LONG * Label with special chars";
 
-static Partition GetTestPartition() {
-  Partition partition;
-  partition.fs = FsType::Empty;
-  partition.sector_start = 2048;
-  partition.sector_end = 21256191;
-  partition.type = PartitionType::Primary;
-  partition.device_path = "/dev/sdc";
-  partition.path = "/dev/sdc1";
-  return partition;
+// Create a sparse image with |size| MiB and attach it to a loop device.
+// Returns path to loop device, or an empty string on error.
+QString AttachImage(const QString& name, qint64 size) {
+  return AttachLoopDevice(QDir(kImageDir).absoluteFilePath(name),
+                          size * kMebiByte);
 }
 
-TEST(OperationTest, ApplyToDiskDelete) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Ext4;
-  Operation format_operation(OperationType::Delete, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+Device::Ptr ScanDevice(const QString& device_path) {
+  const DeviceList devices = ScanDevices({device_path}, false);
+  return devices.isEmpty() ? Device::Ptr() : devices.first();
 }
 
-TEST(OperationTest, ApplyToDiskCreate) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Ext4;
-  Operation format_operation(OperationType::Create, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+// Returns partition of |device| which contains sector at |start| MiB.
+Partition::Ptr FindPartition(const Device::Ptr device, qint64 start) {
+  const qint64 sector = start * kMebiByte / device->sector_size;
+  for (const Partition::Ptr partition : device->partitions) {
+    if (partition->type != PartitionType::Unallocated &&
+        partition->start_sector <= sector &&
+        partition->end_sector >= sector) {
+      return partition;
+    }
+  }
+  return Partition::Ptr();
 }
 
-TEST(OperationTest, ApplyToDiskFormat) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Ext4;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+Operation NewTableOperation(const Device::Ptr device) {
+  Device::Ptr new_device(new Device(*device));
+  new_device->partitions.clear();
+  new_device->table = PartitionTableType::GPT;
+  return Operation(new_device);
 }
 
-TEST(OperationTest, FormatBtrfs) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Btrfs;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
-}
+// Create a partition in [|start|, |end|) MiB of |device|.
+Operation CreateOperation(const Device::Ptr device,
+                          qint64 start,
+                          qint64 end,
+                          FsType fs,
+                          const QString& label = QString()) {
+  const qint64 mebi_sectors = kMebiByte / device->sector_size;
+  Partition::Ptr unallocated(new Partition);
+  unallocated->device_path = device->path;
+  unallocated->sector_size = device->sector_size;
+  unallocated->type = PartitionType::Unallocated;
+  unallocated->start_sector = start * mebi_sectors;
+  unallocated->end_sector = end * mebi_sectors - 1;
 
-TEST(OperationTest, FormatBtrfsWithLabel) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Btrfs;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+  Partition::Ptr new_partition(new Partition(*unallocated));
+  new_partition->status = PartitionStatus::New;
+  new_partition->type = PartitionType::Primary;
+  new_partition->fs = fs;
+  new_partition->label = label;
+  return Operation(OperationType::Create, unallocated, new_partition);
 }
 
-TEST(OperationTest, FormatExt2) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Ext2;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+Operation FormatOperation(const Partition::Ptr partition, FsType fs) {
+  Partition::Ptr new_partition(new Partition(*partition));
+  new_partition->fs = fs;
+  new_partition->label = kLongLabel;
+  new_partition->status = PartitionStatus::Format;
+  return Operation(OperationType::Format, partition, new_partition);
 }
 
-TEST(OperationTest, FormatExt2WithLabel) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Ext2;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+Operation DeleteOperation(const Partition::Ptr partition) {
+  Partition::Ptr new_partition(new Partition(*partition));
+  new_partition->type = PartitionType::Unallocated;
+  new_partition->fs = FsType::Empty;
+  new_partition->status = PartitionStatus::Delete;
+  return Operation(OperationType::Delete, partition, new_partition);
 }
 
-TEST(OperationTest, FormatExt4) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Ext4;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
-}
+class OperationRootTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(QDir().mkpath(kImageDir));
+    device_path_ = AttachImage("disk.img", 1024);
+    ASSERT_FALSE(device_path_.isEmpty());
+    device_ = ScanDevice(device_path_);
+    ASSERT_FALSE(device_.isNull());
+  }
 
-TEST(OperationTest, FormatExt4WithLabel) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Ext4;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
-}
+  void TearDown() override {
+    if (!device_path_.isEmpty()) {
+      DetachLoopDevice(device_path_);
+    }
+    QDir(kImageDir).removeRecursively();
+  }
 
-TEST(OperationTest, FormatFat16) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Fat16;
-  Operation format_operation(OperationType::Format, partition, partition);
-  // Maximum filesystem size supported by fat16 is 4Gib, so mkfs.msdos
-  // always returns false.
-  EXPECT_FALSE(format_operation.applyToDisk());
-}
+  QString device_path_;
+  Device::Ptr device_;
+};
 
-TEST(OperationTest, FormatFat16WithLabel) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Fat16;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_FALSE(format_operation.applyToDisk());
-}
+TEST_F(OperationRootTest, CreateAndFormat) {
+  const FsType kFsTypes[] = {
+    FsType::Btrfs, FsType::Ext2, FsType::Ext4, FsType::Fat16, FsType::Fat32,
+    FsType::Jfs, FsType::LinuxSwap, FsType::NTFS, FsType::Xfs,
+  };
 
-TEST(OperationTest, FormatFat32) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Fat32;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
-}
+  // Partitions are created with labels and formatted in one run.
+  OperationList operations = {NewTableOperation(device_)};
+  qint64 start = 1;
+  for (FsType fs : kFsTypes) {
+    operations.append(CreateOperation(device_, start, start + 100, fs,
+                                      kLongLabel));
+    start += 100;
+  }
+  FormatOptions format_options;
+  format_options.jobs_per_device = 2;
+  ASSERT_TRUE(ApplyOperations(operations, format_options));
+  EXPECT_EQ(GetMkfsRecords().length(), int(sizeof(kFsTypes) /
+                                           sizeof(kFsTypes[0])));
 
-TEST(OperationTest, FormatFat32WithLabel) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Fat32;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
-}
+  Device::Ptr device = ScanDevice(device_path_);
+  ASSERT_FALSE(device.isNull());
+  start = 1;
+  for (FsType fs : kFsTypes) {
+    const Partition::Ptr partition = FindPartition(device, start);
+    ASSERT_FALSE(partition.isNull());
+    EXPECT_EQ(partition->fs, fs);
+    start += 100;
+  }
 
-TEST(OperationTest, FormatJfs) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Jfs;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+  // Each partition is formatted with another filesystem.
+  operations.clear();
+  start = 1;
+  for (int index = 0; index < int(sizeof(kFsTypes) / sizeof(kFsTypes[0]));
+       ++index) {
+    const FsType fs = kFsTypes[(index + 1) % (sizeof(kFsTypes) /
+                                              sizeof(kFsTypes[0]))];
+    operations.append(FormatOperation(FindPartition(device, start), fs));
+    start += 100;
+  }
+  ASSERT_TRUE(ApplyOperations(operations, format_options));
+  device = ScanDevice(device_path_);
+  ASSERT_FALSE(device.isNull());
+  for (const Operation& operation : operations) {
+    const Partition::Ptr partition = FindPartition(
+        device, operation.new_partition->start_sector *
+                device->sector_size / kMebiByte);
+    ASSERT_FALSE(partition.isNull());
+    EXPECT_EQ(partition->fs, operation.new_partition->fs);
+  }
 }
 
-TEST(OperationTest, FormatJfsWithLabel) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Jfs;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
-}
+TEST_F(OperationRootTest, DeleteFormattedPartition) {
+  OperationList operations = {
+    NewTableOperation(device_),
+    CreateOperation(device_, 1, 101, FsType::Ext4),
+    CreateOperation(device_, 101, 201, FsType::Ext4),
+  };
+  FormatOptions format_options;
+  format_options.jobs_per_device = 2;
+  ASSERT_TRUE(ApplyOperations(operations, format_options));
+  Device::Ptr device = ScanDevice(device_path_);
+  ASSERT_FALSE(device.isNull());
+  const Partition::Ptr second = FindPartition(device, 101);
+  ASSERT_FALSE(second.isNull());
+  const QString second_path = second->path;
 
-TEST(OperationTest, FormatLinuxSwap) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::LinuxSwap;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
-}
+  // Second partition is formatted, then deleted, and its number is taken
+  // by a new partition. Only the new one is formatted.
+  operations = {
+    FormatOperation(second, FsType::Xfs),
+    DeleteOperation(second),
+    CreateOperation(device, 301, 401, FsType::Btrfs),
+  };
+  ASSERT_TRUE(ApplyOperations(operations, format_options));
+  const QList<MkfsRecord> records = GetMkfsRecords();
+  ASSERT_EQ(records.length(), 1);
+  EXPECT_EQ(records.first().path, second_path);
+  EXPECT_EQ(records.first().fs, FsType::Btrfs);
 
-TEST(OperationTest, FormatLinuxSwapWithLabel) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::LinuxSwap;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+  device = ScanDevice(device_path_);
+  ASSERT_FALSE(device.isNull());
+  EXPECT_TRUE(FindPartition(device, 101).isNull());
+  const Partition::Ptr third = FindPartition(device, 301);
+  ASSERT_FALSE(third.isNull());
+  EXPECT_EQ(third->path, second_path);
+  EXPECT_EQ(third->fs, FsType::Btrfs);
 }
 
-TEST(OperationTest, FormatNTFS) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::NTFS;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
-}
+TEST_F(OperationRootTest, CreateAndDeletePartition) {
+  OperationList operations = {NewTableOperation(device_)};
+  operations.append(CreateOperation(device_, 1, 101, FsType::Ext4));
+  const Partition::Ptr partition = operations.last().new_partition;
+  operations.append(DeleteOperation(partition));
+  ASSERT_TRUE(ApplyOperations(operations, FormatOptions()));
+  EXPECT_TRUE(GetMkfsRecords().isEmpty());
 
-TEST(OperationTest, FormatNTFSWithLabel) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::NTFS;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+  const Device::Ptr device = ScanDevice(device_path_);
+  ASSERT_FALSE(device.isNull());
+  EXPECT_TRUE(FindPartition(device, 1).isNull());
 }
 
-TEST(OperationTest, FormatXfs) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Xfs;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
-}
+TEST_F(OperationRootTest, ProgressOrder) {
+  OperationList operations = {
+    NewTableOperation(device_),
+    CreateOperation(device_, 1, 101, FsType::Ext4),
+    CreateOperation(device_, 101, 201, FsType::Xfs),
+  };
+  QList<OperationProgress> progresses;
+  FormatOptions format_options;
+  format_options.jobs_per_device = 2;
+  // Handler is never called at the same time by mkfs jobs.
+  ASSERT_TRUE(ApplyOperations(operations, format_options,
+                              [&](const OperationProgress& progress) {
+    progresses.append(progress);
+  }));
+  ASSERT_FALSE(progresses.isEmpty());
 
-TEST(OperationTest, FormatXfsWithLabel) {
-  Partition partition = GetTestPartition();
-  partition.fs = FsType::Xfs;
-  partition.label = kLongLabel;
-  Operation format_operation(OperationType::Format, partition, partition);
-  EXPECT_TRUE(format_operation.applyToDisk());
+  // Device is discarded first if it is, then partition table is written
+  // once, then new partitions are settled, and mkfs runs at last.
+  int phase_index = 0;
+  const OperationPhase kPhases[] = {
+    OperationPhase::Discard, OperationPhase::Commit, OperationPhase::Settle,
+    OperationPhase::Mkfs,
+  };
+  int commits = 0;
+  int overall = 0;
+  for (const OperationProgress& progress : progresses) {
+    while (phase_index < 4 && kPhases[phase_index] != progress.phase) {
+      phase_index ++;
+    }
+    ASSERT_LT(phase_index, 4);
+    EXPECT_EQ(progress.total, operations.length());
+    EXPECT_GE(progress.overall, overall);
+    overall = progress.overall;
+    if (progress.phase == OperationPhase::Commit) {
+      EXPECT_EQ(progress.path, device_path_);
+      if (progress.percent == 100) {
+        commits ++;
+      }
+    } else if (progress.phase == OperationPhase::Settle ||
+               progress.phase == OperationPhase::Mkfs) {
+      EXPECT_GE(progress.index, 1);
+      EXPECT_EQ(progress.path,
+                operations.at(progress.index).new_partition->path);
+    }
+  }
+  EXPECT_EQ(commits, 1);
+  EXPECT_EQ(progresses.last().phase, OperationPhase::Mkfs);
+  EXPECT_EQ(progresses.last().overall, 100);
 }
 
 }  // namespace
-}  // namespace partman
\ No newline at end of file
+}  // namespace installer
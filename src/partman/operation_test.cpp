@@ -22,6 +22,65 @@
 namespace installer {
 namespace {
 
+const char kTestDevicePath[] = "/dev/sda";
+
+Partition::Ptr NewPartition(PartitionType type, FsType fs,
+                            qint64 start_sector, qint64 end_sector) {
+  Partition::Ptr partition(new Partition);
+  partition->device_path = kTestDevicePath;
+  partition->sector_size = 512;
+  partition->type = type;
+  partition->fs = fs;
+  partition->start_sector = start_sector;
+  partition->end_sector = end_sector;
+  return partition;
+}
+
+// Copy |partition| with another |fs|, |label| and |mount_point|.
+Partition::Ptr EditPartition(const Partition::Ptr partition, FsType fs,
+                             const QString& label,
+                             const QString& mount_point) {
+  Partition::Ptr new_partition(new Partition(*partition));
+  new_partition->fs = fs;
+  new_partition->label = label;
+  new_partition->mount_point = mount_point;
+  return new_partition;
+}
+
+// Device with an unallocated area and three ext4 partitions.
+Device::Ptr NewTestDevice() {
+  Device::Ptr device(new Device);
+  device->path = kTestDevicePath;
+  device->sector_size = 512;
+  device->length = 3000000;
+  device->table = PartitionTableType::GPT;
+  device->partitions.append(
+      NewPartition(PartitionType::Unallocated, FsType::Empty, 2048, 1000000));
+  Partition::Ptr home = NewPartition(PartitionType::Normal, FsType::Ext4,
+                                     1000001, 2000000);
+  home->path = "/dev/sda1";
+  device->partitions.append(home);
+  Partition::Ptr srv = NewPartition(PartitionType::Normal, FsType::Ext4,
+                                    2000001, 2500000);
+  srv->path = "/dev/sda2";
+  device->partitions.append(srv);
+  Partition::Ptr spare = NewPartition(PartitionType::Normal, FsType::Ext4,
+                                      2500001, 2900000);
+  spare->path = "/dev/sda3";
+  device->partitions.append(spare);
+  return device;
+}
+
+// Apply |operations| to a new test device and returns its partitions.
+PartitionList ApplyToTestDevice(const OperationList& operations) {
+  Device::Ptr device = NewTestDevice();
+  for (const Operation& operation : operations) {
+    operation.applyToVisual(device);
+  }
+  MergeUnallocatedPartitions(device->partitions);
+  return device->partitions;
+}
+
 TEST(Operation, MergeUnallocatedPartitions) {
   PartitionList partitions;
   {
@@ -69,5 +128,151 @@ TEST(Operation, MergeUnallocatedPartitions) {
   EXPECT_EQ(partitions.length(), 3);
 }
 
+TEST(Operation, OptimizeOperations) {
+  const Device::Ptr device = NewTestDevice();
+  const Partition::Ptr unallocated = device->partitions.at(0);
+  const Partition::Ptr home = device->partitions.at(1);
+  const Partition::Ptr srv = device->partitions.at(2);
+  const Partition::Ptr spare = device->partitions.at(3);
+  OperationList operations;
+
+  // Create root partition, format it again and set its mount point.
+  const Partition::Ptr root = NewPartition(PartitionType::Normal, FsType::Ext4,
+                                           2048, 200000);
+  operations.append(Operation(OperationType::Create, unallocated, root));
+  const Partition::Ptr root_xfs = EditPartition(root, FsType::Xfs, "Root", "");
+  operations.append(Operation(OperationType::Format, root, root_xfs));
+  const Partition::Ptr root_mount =
+      EditPartition(root_xfs, FsType::Xfs, "Root", "/");
+  root_mount->flags.append(PartitionFlag::Boot);
+  operations.append(Operation(OperationType::MountPoint, root_xfs,
+                              root_mount));
+
+  // Create a partition and delete it.
+  const Partition::Ptr rest = NewPartition(PartitionType::Unallocated,
+                                           FsType::Empty, 200001, 1000000);
+  const Partition::Ptr tmp = NewPartition(PartitionType::Normal, FsType::Ext4,
+                                          200001, 400000);
+  operations.append(Operation(OperationType::Create, rest, tmp));
+  const Partition::Ptr tmp_mount = EditPartition(tmp, FsType::Ext4, "", "/tmp");
+  operations.append(Operation(OperationType::MountPoint, tmp, tmp_mount));
+  const Partition::Ptr tmp_deleted = NewPartition(PartitionType::Unallocated,
+                                                  FsType::Empty,
+                                                  200001, 400000);
+  operations.append(Operation(OperationType::Delete, tmp_mount, tmp_deleted));
+
+  // Format existing partition twice, and change its mount point twice.
+  const Partition::Ptr home_btrfs =
+      EditPartition(home, FsType::Btrfs, "Home", "/home");
+  operations.append(Operation(OperationType::Format, home, home_btrfs));
+  const Partition::Ptr home_ext4 =
+      EditPartition(home, FsType::Ext4, "Data", "/home");
+  operations.append(Operation(OperationType::Format, home_btrfs, home_ext4));
+  const Partition::Ptr home_data =
+      EditPartition(home_ext4, FsType::Ext4, "Data", "/data");
+  operations.append(Operation(OperationType::MountPoint, home_ext4,
+                              home_data));
+
+  // Format existing partition, set its mount point and delete it.
+  const Partition::Ptr srv_xfs = EditPartition(srv, FsType::Xfs, "Srv", "");
+  operations.append(Operation(OperationType::Format, srv, srv_xfs));
+  const Partition::Ptr srv_mount =
+      EditPartition(srv_xfs, FsType::Xfs, "Srv", "/srv");
+  operations.append(Operation(OperationType::MountPoint, srv_xfs,
+                              srv_mount));
+  const Partition::Ptr srv_deleted = NewPartition(PartitionType::Unallocated,
+                                                  FsType::Empty,
+                                                  2000001, 2500000);
+  operations.append(Operation(OperationType::Delete, srv_mount, srv_deleted));
+
+  // Format existing partition, then format it to Empty. mkfs of the first
+  // one is kept, as Format to Empty does not run mkfs.
+  const Partition::Ptr spare_btrfs =
+      EditPartition(spare, FsType::Btrfs, "Spare", "");
+  operations.append(Operation(OperationType::Format, spare, spare_btrfs));
+  const Partition::Ptr spare_empty =
+      EditPartition(spare_btrfs, FsType::Empty, "", "");
+  operations.append(Operation(OperationType::Format, spare_btrfs,
+                              spare_empty));
+
+  const OperationList optimized = OptimizeOperations(operations);
+  ASSERT_EQ(optimized.length(), 5);
+  EXPECT_EQ(optimized.at(0).type, OperationType::Create);
+  EXPECT_EQ(optimized.at(0).new_partition->fs, FsType::Xfs);
+  EXPECT_EQ(optimized.at(0).new_partition->mount_point, "/");
+  EXPECT_TRUE(optimized.at(0).new_partition->flags.contains(
+      PartitionFlag::Boot));
+  EXPECT_EQ(optimized.at(1).type, OperationType::Format);
+  EXPECT_EQ(optimized.at(1).new_partition->fs, FsType::Ext4);
+  EXPECT_EQ(optimized.at(1).new_partition->mount_point, "/data");
+  EXPECT_EQ(optimized.at(2).type, OperationType::Delete);
+  EXPECT_EQ(optimized.at(2).orig_partition->start_sector, 2000001);
+  EXPECT_EQ(optimized.at(3).type, OperationType::Format);
+  EXPECT_EQ(optimized.at(3).new_partition->fs, FsType::Btrfs);
+  EXPECT_EQ(optimized.at(4).type, OperationType::Format);
+  EXPECT_EQ(optimized.at(4).new_partition->fs, FsType::Empty);
+
+  // Partitions in original operation list are not changed.
+  EXPECT_EQ(root->fs, FsType::Ext4);
+  EXPECT_TRUE(root->mount_point.isEmpty());
+
+  // Both give the same layout.
+  const PartitionList expected = ApplyToTestDevice(operations);
+  const PartitionList actual = ApplyToTestDevice(optimized);
+  ASSERT_EQ(actual.length(), expected.length());
+  for (int i = 0; i < expected.length(); ++i) {
+    EXPECT_EQ(actual.at(i)->type, expected.at(i)->type);
+    EXPECT_EQ(actual.at(i)->start_sector, expected.at(i)->start_sector);
+    EXPECT_EQ(actual.at(i)->end_sector, expected.at(i)->end_sector);
+    EXPECT_EQ(actual.at(i)->fs, expected.at(i)->fs);
+    EXPECT_EQ(actual.at(i)->label, expected.at(i)->label);
+    EXPECT_EQ(actual.at(i)->mount_point, expected.at(i)->mount_point);
+    EXPECT_EQ(actual.at(i)->flags, expected.at(i)->flags);
+  }
+}
+
+TEST(Operation, OperationProgressReporter) {
+  // Without partitions to format, steps before mkfs take all the progress.
+  OperationProgressReporter table_reporter(nullptr, 2, 4, 0);
+  EXPECT_EQ(table_reporter.overall(), 0);
+  table_reporter.startStep(0, OperationPhase::Commit, kTestDevicePath);
+  EXPECT_EQ(table_reporter.overall(), 0);
+  table_reporter.finishStep(0, OperationPhase::Commit, kTestDevicePath);
+  EXPECT_EQ(table_reporter.overall(), 25);
+  EXPECT_EQ(OperationProgressReporter(nullptr, 0, 0, 0).overall(), 100);
+
+  // Steps before mkfs take 20%, mkfs jobs share the rest.
+  QList<OperationProgress> progresses;
+  OperationProgressReporter reporter(
+      [&](const OperationProgress& progress) {
+        progresses.append(progress);
+      }, 3, 2, 2);
+  reporter.finishStep(0, OperationPhase::Commit, kTestDevicePath);
+  EXPECT_EQ(reporter.overall(), 10);
+  reporter.finishStep(1, OperationPhase::Settle, "/dev/sda1");
+  EXPECT_EQ(reporter.overall(), 20);
+  reporter.updateMkfs(0, 1, "/dev/sda1", 50);
+  EXPECT_EQ(reporter.overall(), 40);
+  reporter.updateMkfs(1, 2, "/dev/sda2", 100);
+  EXPECT_EQ(reporter.overall(), 80);
+  reporter.updateMkfs(0, 1, "/dev/sda1", 100);
+  EXPECT_EQ(reporter.overall(), 100);
+
+  ASSERT_EQ(progresses.length(), 5);
+  EXPECT_EQ(progresses.at(0).phase, OperationPhase::Commit);
+  EXPECT_EQ(progresses.at(0).percent, 100);
+  EXPECT_EQ(progresses.at(0).total, 3);
+  EXPECT_EQ(progresses.at(3).phase, OperationPhase::Mkfs);
+  EXPECT_EQ(progresses.at(3).index, 2);
+  EXPECT_EQ(progresses.at(3).path, "/dev/sda2");
+  EXPECT_EQ(progresses.at(3).overall, 80);
+  EXPECT_EQ(progresses.last().overall, 100);
+
+  // Only mkfs jobs are counted if there are no steps before them.
+  OperationProgressReporter mkfs_reporter(nullptr, 1, 0, 1);
+  mkfs_reporter.updateMkfs(0, 0, "/dev/sda1", 30);
+  EXPECT_EQ(mkfs_reporter.overall(), 30);
+}
+
 }  // namespace
 }  // namespace installer
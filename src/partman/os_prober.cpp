@@ -17,13 +17,24 @@
 
 #include "partman/os_prober.h"
 
+#include <unistd.h>
+#include <QMutex>
+#include <QMutexLocker>
+
 #include "base/command.h"
 #include "base/file_util.h"
+#include "partman/native_os_prober.h"
+#include "sysinfo/system_snapshot.h"
 
 namespace installer {
 
 namespace {
 
+// Result of native prober, reused until system snapshot is refreshed.
+QMutex g_native_items_mutex;
+SystemSnapshot::Ptr g_native_items_snapshot;
+OsProberItems g_native_items;
+
 // Cache output of `os-prober` command.
 QString ReadOsProberOutput() {
   const QString cache_path("/tmp/deepin-installer-os-prober.conf");
@@ -68,6 +79,18 @@ QString ReadOsProberOutput() {
 }  // namespace
 
 OsProberItems GetOsProberItems() {
+  // Partitions can only be mounted by root. `os-prober` is used as fallback,
+  // e.g. when installer is running in debug mode.
+  if (geteuid() == 0) {
+    const SystemSnapshot::Ptr snapshot = SystemSnapshot::Current();
+    QMutexLocker locker(&g_native_items_mutex);
+    if (g_native_items_snapshot != snapshot) {
+      g_native_items = ProbeOsItems();
+      g_native_items_snapshot = snapshot;
+    }
+    return g_native_items;
+  }
+
   OsProberItems result;
 
   const QString output = ReadOsProberOutput();
@@ -34,7 +34,10 @@ struct OsProberItem {
 
 typedef QVector<OsProberItem> OsProberItems;
 
-// Scan system wide os information with `os-prober`.
+// Scan system wide os information.
+// Partitions are probed natively if current process is run by root,
+// or else `os-prober` is used. Result of native prober is reused until
+// SystemSnapshot::Refresh() is called.
 OsProberItems GetOsProberItems();
 
 }  // namespace installer
@@ -18,107 +18,140 @@
 #include "partman/partition_format.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QRegExp>
+#include <QStringList>
+#include <atomic>
 
 #include "base/command.h"
+#include "base/thread_util.h"
 #include "sysinfo/machine.h"
 
 namespace installer {
 namespace {
 
-bool FormatBtrfs(const QString& path, const QString& label) {
+QMutex g_mkfs_records_mutex;
+QList<MkfsRecord> g_mkfs_records;
+
+// Stages of mke2fs which print numeric progress, in order.
+const char* const kMke2fsStages[] = {
+    "Allocating group tables:",
+    "Writing inode tables:",
+    "Writing superblocks and filesystem accounting information:",
+};
+const int kMke2fsStageCount = 3;
+
+// Run mkfs.ext* and pass its progress to |progress|.
+bool SpawnMke2fs(const QString& cmd, const QStringList& args,
+                 QString& output, QString& err,
+                 const MkfsProgressHandler& progress) {
+  if (!progress) {
+    return SpawnCmdStreamed(cmd, args, output, err);
+  }
+  // Progress text of mke2fs is short, keep all of it to find current stage.
+  QByteArray stdout_data;
+  int last_percent = -1;
+  return SpawnCmdStreamed(cmd, args, output, err,
+                          [&](const QByteArray& data) {
+    stdout_data.append(data);
+    const int percent = ParseMke2fsProgress(QString::fromUtf8(stdout_data));
+    if (percent > last_percent) {
+      last_percent = percent;
+      progress(percent);
+    }
+  });
+}
+
+bool FormatBtrfs(const QString& path, const QString& label,
+                 const QStringList& profile_args) {
   QString output;
   QString err;
-  bool ok;
-  if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.btrfs", {"-f", path}, output, err);
-  } else {
+  QStringList args = {"-f"};
+  args.append(profile_args);
+  if (!label.isEmpty()) {
     // Truncate label size.
-    const QString real_label = label.left(255);
-    ok = SpawnCmd("mkfs.btrfs", {"-f", "-L", real_label, path},
-                  output, err);
+    args << "-L" << label.left(255);
   }
+  args << path;
+  const bool ok = SpawnCmdStreamed("mkfs.btrfs", args, output, err);
   if (!ok) {
     qCritical() << "FormatBtrfs() error:" << err << output;
   }
   return ok;
 }
 
-bool FormatExt2(const QString& path, const QString& label) {
+bool FormatExt2(const QString& path, const QString& label,
+                const QStringList& profile_args,
+                const MkfsProgressHandler& progress) {
   QString output;
   QString err;
-  bool ok;
-  if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.ext2", {"-F", path}, output, err);
-  } else {
-    const QString real_label = label.left(16);
-    ok = SpawnCmd("mkfs.ext2", {"-F", "-L", real_label, path},
-                  output, err);
+  QStringList args = {"-F"};
+  args.append(profile_args);
+  if (!label.isEmpty()) {
+    args << "-L" << label.left(16);
   }
+  args << path;
+  const bool ok = SpawnMke2fs("mkfs.ext2", args, output, err, progress);
   if (!ok) {
     qCritical() << "FormatExt2() err:" << err << output;
   }
   return ok;
 }
 
-bool FormatExt3(const QString& path, const QString& label) {
+bool FormatExt3(const QString& path, const QString& label,
+                const QStringList& profile_args,
+                const MkfsProgressHandler& progress) {
   QString output;
   QString err;
-  bool ok;
-  if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.ext3", {"-F", path}, output, err);
-  } else {
-    const QString real_label = label.left(16);
-    ok = SpawnCmd("mkfs.ext3", {"-F", "-L", real_label, path},
-                  output, err);
+  QStringList args = {"-F"};
+  args.append(profile_args);
+  if (!label.isEmpty()) {
+    args << "-L" << label.left(16);
   }
+  args << path;
+  const bool ok = SpawnMke2fs("mkfs.ext3", args, output, err, progress);
   if (!ok) {
     qCritical() << "FormatExt3() err:" << err << output;
   }
   return ok;
 }
 
-bool FormatExt4(const QString& path, const QString& label) {
+bool FormatExt4(const QString& path, const QString& label,
+                const QStringList& profile_args,
+                const MkfsProgressHandler& progress) {
   QString output;
   QString err;
-  bool ok;
+  QStringList args;
   const MachineArch arch = GetMachineArch();
   if (arch == MachineArch::LOONGSON ||
       arch == MachineArch::SW) {
     // Disable 64bit support on loongson and sw platforms.
-    if (label.isEmpty()) {
-      ok = SpawnCmd("mkfs.ext4", {"-O ^64bit", "-F", path}, output, err);
-    } else {
-      const QString real_label = label.left(16);
-      ok = SpawnCmd("mkfs.ext4", {"-O ^64bit", "-F", "-L", real_label, path},
-                    output, err);
-    }
-  } else {
-    if (label.isEmpty()) {
-      ok = SpawnCmd("mkfs.ext4", {"-F", path}, output, err);
-    } else {
-      const QString real_label = label.left(16);
-      ok = SpawnCmd("mkfs.ext4", {"-F", "-L", real_label, path},
-                    output, err);
-    }
+    args << "-O ^64bit";
   }
-
+  args << "-F";
+  args.append(profile_args);
+  if (!label.isEmpty()) {
+    args << "-L" << label.left(16);
+  }
+  args << path;
+  const bool ok = SpawnMke2fs("mkfs.ext4", args, output, err, progress);
   if (!ok) {
     qCritical() << "FormatExt4() err:" << err << output;
   }
   return ok;
 }
 
-bool FormatF2fs(const QString& path, const QString& label) {
+bool FormatF2fs(const QString& path, const QString& label,
+                const QStringList& profile_args) {
   QString output;
   QString err;
-  bool ok;
-  if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.f2fs", {path}, output, err);
-  } else {
-    const QString real_label = label.left(19);
-    ok = SpawnCmd("mkfs.f2fs", {"-l", real_label, path},
-                  output, err);
+  QStringList args = profile_args;
+  if (!label.isEmpty()) {
+    args << "-l" << label.left(19);
   }
+  args << path;
+  const bool ok = SpawnCmdStreamed("mkfs.f2fs", args, output, err);
   if (!ok) {
     qCritical() << "FormatF2fs() err:" << err << output;
   }
@@ -130,12 +163,13 @@ bool FormatFat16(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.msdos", {"-F16", "-v", "-I", path}, output, err);
+    ok = SpawnCmdStreamed("mkfs.msdos", {"-F16", "-v", "-I", path},
+                          output, err);
   } else {
     const QString real_label = label.left(11);
-    ok = SpawnCmd("mkfs.msdos",
-                  {"-F16", "-v", "-I", "-n", real_label, path},
-                  output, err);
+    ok = SpawnCmdStreamed("mkfs.msdos",
+                          {"-F16", "-v", "-I", "-n", real_label, path},
+                          output, err);
   }
   if (!ok) {
     qCritical() << "FormatFat16() err:" << err << output;
@@ -148,12 +182,13 @@ bool FormatFat32(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.msdos", {"-F32", "-v", "-I", path}, output, err);
+    ok = SpawnCmdStreamed("mkfs.msdos", {"-F32", "-v", "-I", path},
+                          output, err);
   } else {
     const QString real_label = label.left(11);
-    ok = SpawnCmd("mkfs.msdos",
-                  {"-F32", "-v", "-I", "-n", real_label, path},
-                  output, err);
+    ok = SpawnCmdStreamed("mkfs.msdos",
+                          {"-F32", "-v", "-I", "-n", real_label, path},
+                          output, err);
   }
   if (!ok) {
     qCritical() << "FormatFat32() err:" << err << output;
@@ -166,11 +201,11 @@ bool FormatHfs(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("hformat", {path}, output, err);
+    ok = SpawnCmdStreamed("hformat", {path}, output, err);
   } else {
     const QString real_label = label.left(27);
-    ok = SpawnCmd("hformat", {"-l", real_label, path},
-                  output, err);
+    ok = SpawnCmdStreamed("hformat", {"-l", real_label, path},
+                          output, err);
   }
   if (!ok) {
     qCritical() << "FormatHfs() err:" << err << output;
@@ -183,11 +218,11 @@ bool FormatHfsPlus(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.hfsplus", {path}, output, err);
+    ok = SpawnCmdStreamed("mkfs.hfsplus", {path}, output, err);
   } else {
     const QString real_label = label.left(63);
-    ok = SpawnCmd("mkfs.hfsplus", {"-v", real_label, path},
-                  output, err);
+    ok = SpawnCmdStreamed("mkfs.hfsplus", {"-v", real_label, path},
+                          output, err);
   }
   if (!ok) {
     qCritical() << "FormatHfsPlus() err:" << err << output;
@@ -200,11 +235,11 @@ bool FormatJfs(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.jfs", {"-q", path}, output, err);
+    ok = SpawnCmdStreamed("mkfs.jfs", {"-q", path}, output, err);
   } else {
     const QString real_label = label.left(11);
-    ok = SpawnCmd("mkfs.jfs", {"-q", "-L", real_label, path},
-                  output, err);
+    ok = SpawnCmdStreamed("mkfs.jfs", {"-q", "-L", real_label, path},
+                          output, err);
   }
   if (!ok) {
     qCritical() << "FormatJfs() err:" << err << output;
@@ -217,11 +252,11 @@ bool FormatLinuxSwap(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("mkswap", {path}, output, err);
+    ok = SpawnCmdStreamed("mkswap", {path}, output, err);
   } else {
     const QString real_label = label.left(15);
-    ok = SpawnCmd("mkswap", {"-L", real_label, path},
-                  output, err);
+    ok = SpawnCmdStreamed("mkswap", {"-L", real_label, path},
+                          output, err);
   }
   if (!ok) {
     qCritical() << "FormatLinuxSwap() err:" << err << output;
@@ -234,11 +269,11 @@ bool FormatNilfs2(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.nilfs2", {path}, output, err);
+    ok = SpawnCmdStreamed("mkfs.nilfs2", {path}, output, err);
   } else {
     const QString real_label = label.left(1);
-    ok = SpawnCmd("mkfs.nilfs2", {"-L", real_label, path},
-                  output, err);
+    ok = SpawnCmdStreamed("mkfs.nilfs2", {"-L", real_label, path},
+                          output, err);
   }
   if (!ok) {
     qCritical() << "FormatNilfs2() err:" << err << output;
@@ -251,12 +286,12 @@ bool FormatNTFS(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("mkntfs", {"-Q", "-v", "-F", path}, output, err);
+    ok = SpawnCmdStreamed("mkntfs", {"-Q", "-v", "-F", path}, output, err);
   } else {
     const QString real_label = label.left(128);
-    ok = SpawnCmd("mkntfs",
-                  {"-Q", "-v", "-F", "-L", real_label, path},
-                  output, err);
+    ok = SpawnCmdStreamed("mkntfs",
+                          {"-Q", "-v", "-F", "-L", real_label, path},
+                          output, err);
   }
   if (!ok) {
     qCritical() << "FormatNTFS() err:" << err << output;
@@ -269,15 +304,16 @@ bool FormatReiser4(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.reiser4", {"--force", "--yes", path}, output, err);
+    ok = SpawnCmdStreamed("mkfs.reiser4", {"--force", "--yes", path},
+                          output, err);
   } else {
     const QString real_label = label.left(16);
-    ok = SpawnCmd("mkfs.reiser4",
-                 {"--force", "--yes",
-                  "--label",
-                  real_label,
-                  path},
-                 output, err);
+    ok = SpawnCmdStreamed("mkfs.reiser4",
+                         {"--force", "--yes",
+                          "--label",
+                          real_label,
+                          path},
+                         output, err);
   }
   if (!ok) {
     qCritical() << "FormatReiser4() err:" << err << output;
@@ -290,12 +326,12 @@ bool FormatReiserfs(const QString& path, const QString& label) {
   QString err;
   bool ok;
   if (label.isEmpty()) {
-    ok = SpawnCmd("mkreiserfs", {"-f", "-f", path}, output, err);
+    ok = SpawnCmdStreamed("mkreiserfs", {"-f", "-f", path}, output, err);
   } else {
     const QString real_label = label.left(16);
-    ok = SpawnCmd("mkreiserfs",
-                  {"-f", "-f", "--label", real_label, path},
-                  output, err);
+    ok = SpawnCmdStreamed("mkreiserfs",
+                          {"-f", "-f", "--label", real_label, path},
+                          output, err);
   }
   if (!ok) {
     qCritical() << "FormatReiserfs() err:" << err << output;
@@ -303,43 +339,126 @@ bool FormatReiserfs(const QString& path, const QString& label) {
   return ok;
 }
 
-bool FormatXfs(const QString& path, const QString& label) {
+bool FormatXfs(const QString& path, const QString& label,
+               const QStringList& profile_args) {
   QString output;
   QString err;
-  bool ok;
-  if (label.isEmpty()) {
-    ok = SpawnCmd("mkfs.xfs", {"-f", path}, output, err);
-  } else {
-    const QString real_label = label.left(12);
-    ok = SpawnCmd("mkfs.xfs", {"-f", "-L", real_label, path},
-                  output, err);
+  QStringList args = {"-f"};
+  args.append(profile_args);
+  if (!label.isEmpty()) {
+    args << "-L" << label.left(12);
   }
+  args << path;
+  const bool ok = SpawnCmdStreamed("mkfs.xfs", args, output, err);
   if (!ok) {
     qCritical() << "FormatXfs() err:" << err << output;
   }
   return ok;
 }
 
+// Run Mkfs() and log its time used. |index| and |total| are used in log.
+bool MkfsJob(const Partition::Ptr partition, FormatProfile profile,
+             int index, int total, const MkfsProgressHandler& progress) {
+  qDebug() << "Mkfs job started:" << index << "/" << total << partition->path;
+  if (progress) {
+    progress(0);
+  }
+  QElapsedTimer timer;
+  timer.start();
+  const bool ok = Mkfs(partition, profile, progress);
+  {
+    QMutexLocker locker(&g_mkfs_records_mutex);
+    g_mkfs_records.append({partition->path, partition->fs, profile, ok,
+                           timer.elapsed()});
+  }
+  if (ok) {
+    if (progress) {
+      progress(100);
+    }
+    qDebug() << "Mkfs job finished:" << index << "/" << total
+             << partition->path << partition->fs << profile
+             << timer.elapsed() << "ms";
+  } else {
+    qCritical() << "Mkfs job failed:" << index << "/" << total
+                << partition->path << partition->fs << profile
+                << timer.elapsed() << "ms";
+  }
+  return ok;
+}
+
+// Bind |index| of partition to |progress|.
+MkfsProgressHandler JobProgressHandler(const MkfsParallelHandler& progress,
+                                       int index) {
+  if (!progress) {
+    return nullptr;
+  }
+  return [progress, index](int percent) {
+    progress(index, percent);
+  };
+}
+
 }  // namespace
 
+int ParseMke2fsProgress(const QString& output) {
+  // Find the last stage started.
+  int stage = -1;
+  int stage_pos = -1;
+  for (int i = 0; i < kMke2fsStageCount; ++i) {
+    const int pos = output.lastIndexOf(kMke2fsStages[i]);
+    if (pos > stage_pos) {
+      stage = i;
+      stage_pos = pos;
+    }
+  }
+  if (stage == -1) {
+    return -1;
+  }
+
+  // Each stage prints "done" at the end, or "current/total" followed by
+  // backspaces while it runs.
+  const QString text =
+      output.mid(stage_pos + QString(kMke2fsStages[stage]).length());
+  int percent = 0;
+  if (text.contains("done")) {
+    percent = 100;
+  } else {
+    QRegExp pattern("(\\d+)/(\\d+)");
+    int pos = 0;
+    while ((pos = pattern.indexIn(text, pos)) != -1) {
+      const qint64 current = pattern.cap(1).toLongLong();
+      const qint64 total = pattern.cap(2).toLongLong();
+      if (total > 0 && current <= total) {
+        percent = int(current * 100 / total);
+      }
+      pos += pattern.matchedLength();
+    }
+  }
+  return (stage * 100 + percent) / kMke2fsStageCount;
+}
+
 // Make filesystem on |partition| based on its fs type.
-bool Mkfs(const Partition::Ptr partition) {
-  qDebug() << "Mkfs()" << partition;
+bool Mkfs(const Partition::Ptr partition, FormatProfile profile,
+          const MkfsProgressHandler& progress) {
+  qDebug() << "Mkfs()" << partition << profile;
+  const QStringList profile_args = GetMkfsProfileArgs(partition->fs, profile);
   switch (partition->fs) {
     case FsType::Btrfs: {
-      return FormatBtrfs(partition->path, partition->label);
+      return FormatBtrfs(partition->path, partition->label, profile_args);
     }
     case FsType::Ext2: {
-      return FormatExt2(partition->path, partition->label);
+      return FormatExt2(partition->path, partition->label, profile_args,
+                         progress);
     }
     case FsType::Ext3: {
-      return FormatExt3(partition->path, partition->label);
+      return FormatExt3(partition->path, partition->label, profile_args,
+                         progress);
     }
     case FsType::Ext4: {
-      return FormatExt4(partition->path, partition->label);
+      return FormatExt4(partition->path, partition->label, profile_args,
+                         progress);
     }
     case FsType::F2fs: {
-      return FormatF2fs(partition->path, partition->label);
+      return FormatF2fs(partition->path, partition->label, profile_args);
     }
     case FsType::Fat16: {
       return FormatFat16(partition->path, partition->label);
@@ -373,7 +492,7 @@ bool Mkfs(const Partition::Ptr partition) {
       return FormatReiserfs(partition->path, partition->label);
     }
     case FsType::Xfs: {
-      return FormatXfs(partition->path, partition->label);
+      return FormatXfs(partition->path, partition->label, profile_args);
     }
     default: {
       qWarning() << "Unsupported filesystem to format!" << partition->path;
@@ -382,4 +501,68 @@ bool Mkfs(const Partition::Ptr partition) {
   }
 }
 
+QList<MkfsRecord> GetMkfsRecords() {
+  QMutexLocker locker(&g_mkfs_records_mutex);
+  return g_mkfs_records;
+}
+
+void ResetMkfsRecords() {
+  QMutexLocker locker(&g_mkfs_records_mutex);
+  g_mkfs_records.clear();
+}
+
+bool MkfsParallel(const PartitionList& partitions,
+                  const FormatOptions& options,
+                  const MkfsParallelHandler& progress) {
+  const int total = partitions.length();
+
+  // Group partitions by physical device.
+  QStringList device_paths;
+  QList<QList<int>> groups;
+  for (int i = 0; i < total; ++i) {
+    const QString& device_path = partitions.at(i)->device_path;
+    int group = device_paths.indexOf(device_path);
+    if (group == -1) {
+      group = device_paths.length();
+      device_paths.append(device_path);
+      groups.append(QList<int>());
+    }
+    groups[group].append(i);
+  }
+
+  QList<FormatProfile> profiles;
+  for (const QString& device_path : device_paths) {
+    profiles.append(ResolveFormatProfile(options.profile,
+                                         GetDeviceQueueInfo(device_path)));
+  }
+
+  if (options.jobs_per_device <= 0) {
+    for (int i = 0; i < total; ++i) {
+      const Partition::Ptr partition = partitions.at(i);
+      const FormatProfile profile =
+          profiles.at(device_paths.indexOf(partition->device_path));
+      if (!MkfsJob(partition, profile, i + 1, total,
+                   JobProgressHandler(progress, i))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::atomic<bool> ok(true);
+  ParallelFor(groups.length(), groups.length(), [&](int group) {
+    const QList<int>& indexes = groups.at(group);
+    const FormatProfile profile = profiles.at(group);
+    ParallelFor(indexes.length(), options.jobs_per_device, [&](int j) {
+      const int index = indexes.at(j);
+      if (!MkfsJob(partitions.at(index), profile, index + 1, total,
+                   JobProgressHandler(progress, index))) {
+        ok = false;
+      }
+    });
+  });
+
+  return ok;
+}
+
 }  // namespace installer
@@ -18,14 +18,67 @@
 #ifndef INSTALLER_PARTMAN_PARTITION_FORMAT_H
 #define INSTALLER_PARTMAN_PARTITION_FORMAT_H
 
+#include <functional>
 #include <QString>
 
+#include "partman/format_profile.h"
 #include "partman/partition.h"
 
 namespace installer {
 
-// Format filesystem.
-bool Mkfs(const Partition::Ptr partition);
+struct FormatOptions {
+  // Maximum number of mkfs jobs run on one device at the same time.
+  // 0 disables parallel formatting.
+  int jobs_per_device = 0;
+  FormatProfile profile = FormatProfile::Default;
+};
+
+// Time used by a mkfs job in MkfsParallel().
+struct MkfsRecord {
+  QString path;
+  FsType fs;
+  FormatProfile profile;
+  bool ok;
+  qint64 elapsed;  // In milliseconds.
+};
+
+// Get records of mkfs jobs since last call of ResetMkfsRecords().
+QList<MkfsRecord> GetMkfsRecords();
+
+// Clear records returned by GetMkfsRecords().
+void ResetMkfsRecords();
+
+// Called with percentage of a running mkfs job.
+typedef std::function<void(int percent)> MkfsProgressHandler;
+
+// Called with index of partition in MkfsParallel() and percentage of its
+// mkfs job.
+typedef std::function<void(int index, int percent)> MkfsParallelHandler;
+
+// Parse overall progress of mke2fs from its stdout |output|, all of its
+// stages are counted. Returns -1 if no progress is found.
+int ParseMke2fsProgress(const QString& output);
+
+// Format filesystem with mkfs options of |profile|.
+// |profile| shall not be Auto.
+// Percentage parsed from output of mkfs is passed to |progress|, only
+// mke2fs reports it for now.
+bool Mkfs(const Partition::Ptr partition,
+          FormatProfile profile = FormatProfile::Default,
+          const MkfsProgressHandler& progress = nullptr);
+
+// Format filesystems of |partitions|. Partitions on different devices are
+// formatted at the same time, and at most |options.jobs_per_device|
+// partitions of one device are formatted at the same time.
+// If jobs_per_device is 0, parallel formatting is disabled: partitions are
+// formatted one by one and it stops at the first error.
+// Auto profile is resolved for each device.
+// |progress| is called with 0 when a job starts, with percentage parsed by
+// Mkfs() while it runs, and with 100 when it succeeds. Note that it may be
+// called in worker threads.
+bool MkfsParallel(const PartitionList& partitions,
+                  const FormatOptions& options,
+                  const MkfsParallelHandler& progress = nullptr);
 
 }  // namespace installer
 
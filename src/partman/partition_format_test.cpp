@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/partition_format.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kMke2fsHeader[] =
+    "Creating filesystem with 26214400 4k blocks and 6553600 inodes\n"
+    "Filesystem UUID: 0b5ae2a6-0cb4-4b9e-8d5e-5f0a1b7e7a1c\n"
+    "Superblock backups stored on blocks: \n"
+    "\t32768, 98304, 163840, 229376, 294912\n\n";
+
+TEST(PartitionFormat, ParseMke2fsProgress) {
+  QString output = kMke2fsHeader;
+  EXPECT_EQ(ParseMke2fsProgress(output), -1);
+
+  output += "Allocating group tables:   0/800\b\b\b\b\b\b\b     \b\b\b\b\b";
+  EXPECT_EQ(ParseMke2fsProgress(output), 0);
+  output += "done                            \n";
+  EXPECT_EQ(ParseMke2fsProgress(output), 33);
+
+  output += "Writing inode tables: 200/800\b\b\b\b\b\b\b400/800\b\b\b\b\b\b\b";
+  EXPECT_EQ(ParseMke2fsProgress(output), 50);
+  output += "done                            \n"
+            "Creating journal (262144 blocks): done\n";
+  EXPECT_EQ(ParseMke2fsProgress(output), 66);
+
+  output += "Writing superblocks and filesystem accounting information: "
+            "  0/800\b\b\b\b\b\b\b";
+  EXPECT_EQ(ParseMke2fsProgress(output), 66);
+  output += "done\n\n";
+  EXPECT_EQ(ParseMke2fsProgress(output), 100);
+}
+
+}  // namespace
+}  // namespace installer
@@ -20,13 +20,17 @@
 #include <parted/parted.h>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QVector>
 
 #include "base/command.h"
+#include "base/thread_util.h"
 #include "partman/libparted_util.h"
 #include "partman/os_prober.h"
 #include "partman/partition_usage.h"
-#include "sysinfo/dev_disk.h"
-#include "sysinfo/proc_mounts.h"
+#include "partman/uevent_monitor.h"
+#include "sysinfo/system_snapshot.h"
 
 namespace installer {
 
@@ -35,6 +39,14 @@ namespace {
 // Absolute path to hook_manager.sh
 const char kHookManagerFile[] = BUILTIN_HOOKS_DIR "/hook_manager.sh";
 
+// Value of DI_FULLDISK_DEVICE to select the largest device.
+const char kAutoMaxDevice[] = "auto_max";
+
+// Minimum number of threads used to scan devices. Reading usage of
+// partitions is mostly waiting for disk io, so more threads than cpu cores
+// are used on small machines.
+const int kMinScanThreads = 4;
+
 // Get flags of |lp_partition|.
 PartitionFlags GetPartitionFlags(PedPartition* lp_partition) {
   Q_ASSERT(lp_partition);
@@ -51,7 +63,15 @@ PartitionFlags GetPartitionFlags(PedPartition* lp_partition) {
   return flags;
 }
 
+// Returns true if |partition| has a filesystem to read usage from.
+bool NeedReadUsage(const Partition::Ptr partition) {
+  return (!partition->path.isEmpty() &&
+          partition->type != PartitionType::Unallocated &&
+          partition->type != PartitionType::Extended);
+}
+
 // Read all partitions of |lp_disk|.
+// Usage of partitions is read later in ReadPartitionUsage().
 PartitionList ReadPartitions(PedDisk* lp_disk) {
   Q_ASSERT(lp_disk);
   PartitionList partitions;
@@ -99,19 +119,7 @@ PartitionList ReadPartitions(PedDisk* lp_disk) {
     partition->path = GetPartitionPath(lp_partition);
 
     // Avoid reading additional filesystem information if there is no path.
-    if (!partition->path.isEmpty() &&
-        partition->type != PartitionType::Unallocated &&
-        partition->type != PartitionType::Extended) {
-
-      // Read label based on filesystem type
-      ReadUsage(partition->path, partition->fs, partition->freespace,
-                partition->length);
-      // If LinuxSwap partition is not mount, it is totally free.
-      if (partition->fs == FsType::LinuxSwap && partition->length <= 0) {
-        partition->length = partition->getByteLength();
-        partition->freespace = partition->length;
-      }
-
+    if (NeedReadUsage(partition)) {
       // Get partition name.
       partition->name = ped_partition_get_name(lp_partition);
     }
@@ -120,6 +128,103 @@ PartitionList ReadPartitions(PedDisk* lp_disk) {
   return partitions;
 }
 
+// Read usage of filesystem in |partition|.
+void ReadPartitionUsage(Partition::Ptr partition) {
+  // Read label based on filesystem type
+  ReadUsage(partition->path, partition->fs, partition->freespace,
+            partition->length);
+  // If LinuxSwap partition is not mount, it is totally free.
+  if (partition->fs == FsType::LinuxSwap && partition->length <= 0) {
+    partition->length = partition->getByteLength();
+    partition->freespace = partition->length;
+  }
+}
+
+// Read metadata and partitions of |lp_device| with libparted.
+// Returns nullptr if type of its partition table is not supported.
+Device::Ptr ScanDevice(PedDevice* lp_device,
+                       const SystemSnapshot::Ptr snapshot,
+                       const QHash<QString, OsType>& os_types) {
+  PedDiskType* disk_type = ped_disk_probe(lp_device);
+  Device::Ptr device(new Device);
+  if (disk_type == nullptr) {
+    // Current device has no partition table.
+    device->table = PartitionTableType::Empty;
+  } else {
+    const QString disk_type_name(disk_type->name);
+    if (disk_type_name == kPartitionTableGPT) {
+      device->table = PartitionTableType::GPT;
+    } else if (disk_type_name == kPartitionTableMsDos) {
+      device->table = PartitionTableType::MsDos;
+    }
+    else if (disk_type_name == kPartitionLoop) {
+      device->table = PartitionTableType::Others;
+      qDebug() << "add device: " << disk_type_name << lp_device->path;
+    } else {
+      // Ignores other type of device->
+      qWarning() << "Ignores other type of device:" << lp_device->path
+                 << disk_type->name;
+      return Device::Ptr();
+    }
+  }
+
+  device->path = lp_device->path;
+  device->model = lp_device->model;
+  device->length = lp_device->length;
+  device->sector_size = lp_device->sector_size;
+  device->heads = lp_device->bios_geom.heads;
+  device->sectors = lp_device->bios_geom.sectors;
+  device->cylinders = lp_device->bios_geom.cylinders;
+
+  if (device->table == PartitionTableType::Empty) {
+    Partition::Ptr free_partition(new Partition);
+    free_partition->device_path = device->path;
+    free_partition->path = "";
+    free_partition->partition_number = -1;
+    free_partition->start_sector = 1;
+    free_partition->end_sector = device->length;
+    free_partition->sector_size = device->sector_size;
+    free_partition->type = PartitionType::Unallocated;
+    device->partitions.append(free_partition);
+
+  } else if (device->table == PartitionTableType::MsDos ||
+      device->table == PartitionTableType::GPT || device->table == PartitionTableType::Others) {
+    PedDisk* lp_disk = nullptr;
+    lp_disk = ped_disk_new(lp_device);
+
+    if (lp_disk) {
+      device->max_prims = ped_disk_get_max_primary_partition_count(lp_disk);
+
+      // If partition table is known, scan partitions in this device->
+      device->partitions = ReadPartitions(lp_disk);
+      // Add additional info to partitions.
+      for (Partition::Ptr partition : device->partitions) {
+        partition->device_path = device->path;
+        partition->sector_size = device->sector_size;
+        if (!partition->path.isEmpty() &&
+            partition->type != PartitionType::Unallocated) {
+          // Read partition label and os.
+          partition->label = snapshot->label(partition->path);
+          if (os_types.contains(partition->path)) {
+            partition->os = os_types.value(partition->path);
+          }
+
+          // Mark busy flag of this partition when it is mounted in system.
+          if (snapshot->isMounted(partition->path)) {
+            partition->busy = true;
+          }
+        }
+      }
+      ped_disk_destroy(lp_disk);
+
+    } else {
+      qCritical() << "Failed to get disk object:" << device->path;
+    }
+  }
+
+  return device;
+}
+
 // Unmount devices and swap partitions.
 bool UnmountDevices() {
   // Swap off partitions and files.
@@ -145,6 +250,98 @@ bool UnmountDevices() {
   return ok;
 }
 
+// Remove device object at |device_path| from libparted cache.
+void RemoveCachedDevice(const QString& device_path) {
+  // Walk through cached devices only, ped_device_get() opens device file.
+  for (PedDevice* lp_device = ped_device_get_next(nullptr);
+      lp_device != nullptr;
+      lp_device = ped_device_get_next(lp_device)) {
+    if (device_path == lp_device->path) {
+      ped_device_destroy(lp_device);
+      break;
+    }
+  }
+}
+
+// Scan |lp_devices| in parallel.
+DeviceList ScanPedDevices(const QList<PedDevice*>& lp_devices,
+                          bool enable_os_prober) {
+  // /proc and /dev/disk/by-* are read only once in each scan.
+  const SystemSnapshot::Ptr snapshot = SystemSnapshot::Refresh();
+
+  // Partition path => type of the first os found in it.
+  QHash<QString, OsType> os_types;
+  if (enable_os_prober) {
+    for (const OsProberItem& item : GetOsProberItems()) {
+      if (!os_types.contains(item.path)) {
+        os_types.insert(item.path, item.type);
+      }
+    }
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  const int max_threads = qMax(kMinScanThreads, QThread::idealThreadCount());
+
+  // Scan devices in parallel, all libparted calls of a device are made in
+  // the same thread. Results are kept in the order of |lp_devices|.
+  QVector<Device::Ptr> scanned_devices(lp_devices.length());
+  QVector<qint64> parted_time(lp_devices.length(), 0);
+  ParallelFor(lp_devices.length(), max_threads, [&](int index) {
+    QElapsedTimer device_timer;
+    device_timer.start();
+    scanned_devices[index] = ScanDevice(lp_devices.at(index),
+                                        snapshot,
+                                        os_types);
+    parted_time[index] = device_timer.elapsed();
+  });
+
+  // Then read usage of all partitions in parallel.
+  QList<Partition::Ptr> usage_partitions;
+  QList<int> usage_device_indexes;
+  for (int index = 0; index < scanned_devices.length(); ++index) {
+    if (scanned_devices.at(index).isNull()) {
+      continue;
+    }
+    for (Partition::Ptr partition : scanned_devices.at(index)->partitions) {
+      if (NeedReadUsage(partition)) {
+        usage_partitions.append(partition);
+        usage_device_indexes.append(index);
+      }
+    }
+  }
+  QVector<qint64> usage_time(usage_partitions.length(), 0);
+  ParallelFor(usage_partitions.length(), max_threads, [&](int index) {
+    QElapsedTimer usage_timer;
+    usage_timer.start();
+    ReadPartitionUsage(usage_partitions.at(index));
+    usage_time[index] = usage_timer.elapsed();
+  });
+
+  DeviceList devices;
+  for (int index = 0; index < scanned_devices.length(); ++index) {
+    const Device::Ptr device = scanned_devices.at(index);
+    if (device.isNull()) {
+      continue;
+    }
+    qint64 device_usage_time = 0;
+    for (int i = 0; i < usage_device_indexes.length(); ++i) {
+      if (usage_device_indexes.at(i) == index) {
+        device_usage_time += usage_time.at(i);
+      }
+    }
+    qDebug() << "ScanDevices()" << device->path
+             << "partitions:" << device->partitions.length()
+             << "libparted(ms):" << parted_time.at(index)
+             << "usage(ms):" << device_usage_time;
+    devices.append(device);
+  }
+  qDebug() << "ScanDevices() elapsed(ms):" << timer.elapsed()
+           << "threads:" << max_threads;
+
+  return devices;
+}
+
 }  // namespace
 
 PartitionManager::PartitionManager(QObject* parent)
@@ -154,8 +351,13 @@ PartitionManager::PartitionManager(QObject* parent)
 
   // Register meta types used in signals.
   qRegisterMetaType<DeviceList>("DeviceList");
+  qRegisterMetaType<DeviceListDiff>("DeviceListDiff");
   qRegisterMetaType<OperationList>("OperationList");
+  qRegisterMetaType<OperationProgress>("OperationProgress");
   qRegisterMetaType<PartitionTableType>("PartitionTableType");
+  qRegisterMetaType<AutoPartPolicy>("AutoPartPolicy");
+  qRegisterMetaType<AutoPartResult>("AutoPartResult");
+  qRegisterMetaType<LuksTuning>("LuksTuning");
   this->initConnections();
 }
 
@@ -164,6 +366,10 @@ PartitionManager::~PartitionManager() {
   // It is released in PartitionDelegate.
 }
 
+void PartitionManager::setFormatOptions(const FormatOptions& options) {
+  format_options_ = options;
+}
+
 void PartitionManager::initConnections() {
   connect(this, &PartitionManager::createPartitionTable,
           this, &PartitionManager::doCreatePartitionTable);
@@ -171,18 +377,83 @@ void PartitionManager::initConnections() {
           this, &PartitionManager::doRefreshDevices);
   connect(this, &PartitionManager::autoPart,
           this, &PartitionManager::doAutoPart);
+  connect(this, &PartitionManager::nativeAutoPart,
+          this, &PartitionManager::doNativeAutoPart);
+  connect(this, &PartitionManager::tuneLuks,
+          this, &PartitionManager::doTuneLuks);
   connect(this, &PartitionManager::manualPart,
           this, &PartitionManager::doManualPart);
 }
 
+DeviceListDiff PartitionManager::updateDevices(const QStringList& device_paths,
+                                               bool enable_os_prober) {
+  DeviceListDiff diff;
+  QStringList scan_paths;
+  for (const QString& device_path : device_paths) {
+    if (QFile::exists(device_path)) {
+      scan_paths.append(device_path);
+    } else {
+      RemoveCachedDevice(device_path);
+      if (DeviceIndex(devices_, device_path) != -1) {
+        diff.removed.append(device_path);
+      }
+    }
+  }
+
+  const DeviceList scanned_devices = ScanDevices(scan_paths, enable_os_prober);
+  for (const QString& device_path : scan_paths) {
+    const int index = DeviceIndex(scanned_devices, device_path);
+    const bool cached = (DeviceIndex(devices_, device_path) != -1);
+    if (index == -1) {
+      // Partition table of this device is not supported any more.
+      if (cached) {
+        diff.removed.append(device_path);
+      }
+    } else if (cached) {
+      diff.changed.append(scanned_devices.at(index));
+    } else {
+      diff.added.append(scanned_devices.at(index));
+    }
+  }
+
+  ApplyDeviceListDiff(devices_, diff);
+  return diff;
+}
+
+void PartitionManager::startUeventMonitor() {
+  if (uevent_monitor_) {
+    return;
+  }
+  uevent_monitor_ = new UeventMonitor(this);
+  if (uevent_monitor_->start()) {
+    connect(uevent_monitor_, &UeventMonitor::devicesChanged,
+            this, &PartitionManager::onUeventDevicesChanged);
+  } else {
+    qWarning() << "PartitionManager failed to monitor device events";
+    delete uevent_monitor_;
+    uevent_monitor_ = nullptr;
+  }
+}
+
 void PartitionManager::doCreatePartitionTable(const QString& device_path,
                                               PartitionTableType table) {
+  if (uevent_monitor_) {
+    uevent_monitor_->pause();
+  }
   if (!CreatePartitionTable(device_path, table)) {
     qCritical() << "PartitionManager failed to create partition table at"
                 << device_path;
   }
-  const DeviceList devices = ScanDevices(enable_os_prober_);
-  emit this->devicesRefreshed(devices);
+  if (devices_.isEmpty()) {
+    devices_ = ScanDevices(enable_os_prober_);
+  } else {
+    // Only this device is changed.
+    this->updateDevices({device_path}, enable_os_prober_);
+  }
+  if (uevent_monitor_) {
+    uevent_monitor_->resume();
+  }
+  emit this->devicesRefreshed(devices_);
 }
 
 void PartitionManager::doRefreshDevices(bool umount, bool enable_os_prober) {
@@ -191,9 +462,19 @@ void PartitionManager::doRefreshDevices(bool umount, bool enable_os_prober) {
     UnmountDevices();
   }
 
+  // Cached device list is kept up to date by uevent monitor, unless mount
+  // state or os-prober option is changed.
+  if (uevent_monitor_ && !umount && !devices_.isEmpty() &&
+      enable_os_prober == enable_os_prober_) {
+    qDebug() << "PartitionManager use cached device list";
+    emit this->devicesRefreshed(devices_);
+    return;
+  }
+
   enable_os_prober_ = enable_os_prober;
-  const DeviceList devices = ScanDevices(enable_os_prober);
-  emit this->devicesRefreshed(devices);
+  devices_ = ScanDevices(enable_os_prober);
+  this->startUeventMonitor();
+  emit this->devicesRefreshed(devices_);
 }
 
 void PartitionManager::doAutoPart(const QString& script_path) {
@@ -202,24 +483,86 @@ void PartitionManager::doAutoPart(const QString& script_path) {
     emit this->autoPartDone(false);
     return;
   }
+  // Disks are not changed by user any more.
+  this->stopUeventMonitor();
   const bool ok = RunScriptFile({kHookManagerFile, script_path});
   emit this->autoPartDone(ok);
 }
 
+void PartitionManager::doNativeAutoPart(const AutoPartPolicy& policy) {
+  // Disks are not changed by user any more.
+  this->stopUeventMonitor();
+  UnmountDevices();
+
+  AutoPartResult result;
+  Device::Ptr device;
+  if (policy.device_path == kAutoMaxDevice) {
+    for (const Device::Ptr item : ScanDevices(false)) {
+      if (!device || item->getByteLength() >= device->getByteLength()) {
+        device = item;
+      }
+    }
+  } else {
+    const DeviceList devices = ScanDevices({policy.device_path}, false);
+    if (!devices.isEmpty()) {
+      device = devices.first();
+    }
+  }
+  if (!device) {
+    qCritical() << "doNativeAutoPart() device not found:"
+                << policy.device_path;
+    emit this->nativeAutoPartDone(false, result);
+    return;
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  const bool ok = AutoPartDevice(device, policy, format_options_, result);
+  qDebug() << "doNativeAutoPart()" << device->path << ok
+           << "elapsed ms:" << timer.elapsed();
+  emit this->nativeAutoPartDone(ok, result);
+}
+
+void PartitionManager::doTuneLuks(int iter_time) {
+  QElapsedTimer timer;
+  timer.start();
+  const LuksTuning tuning = TuneLuks(iter_time);
+  qDebug() << "doTuneLuks() elapsed ms:" << timer.elapsed();
+  emit this->luksTuned(tuning);
+}
+
 void PartitionManager::doManualPart(const OperationList& operations) {
   qDebug() << Q_FUNC_INFO << "\n" << "operations:" << operations;
-  bool ok = true;
-  // Copy operation list, as partition path will be updated in applyToDisk().
-  OperationList real_operations(operations);
-  for (int i = 0; ok && i < real_operations.length(); ++i) {
-    Operation& operation = real_operations[i];
-    ok = operation.applyToDisk();
-  }
+  // Disks are not changed by user any more.
+  this->stopUeventMonitor();
+
+  // Copy operation list, as partition path will be updated in
+  // ApplyOperations(). Redundant edits are removed at the same time.
+  OperationList real_operations = OptimizeOperations(operations);
+  bool ok = ApplyOperations(real_operations, format_options_,
+                            [this](const OperationProgress& progress) {
+    qDebug() << progress;
+    emit this->manualPartProgress(progress);
+  });
   qDebug() << Q_FUNC_INFO << "\n" << "real operations:" << real_operations;
 
   DeviceList devices;
   if (ok) {
-    devices = ScanDevices(false);
+    // Only rescan devices touched by operations.
+    QStringList device_paths;
+    for (const Operation& operation : real_operations) {
+      const QString device_path = operation.devicePath();
+      if (!device_paths.contains(device_path)) {
+        device_paths.append(device_path);
+      }
+    }
+    if (devices_.isEmpty()) {
+      devices_ = ScanDevices(false);
+    } else {
+      this->updateDevices(device_paths, false);
+    }
+    devices = devices_;
+
     // Update mount point of real partitions.
     for (Device::Ptr device : devices) {
       for (Partition::Ptr partition : device->partitions) {
@@ -236,6 +579,23 @@ void PartitionManager::doManualPart(const OperationList& operations) {
   emit this->manualPartDone(ok, devices);
 }
 
+void PartitionManager::stopUeventMonitor() {
+  if (uevent_monitor_) {
+    delete uevent_monitor_;
+    uevent_monitor_ = nullptr;
+  }
+}
+
+void PartitionManager::onUeventDevicesChanged(const QStringList& disk_paths) {
+  qDebug() << "PartitionManager rescan devices:" << disk_paths;
+  const DeviceListDiff diff = this->updateDevices(disk_paths,
+                                                  enable_os_prober_);
+  if (!diff.isEmpty()) {
+    qDebug() << "devices changed:" << diff;
+    emit this->devicesChanged(diff);
+  }
+}
+
 DeviceList ScanDevices(bool enable_os_prober) {
   // 1. List Devices
   // 1.1. Retrieve metadata of each device->
@@ -259,107 +619,32 @@ DeviceList ScanDevices(bool enable_os_prober) {
   }
 #endif // !QT_DEBUG
 
-  DeviceList devices;
-  const LabelItems label_items = ParseLabelDir();
-  const MountItemList mount_items = ParseMountItems();
-
-  OsProberItems os_prober_items;
-  if (enable_os_prober) {
-    os_prober_items = GetOsProberItems();
-  }
-
-  // Walk through all devices.
+  QList<PedDevice*> lp_devices;
   for (PedDevice* lp_device = ped_device_get_next(nullptr);
       lp_device != nullptr;
       lp_device = ped_device_get_next(lp_device)) {
-    PedDiskType* disk_type = ped_disk_probe(lp_device);
-    Device::Ptr device(new Device);
-    if (disk_type == nullptr) {
-      // Current device has no partition table.
-      device->table = PartitionTableType::Empty;
-    } else {
-      const QString disk_type_name(disk_type->name);
-      if (disk_type_name == kPartitionTableGPT) {
-        device->table = PartitionTableType::GPT;
-      } else if (disk_type_name == kPartitionTableMsDos) {
-        device->table = PartitionTableType::MsDos;
-      }
-      else if (disk_type_name == kPartitionLoop) {
-        device->table = PartitionTableType::Others;
-        qDebug() << "add device: " << disk_type_name << lp_device->path;
-      } else {
-        // Ignores other type of device->
-        qWarning() << "Ignores other type of device:" << lp_device->path
-                   << disk_type->name;
-        continue;
-      }
-    }
+    lp_devices.append(lp_device);
+  }
 
-    device->path = lp_device->path;
-    device->model = lp_device->model;
-    device->length = lp_device->length;
-    device->sector_size = lp_device->sector_size;
-    device->heads = lp_device->bios_geom.heads;
-    device->sectors = lp_device->bios_geom.sectors;
-    device->cylinders = lp_device->bios_geom.cylinders;
-
-    if (device->table == PartitionTableType::Empty) {
-      Partition::Ptr free_partition(new Partition);
-      free_partition->device_path = device->path;
-      free_partition->path = "";
-      free_partition->partition_number = -1;
-      free_partition->start_sector = 1;
-      free_partition->end_sector = device->length;
-      free_partition->sector_size = device->sector_size;
-      free_partition->type = PartitionType::Unallocated;
-      device->partitions.append(free_partition);
-
-    } else if (device->table == PartitionTableType::MsDos ||
-        device->table == PartitionTableType::GPT || device->table == PartitionTableType::Others) {
-      PedDisk* lp_disk = nullptr;
-      lp_disk = ped_disk_new(lp_device);
-
-      if (lp_disk) {
-        device->max_prims = ped_disk_get_max_primary_partition_count(lp_disk);
-
-        // If partition table is known, scan partitions in this device->
-        device->partitions = ReadPartitions(lp_disk);
-        // Add additional info to partitions.
-        for (Partition::Ptr partition : device->partitions) {
-          partition->device_path = device->path;
-          partition->sector_size = device->sector_size;
-          if (!partition->path.isEmpty() &&
-              partition->type != PartitionType::Unallocated) {
-            // Read partition label and os.
-            const QString empty_str;
-            partition->label = label_items.value(partition->path, empty_str);
-            for (const OsProberItem& item : os_prober_items) {
-              if (item.path == partition->path) {
-                partition->os = item.type;
-                break;
-              }
-            }
-
-            // Mark busy flag of this partition when it is mounted in system.
-            for (const MountItem& mount_item : mount_items) {
-              if (mount_item.path == partition->path) {
-                partition->busy = true;
-                break;
-              }
-            }
-          }
-        }
-        ped_disk_destroy(lp_disk);
+  return ScanPedDevices(lp_devices, enable_os_prober);
+}
 
-      } else {
-        qCritical() << "Failed to get disk object:" << device->path;
-      }
+DeviceList ScanDevices(const QStringList& device_paths,
+                       bool enable_os_prober) {
+  QList<PedDevice*> lp_devices;
+  for (const QString& device_path : device_paths) {
+    // Drop cached device object in libparted, as size of device may be
+    // changed, e.g. another usb disk is plugged in.
+    RemoveCachedDevice(device_path);
+    PedDevice* lp_device = ped_device_get(device_path.toLocal8Bit().constData());
+    if (lp_device != nullptr) {
+      lp_devices.append(lp_device);
+    } else {
+      qWarning() << "ScanDevices() failed to get device:" << device_path;
     }
-
-    devices.append(device);
   }
 
-  return devices;
+  return ScanPedDevices(lp_devices, enable_os_prober);
 }
 
 }  // namespace installer
@@ -20,12 +20,20 @@
 
 #include <QList>
 #include <QObject>
+#include <QStringList>
 
+#include "partman/auto_part.h"
 #include "partman/device.h"
+#include "partman/luks_tuning.h"
 #include "partman/operation.h"
+#include "partman/partition_format.h"
 
 namespace installer {
 
+class UeventMonitor;
+
+// Device list is cached after first scan, and kept up to date with kernel
+// uevents. Only devices which raised uevents are scanned again.
 class PartitionManager : public QObject {
   Q_OBJECT
 
@@ -33,6 +41,12 @@ class PartitionManager : public QObject {
   explicit PartitionManager(QObject* parent = nullptr);
   ~PartitionManager();
 
+  // Set options used to format partitions in manualPart(), see
+  // MkfsParallel(). Partitions are formatted one by one with default mkfs
+  // options if this is not called.
+  // Call this before moving PartitionManager to its background thread.
+  void setFormatOptions(const FormatOptions& options);
+
  signals:
   // Notify PartitionManager to scan devices.
   // If |umount| is true, umount partitions before scanning.
@@ -40,6 +54,10 @@ class PartitionManager : public QObject {
   void refreshDevices(bool umount, bool enable_os_prober);
   void devicesRefreshed(const DeviceList& devices);
 
+  // Emitted when devices are plugged in, removed or changed outside of
+  // installer, after devicesRefreshed() is emitted.
+  void devicesChanged(const DeviceListDiff& diff);
+
   // Create new partition |table| at |device_path|.
   void createPartitionTable(const QString& device_path,
                             PartitionTableType table);
@@ -50,8 +68,26 @@ class PartitionManager : public QObject {
   // |ok| is true if that script exited 0.
   void autoPartDone(bool ok);
 
+  // Partition a whole disk in-process based on |policy|, instead of running
+  // auto_part.sh. See AutoPartDevice().
+  void nativeAutoPart(const AutoPartPolicy& policy);
+  // Emitted when nativeAutoPart() is done. |result| contains settings to be
+  // saved and is valid only if |ok| is true.
+  void nativeAutoPartDone(bool ok, const AutoPartResult& result);
+
+  // Choose LUKS options for this machine, so that disk is unlocked in about
+  // |iter_time| milliseconds. See TuneLuks().
+  void tuneLuks(int iter_time);
+  // Emitted when tuneLuks() is done.
+  void luksTuned(const LuksTuning& tuning);
+
   void manualPart(const OperationList& operations);
 
+  // Emitted while manualPart() is running, when each step of operations
+  // starts and finishes, and when mkfs reports its percentage.
+  // See ApplyOperations().
+  void manualPartProgress(const OperationProgress& progress);
+
   // Emitted when manualPart() is done.
   // |ok| is true when all operations in operation list are done successfully,
   // and |devices| contains real device list with mount-point.
@@ -60,7 +96,18 @@ class PartitionManager : public QObject {
  private:
   void initConnections();
 
+  // Scan devices at |device_paths| again, and update cached device list.
+  // Returns changes of cached device list.
+  DeviceListDiff updateDevices(const QStringList& device_paths,
+                               bool enable_os_prober);
+
+  void startUeventMonitor();
+  void stopUeventMonitor();
+
   bool enable_os_prober_;
+  FormatOptions format_options_;
+  DeviceList devices_;
+  UeventMonitor* uevent_monitor_ = nullptr;
 
  private slots:
   void doCreatePartitionTable(const QString& device_path,
@@ -68,7 +115,11 @@ class PartitionManager : public QObject {
 
   void doRefreshDevices(bool umount, bool enable_os_prober);
   void doAutoPart(const QString& script_path);
+  void doNativeAutoPart(const AutoPartPolicy& policy);
+  void doTuneLuks(int iter_time);
   void doManualPart(const OperationList& operations);
+
+  void onUeventDevicesChanged(const QStringList& disk_paths);
 };
 
 // Scan all disk devices on this machine.
@@ -76,6 +127,10 @@ class PartitionManager : public QObject {
 // Do not call this function directly, use PartitionManager instead.
 DeviceList ScanDevices(bool enable_os_prober);
 
+// Scan disk devices at |device_paths| only.
+DeviceList ScanDevices(const QStringList& device_paths,
+                       bool enable_os_prober);
+
 }  // namespace installer
 
 #endif  // INSTALLER_PARTMAN_PARTITION_MANAGER_H
@@ -23,8 +23,9 @@
 #include "base/command.h"
 #include "base/string_util.h"
 #include "partman/fs.h"
+#include "partman/fs_superblock.h"
 #include "partman/structs.h"
-#include "sysinfo/proc_swaps.h"
+#include "sysinfo/system_snapshot.h"
 
 namespace installer {
 
@@ -166,14 +167,12 @@ bool ReadJfsUsage(const QString& path, qint64& freespace, qint64& total) {
 }
 
 bool ReadLinuxSwapUsage(const QString& path, qint64& freespace, qint64& total) {
-  const SwapItemList swap_items = ParseSwaps();
   // If this swap partition is used, read from /proc/swaps.
-  for (const SwapItem& item : swap_items) {
-    if (item.filename == path) {
-      total = item.size;
-      freespace = item.size - item.used;
-      return true;
-    }
+  SwapItem item;
+  if (SystemSnapshot::Current()->findSwap(path, item)) {
+    total = item.size;
+    freespace = item.size - item.used;
+    return true;
   }
 
   // If it is not used, it is totally free.
@@ -338,6 +337,12 @@ bool ReadUsage(const QString& partition_path,
                FsType fs_type,
                qint64& freespace,
                qint64& total) {
+  // Parse superblock directly first, which only reads a few KiB from disk,
+  // and fallback to filesystem tools.
+  if (ReadSuperblockUsage(partition_path, fs_type, freespace, total)) {
+    return true;
+  }
+
   bool ok = false;
   switch (fs_type) {
     case FsType::Btrfs: {
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measure end-to-end partitioning cost on loop devices backed by sparse
+// images in tmpfs, or in the folder in --image-dir. Root privilege is
+// required.
+// Result is written in json format, to stdout or the file in --output.
+// Usage: partman-benchmark [--small-size 32] [--large-size 128]
+//                          [--format-profile auto] [--format-jobs 2]
+//                          [--tmpfs-size 4096] [--image-dir dir]
+//                          [--output result.json]
+
+#include <unistd.h>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include "base/command.h"
+#include "base/file_util.h"
+#include "partman/libparted_util.h"
+#include "partman/loop_device_util.h"
+#include "partman/partition_format.h"
+#include "partman/partition_manager.h"
+#include "partman/structs.h"
+#include "ui/delegates/advanced_partition_delegate.h"
+#include "ui/delegates/full_disk_delegate.h"
+
+namespace installer {
+namespace {
+
+const char kWorkDir[] = "/tmp/deepin-installer-partman-benchmark";
+
+// Default image sizes, in GiB. They are below and above default value of
+// partition_full_disk_large_disk_threshold, so that both small and large
+// policies are used.
+const int kDefaultSmallSize = 32;
+const int kDefaultLargeSize = 128;
+const int kDefaultFormatJobs = 2;
+
+// Size of tmpfs holding images, in MiB. Sparse images only take space
+// written by mkfs, and the benchmark fails when tmpfs is full, instead of
+// using up memory of host.
+const int kDefaultTmpfsSize = 4096;
+
+struct LoopDisk {
+  QString image;
+  QString path;
+};
+
+// Create a sparse image of |size| GiB and attach it to a loop device.
+bool AttachLoopDisk(const QString& image, qint64 size, LoopDisk& disk) {
+  disk.image = image;
+  disk.path = AttachLoopDevice(image, size * kGibiByte);
+  return !disk.path.isEmpty();
+}
+
+void DetachLoopDisk(const LoopDisk& disk) {
+  if (!disk.path.isEmpty()) {
+    DetachLoopDevice(disk.path);
+  }
+  QFile::remove(disk.image);
+}
+
+// Get the last partition on |device| which is not unallocated.
+// If |skip| is 1, the one before it is returned.
+Partition::Ptr GetLastPartition(const Device::Ptr device, int skip) {
+  for (int i = device->partitions.length() - 1; i >= 0; --i) {
+    const Partition::Ptr partition = device->partitions.at(i);
+    if (partition->type == PartitionType::Unallocated ||
+        partition->type == PartitionType::Extended) {
+      continue;
+    }
+    if (skip == 0) {
+      return partition;
+    }
+    skip --;
+  }
+  return Partition::Ptr();
+}
+
+Partition::Ptr GetLastUnallocatedPartition(const Device::Ptr device) {
+  for (int i = device->partitions.length() - 1; i >= 0; --i) {
+    if (device->partitions.at(i)->type == PartitionType::Unallocated) {
+      return device->partitions.at(i);
+    }
+  }
+  return Partition::Ptr();
+}
+
+Device::Ptr FindDevice(const DeviceList& devices, const QString& path) {
+  const int index = DeviceIndex(devices, path);
+  return (index == -1) ? Device::Ptr() : devices.at(index);
+}
+
+class PartmanBenchmark {
+ public:
+  PartmanBenchmark(const QList<LoopDisk>& disks,
+                   const FormatOptions& format_options)
+      : disks_(disks) {
+    for (const LoopDisk& disk : disks) {
+      disk_paths_.append(disk.path);
+    }
+    manager_.setFormatOptions(format_options);
+    QObject::connect(&manager_, &PartitionManager::manualPartDone,
+                     [this](bool ok, const DeviceList&) {
+      manual_part_ok_ = ok;
+    });
+    // Cache device list in PartitionManager, so that only loop devices are
+    // scanned again in doManualPart().
+    emit manager_.refreshDevices(false, false);
+  }
+
+  // Scan loop devices and returns scanned devices.
+  DeviceList scan(const QString& name) {
+    QElapsedTimer timer;
+    timer.start();
+    const DeviceList devices = ScanDevices(disk_paths_, false);
+    QJsonObject result;
+    result.insert("name", name);
+    result.insert("devices", devices.length());
+    result.insert("scan_ms", timer.elapsed());
+    scans_.append(result);
+    return devices;
+  }
+
+  // Apply full disk policy to each loop device with partition |table|.
+  bool runFullDisk(const QString& name, PartitionTableType table) {
+    const DeviceList devices = this->scan(name);
+    FullDiskDelegate delegate;
+    delegate.onDeviceRefreshed(devices);
+    OperationList operations;
+    for (const QString& disk_path : disk_paths_) {
+      delegate.resetOperations();
+      if (!delegate.formatWholeDevice(disk_path, table)) {
+        qCritical() << "formatWholeDevice() failed:" << disk_path;
+        return false;
+      }
+      operations.append(delegate.operations());
+    }
+    return this->runManualPart(name, operations);
+  }
+
+  // Edit layout of large disk created by runFullDisk() in advanced mode:
+  // replace data partition with xfs and btrfs partitions and format home.
+  bool runAdvanced(const QString& name) {
+    const DeviceList devices = this->scan(name);
+    AdvancedPartitionDelegate delegate;
+    delegate.onDeviceRefreshed(devices);
+    const QString disk_path = disk_paths_.last();
+
+    Device::Ptr device = FindDevice(delegate.virtual_devices(), disk_path);
+    Partition::Ptr data = device ? GetLastPartition(device, 0) :
+                                   Partition::Ptr();
+    if (!data) {
+      qCritical() << "No data partition found:" << disk_path;
+      return false;
+    }
+    delegate.deletePartition(data);
+    delegate.refreshVisual();
+
+    const FsTypeList fs_list = {FsType::Xfs, FsType::Btrfs};
+    for (int i = 0; i < fs_list.length(); ++i) {
+      device = FindDevice(delegate.virtual_devices(), disk_path);
+      const Partition::Ptr unallocated = GetLastUnallocatedPartition(device);
+      if (!unallocated) {
+        qCritical() << "No unallocated partition found:" << disk_path;
+        return false;
+      }
+      // Split unallocated space equally.
+      const qint64 sectors =
+          unallocated->getSectorLength() / (fs_list.length() - i);
+      if (!delegate.createPartition(unallocated, PartitionType::Normal, true,
+                                    fs_list.at(i), "", sectors)) {
+        return false;
+      }
+      delegate.refreshVisual();
+    }
+
+    // Home partition is the one before data partition.
+    device = FindDevice(delegate.virtual_devices(), disk_path);
+    const Partition::Ptr home = GetLastPartition(device, fs_list.length());
+    if (home) {
+      delegate.formatPartition(home, FsType::Ext4, "/home");
+    }
+
+    return this->runManualPart(name, delegate.operations());
+  }
+
+  QJsonObject result() const {
+    QJsonArray disks;
+    for (const LoopDisk& disk : disks_) {
+      disks.append(disk.path);
+    }
+    QJsonObject result;
+    result.insert("disks", disks);
+    result.insert("scans", scans_);
+    result.insert("runs", runs_);
+    return result;
+  }
+
+ private:
+  bool runManualPart(const QString& name, const OperationList& operations) {
+    manual_part_ok_ = false;
+    QElapsedTimer timer;
+    timer.start();
+    emit manager_.manualPart(operations);
+    const qint64 elapsed = timer.elapsed();
+
+    const CommitStats stats = GetCommitStats();
+    QJsonArray mkfs_jobs;
+    QJsonObject mkfs_ms_by_fs;
+    for (const MkfsRecord& record : GetMkfsRecords()) {
+      const QString fs_name = GetFsTypeName(record.fs);
+      QJsonObject job;
+      job.insert("path", record.path);
+      job.insert("fs", fs_name);
+      job.insert("ok", record.ok);
+      job.insert("ms", record.elapsed);
+      mkfs_jobs.append(job);
+      mkfs_ms_by_fs.insert(fs_name,
+                           mkfs_ms_by_fs.value(fs_name).toInt() +
+                           int(record.elapsed));
+    }
+
+    QJsonObject result;
+    result.insert("name", name);
+    result.insert("ok", manual_part_ok_);
+    result.insert("operations", operations.length());
+    result.insert("commits", stats.commits);
+    result.insert("settles", stats.settles);
+    result.insert("settle_ms", stats.settle_time);
+    result.insert("mkfs", mkfs_jobs);
+    result.insert("mkfs_ms_by_fs", mkfs_ms_by_fs);
+    result.insert("total_ms", elapsed);
+    runs_.append(result);
+    return manual_part_ok_;
+  }
+
+  QList<LoopDisk> disks_;
+  QStringList disk_paths_;
+  PartitionManager manager_;
+  bool manual_part_ok_ = false;
+  QJsonArray scans_;
+  QJsonArray runs_;
+};
+
+}  // namespace
+}  // namespace installer
+
+int main(int argc, char* argv[]) {
+  using namespace installer;
+
+  QCoreApplication app(argc, argv);
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  const QCommandLineOption small_size_option(
+      "small-size", "Size of small disk image in GiB.", "size",
+      QString::number(kDefaultSmallSize));
+  const QCommandLineOption large_size_option(
+      "large-size", "Size of large disk image in GiB.", "size",
+      QString::number(kDefaultLargeSize));
+  const QCommandLineOption profile_option(
+      "format-profile", "Format profile, default, fast or auto.", "profile",
+      "auto");
+  const QCommandLineOption jobs_option(
+      "format-jobs", "Maximum mkfs jobs on one disk, 0 to format one by one.",
+      "jobs", QString::number(kDefaultFormatJobs));
+  const QCommandLineOption tmpfs_size_option(
+      "tmpfs-size", "Size of tmpfs holding images in MiB.", "size",
+      QString::number(kDefaultTmpfsSize));
+  const QCommandLineOption image_dir_option(
+      "image-dir", "Create images in this folder instead of tmpfs.", "dir");
+  const QCommandLineOption output_option(
+      "output", "Write result to file instead of stdout.", "file");
+  parser.addOptions({small_size_option, large_size_option, profile_option,
+                     jobs_option, tmpfs_size_option, image_dir_option,
+                     output_option});
+  parser.process(app);
+
+  if (geteuid() != 0) {
+    qCritical() << "partman-benchmark requires root privilege";
+    return 1;
+  }
+
+  // Keep images in memory by default, so that result does not depend on
+  // disk of host.
+  const bool use_tmpfs = !parser.isSet(image_dir_option);
+  const QString image_dir =
+      use_tmpfs ? kWorkDir : parser.value(image_dir_option);
+  if (!CreateDirs(image_dir)) {
+    qCritical() << "Failed to create image dir:" << image_dir;
+    return 1;
+  }
+  if (use_tmpfs) {
+    const QString options =
+        QString("size=%1m").arg(parser.value(tmpfs_size_option).toInt());
+    if (!SpawnCmd("mount", {"-t", "tmpfs", "-o", options, "tmpfs",
+                            kWorkDir})) {
+      qCritical() << "Failed to mount tmpfs at" << kWorkDir;
+      return 1;
+    }
+  }
+
+  FormatOptions format_options;
+  format_options.jobs_per_device = parser.value(jobs_option).toInt();
+  format_options.profile = ParseFormatProfile(parser.value(profile_option));
+
+  QList<LoopDisk> disks;
+  bool ok = true;
+  const QList<int> sizes = {parser.value(small_size_option).toInt(),
+                            parser.value(large_size_option).toInt()};
+  for (int i = 0; ok && i < sizes.length(); ++i) {
+    LoopDisk disk;
+    const QString image = QString("%1/disk%2.img").arg(image_dir).arg(i);
+    ok = AttachLoopDisk(image, sizes.at(i), disk);
+    if (ok) {
+      disks.append(disk);
+    }
+  }
+
+  QJsonObject result;
+  if (ok) {
+    PartmanBenchmark benchmark(disks, format_options);
+    benchmark.scan("empty");
+    ok = benchmark.runFullDisk("full_disk_legacy", PartitionTableType::MsDos) &&
+         benchmark.runFullDisk("full_disk_uefi", PartitionTableType::GPT) &&
+         benchmark.runAdvanced("advanced");
+    benchmark.scan("final");
+    result = benchmark.result();
+  }
+  result.insert("ok", ok);
+
+  for (const LoopDisk& disk : disks) {
+    DetachLoopDisk(disk);
+  }
+  if (use_tmpfs) {
+    SpawnCmd("umount", {kWorkDir});
+    QDir(kWorkDir).removeRecursively();
+  }
+
+  const QByteArray json = QJsonDocument(result).toJson();
+  if (parser.isSet(output_option)) {
+    QFile file(parser.value(output_option));
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+      qCritical() << "Failed to write result to" << file.fileName();
+      return 1;
+    }
+  } else {
+    QTextStream(stdout) << json;
+  }
+
+  return ok ? 0 : 1;
+}
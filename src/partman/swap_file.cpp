@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/swap_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/magic.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+#include <QByteArray>
+#include <QDebug>
+#include <QFileInfo>
+#include <QUuid>
+
+namespace installer {
+
+namespace {
+
+// Blocks are preallocated in chunks of 256MiB, so that progress can be
+// reported on slow disks.
+const qint64 kAllocChunkSize = 256 * 1024 * 1024;
+
+// Zeros are written in chunks of 4MiB.
+const qint64 kZeroChunkSize = 4 * 1024 * 1024;
+
+// Layout of swap header, see union swap_header in linux/swap.h.
+const char kSwapSignature[] = "SWAPSPACE2";
+const int kSwapSignatureLength = 10;
+// Offset of version, last_page and nr_badpages, after boot bits.
+const int kSwapInfoOffset = 1024;
+const int kSwapUuidOffset = kSwapInfoOffset + 3 * sizeof(quint32);
+const quint32 kSwapVersion = 1;
+// mkswap requires at least 10 pages.
+const qint64 kSwapMinPages = 10;
+
+// Allocate |size| bytes of |fd|, with fallocate() or by writing zeros.
+bool AllocateBlocks(int fd,
+                    qint64 size,
+                    bool zero_fill,
+                    const std::function<void(int progress)>& progress) {
+  const QByteArray zeros(zero_fill ? int(kZeroChunkSize) : 0, '\0');
+  int last_progress = -1;
+  qint64 offset = 0;
+  while (offset < size) {
+    if (zero_fill) {
+      const qint64 length = qMin(kZeroChunkSize, size - offset);
+      const ssize_t written = pwrite(fd, zeros.constData(), size_t(length),
+                                     offset);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        qCritical() << "AllocateBlocks() write failed:" << strerror(errno);
+        return false;
+      }
+      offset += written;
+    } else {
+      const qint64 length = qMin(kAllocChunkSize, size - offset);
+      if (fallocate(fd, 0, offset, length) != 0) {
+        if (errno == EOPNOTSUPP && offset == 0) {
+          qWarning() << "AllocateBlocks() fallocate() not supported";
+          return AllocateBlocks(fd, size, true, progress);
+        }
+        qCritical() << "AllocateBlocks() fallocate failed:" << strerror(errno);
+        return false;
+      }
+      offset += length;
+    }
+
+    const int value = int(offset * 100 / size);
+    if (progress && value != last_progress) {
+      last_progress = value;
+      progress(value);
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+SwapFileMethod GetSwapFileMethod(const QString& path) {
+  const QString dir = QFileInfo(path).absolutePath();
+  struct statfs buf;
+  if (statfs(dir.toLocal8Bit().constData(), &buf) != 0) {
+    qWarning() << "GetSwapFileMethod() statfs failed:" << dir
+               << strerror(errno);
+    return SwapFileMethod::ZeroFill;
+  }
+
+  switch (static_cast<quint32>(buf.f_type)) {
+    case EXT4_SUPER_MAGIC:  // Also ext2 and ext3.
+    case XFS_SUPER_MAGIC: {
+      return SwapFileMethod::Fallocate;
+    }
+    case BTRFS_SUPER_MAGIC: {
+      return SwapFileMethod::BtrfsNoCow;
+    }
+    default: {
+      // Swap file with unwritten extents is refused by other filesystems.
+      return SwapFileMethod::ZeroFill;
+    }
+  }
+}
+
+bool WriteSwapHeader(int fd, qint64 size) {
+  const qint64 page_size = sysconf(_SC_PAGESIZE);
+  const qint64 pages = size / page_size;
+  if (pages < kSwapMinPages) {
+    qCritical() << "WriteSwapHeader() swap area is too small:" << size;
+    return false;
+  }
+
+  QByteArray header(int(page_size), '\0');
+  const quint32 info[3] = { kSwapVersion, quint32(pages - 1), 0 };
+  memcpy(header.data() + kSwapInfoOffset, info, sizeof(info));
+  const QByteArray uuid = QUuid::createUuid().toRfc4122();
+  memcpy(header.data() + kSwapUuidOffset, uuid.constData(),
+         size_t(uuid.size()));
+  memcpy(header.data() + page_size - kSwapSignatureLength, kSwapSignature,
+         kSwapSignatureLength);
+
+  if (pwrite(fd, header.constData(), size_t(page_size), 0) != page_size) {
+    qCritical() << "WriteSwapHeader() write failed:" << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool CreateSwapFile(const QString& path,
+                    qint64 size,
+                    const std::function<void(int progress)>& progress) {
+  const SwapFileMethod method = GetSwapFileMethod(path);
+  qDebug() << "CreateSwapFile()" << path << size
+           << "method:" << static_cast<int>(method);
+
+  const QByteArray file = path.toLocal8Bit();
+  if (unlink(file.constData()) != 0 && errno != ENOENT) {
+    qCritical() << "CreateSwapFile() failed to remove old file:"
+                << strerror(errno);
+    return false;
+  }
+
+  const int fd = open(file.constData(),
+                      O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    qCritical() << "CreateSwapFile() failed to create file:" << path
+                << strerror(errno);
+    return false;
+  }
+
+  // umask may clear more permission bits.
+  bool ok = (fchmod(fd, 0600) == 0);
+
+  if (ok && method == SwapFileMethod::BtrfsNoCow) {
+    // NOCOW attribute takes effect only if it is set on an empty file.
+    // This also disables compression of the file.
+    int flags = 0;
+    ok = (ioctl(fd, FS_IOC_GETFLAGS, &flags) == 0);
+    flags |= FS_NOCOW_FL;
+    ok = ok && (ioctl(fd, FS_IOC_SETFLAGS, &flags) == 0);
+    if (!ok) {
+      qCritical() << "CreateSwapFile() failed to disable copy-on-write:"
+                  << strerror(errno);
+    }
+  }
+
+  ok = ok &&
+       AllocateBlocks(fd, size, method == SwapFileMethod::ZeroFill,
+                      progress) &&
+       WriteSwapHeader(fd, size);
+  if (ok && fdatasync(fd) != 0) {
+    qCritical() << "CreateSwapFile() fdatasync failed:" << strerror(errno);
+    ok = false;
+  }
+  close(fd);
+
+  if (!ok) {
+    unlink(file.constData());
+  }
+  return ok;
+}
+
+}  // namespace installer
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_PARTMAN_SWAP_FILE_H
+#define INSTALLER_PARTMAN_SWAP_FILE_H
+
+#include <functional>
+#include <QString>
+
+namespace installer {
+
+// Method used to allocate blocks of a swap file.
+enum class SwapFileMethod {
+  Fallocate,  // Preallocate with fallocate(), on ext4 and xfs.
+  // Disable copy-on-write of the file and preallocate it, on btrfs.
+  BtrfsNoCow,
+  ZeroFill,  // Write zeros, on other filesystems.
+};
+
+// Get allocation method for swap file at |path|, based on filesystem type of
+// its parent folder.
+SwapFileMethod GetSwapFileMethod(const QString& path);
+
+// Write swap area header of a swap file with |size| bytes to |fd|, like
+// `mkswap` does.
+bool WriteSwapHeader(int fd, qint64 size);
+
+// Create a swap file at |path| with |size| bytes, old file is removed.
+// |progress| is called with percentage while blocks are allocated.
+// Swap file is only readable by root, and is removed on error.
+bool CreateSwapFile(const QString& path,
+                    qint64 size,
+                    const std::function<void(int progress)>& progress);
+
+}  // namespace installer
+
+#endif  // INSTALLER_PARTMAN_SWAP_FILE_H
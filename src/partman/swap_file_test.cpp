@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/swap_file.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const qint64 kSwapFileSize = 8 * 1024 * 1024;
+
+TEST(SwapFile, CreateSwapFile) {
+  const QString path = QDir::temp().absoluteFilePath("installer-swap-file");
+  QList<int> progress_list;
+  ASSERT_TRUE(CreateSwapFile(path, kSwapFileSize, [&](int progress) {
+    progress_list.append(progress);
+  }));
+  ASSERT_FALSE(progress_list.isEmpty());
+  EXPECT_EQ(progress_list.last(), 100);
+
+  QFile file(path);
+  EXPECT_EQ(file.size(), kSwapFileSize);
+  EXPECT_EQ(file.permissions() & 0x0FFF,
+            QFile::ReadOwner | QFile::WriteOwner |
+            QFile::ReadUser | QFile::WriteUser);
+
+  const int page_size = int(sysconf(_SC_PAGESIZE));
+  ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+  const QByteArray header = file.read(page_size);
+  file.close();
+  ASSERT_EQ(header.size(), page_size);
+  EXPECT_EQ(header.right(10), QByteArray("SWAPSPACE2"));
+
+  quint32 info[3];
+  memcpy(info, header.constData() + 1024, sizeof(info));
+  EXPECT_EQ(info[0], 1u);
+  EXPECT_EQ(info[1], quint32(kSwapFileSize / page_size - 1));
+  EXPECT_EQ(info[2], 0u);
+
+  // Old file is replaced.
+  ASSERT_TRUE(CreateSwapFile(path, kSwapFileSize * 2, nullptr));
+  EXPECT_EQ(QFileInfo(path).size(), kSwapFileSize * 2);
+
+  EXPECT_TRUE(QFile::remove(path));
+}
+
+TEST(SwapFile, TooSmall) {
+  const QString path = QDir::temp().absoluteFilePath("installer-swap-file");
+  EXPECT_FALSE(CreateSwapFile(path, 4096, nullptr));
+  EXPECT_FALSE(QFile::exists(path));
+}
+
+}  // namespace
+}  // namespace installer
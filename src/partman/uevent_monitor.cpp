@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/uevent_monitor.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QHash>
+#include <QSocketNotifier>
+#include <QTimer>
+
+namespace installer {
+
+namespace {
+
+// Multicast group of uevents sent by udev, after it has probed the device
+// and created links in /dev/disk/by-*. Kernel sends raw uevents to group 1,
+// which may arrive before udev has done its job.
+const int kUdevUeventGroup = 2;
+
+// udev messages start with a binary header, see udev_monitor_netlink_header
+// in libudev-monitor.c.
+const char kUdevPrefix[] = "libudev";
+const quint32 kUdevMagic = 0xfeedcafe;
+const int kUdevHeaderSize = 40;
+
+// Events received in this period are merged.
+const int kMergeEventsInterval = 800;
+
+// Maximum size of one uevent message.
+const int kUeventBufSize = 8 * 1024;
+
+// Prefix of disks which are not scanned by partition manager.
+const char* const kIgnoredDisks[] = {
+  "loop", "ram", "zram", "sr", "fd",
+};
+
+}  // namespace
+
+bool ParseBlockUevent(const QByteArray& message, BlockUevent& event) {
+  // Kernel message is a header like "add@/devices/...", followed by a list
+  // of KEY=VALUE items, separated by '\0'. udev message has a binary header
+  // with offset and length of the same list.
+  QByteArray properties = message;
+  if (message.startsWith(QByteArray(kUdevPrefix, sizeof(kUdevPrefix)))) {
+    if (message.size() < kUdevHeaderSize) {
+      return false;
+    }
+    quint32 magic;
+    quint32 properties_off;
+    quint32 properties_len;
+    memcpy(&magic, message.constData() + 8, sizeof(magic));
+    memcpy(&properties_off, message.constData() + 16, sizeof(properties_off));
+    memcpy(&properties_len, message.constData() + 20, sizeof(properties_len));
+    if (ntohl(magic) != kUdevMagic ||
+        properties_off > quint32(message.size()) ||
+        properties_len > quint32(message.size()) - properties_off) {
+      return false;
+    }
+    properties = message.mid(int(properties_off), int(properties_len));
+  }
+
+  QHash<QByteArray, QByteArray> items;
+  for (const QByteArray& item : properties.split('\0')) {
+    const int index = item.indexOf('=');
+    if (index > 0) {
+      items.insert(item.left(index), item.mid(index + 1));
+    }
+  }
+
+  if (items.value("SUBSYSTEM") != "block") {
+    return false;
+  }
+  const QByteArray dev_type = items.value("DEVTYPE");
+  if (dev_type != "disk" && dev_type != "partition") {
+    return false;
+  }
+  // DEVNAME is full path to device file in udev messages.
+  QString dev_name = items.value("DEVNAME");
+  if (dev_name.startsWith("/dev/")) {
+    dev_name = dev_name.mid(5);
+  }
+  const QString dev_path = items.value("DEVPATH");
+  if (dev_name.isEmpty() || dev_path.isEmpty()) {
+    return false;
+  }
+
+  QString disk_name;
+  event.is_partition = (dev_type == "partition");
+  if (event.is_partition) {
+    // Parent folder of partition in sysfs is its disk, like
+    // /devices/pci0000:00/0000:00:14.0/.../block/sdb/sdb1
+    const QStringList parts = dev_path.split('/', QString::SkipEmptyParts);
+    if (parts.length() < 2) {
+      return false;
+    }
+    disk_name = parts.at(parts.length() - 2);
+  } else {
+    disk_name = dev_name;
+  }
+
+  for (const char* prefix : kIgnoredDisks) {
+    if (disk_name.startsWith(prefix)) {
+      return false;
+    }
+  }
+
+  event.action = items.value("ACTION");
+  event.disk_path = QString("/dev/%1").arg(disk_name);
+  return true;
+}
+
+UeventMonitor::UeventMonitor(QObject* parent)
+    : QObject(parent),
+      timer_(new QTimer(this)) {
+  this->setObjectName("uevent_monitor");
+
+  timer_->setSingleShot(true);
+  timer_->setInterval(kMergeEventsInterval);
+  connect(timer_, &QTimer::timeout,
+          this, &UeventMonitor::onTimeout);
+}
+
+UeventMonitor::~UeventMonitor() {
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool UeventMonitor::start() {
+  if (fd_ != -1) {
+    return true;
+  }
+
+  fd_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+               NETLINK_KOBJECT_UEVENT);
+  if (fd_ == -1) {
+    qWarning() << "UeventMonitor socket() failed:" << strerror(errno);
+    return false;
+  }
+
+  struct sockaddr_nl addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_pid = 0;  // Assigned by kernel.
+  addr.nl_groups = kUdevUeventGroup;
+  if (bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr))
+      == -1) {
+    qWarning() << "UeventMonitor bind() failed:" << strerror(errno);
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  notifier_ = new QSocketNotifier(fd_, QSocketNotifier::Read, this);
+  // activated() signal is overloaded in newer Qt versions.
+  connect(notifier_, SIGNAL(activated(int)),
+          this, SLOT(onActivated()));
+  return true;
+}
+
+void UeventMonitor::pause() {
+  paused_ = true;
+  timer_->stop();
+  pending_disks_.clear();
+}
+
+void UeventMonitor::resume() {
+  // Drop events emitted while disks were modified by ourself.
+  readMessages();
+  pending_disks_.clear();
+  paused_ = false;
+}
+
+void UeventMonitor::readMessages() {
+  if (fd_ == -1) {
+    return;
+  }
+
+  char buf[kUeventBufSize];
+  while (true) {
+    const ssize_t num_read = recv(fd_, buf, sizeof(buf), 0);
+    if (num_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        qWarning() << "UeventMonitor recv() failed:" << strerror(errno);
+      }
+      break;
+    }
+    if (num_read == 0 || paused_) {
+      continue;
+    }
+
+    BlockUevent event;
+    if (ParseBlockUevent(QByteArray(buf, int(num_read)), event)) {
+      qDebug() << "UeventMonitor:" << event.action << event.disk_path
+               << "partition:" << event.is_partition;
+      pending_disks_.insert(event.disk_path);
+    }
+  }
+}
+
+void UeventMonitor::onActivated() {
+  readMessages();
+  if (!pending_disks_.isEmpty()) {
+    // Restart timer to wait for more events.
+    timer_->start();
+  }
+}
+
+void UeventMonitor::onTimeout() {
+  if (paused_ || pending_disks_.isEmpty()) {
+    return;
+  }
+  QStringList disk_paths = pending_disks_.toList();
+  disk_paths.sort();
+  pending_disks_.clear();
+  emit this->devicesChanged(disk_paths);
+}
+
+}  // namespace installer
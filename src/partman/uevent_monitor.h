@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_PARTMAN_UEVENT_MONITOR_H
+#define INSTALLER_PARTMAN_UEVENT_MONITOR_H
+
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+class QSocketNotifier;
+class QTimer;
+
+namespace installer {
+
+// Block device event parsed from uevent message.
+struct BlockUevent {
+  QString action;  // add, remove, change...
+  QString disk_path;  // Path to disk device, like /dev/sdb.
+  bool is_partition = false;
+};
+
+// Parse uevent |message| received from netlink socket, sent by either
+// kernel or udev.
+// Returns false if |message| is not about a disk or partition, or its disk
+// is never scanned by partition manager, like loop, ram and cdrom devices.
+bool ParseBlockUevent(const QByteArray& message, BlockUevent& event);
+
+// Monitors uevents of block devices sent by udev, with a netlink socket.
+// udev sends them after device is probed and its links are created, so
+// disks can be scanned as soon as events are reported.
+// Events are merged in a short period before being reported, as creating a
+// partition table emits a series of events for the disk and its partitions.
+// This object shall live in a thread with event loop.
+class UeventMonitor : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit UeventMonitor(QObject* parent = nullptr);
+  ~UeventMonitor();
+
+  // Open netlink socket and start monitoring. Returns false on failure.
+  bool start();
+
+  // Ignore all events received from now on, until resume() is called.
+  // Used when partition manager itself is modifying disks.
+  void pause();
+  void resume();
+
+ signals:
+  // Emitted with path to disks which are added, removed or changed.
+  void devicesChanged(const QStringList& disk_paths);
+
+ private:
+  // Read all pending messages from socket.
+  void readMessages();
+
+  int fd_ = -1;
+  bool paused_ = false;
+  QSocketNotifier* notifier_ = nullptr;
+  QTimer* timer_ = nullptr;
+  QSet<QString> pending_disks_;
+
+ private slots:
+  void onActivated();
+  void onTimeout();
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_PARTMAN_UEVENT_MONITOR_H
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "partman/uevent_monitor.h"
+
+#include <arpa/inet.h>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+QByteArray MakeMessage(const QList<QByteArray>& items) {
+  QByteArray message;
+  for (const QByteArray& item : items) {
+    message.append(item);
+    message.append('\0');
+  }
+  return message;
+}
+
+TEST(UeventMonitorTest, ParseBlockUevent) {
+  BlockUevent event;
+  const QByteArray partition_msg = MakeMessage({
+      "add@/devices/pci0000:00/0000:00:14.0/usb2/2-1/2-1:1.0/host6/"
+          "target6:0:0/6:0:0:0/block/sdb/sdb1",
+      "ACTION=add",
+      "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb2/2-1/2-1:1.0/host6/"
+          "target6:0:0/6:0:0:0/block/sdb/sdb1",
+      "SUBSYSTEM=block",
+      "MAJOR=8",
+      "MINOR=17",
+      "DEVNAME=sdb1",
+      "DEVTYPE=partition",
+      "PARTN=1",
+      "SEQNUM=4242",
+  });
+  EXPECT_TRUE(ParseBlockUevent(partition_msg, event));
+  EXPECT_EQ(event.action, "add");
+  EXPECT_EQ(event.disk_path, "/dev/sdb");
+  EXPECT_TRUE(event.is_partition);
+
+  const QByteArray disk_msg = MakeMessage({
+      "change@/devices/pci0000:00/0000:00:1d.0/0000:3d:00.0/nvme/nvme0/"
+          "nvme0n1",
+      "ACTION=change",
+      "DEVPATH=/devices/pci0000:00/0000:00:1d.0/0000:3d:00.0/nvme/nvme0/"
+          "nvme0n1",
+      "SUBSYSTEM=block",
+      "DEVNAME=nvme0n1",
+      "DEVTYPE=disk",
+  });
+  EXPECT_TRUE(ParseBlockUevent(disk_msg, event));
+  EXPECT_EQ(event.action, "change");
+  EXPECT_EQ(event.disk_path, "/dev/nvme0n1");
+  EXPECT_FALSE(event.is_partition);
+
+  // Loop devices are ignored.
+  const QByteArray loop_msg = MakeMessage({
+      "change@/devices/virtual/block/loop0",
+      "ACTION=change",
+      "DEVPATH=/devices/virtual/block/loop0",
+      "SUBSYSTEM=block",
+      "DEVNAME=loop0",
+      "DEVTYPE=disk",
+  });
+  EXPECT_FALSE(ParseBlockUevent(loop_msg, event));
+
+  // Not a block device.
+  const QByteArray usb_msg = MakeMessage({
+      "add@/devices/pci0000:00/0000:00:14.0/usb2/2-1",
+      "ACTION=add",
+      "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb2/2-1",
+      "SUBSYSTEM=usb",
+      "DEVNAME=bus/usb/002/003",
+      "DEVTYPE=usb_device",
+  });
+  EXPECT_FALSE(ParseBlockUevent(usb_msg, event));
+}
+
+TEST(UeventMonitorTest, ParseUdevBlockUevent) {
+  const QByteArray properties = MakeMessage({
+      "ACTION=remove",
+      "DEVPATH=/devices/pci0000:00/0000:00:14.0/usb2/2-1/2-1:1.0/host6/"
+          "target6:0:0/6:0:0:0/block/sdb/sdb2",
+      "SUBSYSTEM=block",
+      "DEVNAME=/dev/sdb2",
+      "DEVTYPE=partition",
+      "ID_FS_TYPE=ext4",
+  });
+
+  // Header of udev_monitor_netlink_header, properties follow it.
+  QByteArray message("libudev", 8);
+  const quint32 header[] = {
+      htonl(0xfeedcafe), 40, 40, quint32(properties.size()), 0, 0, 0, 0,
+  };
+  message.append(reinterpret_cast<const char*>(header), sizeof(header));
+  message.append(properties);
+
+  BlockUevent event;
+  EXPECT_TRUE(ParseBlockUevent(message, event));
+  EXPECT_EQ(event.action, "remove");
+  EXPECT_EQ(event.disk_path, "/dev/sdb");
+  EXPECT_TRUE(event.is_partition);
+
+  // Properties out of message.
+  EXPECT_FALSE(ParseBlockUevent(message.left(60), event));
+}
+
+}  // namespace
+}  // namespace installer
@@ -23,14 +23,15 @@
 #include <QDir>
 
 #include "partman/structs.h"
-#include "sysinfo/proc_partitions.h"
+#include "sysinfo/system_snapshot.h"
 
 namespace installer {
 
 qint64 GetMaximumDeviceSize() {
-  const PartitionItemList list = ParsePartitionItems();
   qint64 result = 0;
-  for (const PartitionItem item : list) {
+  // Hold the snapshot, Refresh() may replace the current one meanwhile.
+  const SystemSnapshot::Ptr snapshot = SystemSnapshot::Current();
+  for (const PartitionItem& item : snapshot->partitions()) {
     result = qMax(result, item.blocks);
   }
 
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "service/backend/target_finalizer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <unistd.h>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+#include <atomic>
+
+#include "base/thread_util.h"
+#include "sysinfo/proc_meminfo.h"
+#include "sysinfo/proc_mountinfo.h"
+
+namespace installer {
+
+namespace {
+
+// Interval to sample /proc/meminfo while syncing, in milliseconds.
+const int kWritebackSampleInterval = 1000;
+// Sleep in short slices so that sampling stops soon after sync is done.
+const int kWritebackSleepSlice = 100;
+
+// Returns true if |mount_point| is |target| or below it.
+bool IsTargetMountPoint(const QString& target, const QString& mount_point) {
+  return (mount_point == target) || mount_point.startsWith(target + "/");
+}
+
+// Returns the first mount point of each block device mounted at |target|
+// or below it.
+QStringList GetTargetFilesystems(const QString& target) {
+  QStringList sources;
+  QStringList mount_points;
+  for (const MountInfoItem& item : ParseMountInfo()) {
+    if (IsTargetMountPoint(target, item.mount_point) &&
+        item.source.startsWith("/dev/") &&
+        !sources.contains(item.source)) {
+      sources.append(item.source);
+      mount_points.append(item.mount_point);
+    }
+  }
+  return mount_points;
+}
+
+// Returns all mount points at |target| or below it, in reverse order of
+// mounting, so that each of them is unmounted before its parent.
+QStringList GetTargetMountPoints(const QString& target) {
+  QStringList mount_points;
+  for (const MountInfoItem& item : ParseMountInfo()) {
+    if (IsTargetMountPoint(target, item.mount_point)) {
+      mount_points.prepend(item.mount_point);
+    }
+  }
+  return mount_points;
+}
+
+void SyncFilesystem(const QString& mount_point) {
+  const int fd = open(mount_point.toLocal8Bit().constData(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    qWarning() << "SyncFilesystem() failed to open" << mount_point;
+    return;
+  }
+  if (syncfs(fd) == -1) {
+    qWarning() << "SyncFilesystem() syncfs failed:" << mount_point
+               << strerror(errno);
+  }
+  close(fd);
+}
+
+}  // namespace
+
+QDebug& operator<<(QDebug& debug, const FinalizePhase& phase) {
+  switch (phase) {
+    case FinalizePhase::Sync: {
+      debug << "Sync";
+      break;
+    }
+    case FinalizePhase::Unmount: {
+      debug << "Unmount";
+      break;
+    }
+  }
+  return debug;
+}
+
+QDebug& operator<<(QDebug& debug, const FinalizeProgress& progress) {
+  debug << "FinalizeProgress: {"
+        << "phase:" << progress.phase
+        << "path:" << progress.path
+        << "remaining:" << progress.remaining
+        << "percent:" << progress.percent
+        << "eta:" << progress.eta
+        << "}";
+  return debug;
+}
+
+void WritebackEstimator::update(qint64 pending, qint64 elapsed) {
+  pending_ = pending;
+  elapsed_ = elapsed;
+  // More data is dirtied than written back, estimate from this sample.
+  if (pending > initial_) {
+    initial_ = pending;
+    initial_elapsed_ = elapsed;
+  }
+}
+
+int WritebackEstimator::percent() const {
+  if (initial_ <= 0) {
+    return 100;
+  }
+  return int((initial_ - pending_) * 100 / initial_);
+}
+
+int WritebackEstimator::eta() const {
+  if (initial_ < 0) {
+    return -1;
+  }
+  if (pending_ <= 0) {
+    return 0;
+  }
+  const qint64 written = initial_ - pending_;
+  const qint64 duration = elapsed_ - initial_elapsed_;
+  if (written <= 0 || duration <= 0) {
+    return -1;
+  }
+  // Round up to seconds.
+  return int((pending_ * duration / written + 999) / 1000);
+}
+
+void SyncTargetFilesystems(const QString& target,
+                           const FinalizeProgressHandler& handler) {
+  const QStringList mount_points = GetTargetFilesystems(target);
+  const int count = mount_points.length();
+  if (count == 0) {
+    qWarning() << "SyncTargetFilesystems() no filesystem at" << target;
+    return;
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  std::atomic<int> synced(0);
+
+  // syncfs() reports nothing until it returns, so an extra task samples
+  // page cache until all filesystems are synced. Dirty and Writeback are
+  // system wide, which is close enough as only target disk is written now.
+  const int tasks = handler ? count + 1 : count;
+  ParallelFor(tasks, tasks, [&](int index) {
+    if (index < count) {
+      SyncFilesystem(mount_points.at(index));
+      synced ++;
+      return;
+    }
+
+    WritebackEstimator estimator;
+    while (true) {
+      const bool done = (synced == count);
+      const MemInfo info = GetMemInfo();
+      estimator.update(info.dirty + info.writeback, timer.elapsed());
+
+      FinalizeProgress progress;
+      progress.phase = FinalizePhase::Sync;
+      progress.remaining = estimator.pending();
+      progress.percent = done ? 100 : qMin(estimator.percent(), 99);
+      progress.eta = done ? 0 : estimator.eta();
+      handler(progress);
+      if (done) {
+        break;
+      }
+
+      for (int slept = 0;
+           slept < kWritebackSampleInterval && synced < count;
+           slept += kWritebackSleepSlice) {
+        QThread::msleep(kWritebackSleepSlice);
+      }
+    }
+  });
+
+  qDebug() << "SyncTargetFilesystems()" << mount_points
+           << "elapsed(ms):" << timer.elapsed();
+}
+
+bool UnmountTarget(const QString& target, int retries, int interval,
+                   const FinalizeProgressHandler& handler) {
+  const QStringList mount_points = GetTargetMountPoints(target);
+  QElapsedTimer timer;
+  timer.start();
+  bool ok = true;
+  for (int index = 0; index < mount_points.length(); ++index) {
+    const QString& mount_point = mount_points.at(index);
+    if (handler) {
+      FinalizeProgress progress;
+      progress.phase = FinalizePhase::Unmount;
+      progress.path = mount_point;
+      progress.percent = index * 100 / mount_points.length();
+      handler(progress);
+    }
+
+    const QByteArray path = mount_point.toLocal8Bit();
+    int result = umount2(path.constData(), 0);
+    int error = errno;
+    for (int attempt = 1;
+         result == -1 && error == EBUSY && attempt < retries;
+         ++attempt) {
+      qWarning() << "UnmountTarget() busy:" << mount_point
+                 << "attempt:" << attempt;
+      QThread::msleep(interval);
+      result = umount2(path.constData(), 0);
+      error = errno;
+    }
+
+    // EINVAL is returned if it is not a mount point any more.
+    if (result == 0 || error == EINVAL) {
+      continue;
+    }
+    ok = false;
+    if (error == EBUSY) {
+      qCritical() << "UnmountTarget() detach busy mount point:"
+                  << mount_point;
+      if (umount2(path.constData(), MNT_DETACH) == -1) {
+        qCritical() << "UnmountTarget() failed to detach" << mount_point
+                    << strerror(errno);
+      }
+    } else {
+      qCritical() << "UnmountTarget() failed to unmount" << mount_point
+                  << strerror(error);
+    }
+  }
+
+  // Filesystems detached lazily are written back when they are not busy,
+  // flush them now as far as possible.
+  if (!ok) {
+    sync();
+  }
+
+  qDebug() << "UnmountTarget()" << mount_points
+           << "elapsed(ms):" << timer.elapsed();
+  return ok;
+}
+
+}  // namespace installer
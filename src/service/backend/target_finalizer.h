@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef INSTALLER_SERVICE_BACKEND_TARGET_FINALIZER_H
+#define INSTALLER_SERVICE_BACKEND_TARGET_FINALIZER_H
+
+#include <QDebug>
+#include <QString>
+#include <functional>
+
+namespace installer {
+
+enum class FinalizePhase {
+  Sync,  // Write back dirty data of target filesystems.
+  Unmount,  // Unmount target filesystems.
+};
+QDebug& operator<<(QDebug& debug, const FinalizePhase& phase);
+
+// Progress of SyncTargetFilesystems() and UnmountTarget().
+struct FinalizeProgress {
+  FinalizePhase phase = FinalizePhase::Sync;
+  // Mount point being unmounted, empty in Sync phase.
+  QString path;
+  // Dirty and writeback data in page cache, in bytes.
+  qint64 remaining = 0;
+  // Percentage of data written back, or of mount points unmounted.
+  int percent = 0;
+  // Estimated time to finish writeback in seconds, -1 if unknown.
+  int eta = -1;
+};
+QDebug& operator<<(QDebug& debug, const FinalizeProgress& progress);
+
+typedef std::function<void(const FinalizeProgress& progress)>
+    FinalizeProgressHandler;
+
+// Estimates progress of writeback from samples of Dirty + Writeback in
+// /proc/meminfo.
+class WritebackEstimator {
+ public:
+  // Add a sample with |pending| bytes not written back yet, taken |elapsed|
+  // milliseconds after writeback started.
+  void update(qint64 pending, qint64 elapsed);
+
+  qint64 pending() const { return pending_; }
+
+  // Percentage of data written back since the largest sample.
+  int percent() const;
+
+  // Seconds to write back pending data at the observed rate, or -1 if
+  // nothing is written back yet.
+  int eta() const;
+
+ private:
+  // Largest sample, and time when it is taken.
+  qint64 initial_ = -1;
+  qint64 initial_elapsed_ = 0;
+
+  qint64 pending_ = 0;
+  qint64 elapsed_ = 0;
+};
+
+// Call syncfs() on each block device filesystem mounted at |target| or below
+// it, in parallel. Dirty and Writeback of /proc/meminfo are sampled each
+// second while waiting, and |handler| is called with each sample. Like
+// ApplyOperations(), |handler| is called in a worker thread.
+void SyncTargetFilesystems(const QString& target,
+                           const FinalizeProgressHandler& handler = nullptr);
+
+// Unmount all filesystems mounted at |target| or below it, in reverse order
+// of mounting. A busy mount point is tried at most |retries| times, with
+// |interval| milliseconds between them, and is detached lazily at last.
+// Returns false if any mount point is detached lazily or fails to unmount.
+bool UnmountTarget(const QString& target, int retries, int interval,
+                   const FinalizeProgressHandler& handler = nullptr);
+
+}  // namespace installer
+
+#endif  // INSTALLER_SERVICE_BACKEND_TARGET_FINALIZER_H
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Unmount nested tmpfs mounts with UnmountTarget().
+
+#include "service/backend/target_finalizer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <QDir>
+#include <QElapsedTimer>
+
+#include "base/command.h"
+#include "sysinfo/proc_mountinfo.h"
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kTestDir[] = "/tmp/deepin-installer-target-finalizer-test";
+
+// Returns mount points at |target| or below it.
+QStringList GetMountPoints(const QString& target) {
+  QStringList mount_points;
+  for (const MountInfoItem& item : ParseMountInfo()) {
+    if (item.mount_point == target ||
+        item.mount_point.startsWith(target + "/")) {
+      mount_points.append(item.mount_point);
+    }
+  }
+  return mount_points;
+}
+
+class TargetFinalizerRootTest : public testing::Test {
+ protected:
+  // Mount a tmpfs at |target|, |target|/a, |target|/a/b and |target|/c,
+  // in this order.
+  void SetUp() override {
+    target_ = QString(kTestDir) + "/target";
+    ASSERT_TRUE(QDir().mkpath(target_));
+    for (const QString& path : {QString(), QString("/a"), QString("/a/b"),
+                                QString("/c")}) {
+      ASSERT_TRUE(QDir().mkpath(target_ + path));
+      ASSERT_TRUE(SpawnCmd("mount", {"-t", "tmpfs", "-o", "size=1m",
+                                     "tmpfs", target_ + path}));
+    }
+    ASSERT_EQ(GetMountPoints(target_).length(), 4);
+  }
+
+  void TearDown() override {
+    for (const QString& mount_point : GetMountPoints(target_)) {
+      SpawnCmd("umount", {"--lazy", mount_point});
+    }
+    QDir(kTestDir).removeRecursively();
+  }
+
+  QString target_;
+};
+
+TEST_F(TargetFinalizerRootTest, UnmountNested) {
+  QStringList paths;
+  QList<int> percents;
+  ASSERT_TRUE(UnmountTarget(target_, 3, 10,
+                            [&](const FinalizeProgress& progress) {
+    EXPECT_EQ(progress.phase, FinalizePhase::Unmount);
+    paths.append(progress.path);
+    percents.append(progress.percent);
+  }));
+
+  // Children are unmounted before their parents, in reverse order of
+  // mounting.
+  const QStringList expected = {
+    target_ + "/c", target_ + "/a/b", target_ + "/a", target_,
+  };
+  EXPECT_EQ(paths, expected);
+  EXPECT_EQ(percents, QList<int>({0, 25, 50, 75}));
+  EXPECT_TRUE(GetMountPoints(target_).isEmpty());
+}
+
+TEST_F(TargetFinalizerRootTest, UnmountBusy) {
+  // A file opened in target/a/b keeps it busy.
+  const QString busy_file = target_ + "/a/b/busy";
+  const int fd = open(busy_file.toLocal8Bit().constData(),
+                      O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(write(fd, "busy", 4), 4);
+
+  const int kRetries = 3;
+  const int kInterval = 200;
+  QElapsedTimer timer;
+  timer.start();
+  EXPECT_FALSE(UnmountTarget(target_, kRetries, kInterval));
+  const qint64 elapsed = timer.elapsed();
+
+  // Busy mount point is tried |kRetries| times, then detached lazily, and
+  // all mount points are gone.
+  EXPECT_GE(elapsed, (kRetries - 1) * kInterval);
+  EXPECT_LT(elapsed, kRetries * kInterval + 1000);
+  EXPECT_TRUE(GetMountPoints(target_).isEmpty());
+
+  // Detached filesystem is still usable until the file is closed.
+  char buf[4];
+  EXPECT_EQ(pread(fd, buf, sizeof(buf), 0), 4);
+  EXPECT_EQ(QByteArray(buf, sizeof(buf)), QByteArray("busy"));
+  close(fd);
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "service/backend/target_finalizer.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(TargetFinalizer, WritebackEstimator) {
+  WritebackEstimator estimator;
+  EXPECT_EQ(estimator.eta(), -1);
+
+  estimator.update(1000, 0);
+  EXPECT_EQ(estimator.percent(), 0);
+  EXPECT_EQ(estimator.eta(), -1);
+
+  // 400 bytes are written back in 2s, 600 bytes are left.
+  estimator.update(600, 2000);
+  EXPECT_EQ(estimator.pending(), 600);
+  EXPECT_EQ(estimator.percent(), 40);
+  EXPECT_EQ(estimator.eta(), 3);
+
+  // More data is dirtied, estimate again from here.
+  estimator.update(2000, 3000);
+  EXPECT_EQ(estimator.percent(), 0);
+  EXPECT_EQ(estimator.eta(), -1);
+  estimator.update(1500, 4000);
+  EXPECT_EQ(estimator.percent(), 25);
+  EXPECT_EQ(estimator.eta(), 3);
+
+  estimator.update(0, 5000);
+  EXPECT_EQ(estimator.percent(), 100);
+  EXPECT_EQ(estimator.eta(), 0);
+}
+
+TEST(TargetFinalizer, NothingToWriteBack) {
+  WritebackEstimator estimator;
+  estimator.update(0, 0);
+  EXPECT_EQ(estimator.percent(), 100);
+  EXPECT_EQ(estimator.eta(), 0);
+}
+
+}  // namespace
+}  // namespace installer
@@ -38,12 +38,12 @@ FirstBootHookWorker::FirstBootHookWorker(QObject* parent) : QObject(parent) {
 }
 
 void FirstBootHookWorker::doStartHook() {
+  // Output of hooks is written to log while they are running, only head
+  // and tail of it is kept for error report.
   QString out, err;
-  const bool ok = RunScriptFile({kFirstBootHookFile}, out, err);
-  if (!out.isEmpty()) {
-    qWarning() << kFirstBootHookFile << "OUT:" << out;
-  }
-  if (!err.isEmpty()) {
+  const bool ok = RunScriptFileStreamed({kFirstBootHookFile}, out, err);
+  if (!ok) {
+    qCritical() << kFirstBootHookFile << "OUT:" << out;
     qCritical() << kFirstBootHookFile << "ERR:" << err;
   }
 
@@ -27,6 +27,7 @@
 #include "base/thread_util.h"
 #include "service/backend/hooks_pack.h"
 #include "service/backend/hook_worker.h"
+#include "service/backend/target_finalizer.h"
 #include "service/settings_name.h"
 #include "service/settings_manager.h"
 
@@ -38,12 +39,45 @@ const int kBeforeChrootEndVal = 60;
 const int kInChrootStartVal = kBeforeChrootEndVal;
 const int kInChrootEndVal = 85;
 const int kAfterChrootStartVal = kInChrootEndVal;
-const int kAfterChrootEndVal = 100;
+const int kAfterChrootEndVal = 95;
+// Target filesystems are synced and unmounted after all hooks, see
+// finalizeTarget().
+const int kSyncStartVal = kAfterChrootEndVal;
+const int kSyncEndVal = 99;
+const int kUnmountEndVal = 100;
+
+// A busy mount point of /target is tried 5 times in 5s before it is
+// detached lazily.
+const int kUnmountRetries = 5;
+const int kUnmountRetryInterval = 1000;
 
 const char kUnsquashfsProgressFile[] = "/dev/shm/unsquashfs_progress";
+// Swap file is created before filesystem is extracted, in before-chroot
+// stage, its progress is mapped to [kBeforeChrootStartVal,
+// kUnsquashfsStartVal).
+const char kSwapFileProgressFile[] = "/dev/shm/swap_file_progress";
+const int kUnsquashfsStartVal = 8;
 // Interval to read unsquashfs progress file, 5000ms.
 const int kReadUnsquashfsInterval = 5000;
 
+const char kTargetDir[] = "/target";
+
+// dpkg config file to skip fsync() in target system.
+const char kUnsafeIoDpkgFile[] =
+    "/target/etc/dpkg/dpkg.cfg.d/99deepin-installer-unsafe-io";
+
+bool EnableUnsafeIo() {
+  qDebug() << "EnableUnsafeIo()";
+  return CreateParentDirs(kUnsafeIoDpkgFile) &&
+         WriteTextFile(kUnsafeIoDpkgFile, "force-unsafe-io\n");
+}
+
+void DisableUnsafeIo() {
+  if (QFile::exists(kUnsafeIoDpkgFile) && !QFile::remove(kUnsafeIoDpkgFile)) {
+    qCritical() << "Failed to remove" << kUnsafeIoDpkgFile;
+  }
+}
+
 int ReadProgressValue(const QString& file) {
   if (QFile::exists(file)) {
     const QString val(ReadFile(file));
@@ -64,6 +98,8 @@ HooksManager::HooksManager(QObject* parent)
       lastRunTime(0) {
   this->setObjectName("hooks_manager");
 
+  qRegisterMetaType<FinalizeProgress>("FinalizeProgress");
+
   hook_worker_->moveToThread(hook_worker_thread_);
   this->initConnections();
 
@@ -97,12 +133,45 @@ void HooksManager::initConnections() {
           hook_worker_, &HookWorker::deleteLater);
 }
 
+void HooksManager::finalizeTarget() {
+  qDebug() << "finalizeTarget()";
+  int last_progress = -1;
+  const FinalizeProgressHandler handler =
+      [this, &last_progress](const FinalizeProgress& progress) {
+    int value;
+    if (progress.phase == FinalizePhase::Sync) {
+      value = kSyncStartVal +
+          (kSyncEndVal - kSyncStartVal) * progress.percent / 100;
+    } else {
+      value = kSyncEndVal +
+          (kUnmountEndVal - kSyncEndVal) * progress.percent / 100;
+    }
+    if (value != last_progress) {
+      last_progress = value;
+      emit this->processUpdate(value);
+    }
+    emit this->finalizeProgress(progress);
+  };
+
+  SyncTargetFilesystems(kTargetDir, handler);
+  if (!UnmountTarget(kTargetDir, kUnmountRetries, kUnmountRetryInterval,
+                     handler)) {
+    qWarning() << "Some filesystems of" << kTargetDir
+               << "are detached lazily";
+  }
+}
+
 void HooksManager::runNextHook() {
   hooks_pack_->current_hook ++;
   if (hooks_pack_->current_hook >= hooks_pack_->hooks.length()) {
     // Clear environment of current hooks pack.
     if (hooks_pack_->type == HookType::BeforeChroot) {
       unsquashfs_timer_->stop();
+    } else if (hooks_pack_->type == HookType::InChroot && unsafe_io_) {
+      // Packages are all installed, restore dpkg config and write back
+      // data skipped by dpkg.
+      DisableUnsafeIo();
+      SyncTargetFilesystems(kTargetDir);
     }
 
     HooksPack* next_hooks_pack = hooks_pack_->next;
@@ -111,6 +180,7 @@ void HooksManager::runNextHook() {
     if (hooks_pack_ == nullptr) {
       qDebug() << "hooks_pack_ is null, all jobs done!";
       // All hooks pack jobs are finished.
+      this->finalizeTarget();
       emit this->finished();
     } else {
       qDebug() << "Run next hooks pack";
@@ -158,6 +228,9 @@ void HooksManager::runHooksPack() {
       emit this->errorOccurred();
       return;
     }
+    if (unsafe_io_ && !EnableUnsafeIo()) {
+      qWarning() << "Failed to enable unsafe io of dpkg";
+    }
   }
 
   // Run hooks one by one.
@@ -169,11 +242,13 @@ void HooksManager::monitorProgressFiles() {
   qDebug() << "monitorProgressFiles()";
   // Remove old progress files first.
   QFile::remove(kUnsquashfsProgressFile);
+  QFile::remove(kSwapFileProgressFile);
   unsquashfs_timer_->start();
 }
 
 void HooksManager::handleRunHooks() {
   enableScriptAnalyze = GetSettingsBool(kEnableAnalysisScriptTime);
+  unsafe_io_ = GetSettingsBool(kInstallUnsafeIo);
   lastRunTime = QDateTime::currentDateTime().toMSecsSinceEpoch();
 
   qDebug() << "handleRunHooks()";
@@ -203,9 +278,16 @@ void HooksManager::handleRunHooks() {
 
 void HooksManager::handleReadUnsquashfsTimeout() {
   // Read progress value and notify UI thread.
-  const int val = ReadProgressValue(kUnsquashfsProgressFile);
-  const int progress = kBeforeChrootStartVal +
-      (kBeforeChrootEndVal - kBeforeChrootStartVal) * val / 100;
+  int progress;
+  if (QFile::exists(kUnsquashfsProgressFile)) {
+    const int val = ReadProgressValue(kUnsquashfsProgressFile);
+    progress = kUnsquashfsStartVal +
+        (kBeforeChrootEndVal - kUnsquashfsStartVal) * val / 100;
+  } else {
+    const int val = ReadProgressValue(kSwapFileProgressFile);
+    progress = kBeforeChrootStartVal +
+        (kUnsquashfsStartVal - kBeforeChrootStartVal) * val / 100;
+  }
   if (hooks_pack_ && hooks_pack_->type == HookType::BeforeChroot) {
     emit this->processUpdate(progress);
   } else {
@@ -214,6 +296,11 @@ void HooksManager::handleReadUnsquashfsTimeout() {
 }
 
 void HooksManager::onHooksManagerFinished() {
+  // Config file of unsafe io is still there if in_chroot hooks failed.
+  if (unsafe_io_) {
+    DisableUnsafeIo();
+  }
+
   // Release hooks pack
   while (hooks_pack_) {
     HooksPack* next_hooks_pack = hooks_pack_->next;
@@ -21,6 +21,8 @@
 #include <QObject>
 #include <utility>
 
+#include "service/backend/target_finalizer.h"
+
 class QThread;
 class QTimer;
 
@@ -53,18 +55,27 @@ class HooksManager : public QObject {
   // Emitted when installation process finished successfully.
   void finished();
 
-  // Installation process is split into four stages:
+  // Installation process is split into five stages:
   //   * before_chroot: 5-60
-  //   * in_chroot: 60-80
-  //   * after_chroot: 80-100
+  //   * in_chroot: 60-85
+  //   * after_chroot: 85-95
+  //   * sync and unmount /target: 95-100
   void processUpdate(int process);
 
+  // Emitted while target filesystems are synced and unmounted, after all
+  // hooks are done.
+  void finalizeProgress(const FinalizeProgress& progress);
+
   // Emit this signal in other objects to run hooks in background thread.
   void runHooks();
 
  private:
   void initConnections();
 
+  // Write back data of /target and unmount it, reporting progress with
+  // finalizeProgress() signal.
+  void finalizeTarget();
+
   void runNextHook();
 
   // Run hook scripts with |hook_type|.
@@ -80,6 +91,9 @@ class HooksManager : public QObject {
   // This timer is used to read progress file each second.
   QTimer* unsquashfs_timer_ = nullptr;
 
+  // Disable fsync() of dpkg while running in_chroot hooks.
+  bool unsafe_io_ = false;
+
   // Recored the script run time
   bool enableScriptAnalyze;
   qlonglong lastRunTime;
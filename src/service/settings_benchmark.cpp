@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measure lookups per second of GetSettingsValue(), compared with reading
+// installer config and default settings with QSettings on each lookup.
+// Usage: settings-benchmark [count]
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSettings>
+
+#include "service/settings_manager.h"
+#include "service/settings_name.h"
+
+namespace {
+
+const int kDefaultCount = 10000;
+
+// Same as files read by settings_manager.cpp.
+#ifdef QT_DEBUG
+const char kInstallerConfigFile[] = "/tmp/deepin-installer.conf";
+#else
+const char kInstallerConfigFile[] = "/etc/deepin-installer.conf";
+#endif // QT_DEBUG
+const char kDefaultSettingsFile[] = RESOURCES_DIR "/default_settings.ini";
+
+// Keys looked up in a row when pages are created.
+const char* const kKeys[] = {
+    installer::kSkipDiskSpaceInsufficientPage,
+    installer::kSkipVirtualMachinePage,
+    installer::kSkipSelectLanguagePage,
+    installer::kSkipSystemInfoPage,
+    installer::kSkipTimezonePage,
+    installer::kSkipPartitionPage,
+    installer::kSystemInfoDefaultUsername,
+    installer::kSystemInfoPasswordMinLen,
+    installer::kTimezoneDefault,
+    installer::kTimezoneUseWindowsTime,
+};
+
+// Lookup in the way GetSettingsValue() did without cache.
+QVariant ReadSettingsValue(const QString& key) {
+  QSettings settings(kInstallerConfigFile, QSettings::IniFormat);
+  if (settings.contains(key)) {
+    return settings.value(key);
+  }
+  QSettings default_settings(kDefaultSettingsFile, QSettings::IniFormat);
+  return default_settings.value(key);
+}
+
+void RunBenchmark(const char* name,
+                  QVariant (*lookup)(const QString& key),
+                  int count) {
+  QElapsedTimer timer;
+  timer.start();
+  int invalid = 0;
+  for (int i = 0; i < count; ++i) {
+    for (const char* key : kKeys) {
+      if (!lookup(key).isValid()) {
+        invalid ++;
+      }
+    }
+  }
+  const qint64 elapsed = qMax(timer.nsecsElapsed(), qint64(1));
+  const qint64 lookups = count * qint64(sizeof(kKeys) / sizeof(kKeys[0]));
+  qDebug() << name << "lookups:" << lookups
+           << "invalid:" << invalid
+           << "total(ms):" << elapsed / 1000000
+           << "lookups/s:" << lookups * 1000000000 / elapsed;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  int count = kDefaultCount;
+  if (argc > 1) {
+    count = qMax(1, QString(argv[1]).toInt());
+  }
+
+  RunBenchmark("QSettings", ReadSettingsValue, count);
+  RunBenchmark("cache", installer::GetSettingsValue, count);
+  return 0;
+}
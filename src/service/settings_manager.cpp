@@ -17,7 +17,9 @@
 
 #include "service/settings_manager.h"
 
+#include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -27,8 +29,11 @@
 #include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QFileInfoList>
 #include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QSettings>
 #include <random>
 
@@ -70,9 +75,147 @@ const char kDeepinOemDir[] = "/lib/live/mount/medium/oem";
 // Filename of oem settings
 const char kOemSettingsFilename[] = "settings.ini";
 
+// Absolute path to settings files in use, which are replaced in unit tests.
+QString g_default_settings_file = kDefaultSettingsFile;
+QString g_installer_config_file = kInstallerConfigFile;
+
+// Stat of a settings file when it was loaded into cache.
+struct SettingsFileStamp {
+  bool exists = false;
+  dev_t dev = 0;
+  ino_t ino = 0;
+  off_t size = 0;
+  timespec mtime = {0, 0};
+
+  bool operator==(const SettingsFileStamp& other) const {
+    return (exists == other.exists && dev == other.dev &&
+            ino == other.ino && size == other.size &&
+            mtime.tv_sec == other.mtime.tv_sec &&
+            mtime.tv_nsec == other.mtime.tv_nsec);
+  }
+  bool operator!=(const SettingsFileStamp& other) const {
+    return !(*this == other);
+  }
+};
+
+SettingsFileStamp GetSettingsFileStamp(const QString& path) {
+  SettingsFileStamp stamp;
+  struct stat st;
+  if (stat(path.toLocal8Bit().constData(), &st) == 0) {
+    stamp.exists = true;
+    stamp.dev = st.st_dev;
+    stamp.ino = st.st_ino;
+    stamp.size = st.st_size;
+    stamp.mtime = st.st_mtim;
+  }
+  return stamp;
+}
+
+// Settings files are merged into |g_settings_values|, and are parsed again
+// only if any of them is created, replaced or modified. QSettings writes
+// files with rename(), so the inode changes on each write too.
+QMutex g_settings_mutex;
+QHash<QString, QVariant> g_settings_values;
+QStringList g_settings_files;
+QList<SettingsFileStamp> g_settings_stamps;
+
+// Returns settings files in layer order, later ones take precedence:
+// default settings of this architecture, oem settings, installer config.
+QStringList GetSettingsFiles() {
+  return {
+      g_default_settings_file,
+      GetOemDir().absoluteFilePath(kOemSettingsFilename),
+      g_installer_config_file,
+  };
+}
+
+// Reload settings cache if needed. |g_settings_mutex| shall be locked.
+void UpdateSettingsCache() {
+  const QStringList files = GetSettingsFiles();
+  QList<SettingsFileStamp> stamps;
+  for (const QString& file : files) {
+    stamps.append(GetSettingsFileStamp(file));
+  }
+  if (files == g_settings_files && stamps == g_settings_stamps) {
+    return;
+  }
+
+  g_settings_values.clear();
+  for (int i = 0; i < files.length(); ++i) {
+    if (!stamps.at(i).exists) {
+      continue;
+    }
+    const QSettings settings(files.at(i), QSettings::IniFormat);
+    for (const QString& key : settings.allKeys()) {
+      g_settings_values.insert(key, settings.value(key));
+    }
+  }
+  g_settings_files = files;
+  g_settings_stamps = stamps;
+}
+
+// Settings written in current ConfigTransaction, which are not saved yet.
+// Each thread has its own transaction, so that a transaction never saves
+// settings staged by another thread.
+thread_local QHash<QString, QVariant> g_staged_values;
+thread_local int g_transaction_depth = 0;
+
+// Stage |key| in current transaction, or save it at once if there is no
+// transaction.
 void AppendToConfigFile(const QString& key, const QVariant& value) {
-  QSettings settings(kInstallerConfigFile, QSettings::IniFormat);
-  settings.setValue(key, value);
+  ConfigTransaction transaction;
+  g_staged_values.insert(key, value);
+}
+
+// Save |values| into installer config file. A copy of config file is updated
+// and synced to disk, then it is renamed to replace the original one, so that
+// config file is complete even if the installer crashes while writing.
+bool SaveToConfigFile(const QHash<QString, QVariant>& values) {
+  const QString tmp_file = g_installer_config_file + ".tmp";
+  QFile::remove(tmp_file);
+  if (QFile::exists(g_installer_config_file) &&
+      !QFile::copy(g_installer_config_file, tmp_file)) {
+    qCritical() << "SaveToConfigFile() failed to copy config file";
+    return false;
+  }
+
+  {
+    QSettings settings(tmp_file, QSettings::IniFormat);
+    for (auto iter = values.constBegin(); iter != values.constEnd(); ++iter) {
+      settings.setValue(iter.key(), iter.value());
+    }
+    settings.sync();
+    if (settings.status() != QSettings::NoError) {
+      qCritical() << "SaveToConfigFile() failed to write:" << tmp_file;
+      QFile::remove(tmp_file);
+      return false;
+    }
+  }
+
+  const QByteArray tmp_path = tmp_file.toLocal8Bit();
+  const int fd = open(tmp_path.constData(), O_RDONLY | O_CLOEXEC);
+  const bool synced = (fd != -1) && (fsync(fd) == 0);
+  if (fd != -1) {
+    close(fd);
+  }
+  const QByteArray config_path = g_installer_config_file.toLocal8Bit();
+  if (!synced ||
+      rename(tmp_path.constData(), config_path.constData()) != 0) {
+    qCritical() << "SaveToConfigFile() failed to replace config file:"
+                << strerror(errno);
+    QFile::remove(tmp_file);
+    return false;
+  }
+
+  // Persist the rename too.
+  const QByteArray dir_path =
+      QFileInfo(g_installer_config_file).absolutePath().toLocal8Bit();
+  const int dir_fd = open(dir_path.constData(), O_RDONLY | O_DIRECTORY);
+  if (dir_fd != -1) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  return true;
 }
 
 QStringList ListAvatarFiles(const QString& dir_name) {
@@ -112,6 +255,42 @@ QDir GetOemDir() {
   return QDir(g_oem_dir);
 }
 
+void SetSettingsFilesForTest(const QString& default_file,
+                             const QString& oem_dir,
+                             const QString& config_file) {
+  QMutexLocker locker(&g_settings_mutex);
+  g_default_settings_file =
+      default_file.isEmpty() ? kDefaultSettingsFile : default_file;
+  g_oem_dir = oem_dir;
+  g_installer_config_file =
+      config_file.isEmpty() ? kInstallerConfigFile : config_file;
+}
+
+ConfigTransaction::ConfigTransaction() {
+  outer_ = (g_transaction_depth == 0);
+  g_transaction_depth ++;
+}
+
+ConfigTransaction::~ConfigTransaction() {
+  this->commit();
+  g_transaction_depth --;
+}
+
+bool ConfigTransaction::commit() {
+  if (!outer_) {
+    // Saved by the outer transaction.
+    return true;
+  }
+
+  QMutexLocker locker(&g_settings_mutex);
+  if (g_staged_values.isEmpty()) {
+    return true;
+  }
+  const bool ok = SaveToConfigFile(g_staged_values);
+  g_staged_values.clear();
+  return ok;
+}
+
 bool GetSettingsBool(const QString& key) {
   const QVariant value = GetSettingsValue(key);
   if (value.isValid()) {
@@ -153,17 +332,17 @@ QStringList GetSettingsStringList(const QString& key) {
 }
 
 QVariant GetSettingsValue(const QString& key) {
-  QSettings settings(kInstallerConfigFile, QSettings::IniFormat);
-  if (settings.contains(key)) {
-    return settings.value(key);
+  QMutexLocker locker(&g_settings_mutex);
+  if (g_staged_values.contains(key)) {
+    return g_staged_values.value(key);
   }
-
-  // Read default settings
-  QSettings default_settings(kDefaultSettingsFile, QSettings::IniFormat);
-  if (!default_settings.contains(key)) {
+  UpdateSettingsCache();
+  const auto iter = g_settings_values.constFind(key);
+  if (iter == g_settings_values.constEnd()) {
     qWarning() << "getSettingsValue() Invalid key:" << key;
+    return QVariant();
   }
-  return default_settings.value(key);
+  return iter.value();
 }
 
 QString GetAutoPartFile() {
@@ -260,19 +439,19 @@ bool AppendConfigFile(const QString& conf_file) {
     return false;
   }
 
-  QSettings target_settings(kInstallerConfigFile, QSettings::IniFormat);
+  ConfigTransaction transaction;
   QSettings new_settings(conf_file, QSettings::IniFormat);
 
   for (const QString& key : new_settings.allKeys()) {
     const QVariant value = new_settings.value(key);
-    target_settings.setValue(key, value);
+    AppendToConfigFile(key, value);
   }
 
-  return true;
+  return transaction.commit();
 }
 
 bool DeleteConfigFile() {
-  QFile file(kInstallerConfigFile);
+  QFile file(g_installer_config_file);
   if (file.exists()) {
     if (!file.remove()) {
       qCritical() << "Failed to delete installer config file!";
@@ -287,7 +466,7 @@ void WriteUEFI(bool is_efi) {
 }
 
 QString ReadLocale() {
-  QSettings settings(kInstallerConfigFile, QSettings::IniFormat);
+  QSettings settings(g_installer_config_file, QSettings::IniFormat);
   QString locale;
 
   // Get user-selected locale.
@@ -324,10 +503,10 @@ void WriteHostname(const QString& hostname) {
 void WriteKeyboard(const QString& model,
                    const QString& layout,
                    const QString& variant) {
-  QSettings settings(kInstallerConfigFile, QSettings::IniFormat);
-  settings.setValue("DI_KEYBOARD_MODEL", model);
-  settings.setValue("DI_LAYOUT", layout);
-  settings.setValue("DI_LAYOUT_VARIANT", variant);
+  ConfigTransaction transaction;
+  AppendToConfigFile("DI_KEYBOARD_MODEL", model);
+  AppendToConfigFile("DI_LAYOUT", layout);
+  AppendToConfigFile("DI_LAYOUT_VARIANT", variant);
 }
 
 void WriteLocale(const QString& locale) {
@@ -340,8 +519,7 @@ void WritePassword(const QString& password) {
 }
 
 void WriteTimezone(const QString& timezone) {
-  QSettings settings(kInstallerConfigFile, QSettings::IniFormat);
-  settings.setValue("DI_TIMEZONE", timezone);
+  AppendToConfigFile("DI_TIMEZONE", timezone);
 }
 
 void WriteUsername(const QString& username) {
@@ -357,11 +535,35 @@ void WritePartitionInfo(const QString& root_disk,
            << ", root_partition:" << root_partition
            << ", boot_partition:" << boot_partition
            << ", mount_points:" << mount_points;
-  QSettings settings(kInstallerConfigFile, QSettings::IniFormat);
-  settings.setValue("DI_ROOT_DISK", root_disk);
-  settings.setValue("DI_ROOT_PARTITION", root_partition);
-  settings.setValue("DI_BOOTLOADER", boot_partition);
-  settings.setValue("DI_MOUNTPOINTS", mount_points);
+  ConfigTransaction transaction;
+  AppendToConfigFile("DI_ROOT_DISK", root_disk);
+  AppendToConfigFile("DI_ROOT_PARTITION", root_partition);
+  AppendToConfigFile("DI_BOOTLOADER", boot_partition);
+  AppendToConfigFile("DI_MOUNTPOINTS", mount_points);
+}
+
+void WriteLuksOptions(const QString& cipher,
+                      int key_size,
+                      const QString& pbkdf,
+                      int pbkdf_memory,
+                      int pbkdf_parallel,
+                      int pbkdf_iterations,
+                      int iter_time) {
+  ConfigTransaction transaction;
+  AppendToConfigFile("DI_CRYPT_CIPHER", cipher);
+  AppendToConfigFile("DI_CRYPT_KEY_SIZE", key_size);
+  AppendToConfigFile("DI_CRYPT_PBKDF", pbkdf);
+  AppendToConfigFile("DI_CRYPT_PBKDF_MEMORY", pbkdf_memory);
+  AppendToConfigFile("DI_CRYPT_PBKDF_PARALLEL", pbkdf_parallel);
+  AppendToConfigFile("DI_CRYPT_PBKDF_ITERATIONS", pbkdf_iterations);
+  AppendToConfigFile("DI_CRYPT_ITER_TIME", iter_time);
+}
+
+void WriteFullDiskCryptInfo(const QString& partition, const QString& target) {
+  ConfigTransaction transaction;
+  AppendToConfigFile("DI_CRYPT_ROOT", true);
+  AppendToConfigFile("DI_CRYPT_PARTITION", partition);
+  AppendToConfigFile("DI_CRYPT_TARGET", target);
 }
 
 void WriteRequiringSwapFile(bool is_required) {
@@ -369,14 +571,15 @@ void WriteRequiringSwapFile(bool is_required) {
 }
 
 void AddConfigFile() {
-  QSettings target_settings(kInstallerConfigFile, QSettings::IniFormat);
+  ConfigTransaction transaction;
 
   // Read default settings
-  QSettings default_settings(kDefaultSettingsFile, QSettings::IniFormat);
+  QSettings default_settings(g_default_settings_file,
+                             QSettings::IniFormat);
   for (const QString& key : default_settings.allKeys()) {
     const QVariant value(default_settings.value(key));
     // Do not use section groups.
-    target_settings.setValue(key, value);
+    AppendToConfigFile(key, value);
   }
 
   // Read oem settings
@@ -385,7 +588,7 @@ void AddConfigFile() {
     QSettings oem_settings(oem_file , QSettings::IniFormat);
     for (const QString& key : oem_settings.allKeys()) {
       const QVariant value = oem_settings.value(key);
-      target_settings.setValue(key, value);
+      AppendToConfigFile(key, value);
     }
   }
 }
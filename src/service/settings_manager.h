@@ -25,9 +25,38 @@
 
 namespace installer {
 
+// Collects settings written by Write*() functions while it is alive, and
+// saves them into installer config file with one write, fsync and rename.
+// Transactions created while another one is alive in the same thread join
+// the outer one. Staged settings are visible to GetSettingsValue() in that
+// thread before they are saved.
+class ConfigTransaction {
+ public:
+  ConfigTransaction();
+
+  // Saves settings staged after last commit().
+  ~ConfigTransaction();
+
+  // Saves staged settings now. Returns false if failed to write config file.
+  // Does nothing in nested transactions.
+  bool commit();
+
+ private:
+  bool outer_ = false;
+
+  Q_DISABLE_COPY(ConfigTransaction)
+};
+
 // Get absolute path to oem/ folder. Note that oem folder may not exist.
 QDir GetOemDir();
 
+// Use |default_file|, settings.ini in |oem_dir| and |config_file| instead of
+// installed settings files. Empty values restore installed ones.
+// Only used in unit tests.
+void SetSettingsFilesForTest(const QString& default_file,
+                             const QString& oem_dir,
+                             const QString& config_file);
+
 // Read settings value from ini file.
 
 // Get boolean option value from settings file.
@@ -118,6 +147,25 @@ void WritePartitionInfo(const QString& root_disk,
                         const QString& boot_partition,
                         const QString& mount_points);
 
+// Write options of `cryptsetup luksFormat` used in auto_part.sh.
+//  * |cipher| and |key_size|, cipher is empty to use default of cryptsetup;
+//  * |pbkdf|, |pbkdf_memory| in KiB, |pbkdf_parallel| and |pbkdf_iterations|,
+//    iterations is 0 if it shall be calculated by cryptsetup;
+//  * |iter_time|, expected time to unlock disk, in milliseconds.
+void WriteLuksOptions(const QString& cipher,
+                      int key_size,
+                      const QString& pbkdf,
+                      int pbkdf_memory,
+                      int pbkdf_parallel,
+                      int pbkdf_iterations,
+                      int iter_time);
+
+// Write LUKS partition created by native auto partitioning, as
+// auto_part.sh does.
+//  * |partition|, path to LUKS partition;
+//  * |target|, mapper name of opened LUKS partition.
+void WriteFullDiskCryptInfo(const QString& partition, const QString& target);
+
 // Whether swap file is required. Swap file is created in before_chroot/.
 void WriteRequiringSwapFile(bool is_required);
 
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/settings_manager.h"
+
+#include <sys/stat.h>
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+
+#include "base/file_util.h"
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kTestDir[] = "/tmp/deepin-installer-settings-test";
+
+// Returns inode of file at |path|, or 0 if not found.
+ino_t GetInode(const QString& path) {
+  struct stat st;
+  if (stat(path.toLocal8Bit().constData(), &st) != 0) {
+    return 0;
+  }
+  return st.st_ino;
+}
+
+// Settings files in a temp folder are used instead of installed ones.
+class SettingsManagerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    QDir(kTestDir).removeRecursively();
+    ASSERT_TRUE(CreateDirs(this->oemDir()));
+    ASSERT_TRUE(WriteTextFile(this->defaultFile(),
+                              "[General]\n"
+                              "default_key=default\n"
+                              "oem_key=default\n"
+                              "config_key=default\n"));
+    ASSERT_TRUE(WriteTextFile(this->oemDir() + "/settings.ini",
+                              "[General]\n"
+                              "oem_key=oem\n"
+                              "config_key=oem\n"));
+    ASSERT_TRUE(WriteTextFile(this->configFile(),
+                              "[General]\n"
+                              "config_key=config\n"));
+    SetSettingsFilesForTest(this->defaultFile(), this->oemDir(),
+                            this->configFile());
+  }
+
+  void TearDown() override {
+    SetSettingsFilesForTest("", "", "");
+    QDir(kTestDir).removeRecursively();
+  }
+
+  QString defaultFile() const {
+    return QString(kTestDir) + "/default_settings.ini";
+  }
+  QString oemDir() const {
+    return QString(kTestDir) + "/oem";
+  }
+  QString configFile() const {
+    return QString(kTestDir) + "/deepin-installer.conf";
+  }
+};
+
+TEST_F(SettingsManagerTest, Precedence) {
+  // default settings < oem settings < installer config.
+  EXPECT_EQ(GetSettingsString("default_key"), "default");
+  EXPECT_EQ(GetSettingsString("oem_key"), "oem");
+  EXPECT_EQ(GetSettingsString("config_key"), "config");
+  EXPECT_FALSE(GetSettingsValue("missing_key").isValid());
+}
+
+TEST_F(SettingsManagerTest, ReloadOnWrite) {
+  EXPECT_EQ(GetSettingsString("oem_key"), "oem");
+
+  // QSettings replaces config file with rename(), so its inode changes even
+  // if mtime and size are the same as cached ones.
+  const ino_t inode = GetInode(this->configFile());
+  ASSERT_NE(inode, ino_t(0));
+  {
+    QSettings settings(this->configFile(), QSettings::IniFormat);
+    settings.setValue("oem_key", "config");
+    settings.sync();
+    ASSERT_EQ(settings.status(), QSettings::NoError);
+  }
+  EXPECT_NE(GetInode(this->configFile()), inode);
+  EXPECT_EQ(GetSettingsString("oem_key"), "config");
+
+  // Removed layers are dropped too.
+  ASSERT_TRUE(QFile::remove(this->configFile()));
+  EXPECT_EQ(GetSettingsString("oem_key"), "oem");
+  EXPECT_EQ(GetSettingsString("config_key"), "oem");
+}
+
+TEST_F(SettingsManagerTest, NestedTransaction) {
+  {
+    ConfigTransaction outer;
+    WriteHostname("outer");
+    {
+      // Inner transaction is saved by the outer one.
+      ConfigTransaction inner;
+      WriteUsername("inner");
+      EXPECT_TRUE(inner.commit());
+    }
+    EXPECT_FALSE(ReadFile(this->configFile()).contains("DI_HOSTNAME"));
+    EXPECT_FALSE(ReadFile(this->configFile()).contains("DI_USERNAME"));
+
+    // Staged settings are read before they are saved.
+    EXPECT_EQ(GetSettingsString("DI_HOSTNAME"), "outer");
+    EXPECT_EQ(GetSettingsString("DI_USERNAME"), "inner");
+  }
+
+  const QString content = ReadFile(this->configFile());
+  EXPECT_TRUE(content.contains("DI_HOSTNAME=outer"));
+  EXPECT_TRUE(content.contains("DI_USERNAME=inner"));
+  EXPECT_EQ(GetSettingsString("DI_HOSTNAME"), "outer");
+}
+
+TEST_F(SettingsManagerTest, CommitAfterCommit) {
+  ConfigTransaction transaction;
+  WriteHostname("first");
+  ASSERT_TRUE(transaction.commit());
+  EXPECT_TRUE(ReadFile(this->configFile()).contains("DI_HOSTNAME=first"));
+
+  // Settings staged after commit() are saved by the next one.
+  WriteHostname("second");
+  EXPECT_FALSE(ReadFile(this->configFile()).contains("DI_HOSTNAME=second"));
+  ASSERT_TRUE(transaction.commit());
+  EXPECT_TRUE(ReadFile(this->configFile()).contains("DI_HOSTNAME=second"));
+  EXPECT_FALSE(ReadFile(this->configFile()).contains("DI_HOSTNAME=first"));
+
+  // Nothing is staged.
+  const ino_t inode = GetInode(this->configFile());
+  EXPECT_TRUE(transaction.commit());
+  EXPECT_EQ(GetInode(this->configFile()), inode);
+}
+
+TEST_F(SettingsManagerTest, AtomicReplace) {
+  // Settings written out of transaction are saved at once, by replacing
+  // config file with an updated copy.
+  const ino_t inode = GetInode(this->configFile());
+  ASSERT_NE(inode, ino_t(0));
+  WriteHostname("deepin");
+  EXPECT_NE(GetInode(this->configFile()), inode);
+  EXPECT_FALSE(QFile::exists(this->configFile() + ".tmp"));
+
+  const QString content = ReadFile(this->configFile());
+  EXPECT_TRUE(content.contains("DI_HOSTNAME=deepin"));
+  EXPECT_TRUE(content.contains("config_key=config"));
+
+  // Config file is created if not found.
+  ASSERT_TRUE(QFile::remove(this->configFile()));
+  WriteUsername("deepin");
+  EXPECT_TRUE(ReadFile(this->configFile()).contains("DI_USERNAME=deepin"));
+  EXPECT_FALSE(QFile::exists(this->configFile() + ".tmp"));
+}
+
+}  // namespace
+}  // namespace installer
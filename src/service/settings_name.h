@@ -113,6 +113,13 @@ const char kPartitionPreferLogicalPartition[] =
     "partition_prefer_logical_partition";
 const char kPartitionBootPartitionFs[] = "partition_boot_partition_fs";
 const char kPartitionEnableOsProber[] = "partition_enable_os_prober";
+const char kPartitionParallelFormat[] = "partition_parallel_format";
+const char kPartitionFormatJobsPerDevice[] =
+    "partition_format_jobs_per_device";
+const char kPartitionFormatProfile[] = "partition_format_profile";
+const char kPartitionNativeAutoPart[] = "partition_native_auto_part";
+const char kPartitionLuksAutoTune[] = "partition_luks_auto_tune";
+const char kPartitionLuksUnlockTime[] = "partition_luks_unlock_time";
 const char kPartitionHideInstallationDevice[] =
     "partition_hide_installation_device";
 
@@ -157,6 +164,9 @@ const char kInstallFailedErrMsgLen[] = "install_failed_err_msg_len";
 // Misc
 const char kScreenDefaultBrightness[] = "screen_default_brightness";
 
+// Unsafe I/O of dpkg in in_chroot hooks
+const char kInstallUnsafeIo[] = "install_unsafe_io";
+
 // Statistics script runtime
 const char kEnableAnalysisScriptTime[] = "enable_analysis_script_time";
 
@@ -65,7 +65,7 @@ void GenerateLocale(const QString& locale) {
   }
 
   QString out, err;
-  if (!SpawnCmd("locale-gen", {}, out, err)) {
+  if (!SpawnCmdStreamed("locale-gen", {}, out, err)) {
     qCritical() << "locale-gen failed:" << out << err;
   }
 
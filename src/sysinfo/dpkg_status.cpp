@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sysinfo/dpkg_status.h"
+
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QHash>
+#include <QSet>
+
+namespace installer {
+
+namespace {
+
+const char kPackageField[] = "Package:";
+const char kArchField[] = "Architecture:";
+const char kVersionField[] = "Version:";
+const char kStatusField[] = "Status:";
+
+// Returns value of |field| if |line| starts with it.
+bool ReadField(const char* line, int len, const char* field, QString& value) {
+  const int field_len = int(strlen(field));
+  if (len < field_len || strncmp(line, field, size_t(field_len)) != 0) {
+    return false;
+  }
+  value = QString::fromUtf8(line + field_len, len - field_len).trimmed();
+  return true;
+}
+
+bool HasWildcard(const QString& pattern) {
+  return pattern.contains('*') ||
+         pattern.contains('?') ||
+         pattern.contains('[');
+}
+
+}  // namespace
+
+bool DpkgPackage::present() const {
+  return !status.isEmpty() && !status.endsWith("not-installed");
+}
+
+DpkgPackageList ParseDpkgStatus(const QByteArray& content) {
+  DpkgPackageList result;
+  DpkgPackage package;
+  const char* data = content.constData();
+  const int size = content.size();
+  int start = 0;
+  while (start <= size) {
+    int end = content.indexOf('\n', start);
+    if (end == -1) {
+      end = size;
+    }
+    const char* line = data + start;
+    const int len = end - start;
+
+    if (len == 0) {
+      // Empty line separates paragraphs.
+      if (!package.name.isEmpty()) {
+        result.append(package);
+      }
+      package = DpkgPackage();
+    } else if (line[0] != ' ' && line[0] != '\t') {
+      // Continuation lines of multi-line fields are skipped.
+      if (!ReadField(line, len, kPackageField, package.name) &&
+          !ReadField(line, len, kArchField, package.arch) &&
+          !ReadField(line, len, kVersionField, package.version)) {
+        ReadField(line, len, kStatusField, package.status);
+      }
+    }
+    start = end + 1;
+  }
+
+  if (!package.name.isEmpty()) {
+    result.append(package);
+  }
+  return result;
+}
+
+DpkgPackageList ReadDpkgStatus(const QString& status_file) {
+  const int fd = open(status_file.toLocal8Bit().constData(),
+                      O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    qWarning() << "ReadDpkgStatus() failed to open:" << status_file;
+    return DpkgPackageList();
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return DpkgPackageList();
+  }
+
+  void* addr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE,
+                    fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    qWarning() << "ReadDpkgStatus() mmap() failed:" << status_file;
+    return DpkgPackageList();
+  }
+
+  // Parse mapped pages directly, without copying them.
+  const QByteArray content = QByteArray::fromRawData(
+      static_cast<const char*>(addr), int(st.st_size));
+  const DpkgPackageList result = ParseDpkgStatus(content);
+  munmap(addr, size_t(st.st_size));
+  return result;
+}
+
+QStringList MatchDpkgPackages(const DpkgPackageList& packages,
+                              const QStringList& patterns) {
+  // Index present packages by name, exact names are looked up in it
+  // and only wildcard patterns need a full scan.
+  QHash<QString, int> index;
+  for (int i = 0; i < packages.length(); ++i) {
+    if (packages.at(i).present() && !index.contains(packages.at(i).name)) {
+      index.insert(packages.at(i).name, i);
+    }
+  }
+
+  QList<QByteArray> globs;
+  QSet<int> matched;
+  for (const QString& pattern : patterns) {
+    if (HasWildcard(pattern)) {
+      globs.append(pattern.toUtf8());
+    } else if (index.contains(pattern)) {
+      matched.insert(index.value(pattern));
+    }
+  }
+
+  if (!globs.isEmpty()) {
+    for (auto iter = index.constBegin(); iter != index.constEnd(); ++iter) {
+      const QByteArray name = iter.key().toUtf8();
+      for (const QByteArray& glob : globs) {
+        if (fnmatch(glob.constData(), name.constData(), 0) == 0) {
+          matched.insert(iter.value());
+          break;
+        }
+      }
+    }
+  }
+
+  QStringList result;
+  for (int i = 0; i < packages.length(); ++i) {
+    if (matched.contains(i)) {
+      result.append(packages.at(i).name);
+    }
+  }
+  return result;
+}
+
+}  // namespace installer
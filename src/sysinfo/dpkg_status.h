@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_SYSINFO_DPKG_STATUS_H
+#define INSTALLER_SYSINFO_DPKG_STATUS_H
+
+#include <QByteArray>
+#include <QList>
+#include <QStringList>
+
+namespace installer {
+
+// Package paragraph in dpkg status database.
+struct DpkgPackage {
+  QString name;
+  QString arch;
+  QString version;
+  QString status;  // "want flag status", like "install ok installed"
+
+  // Returns true if package is known to dpkg, that is, either installed or
+  // only its config files remain.
+  bool present() const;
+};
+
+typedef QList<DpkgPackage> DpkgPackageList;
+
+// Parse |content| of dpkg status file.
+DpkgPackageList ParseDpkgStatus(const QByteArray& content);
+
+// Map |status_file| into memory and parse it.
+// Returns an empty list if failed to read that file.
+DpkgPackageList ReadDpkgStatus(
+    const QString& status_file = "/var/lib/dpkg/status");
+
+// Returns names of packages in |packages| which are present and match any of
+// |patterns|. Shell wildcards are supported, like "libwireshark*".
+// Each name appears only once, in the order of |packages|.
+QStringList MatchDpkgPackages(const DpkgPackageList& packages,
+                              const QStringList& patterns);
+
+}  // namespace installer
+
+#endif  // INSTALLER_SYSINFO_DPKG_STATUS_H
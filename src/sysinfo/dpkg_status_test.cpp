@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sysinfo/dpkg_status.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kStatusContent[] =
+    "Package: tshark\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "Version: 2.2.6\n"
+    "Description: network traffic analyzer\n"
+    " multi-line description\n"
+    "\n"
+    "Package: libwireshark8\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "Version: 2.2.6\n"
+    "\n"
+    "Package: libwiretap6\n"
+    "Status: deinstall ok config-files\n"
+    "Version: 2.2.6\n"
+    "\n"
+    "Package: casper\n"
+    "Status: purge ok not-installed\n"
+    "\n"
+    "Package: libwireshark-data\n"
+    "Status: install ok installed\n"
+    "Version: 2.2.6\n";
+
+TEST(DpkgStatusTest, ParseDpkgStatus) {
+  const DpkgPackageList packages = ParseDpkgStatus(kStatusContent);
+  ASSERT_EQ(packages.length(), 5);
+  EXPECT_EQ(packages.at(0).name, "tshark");
+  EXPECT_EQ(packages.at(0).arch, "amd64");
+  EXPECT_EQ(packages.at(0).version, "2.2.6");
+  EXPECT_TRUE(packages.at(0).present());
+  EXPECT_TRUE(packages.at(2).present());
+  EXPECT_FALSE(packages.at(3).present());
+  EXPECT_EQ(packages.at(4).name, "libwireshark-data");
+}
+
+TEST(DpkgStatusTest, MatchDpkgPackages) {
+  const DpkgPackageList packages = ParseDpkgStatus(kStatusContent);
+  const QStringList result = MatchDpkgPackages(
+      packages, {"libwireshark*", "tshark", "casper", "libwiretap*", "vim"});
+  EXPECT_EQ(result, QStringList({"tshark", "libwireshark8", "libwiretap6",
+                                 "libwireshark-data"}));
+}
+
+TEST(DpkgStatusTest, ReadDpkgStatus) {
+  const DpkgPackageList packages = ReadDpkgStatus();
+  if (!packages.isEmpty()) {
+    EXPECT_FALSE(packages.first().name.isEmpty());
+  }
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sysinfo/fstab.h"
+
+#include <algorithm>
+#include <QDebug>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QStringList>
+
+#include "base/command.h"
+#include "base/file_util.h"
+#include "sysinfo/dev_disk.h"
+
+namespace installer {
+
+namespace {
+
+// Same as pseudofs_types in hooks/after_chroot/genfstab, generated from
+// util-linux source: libmount/src/utils.c
+const char* const kPseudoFsTypes[] = {
+    "anon_inodefs", "autofs", "bdev", "binfmt_misc", "cgroup", "configfs",
+    "cpuset", "debugfs", "devfs", "devpts", "devtmpfs", "dlmfs",
+    "fuse.gvfs-fuse-daemon", "fusectl", "hugetlbfs", "mqueue", "nfsd",
+    "none", "pipefs", "proc", "pstore", "ramfs", "rootfs", "rpc_pipefs",
+    "securityfs", "sockfs", "spufs", "sysfs", "tmpfs", "overlayfs", "overlay",
+    "iso9660",
+};
+
+// Filesystems with fsck tool, same as fsck_types in genfstab.
+const char* const kFsckTypes[] = {
+    "cramfs", "exfat", "ext2", "ext3", "ext4", "ext4dev", "jfs", "minix",
+    "msdos", "reiserfs", "vfat", "xfs",
+};
+
+const char kFuseBlkType[] = "fuseblk";
+
+// Suffix of swap file which is removed but still in use.
+const char kDeletedSwapSuffix[] = "\\040(deleted)";
+
+template <size_t N>
+bool Contains(const char* const (&items)[N], const QString& value) {
+  for (const char* item : items) {
+    if (value == item) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Escape whitespaces and backslashes in fstab field, as mangle() in
+// genfstab does.
+QString Mangle(const QString& field) {
+  QString result;
+  for (const QChar chr : field) {
+    if (chr.isSpace() || chr == '\\') {
+      result += QString("\\%1").arg(chr.unicode(), 3, 8, QChar('0'));
+    } else {
+      result += chr;
+    }
+  }
+  return result;
+}
+
+// Left justify |field| in |width| columns, like "%-20s" of printf.
+QString Pad(const QString& field, int width) {
+  return QString("%1").arg(field, -width);
+}
+
+// Write comment and first field of entry for device at |source|.
+QString FormatSource(const FstabInput& input, const QString& source) {
+  QStringList comment = {source};
+  const QString label = input.part_labels.value(source);
+  if (!label.isEmpty()) {
+    comment.append("LABEL=" + Mangle(label));
+  }
+  const QString uuid = input.uuids.value(source);
+  const QString spec = uuid.isEmpty() ? Mangle(source) :
+                                        "UUID=" + Mangle(uuid);
+  return QString("# %1\n%2").arg(comment.join(' '), Pad(spec, 20));
+}
+
+// Append index of mount |index| and its submounts in |mounts| to |order|,
+// in the same order as `findmnt -R` does.
+void AppendSubmounts(const MountInfoItemList& mounts,
+                     int index,
+                     QList<int>& order) {
+  order.append(index);
+  const int id = mounts.at(index).id;
+  // Submounts are sorted by mount id.
+  QList<QPair<int, int>> children;
+  for (int i = 0; i < mounts.length(); ++i) {
+    if (mounts.at(i).parent_id == id && mounts.at(i).id != id) {
+      children.append(qMakePair(mounts.at(i).id, i));
+    }
+  }
+  std::sort(children.begin(), children.end());
+  for (const QPair<int, int>& child : children) {
+    AppendSubmounts(mounts, child.second, order);
+  }
+}
+
+// Decode "\xHH" in names of /dev/disk/ links, escaped by udev.
+QString DecodeUdevName(const QString& name) {
+  QString result = name;
+  QRegExp pattern("\\\\x([0-9a-fA-F]{2})");
+  int pos = 0;
+  while ((pos = pattern.indexIn(result, pos)) != -1) {
+    const QChar chr(pattern.cap(1).toInt(nullptr, 16));
+    result.replace(pos, pattern.matchedLength(), chr);
+    pos += 1;
+  }
+  return result;
+}
+
+// Get /dev/mapper/ path of device mapper device at |path|, like /dev/dm-0.
+QString GetDeviceMapperPath(const QString& path) {
+  const QString name_file = QString("/sys/class/block/%1/dm/name")
+      .arg(QFileInfo(path).fileName());
+  const QString name = ReadFile(name_file).trimmed();
+  if (name.isEmpty()) {
+    qWarning() << "Failed to resolve device mapper name for:" << path;
+    return path;
+  }
+  return "/dev/mapper/" + name;
+}
+
+}  // namespace
+
+FstabInput ReadFstabInput() {
+  FstabInput input;
+  input.mounts = ParseMountInfo();
+  input.swaps = ParseSwaps();
+
+  // Keys of /dev/disk/ items are canonical paths.
+  input.uuids = ParseUUIDDir();
+  const PartLabelItems part_labels = ParsePartLabelDir();
+
+  QStringList sources;
+  for (const MountInfoItem& item : input.mounts) {
+    if (item.source.startsWith("/dev/")) {
+      sources.append(item.source);
+    }
+    if (item.fs == kFuseBlkType && !input.fuse_types.contains(item.source)) {
+      QString out;
+      if (SpawnCmd("lsblk", {"-no", "FSTYPE", item.source}, out)) {
+        input.fuse_types.insert(item.source, out.trimmed());
+      }
+    }
+  }
+  for (SwapItem& swap : input.swaps) {
+    if (swap.type == SwapType::Partition) {
+      if (QRegExp("/dev/dm-\\d+").exactMatch(swap.filename)) {
+        swap.filename = GetDeviceMapperPath(swap.filename);
+      } else {
+        swap.filename = UnescapeMountPath(swap.filename);
+      }
+      sources.append(swap.filename);
+    }
+  }
+
+  for (const QString& source : sources) {
+    const QString path = QFileInfo(source).canonicalFilePath();
+    if (input.uuids.contains(path)) {
+      input.uuids.insert(source, input.uuids.value(path));
+    }
+    if (part_labels.contains(path)) {
+      input.part_labels.insert(source,
+                               DecodeUdevName(part_labels.value(path)));
+    }
+  }
+  return input;
+}
+
+QString MergeMountOptions(const QString& mount_options,
+                          const QString& super_options) {
+  if (mount_options == super_options) {
+    return mount_options;
+  }
+  QStringList options = mount_options.split(',', QString::SkipEmptyParts);
+  options.append(super_options.split(',', QString::SkipEmptyParts));
+
+  // Remove "rw" of both, and "ro" if any, then add the result back.
+  int rw = 0;
+  for (int i = 0; i < 2; ++i) {
+    if (options.removeOne("rw")) {
+      rw ++;
+    }
+  }
+  bool ro = false;
+  for (int i = rw; i < 2; ++i) {
+    if (options.removeOne("ro")) {
+      ro = true;
+    }
+  }
+  options.prepend(ro ? "ro" : "rw");
+  return options.join(',');
+}
+
+bool GenerateFstab(const FstabInput& input,
+                   const QString& root,
+                   QString& content) {
+  content.clear();
+  int root_index = -1;
+  for (int i = 0; i < input.mounts.length(); ++i) {
+    if (input.mounts.at(i).mount_point == root) {
+      root_index = i;
+      break;
+    }
+  }
+  if (root_index == -1) {
+    qCritical() << "GenerateFstab()" << root << "is not a mountpoint";
+    return false;
+  }
+
+  QList<int> order;
+  AppendSubmounts(input.mounts, root_index, order);
+  for (int index : order) {
+    const MountInfoItem& item = input.mounts.at(index);
+    if (Contains(kPseudoFsTypes, item.fs)) {
+      continue;
+    }
+
+    // Only fsck root filesystem first.
+    int pass = (index == root_index) ? 1 : 2;
+    if (!Contains(kFsckTypes, item.fs)) {
+      pass = 0;
+    }
+
+    QString fs = item.fs;
+    if (fs == kFuseBlkType) {
+      // This is probably NTFS-3g.
+      const QString real_fs = input.fuse_types.value(item.source);
+      if (real_fs.isEmpty()) {
+        qCritical() << "Failed to derive real filesystem type for FUSE"
+                    << "device on" << item.mount_point;
+      } else {
+        fs = real_fs;
+      }
+    }
+
+    QString target = item.mount_point;
+    if (target.startsWith(root)) {
+      target = target.mid(root.length());
+    }
+    if (target.startsWith('/')) {
+      target = target.mid(1);
+    }
+
+    content += FormatSource(input, item.source);
+    content += "\t" + Pad("/" + Mangle(target), 10);
+    content += "\t" + Pad(fs, 10);
+    content += "\t" + Pad(MergeMountOptions(item.mount_options,
+                                             item.super_options), 10);
+    content += QString("\t0 %1\n\n").arg(pass);
+  }
+
+  for (const SwapItem& swap : input.swaps) {
+    if (swap.filename.endsWith(kDeletedSwapSuffix)) {
+      continue;
+    }
+    QString options = "defaults";
+    if (swap.priority != -1) {
+      options += QString(",pri=%1").arg(swap.priority);
+    }
+    if (swap.type == SwapType::File) {
+      content += Pad(swap.filename, 20);
+    } else {
+      content += FormatSource(input, swap.filename);
+    }
+    content += QString("\t%1\t%2\t%3\t0 0\n\n")
+        .arg(Pad("none", 10), Pad("swap", 10), Pad(options, 10));
+  }
+
+  return true;
+}
+
+QString GenerateCrypttab(const FstabInput& input,
+                         const QString& target,
+                         const QString& partition,
+                         const QString& options) {
+  const QString uuid = input.uuids.value(partition);
+  if (uuid.isEmpty()) {
+    qCritical() << "GenerateCrypttab() no UUID found:" << partition;
+    return QString();
+  }
+  return QString("%1 UUID=%2 none %3\n").arg(target, uuid, options);
+}
+
+}  // namespace installer
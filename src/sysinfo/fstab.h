@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_SYSINFO_FSTAB_H
+#define INSTALLER_SYSINFO_FSTAB_H
+
+#include <QHash>
+#include <QString>
+
+#include "sysinfo/proc_mountinfo.h"
+#include "sysinfo/proc_swaps.h"
+
+namespace installer {
+
+// Snapshot of mounts and devices used to generate fstab and crypttab.
+// Device properties are indexed by device path as it appears in |mounts|
+// and |swaps|, and by canonical device path.
+struct FstabInput {
+  MountInfoItemList mounts;
+  SwapItemList swaps;
+  // Device path => UUID of filesystem or LUKS header.
+  QHash<QString, QString> uuids;
+  // Device path => partition label.
+  QHash<QString, QString> part_labels;
+  // Device path => real filesystem type of fuseblk mounts.
+  QHash<QString, QString> fuse_types;
+};
+
+// Read mount table, active swaps and /dev/disk/ of this machine.
+// Device mapper paths of swaps are replaced with /dev/mapper/ names.
+FstabInput ReadFstabInput();
+
+// Merge per mount |mount_options| and per superblock |super_options|, as
+// OPTIONS column of `findmnt` does.
+QString MergeMountOptions(const QString& mount_options,
+                          const QString& super_options);
+
+// Generate fstab entries of filesystem mounted at |root| and its submounts,
+// and of active swaps. Pseudo filesystems are ignored and devices are
+// identified by UUID, the output is the same as `genfstab -p -U |root|`.
+// Returns false if |root| is not a mount point.
+bool GenerateFstab(const FstabInput& input,
+                   const QString& root,
+                   QString& content);
+
+// Generate crypttab entry which unlocks |partition| as |target| with
+// |options|. Returns an empty string if UUID of |partition| is unknown.
+QString GenerateCrypttab(const FstabInput& input,
+                         const QString& target,
+                         const QString& partition,
+                         const QString& options);
+
+}  // namespace installer
+
+#endif  // INSTALLER_SYSINFO_FSTAB_H
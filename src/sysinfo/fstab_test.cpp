@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sysinfo/fstab.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+// Mount table of installation target, with host mounts and pseudo
+// filesystems.
+const char kMountInfo[] =
+    "1 0 0:20 / / rw,relatime - overlay overlay rw,lowerdir=/lower,"
+    "upperdir=/upper\n"
+    "21 1 8:2 / /target rw,relatime - ext4 /dev/sda2 rw,errors=remount-ro\n"
+    "30 21 8:3 / /target/home rw,noatime - ext4 /dev/sda3 rw\n"
+    "22 21 8:1 / /target/boot/efi rw,relatime - vfat /dev/sda1 rw,fmask=0022,"
+    "dmask=0022,codepage=437,iocharset=iso8859-1,shortname=mixed,"
+    "errors=remount-ro\n"
+    "25 21 0:5 / /target/dev rw,nosuid - devtmpfs udev rw,size=1000k,mode=755\n"
+    "26 25 0:6 / /target/dev/pts rw,nosuid,noexec - devpts devpts rw,gid=5,"
+    "mode=620\n"
+    "31 30 8:5 / /target/home/data ro,nosuid,nodev - fuseblk /dev/sda5 rw,"
+    "user_id=0,group_id=0,allow_other,blksize=4096\n"
+    "32 21 0:40 / /target/srv rw,relatime - btrfs /dev/mapper/vg-srv rw,"
+    "space_cache,subvolid=5,subvol=/\n"
+    "40 1 8:17 / /media/cdrom ro,relatime - iso9660 /dev/sdb1 ro,nojoliet\n";
+
+// Output of `genfstab -p -U /target` on the same mount table and swaps,
+// with blkid, lsblk and findmnt replaced by stubs.
+const char kGenfstabOutput[] =
+    "# /dev/sda2 LABEL=Root\n"
+    "UUID=2b4c5e9a-9d3e-4bd0-a1e8-1f1a2f3b4c5d\t/         \text4      \t"
+    "rw,relatime,errors=remount-ro\t0 1\n"
+    "\n"
+    "# /dev/sda1 LABEL=EFI\n"
+    "UUID=1A2B-3C4D      \t/boot/efi \tvfat      \t"
+    "rw,relatime,fmask=0022,dmask=0022,codepage=437,iocharset=iso8859-1,"
+    "shortname=mixed,errors=remount-ro\t0 2\n"
+    "\n"
+    "# /dev/sda3 LABEL=Home\\040Disk\n"
+    "UUID=3c5d6e7f-0011-4233-8455-667788990011\t/home     \text4      \t"
+    "rw,noatime\t0 2\n"
+    "\n"
+    "# /dev/sda5\n"
+    "UUID=0123456789ABCDEF\t/home/data\tntfs      \t"
+    "ro,nosuid,nodev,user_id=0,group_id=0,allow_other,blksize=4096\t0 0\n"
+    "\n"
+    "# /dev/mapper/vg-srv\n"
+    "/dev/mapper/vg-srv  \t/srv      \tbtrfs     \t"
+    "rw,relatime,space_cache,subvolid=5,subvol=/\t0 0\n"
+    "\n"
+    "# /dev/sda4\n"
+    "UUID=4d4d4d4d-aaaa-4bbb-8ccc-dddddddddddd\tnone      \tswap      \t"
+    "defaults,pri=-2\t0 0\n"
+    "\n"
+    "# /dev/mapper/vg-swap\n"
+    "UUID=5e5e5e5e-aaaa-4bbb-8ccc-eeeeeeeeeeee\tnone      \tswap      \t"
+    "defaults,pri=5\t0 0\n"
+    "\n"
+    "/target/swapfile    \tnone      \tswap      \tdefaults  \t0 0\n"
+    "\n";
+
+FstabInput NewFstabInput() {
+  FstabInput input;
+  input.mounts = ParseMountInfo(kMountInfo);
+  input.swaps = {
+      {"/dev/sda4", SwapType::Partition, 2097148000, 0, -2},
+      {"/dev/mapper/vg-swap", SwapType::Partition, 1048572000, 0, 5},
+      {"/target/swapfile", SwapType::File, 524284000, 0, -1},
+      {"/target/old\\040swap\\040(deleted)", SwapType::File, 524284000, 0,
+       -3},
+  };
+  input.uuids = {
+      {"/dev/sda1", "1A2B-3C4D"},
+      {"/dev/sda2", "2b4c5e9a-9d3e-4bd0-a1e8-1f1a2f3b4c5d"},
+      {"/dev/sda3", "3c5d6e7f-0011-4233-8455-667788990011"},
+      {"/dev/sda4", "4d4d4d4d-aaaa-4bbb-8ccc-dddddddddddd"},
+      {"/dev/sda5", "0123456789ABCDEF"},
+      {"/dev/sda6", "6f6f6f6f-aaaa-4bbb-8ccc-ffffffffffff"},
+      {"/dev/mapper/vg-swap", "5e5e5e5e-aaaa-4bbb-8ccc-eeeeeeeeeeee"},
+  };
+  input.part_labels = {
+      {"/dev/sda1", "EFI"},
+      {"/dev/sda2", "Root"},
+      {"/dev/sda3", "Home Disk"},
+  };
+  input.fuse_types = {{"/dev/sda5", "ntfs"}};
+  return input;
+}
+
+TEST(FstabTest, MergeMountOptions) {
+  EXPECT_EQ(MergeMountOptions("rw,relatime", "rw,errors=remount-ro"),
+            "rw,relatime,errors=remount-ro");
+  EXPECT_EQ(MergeMountOptions("ro,nosuid", "rw,user_id=0"),
+            "ro,nosuid,user_id=0");
+  EXPECT_EQ(MergeMountOptions("rw,noatime", "ro"), "ro,noatime");
+  EXPECT_EQ(MergeMountOptions("rw", "rw"), "rw");
+  EXPECT_EQ(MergeMountOptions("rw", ""), "rw");
+}
+
+TEST(FstabTest, GenerateFstab) {
+  const FstabInput input = NewFstabInput();
+  QString content;
+  ASSERT_TRUE(GenerateFstab(input, "/target", content));
+  EXPECT_EQ(content, kGenfstabOutput);
+
+  EXPECT_FALSE(GenerateFstab(input, "/target/usr", content));
+}
+
+TEST(FstabTest, GenerateFstabEscape) {
+  FstabInput input;
+  input.mounts = ParseMountInfo(
+      "21 1 8:2 / /target rw - ext4 /dev/sda2 rw\n"
+      "22 21 8:3 / /target/data\\040disk rw - ext4 /dev/sda3 rw\n");
+  QString content;
+  ASSERT_TRUE(GenerateFstab(input, "/target", content));
+  EXPECT_EQ(content,
+            "# /dev/sda2\n"
+            "/dev/sda2           \t/         \text4      \t"
+            "rw        \t0 1\n"
+            "\n"
+            "# /dev/sda3\n"
+            "/dev/sda3           \t/data\\040disk\text4      \t"
+            "rw        \t0 2\n"
+            "\n");
+}
+
+TEST(FstabTest, GenerateCrypttab) {
+  const FstabInput input = NewFstabInput();
+  EXPECT_EQ(GenerateCrypttab(input, "luks_crypt0", "/dev/sda6", "luks"),
+            "luks_crypt0 UUID=6f6f6f6f-aaaa-4bbb-8ccc-ffffffffffff "
+            "none luks\n");
+  EXPECT_TRUE(GenerateCrypttab(input, "luks_crypt0", "/dev/sdz1",
+                               "luks").isEmpty());
+}
+
+}  // namespace
+}  // namespace installer
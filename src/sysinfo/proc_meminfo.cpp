@@ -52,11 +52,13 @@ MemInfo GetMemInfo() {
   MemInfo info;
   info.buffers = hash.value("Buffers");
   info.cached = hash.value("Cached");
+  info.dirty = hash.value("Dirty");
   info.mem_available = hash.value("MemAvailable");
   info.mem_free = hash.value("MemFree");
   info.mem_total = hash.value("MemTotal");
   info.swap_free = hash.value("SwapFree");
   info.swap_total = hash.value("SwapTotal");
+  info.writeback = hash.value("Writeback");
 
   return info;
 }
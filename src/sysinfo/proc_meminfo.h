@@ -27,11 +27,13 @@ namespace installer {
 struct MemInfo {
   qint64 buffers = 0;
   qint64 cached = 0;
+  qint64 dirty = 0;  // Waiting to be written back to disk.
   qint64 mem_available = 0;
   qint64 mem_free = 0;
   qint64 mem_total = 0;
   qint64 swap_free = 0;
   qint64 swap_total = 0;
+  qint64 writeback = 0;  // Being written back to disk.
 };
 
 MemInfo GetMemInfo();
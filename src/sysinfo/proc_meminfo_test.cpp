@@ -26,6 +26,8 @@ TEST(ProcMemInfoTest, GetMemInfoTest) {
   const MemInfo info = GetMemInfo();
   EXPECT_GT(info.mem_total, 0);
   EXPECT_GT(info.buffers, 0);
+  EXPECT_GE(info.dirty, 0);
+  EXPECT_GE(info.writeback, 0);
 }
 
 }  // namespace
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sysinfo/proc_mountinfo.h"
+
+#include <QStringList>
+
+#include "base/file_util.h"
+
+namespace installer {
+
+MountInfoItemList ParseMountInfo(const QString& content) {
+  MountInfoItemList result;
+  for (const QString& line : content.split('\n', QString::SkipEmptyParts)) {
+    const QStringList parts = line.split(' ', QString::SkipEmptyParts);
+    // Optional fields end with a single hyphen.
+    const int separator = parts.indexOf("-");
+    if (separator < 6 || separator + 3 >= parts.length()) {
+      continue;
+    }
+    MountInfoItem item;
+    item.id = parts.at(0).toInt();
+    item.parent_id = parts.at(1).toInt();
+    item.mount_point = UnescapeMountPath(parts.at(4));
+    item.mount_options = parts.at(5);
+    item.fs = parts.at(separator + 1);
+    item.source = UnescapeMountPath(parts.at(separator + 2));
+    item.super_options = parts.at(separator + 3);
+    result.append(item);
+  }
+  return result;
+}
+
+MountInfoItemList ParseMountInfo() {
+  return ParseMountInfo(ReadFile("/proc/self/mountinfo"));
+}
+
+QString UnescapeMountPath(const QString& path) {
+  QString result;
+  for (int i = 0; i < path.length(); ++i) {
+    if (path.at(i) == '\\' && i + 3 < path.length()) {
+      bool ok = false;
+      const int value = path.mid(i + 1, 3).toInt(&ok, 8);
+      if (ok) {
+        result.append(QChar(value));
+        i += 3;
+        continue;
+      }
+    }
+    result.append(path.at(i));
+  }
+  return result;
+}
+
+}  // namespace installer
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_SYSINFO_PROC_MOUNTINFO_H
+#define INSTALLER_SYSINFO_PROC_MOUNTINFO_H
+
+#include <QList>
+#include <QString>
+
+namespace installer {
+
+// A line in /proc/self/mountinfo, see proc(5).
+struct MountInfoItem {
+  int id;
+  int parent_id;
+  QString mount_point;  // Escaped characters are decoded.
+  QString mount_options;  // Per mount options.
+  QString fs;  // filesystem type
+  QString source;  // Escaped characters are decoded.
+  QString super_options;  // Per superblock options.
+};
+
+typedef QList<MountInfoItem> MountInfoItemList;
+
+// Parse |content| of /proc/self/mountinfo.
+MountInfoItemList ParseMountInfo(const QString& content);
+
+// Read and parse /proc/self/mountinfo.
+MountInfoItemList ParseMountInfo();
+
+// Decode octal escaped characters in |path|, like "\040".
+QString UnescapeMountPath(const QString& path);
+
+}  // namespace installer
+
+#endif  // INSTALLER_SYSINFO_PROC_MOUNTINFO_H
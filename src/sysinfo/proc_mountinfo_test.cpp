@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sysinfo/proc_mountinfo.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(ProcMountInfoTest, ParseMountInfo) {
+  const MountInfoItemList items = ParseMountInfo(
+      "21 1 8:2 / /target rw,relatime shared:1 - ext4 /dev/sda2 rw\n"
+      "31 21 8:5 / /target/data\\040disk ro - fuseblk /dev/sda5 rw,user_id=0\n"
+      "32 21 0:5 / /target/broken rw -\n");
+  ASSERT_EQ(items.length(), 2);
+  EXPECT_EQ(items.at(0).id, 21);
+  EXPECT_EQ(items.at(0).parent_id, 1);
+  EXPECT_EQ(items.at(0).mount_point, "/target");
+  EXPECT_EQ(items.at(0).mount_options, "rw,relatime");
+  EXPECT_EQ(items.at(0).fs, "ext4");
+  EXPECT_EQ(items.at(0).source, "/dev/sda2");
+  EXPECT_EQ(items.at(1).mount_point, "/target/data disk");
+  EXPECT_EQ(items.at(1).super_options, "rw,user_id=0");
+
+  EXPECT_GT(ParseMountInfo().length(), 0);
+}
+
+TEST(ProcMountInfoTest, UnescapeMountPath) {
+  EXPECT_EQ(UnescapeMountPath("/media/a\\040b\\011c"), "/media/a b\tc");
+  EXPECT_EQ(UnescapeMountPath("/media/a\\134b"), "/media/a\\b");
+  EXPECT_EQ(UnescapeMountPath("/media/a\\x20"), "/media/a\\x20");
+}
+
+}  // namespace
+}  // namespace installer
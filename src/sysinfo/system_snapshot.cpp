@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sysinfo/system_snapshot.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace installer {
+
+namespace {
+
+QMutex g_snapshot_mutex;
+SystemSnapshot::Ptr g_current_snapshot;
+
+inline quint64 DeviceNumber(int major, int minor) {
+  return (quint64(quint32(major)) << 32) | quint32(minor);
+}
+
+}  // namespace
+
+SystemSnapshot::SystemSnapshot() {
+}
+
+SystemSnapshot::Ptr SystemSnapshot::Create() {
+  QElapsedTimer timer;
+  timer.start();
+
+  SystemSnapshot* snapshot = new SystemSnapshot();
+  snapshot->mounts_ = ParseMountItems();
+  snapshot->swaps_ = ParseSwaps();
+  snapshot->partitions_ = ParsePartitionItems();
+  snapshot->labels_ = ParseLabelDir();
+  snapshot->part_labels_ = ParsePartLabelDir();
+  snapshot->uuids_ = ParseUUIDDir();
+
+  for (int i = 0; i < snapshot->mounts_.length(); ++i) {
+    snapshot->mount_index_[snapshot->mounts_.at(i).path].append(i);
+  }
+  for (int i = 0; i < snapshot->swaps_.length(); ++i) {
+    snapshot->swap_index_.insert(snapshot->swaps_.at(i).filename, i);
+  }
+  for (int i = 0; i < snapshot->partitions_.length(); ++i) {
+    const PartitionItem& item = snapshot->partitions_.at(i);
+    snapshot->partition_index_.insert(QString("/dev/%1").arg(item.name), i);
+    snapshot->devno_index_.insert(DeviceNumber(item.major, item.minor), i);
+  }
+  for (auto iter = snapshot->uuids_.constBegin();
+       iter != snapshot->uuids_.constEnd(); ++iter) {
+    snapshot->uuid_index_.insert(iter.value(), iter.key());
+  }
+
+  qDebug() << "SystemSnapshot::Create() elapsed(ms):" << timer.elapsed();
+  return Ptr(snapshot);
+}
+
+SystemSnapshot::Ptr SystemSnapshot::Current() {
+  QMutexLocker locker(&g_snapshot_mutex);
+  if (g_current_snapshot.isNull()) {
+    g_current_snapshot = Create();
+  }
+  return g_current_snapshot;
+}
+
+SystemSnapshot::Ptr SystemSnapshot::Refresh() {
+  const Ptr snapshot = Create();
+  QMutexLocker locker(&g_snapshot_mutex);
+  g_current_snapshot = snapshot;
+  return snapshot;
+}
+
+bool SystemSnapshot::isMounted(const QString& path) const {
+  return mount_index_.contains(path);
+}
+
+MountItemList SystemSnapshot::mountItems(const QString& path) const {
+  MountItemList result;
+  for (int index : mount_index_.value(path)) {
+    result.append(mounts_.at(index));
+  }
+  return result;
+}
+
+QString SystemSnapshot::mountPoint(const QString& path) const {
+  const QList<int> indexes = mount_index_.value(path);
+  return indexes.isEmpty() ? QString() : mounts_.at(indexes.first()).mount;
+}
+
+bool SystemSnapshot::findSwap(const QString& path, SwapItem& item) const {
+  const int index = swap_index_.value(path, -1);
+  if (index == -1) {
+    return false;
+  }
+  item = swaps_.at(index);
+  return true;
+}
+
+bool SystemSnapshot::findPartition(const QString& path,
+                                   PartitionItem& item) const {
+  const int index = partition_index_.value(path, -1);
+  if (index == -1) {
+    return false;
+  }
+  item = partitions_.at(index);
+  return true;
+}
+
+bool SystemSnapshot::findPartition(int major, int minor,
+                                   PartitionItem& item) const {
+  const int index = devno_index_.value(DeviceNumber(major, minor), -1);
+  if (index == -1) {
+    return false;
+  }
+  item = partitions_.at(index);
+  return true;
+}
+
+QString SystemSnapshot::label(const QString& path) const {
+  return labels_.value(path);
+}
+
+QString SystemSnapshot::partLabel(const QString& path) const {
+  return part_labels_.value(path);
+}
+
+QString SystemSnapshot::uuid(const QString& path) const {
+  return uuids_.value(path);
+}
+
+QString SystemSnapshot::pathOfUuid(const QString& uuid) const {
+  return uuid_index_.value(uuid);
+}
+
+}  // namespace installer
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_SYSINFO_SYSTEM_SNAPSHOT_H
+#define INSTALLER_SYSINFO_SYSTEM_SNAPSHOT_H
+
+#include <QHash>
+#include <QSharedPointer>
+#include <QString>
+
+#include "sysinfo/dev_disk.h"
+#include "sysinfo/proc_mounts.h"
+#include "sysinfo/proc_partitions.h"
+#include "sysinfo/proc_swaps.h"
+
+namespace installer {
+
+// Block device and mount state of current system, read from /proc/mounts,
+// /proc/swaps, /proc/partitions and /dev/disk/by-*. Each source is read only
+// once when snapshot is created, and indexed for constant time lookups.
+// Snapshot is never changed after creation, so that it can be shared between
+// threads.
+class SystemSnapshot {
+ public:
+  typedef QSharedPointer<const SystemSnapshot> Ptr;
+
+  // Read all sources and create a new snapshot.
+  static Ptr Create();
+
+  // Returns snapshot created by last call of Refresh().
+  // A new one is created if Refresh() is never called.
+  static Ptr Current();
+
+  // Create a new snapshot and make it current. Called each time devices are
+  // scanned.
+  static Ptr Refresh();
+
+  const MountItemList& mounts() const { return mounts_; }
+  const SwapItemList& swaps() const { return swaps_; }
+  const PartitionItemList& partitions() const { return partitions_; }
+  const LabelItems& labels() const { return labels_; }
+  const PartLabelItems& partLabels() const { return part_labels_; }
+  const UUIDItems& uuids() const { return uuids_; }
+
+  // Returns true if device at |path| is mounted somewhere.
+  bool isMounted(const QString& path) const;
+
+  // Returns all mount points of device at |path|, in order of /proc/mounts.
+  MountItemList mountItems(const QString& path) const;
+
+  // Returns the first mount point of device at |path|, or an empty string.
+  QString mountPoint(const QString& path) const;
+
+  // Find item in /proc/swaps of swap partition or file at |path|.
+  bool findSwap(const QString& path, SwapItem& item) const;
+
+  // Find item in /proc/partitions of block device at |path|, like /dev/sda1,
+  // or with device number |major|:|minor|.
+  bool findPartition(const QString& path, PartitionItem& item) const;
+  bool findPartition(int major, int minor, PartitionItem& item) const;
+
+  // Returns filesystem label, GPT partition label or filesystem UUID of
+  // partition at |path|.
+  QString label(const QString& path) const;
+  QString partLabel(const QString& path) const;
+  QString uuid(const QString& path) const;
+
+  // Returns path to partition with filesystem |uuid|.
+  QString pathOfUuid(const QString& uuid) const;
+
+ private:
+  SystemSnapshot();
+
+  MountItemList mounts_;
+  SwapItemList swaps_;
+  PartitionItemList partitions_;
+  LabelItems labels_;
+  PartLabelItems part_labels_;
+  UUIDItems uuids_;
+
+  // Indexes to items in lists above.
+  QHash<QString, QList<int>> mount_index_;
+  QHash<QString, int> swap_index_;
+  QHash<QString, int> partition_index_;
+  QHash<quint64, int> devno_index_;
+  QHash<QString, QString> uuid_index_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_SYSINFO_SYSTEM_SNAPSHOT_H
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sysinfo/system_snapshot.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(SystemSnapshotTest, Lookup) {
+  const SystemSnapshot::Ptr snapshot = SystemSnapshot::Create();
+  ASSERT_FALSE(snapshot.isNull());
+
+  for (const MountItem& item : snapshot->mounts()) {
+    EXPECT_TRUE(snapshot->isMounted(item.path));
+    EXPECT_FALSE(snapshot->mountItems(item.path).isEmpty());
+  }
+  EXPECT_FALSE(snapshot->isMounted("/dev/not-exist"));
+  EXPECT_TRUE(snapshot->mountPoint("/dev/not-exist").isEmpty());
+
+  for (const PartitionItem& item : snapshot->partitions()) {
+    PartitionItem found;
+    EXPECT_TRUE(snapshot->findPartition(QString("/dev/%1").arg(item.name),
+                                        found));
+    EXPECT_EQ(found.name, item.name);
+    EXPECT_TRUE(snapshot->findPartition(item.major, item.minor, found));
+    EXPECT_EQ(found.name, item.name);
+  }
+
+  for (const SwapItem& item : snapshot->swaps()) {
+    SwapItem found;
+    EXPECT_TRUE(snapshot->findSwap(item.filename, found));
+    EXPECT_EQ(found.size, item.size);
+  }
+
+  for (const QString& path : snapshot->uuids().keys()) {
+    EXPECT_EQ(snapshot->pathOfUuid(snapshot->uuid(path)), path);
+  }
+}
+
+TEST(SystemSnapshotTest, Refresh) {
+  const SystemSnapshot::Ptr current = SystemSnapshot::Current();
+  EXPECT_EQ(current, SystemSnapshot::Current());
+  const SystemSnapshot::Ptr refreshed = SystemSnapshot::Refresh();
+  EXPECT_NE(current, refreshed);
+  EXPECT_EQ(refreshed, SystemSnapshot::Current());
+}
+
+}  // namespace
+}  // namespace installer
@@ -50,14 +50,60 @@ const QMap<FsType, QString> FsFormatCmdMap{
     { FsType::Xfs, QString("mkfs.xfs") }
 };
 
+// Copy |device| so that operations can be applied to the copy. Unallocated
+// partitions are copied too, as they are modified while being merged.
+// Other partitions are replaced, not modified, by operations.
+Device::Ptr CopyDevice(const Device::Ptr device) {
+  Device::Ptr new_device(new Device(*device));
+  for (Partition::Ptr& partition : new_device->partitions) {
+    if (partition->type == PartitionType::Unallocated) {
+      partition.reset(new Partition(*partition));
+    }
+  }
+  return new_device;
+}
+
+// Returns true if |a| and |b| refer to the same partitions.
+// Operations shall replace their partitions instead of modifying them,
+// so that changed operations can be found by comparing pointers.
+bool IsSameOperation(const Operation& a, const Operation& b) {
+  return (a.type == b.type &&
+          a.device == b.device &&
+          a.orig_partition == b.orig_partition &&
+          a.new_partition == b.new_partition);
+}
+
+// Add |flags| to a copy of new partition of |operation|, as partitions are
+// shared with virtual devices and undo snapshots. Partition is kept if it
+// has all of |flags| already, so that no undo snapshot is pushed.
+void AddPartitionFlags(Operation& operation, const PartitionFlags& flags) {
+  Partition::Ptr new_partition;
+  for (PartitionFlag flag : flags) {
+    if (!operation.new_partition->flags.contains(flag)) {
+      if (new_partition.isNull()) {
+        new_partition.reset(new Partition(*operation.new_partition));
+      }
+      new_partition->flags.append(flag);
+    }
+  }
+  if (!new_partition.isNull()) {
+    operation.new_partition = new_partition;
+  }
+}
+
 }  // namespace
 
 AdvancedPartitionDelegate::AdvancedPartitionDelegate(QObject* parent)
     : QObject(parent),
       real_devices_(),
       virtual_devices_(),
+      base_devices_(),
       bootloader_path_(),
-      operations_() {
+      operations_(),
+      applied_operations_(),
+      applied_devices_(),
+      undo_stack_(),
+      redo_stack_() {
   this->setObjectName("advanced_partition_delegate");
 }
 
@@ -273,8 +319,8 @@ bool AdvancedPartitionDelegate::setBootFlag() {
   for (Operation& operation : operations_) {
       if (operation.type == OperationType::Create || operation.type == OperationType::MountPoint) {
           if (operation.new_partition->fs == FsType::EFI) {
-              operation.new_partition->flags.append(PartitionFlag::Boot);
-              operation.new_partition->flags.append(PartitionFlag::ESP);
+              AddPartitionFlags(operation,
+                                {PartitionFlag::Boot, PartitionFlag::ESP});
               found_boot = true;
           }
       }
@@ -296,7 +342,7 @@ bool AdvancedPartitionDelegate::setBootFlag() {
               operation.type == OperationType::MountPoint ||
               operation.type == OperationType::Format) {
               if (operation.new_partition->mount_point == kMountPointBoot) {
-                  operation.new_partition->flags.append(PartitionFlag::Boot);
+                  AddPartitionFlags(operation, {PartitionFlag::Boot});
                   found_boot = true;
               }
           }
@@ -310,7 +356,7 @@ bool AdvancedPartitionDelegate::setBootFlag() {
               operation.type == OperationType::MountPoint ||
               operation.type == OperationType::Format) {
               if (operation.new_partition->mount_point == kMountPointRoot) {
-                  operation.new_partition->flags.append(PartitionFlag::Boot);
+                  AddPartitionFlags(operation, {PartitionFlag::Boot});
                   found_boot = true;
               }
           }
@@ -443,6 +489,7 @@ bool AdvancedPartitionDelegate::createPartition(const Partition::Ptr partition,
     return false;
   }
   Device::Ptr device = virtual_devices_[device_index];
+  Partition::Ptr unallocated = partition;
 
   if (device->table == PartitionTableType::Empty) {
     // Add NewPartTable operation.
@@ -452,24 +499,28 @@ bool AdvancedPartitionDelegate::createPartition(const Partition::Ptr partition,
                        PartitionTableType::MsDos;
     //NOTE: GPT table need 33 sectors in the end.
     if (new_device->table == PartitionTableType::GPT) {
-        partition->length -= 33;
-        partition->end_sector -= 33;
+        unallocated.reset(new Partition(*partition));
+        unallocated->length -= 33;
+        unallocated->end_sector -= 33;
     }
     const Operation operation(new_device);
     operations_.append(operation);
-    // Update virtual device property at the same time.
+    // Update virtual device property at the same time. Old device is kept
+    // in undo history, so update a copy of it.
+    device = CopyDevice(device);
     operation.applyToVisual(device);
+    virtual_devices_[device_index] = device;
   }
 
   if (partition_type == PartitionType::Normal) {
-    return createPrimaryPartition(partition,
+    return createPrimaryPartition(unallocated,
                                   PartitionType::Normal,
                                   align_start,
                                   fs_type,
                                   mount_point,
                                   total_sectors);
   } else if (partition_type == PartitionType::Logical) {
-    return createLogicalPartition(partition,
+    return createLogicalPartition(unallocated,
                                   align_start,
                                   fs_type,
                                   mount_point,
@@ -649,6 +700,9 @@ AdvancedPartitionDelegate::createPrimaryPartition(const Partition::Ptr partition
       operations_.append(operation);
 
       // Remove extended partition from partition list explicitly.
+      // Virtual device is not modified, the copy is only used to allocate
+      // partition number.
+      device.reset(new Device(*device));
       device->partitions.removeAt(ext_index);
 
     } else if (IsPartitionsJoint(ext_partition, partition)) {
@@ -750,6 +804,8 @@ void AdvancedPartitionDelegate::deletePartition(const Partition::Ptr partition)
   new_partition->fs           = FsType::Empty;
   new_partition->status       = PartitionStatus::Delete;
 
+  // Set if CreateOperation of |partition| is removed.
+  bool create_removed = false;
   if (partition->status == PartitionStatus::New) {
     // If status of old partition is New, there shall be a CreateOperation
     // which generates that partition-> Merge that CreateOperation
@@ -760,9 +816,9 @@ void AdvancedPartitionDelegate::deletePartition(const Partition::Ptr partition)
         const Operation& operation = operations_.at(index);
         if (operation.type == OperationType::Create &&
             *operation.new_partition.data() == *partition.data()) {
-            partition->type   = PartitionType::Unallocated;
-            partition->fs     = FsType::Empty;
-            partition->status = PartitionStatus::Delete;
+            // |partition| is not modified, as it is still referenced by
+            // virtual devices in undo history.
+            create_removed = true;
 
             qDebug() << "delete partition info: " << *partition.data();
 
@@ -776,7 +832,10 @@ void AdvancedPartitionDelegate::deletePartition(const Partition::Ptr partition)
                 if (it->type == OperationType::Create &&
                     partition->device_path == it->orig_partition->device_path &&
                     it->orig_partition->start_sector == end_size) {
-                    it->orig_partition->start_sector = start_size;
+                    Partition::Ptr orig_partition(
+                        new Partition(*it->orig_partition));
+                    orig_partition->start_sector = start_size;
+                    it->orig_partition = orig_partition;
                 }
             }
             break;
@@ -788,7 +847,7 @@ void AdvancedPartitionDelegate::deletePartition(const Partition::Ptr partition)
       qDebug() << "add delete operation" << *new_partition.data();
   }
 
-  if (partition->type == PartitionType::Logical) {
+  if (!create_removed && partition->type == PartitionType::Logical) {
     // Delete extended partition if needed.
     const int device_index = DeviceIndex(virtual_devices_,
                                          partition->device_path);
@@ -846,8 +905,10 @@ void AdvancedPartitionDelegate::formatPartition(const Partition::Ptr partition,
       if ((operation.new_partition->path == partition->path) &&
           (operation.type == OperationType::Format ||
            operation.type == OperationType::Create)) {
-        operation.new_partition->mount_point = mount_point;
-        operation.new_partition->fs = fs_type;
+        Partition::Ptr new_partition(new Partition(*operation.new_partition));
+        new_partition->mount_point = mount_point;
+        new_partition->fs = fs_type;
+        operation.new_partition = new_partition;
         return;
       }
     }
@@ -872,7 +933,59 @@ void AdvancedPartitionDelegate::onDeviceRefreshed(const DeviceList& devices) {
   qDebug() << "device refreshed():" << devices;
   real_devices_ = devices;
   operations_.clear();
-  virtual_devices_ = FilterInstallerDevice(real_devices_);
+  this->resetBaseDevices();
+  virtual_devices_.clear();
+  for (const Device::Ptr device : base_devices_) {
+    virtual_devices_.append(CopyDevice(device));
+  }
+  applied_operations_ = operations_;
+  applied_devices_ = virtual_devices_;
+  undo_stack_.clear();
+  redo_stack_.clear();
+
+  emit this->deviceRefreshed(virtual_devices_);
+}
+
+void AdvancedPartitionDelegate::onDevicesChanged(const DeviceListDiff& diff) {
+  qDebug() << "devices changed:" << diff;
+  QStringList device_paths(diff.removed);
+  for (const Device::Ptr& device : diff.changed) {
+    device_paths.append(device->path);
+  }
+
+  // Operations on other devices are kept.
+  OperationList operations;
+  for (const Operation& operation : operations_) {
+    const QString device_path =
+        (operation.type == OperationType::NewPartTable) ?
+        operation.device->path :
+        operation.orig_partition->device_path;
+    if (!device_paths.contains(device_path)) {
+      operations.append(operation);
+    }
+  }
+  operations_ = operations;
+
+  ApplyDeviceListDiff(real_devices_, diff);
+  this->resetBaseDevices();
+
+  // Virtual devices not changed are kept.
+  DeviceList virtual_devices;
+  for (const Device::Ptr device : base_devices_) {
+    const int index = DeviceIndex(virtual_devices_, device->path);
+    if (index == -1 || device_paths.contains(device->path)) {
+      virtual_devices.append(this->buildVirtualDevice(device->path));
+    } else {
+      virtual_devices.append(virtual_devices_.at(index));
+    }
+  }
+  virtual_devices_ = virtual_devices;
+  applied_operations_ = operations_;
+  applied_devices_ = virtual_devices_;
+
+  // Device list is changed, so old snapshots can not be restored.
+  undo_stack_.clear();
+  redo_stack_.clear();
 
   emit this->deviceRefreshed(virtual_devices_);
 }
@@ -959,35 +1072,76 @@ void AdvancedPartitionDelegate::onManualPartDone(const DeviceList& devices) {
 }
 
 void AdvancedPartitionDelegate::refreshVisual() {
-// Filters partition list based on the following policy:
-  // * Remove extended partition if no logical partition exists;
-  // * Merge unallocated partition with next unallocated one;
-  // * Ignore partitions with size less than 100Mib;
-
-  virtual_devices_ = FilterInstallerDevice(real_devices_);
+  // Policy:
+  // * If operations are only appended since last refresh, apply the new
+  //   operations to a copy of their devices;
+  // * Otherwise rebuild devices of changed operations from base devices;
+  // * Devices not touched are kept as is.
+
+  // Find the first operation changed since last refresh.
+  const int common = qMin(applied_operations_.length(), operations_.length());
+  int first_changed = 0;
+  while (first_changed < common &&
+         IsSameOperation(applied_operations_.at(first_changed),
+                         operations_.at(first_changed))) {
+    first_changed ++;
+  }
+  if (first_changed == applied_operations_.length() &&
+      first_changed == operations_.length()) {
+    return;
+  }
 
-  for (Device::Ptr device : virtual_devices_) {
-      device->partitions = FilterFragmentationPartition(device->partitions);
+  // Devices touched by removed or modified operations.
+  QStringList rebuild_paths;
+  for (int index = first_changed; index < applied_operations_.length();
+       ++index) {
+    const QString device_path = applied_operations_.at(index).devicePath();
+    if (!rebuild_paths.contains(device_path)) {
+      rebuild_paths.append(device_path);
+    }
+  }
+  QStringList changed_paths(rebuild_paths);
+  for (int index = first_changed; index < operations_.length(); ++index) {
+    const QString device_path = operations_.at(index).devicePath();
+    if (!changed_paths.contains(device_path)) {
+      changed_paths.append(device_path);
+    }
   }
 
-  for (Device::Ptr device : virtual_devices_) {
-      // Merge unallocated partitions.
-      MergeUnallocatedPartitions(device->partitions);
+  undo_stack_.append({applied_operations_, applied_devices_});
+  redo_stack_.clear();
 
-      for (Operation& operation : operations_) {
-          if ((operation.type == OperationType::NewPartTable && *operation.device.data() == *device.data()) ||
-              (operation.type != OperationType::NewPartTable && operation.orig_partition->device_path == device->path)) {
-              operation.applyToVisual(device);
-          }
-      }
+  DeviceList changed_devices;
+  for (const QString& device_path : changed_paths) {
+    const int device_index = DeviceIndex(virtual_devices_, device_path);
+    if (device_index == -1) {
+      qWarning() << "refreshVisual() device not found:" << device_path;
+      continue;
+    }
 
-      // Merge unallocated partitions.
+    Device::Ptr device;
+    if (rebuild_paths.contains(device_path)) {
+      device = this->buildVirtualDevice(device_path);
+    } else {
+      device = CopyDevice(virtual_devices_.at(device_index));
+      for (int index = first_changed; index < operations_.length(); ++index) {
+        const Operation& operation = operations_.at(index);
+        if (operation.devicePath() == device_path) {
+          operation.applyToVisual(device);
+        }
+      }
       MergeUnallocatedPartitions(device->partitions);
+    }
+    virtual_devices_[device_index] = device;
+    changed_devices.append(device);
   }
 
-  qDebug() << "devices:" << virtual_devices_;
-  qDebug() << "operations:" << operations_;
-  emit this->deviceRefreshed(virtual_devices_);
+  applied_operations_ = operations_;
+  applied_devices_ = virtual_devices_;
+
+  for (const Device::Ptr device : changed_devices) {
+    emit this->deviceChanged(device);
+  }
 }
 
 void AdvancedPartitionDelegate::resetOperationMountPoint(
@@ -1005,7 +1159,9 @@ void AdvancedPartitionDelegate::resetOperationMountPoint(
         return;
       } else {
         // Clear mount point of old operation.
-        operation.new_partition->mount_point = "";
+        Partition::Ptr new_partition(new Partition(*operation.new_partition));
+        new_partition->mount_point = "";
+        operation.new_partition = new_partition;
         qDebug() << "Clear mount-point of operation:" << operation;
         return;
       }
@@ -1013,10 +1169,28 @@ void AdvancedPartitionDelegate::resetOperationMountPoint(
   }
 }
 
+void AdvancedPartitionDelegate::redo() {
+  if (redo_stack_.isEmpty()) {
+    return;
+  }
+  const EditSnapshot snapshot = redo_stack_.takeLast();
+  undo_stack_.append({applied_operations_, applied_devices_});
+  this->restoreSnapshot(snapshot);
+}
+
 void AdvancedPartitionDelegate::setBootloaderPath(const QString& path) {
   bootloader_path_ = path;
 }
 
+void AdvancedPartitionDelegate::undo() {
+  if (undo_stack_.isEmpty()) {
+    return;
+  }
+  const EditSnapshot snapshot = undo_stack_.takeLast();
+  redo_stack_.append({applied_operations_, applied_devices_});
+  this->restoreSnapshot(snapshot);
+}
+
 bool AdvancedPartitionDelegate::unFormatPartition(const Partition::Ptr partition) {
   Q_ASSERT(partition->status == PartitionStatus::Format);
   if (partition->status == PartitionStatus::Format) {
@@ -1055,4 +1229,55 @@ void AdvancedPartitionDelegate::updateMountPoint(const Partition::Ptr partition,
   }
 }
 
+void AdvancedPartitionDelegate::resetBaseDevices() {
+  // Filters partition list based on the following policy:
+  // * Ignore unallocated partitions with size less than 2Mib;
+  // * Merge unallocated partition with next unallocated one;
+  base_devices_ = FilterInstallerDevice(real_devices_);
+  for (Device::Ptr device : base_devices_) {
+    device->partitions = FilterFragmentationPartition(device->partitions);
+    MergeUnallocatedPartitions(device->partitions);
+  }
+}
+
+Device::Ptr AdvancedPartitionDelegate::buildVirtualDevice(
+    const QString& device_path) const {
+  const int index = DeviceIndex(base_devices_, device_path);
+  if (index == -1) {
+    qCritical() << "buildVirtualDevice() device not found:" << device_path;
+    return Device::Ptr();
+  }
+
+  const Device::Ptr device = CopyDevice(base_devices_.at(index));
+  for (const Operation& operation : operations_) {
+    if (operation.devicePath() == device_path) {
+      operation.applyToVisual(device);
+    }
+  }
+  MergeUnallocatedPartitions(device->partitions);
+  return device;
+}
+
+void AdvancedPartitionDelegate::restoreSnapshot(
+    const EditSnapshot& snapshot) {
+  // Device list is not changed between snapshots, only devices in it
+  // are replaced.
+  DeviceList changed_devices;
+  for (int index = 0; index < snapshot.devices.length(); ++index) {
+    if (index >= virtual_devices_.length() ||
+        virtual_devices_.at(index) != snapshot.devices.at(index)) {
+      changed_devices.append(snapshot.devices.at(index));
+    }
+  }
+
+  operations_ = snapshot.operations;
+  applied_operations_ = snapshot.operations;
+  virtual_devices_ = snapshot.devices;
+  applied_devices_ = snapshot.devices;
+
+  for (const Device::Ptr device : changed_devices) {
+    emit this->deviceChanged(device);
+  }
+}
+
 }  // namespace installer
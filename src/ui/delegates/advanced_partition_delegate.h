@@ -76,10 +76,17 @@ class AdvancedPartitionDelegate : public QObject {
   //  * An EFI partition exists if EFI mode is on;
   AdvancedValidateStates validate() const;
 
+  // Returns true if there are operations to undo or redo.
+  bool canUndo() const { return !undo_stack_.isEmpty(); }
+  bool canRedo() const { return !redo_stack_.isEmpty(); }
+
  signals:
   // Emitted when virtual device list is updated.
   void deviceRefreshed(const DeviceList& devices);
 
+  // Emitted when only |device| in virtual device list is updated.
+  void deviceChanged(const Device::Ptr device);
+
  public slots:
   bool createPartition(const Partition::Ptr partition,
                        PartitionType partition_type,
@@ -106,12 +113,23 @@ class AdvancedPartitionDelegate : public QObject {
   // Save real device list when it is refreshed.
   void onDeviceRefreshed(const DeviceList& devices);
 
+  // Update real device list with |diff|, operations on changed devices are
+  // dropped.
+  void onDevicesChanged(const DeviceListDiff& diff);
+
   // Write partitioning settings to file.
   void onManualPartDone(const DeviceList& devices);
 
   // Refresh virtual device list based on current operations.
+  // Only devices touched by operations changed since last refresh are
+  // updated, and deviceChanged() is emitted for each of them.
   void refreshVisual();
 
+  // Revert operation list and virtual devices to the state before last
+  // refresh, or restore the state reverted by undo().
+  void undo();
+  void redo();
+
   // Clear mount point of operation.new_partition with value |mount_point|.
   void resetOperationMountPoint(const QString& mount_point);
 
@@ -123,13 +141,41 @@ class AdvancedPartitionDelegate : public QObject {
   void updateMountPoint(const Partition::Ptr partition, const QString& mount_point);
 
  private:
+  // Operations and virtual devices saved for undo() and redo().
+  struct EditSnapshot {
+    OperationList operations;
+    DeviceList devices;
+  };
+
+  // Filter and merge partitions of real devices into |base_devices_|.
+  void resetBaseDevices();
+
+  // Build virtual device at |device_path| by applying all of operations on
+  // it to its base device.
+  Device::Ptr buildVirtualDevice(const QString& device_path) const;
+
+  // Replace current operations and virtual devices with |snapshot|.
+  void restoreSnapshot(const EditSnapshot& snapshot);
+
   DeviceList real_devices_;
   DeviceList virtual_devices_;
 
+  // Real devices with small partitions filtered, which virtual devices
+  // are built from. Partitions in it are never modified.
+  DeviceList base_devices_;
+
   QString bootloader_path_;
 
   // Currently defined operations.
   OperationList operations_;
+
+  // Operations and virtual devices at last refresh. Devices in the list
+  // are never modified, a copy is updated instead.
+  OperationList applied_operations_;
+  DeviceList applied_devices_;
+
+  QList<EditSnapshot> undo_stack_;
+  QList<EditSnapshot> redo_stack_;
 };
 
 }  // namespace installer
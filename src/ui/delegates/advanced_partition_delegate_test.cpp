@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ui/delegates/advanced_partition_delegate.h"
+
+#include <QDebug>
+
+#include "partman/structs.h"
+#include "ui/delegates/partition_util.h"
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+// Create a partition on device at |device_path|.
+Partition::Ptr NewPartition(const QString& device_path, int number,
+                            PartitionType type, FsType fs,
+                            qint64 start_sector, qint64 end_sector) {
+  Partition::Ptr partition(new Partition);
+  partition->device_path = device_path;
+  partition->sector_size = 512;
+  partition->type = type;
+  partition->fs = fs;
+  partition->start_sector = start_sector;
+  partition->end_sector = end_sector;
+  if (number > 0) {
+    partition->changeNumber(number);
+  }
+  return partition;
+}
+
+// 2GiB msdos device with two ext4 partitions and free space at the end.
+Device::Ptr NewTestDevice(const QString& device_path) {
+  Device::Ptr device(new Device);
+  device->path = device_path;
+  device->sector_size = 512;
+  device->length = 4194304;
+  device->max_prims = 4;
+  device->table = PartitionTableType::MsDos;
+  device->partitions.append(NewPartition(device_path, 1,
+                                         PartitionType::Normal, FsType::Ext4,
+                                         2048, 1000000));
+  device->partitions.append(NewPartition(device_path, 2,
+                                         PartitionType::Normal, FsType::Ext4,
+                                         1000001, 2000000));
+  device->partitions.append(NewPartition(device_path, -1,
+                                         PartitionType::Unallocated,
+                                         FsType::Empty,
+                                         2000001, 4194303));
+  return device;
+}
+
+// Describe partitions of |devices| in text, so that devices built in
+// different ways can be compared.
+QString DumpDevices(const DeviceList& devices) {
+  QString dump;
+  {
+    QDebug debug(&dump);
+    for (const Device::Ptr device : devices) {
+      debug << device->path << device->table;
+      for (const Partition::Ptr partition : device->partitions) {
+        debug << *partition;
+      }
+    }
+  }
+  return dump;
+}
+
+// Build virtual devices by applying all of |operations| to filtered
+// |real_devices|, without any cache.
+DeviceList ReplayOperations(const DeviceList& real_devices,
+                            const OperationList& operations) {
+  DeviceList devices = FilterInstallerDevice(real_devices);
+  for (Device::Ptr device : devices) {
+    device->partitions = FilterFragmentationPartition(device->partitions);
+    MergeUnallocatedPartitions(device->partitions);
+    for (const Operation& operation : operations) {
+      if (operation.devicePath() == device->path) {
+        operation.applyToVisual(device);
+      }
+    }
+    MergeUnallocatedPartitions(device->partitions);
+  }
+  return devices;
+}
+
+class AdvancedPartitionDelegateTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    real_devices_.append(NewTestDevice("/dev/sdy"));
+    real_devices_.append(NewTestDevice("/dev/sdz"));
+    delegate_.onDeviceRefreshed(real_devices_);
+  }
+
+  // Returns partition at |path| in virtual devices.
+  Partition::Ptr findPartition(const QString& path) const {
+    for (const Device::Ptr device : delegate_.virtual_devices()) {
+      for (const Partition::Ptr partition : device->partitions) {
+        if (partition->path == path) {
+          return partition;
+        }
+      }
+    }
+    return Partition::Ptr();
+  }
+
+  // Returns the last unallocated partition of device at |device_path|.
+  Partition::Ptr findUnallocated(const QString& device_path) const {
+    Partition::Ptr unallocated;
+    for (const Device::Ptr device : delegate_.virtual_devices()) {
+      for (const Partition::Ptr partition : device->partitions) {
+        if (device->path == device_path &&
+            partition->type == PartitionType::Unallocated) {
+          unallocated = partition;
+        }
+      }
+    }
+    return unallocated;
+  }
+
+  // Refresh virtual devices and check them against a full replay of
+  // operations. Devices are saved in |history_| for undo() and redo().
+  void refreshAndCheck() {
+    delegate_.refreshVisual();
+    const QString dump = DumpDevices(delegate_.virtual_devices());
+    EXPECT_EQ(dump, DumpDevices(ReplayOperations(real_devices_,
+                                                 delegate_.operations())));
+    history_.append(dump);
+  }
+
+  DeviceList real_devices_;
+  AdvancedPartitionDelegate delegate_;
+  QStringList history_;
+};
+
+TEST_F(AdvancedPartitionDelegateTest, RefreshUndoRedo) {
+  history_.append(DumpDevices(delegate_.virtual_devices()));
+
+  // Format an existing partition as root.
+  const Partition::Ptr sdy1 = findPartition("/dev/sdy1");
+  ASSERT_FALSE(sdy1.isNull());
+  delegate_.formatPartition(sdy1, FsType::Ext4, kMountPointRoot);
+  refreshAndCheck();
+
+  // Create a partition on the other device.
+  const Partition::Ptr unallocated = findUnallocated("/dev/sdz");
+  ASSERT_FALSE(unallocated.isNull());
+  ASSERT_TRUE(delegate_.createPartition(unallocated, PartitionType::Normal,
+                                        true, FsType::Ext4, "/home",
+                                        1048576));
+  refreshAndCheck();
+  const Partition::Ptr sdz3 = findPartition("/dev/sdz3");
+  ASSERT_FALSE(sdz3.isNull());
+  EXPECT_EQ(sdz3->mount_point, "/home");
+
+  // Delete an existing partition, its space is merged with free space.
+  const Partition::Ptr sdy2 = findPartition("/dev/sdy2");
+  ASSERT_FALSE(sdy2.isNull());
+  delegate_.deletePartition(sdy2);
+  refreshAndCheck();
+  EXPECT_EQ(findUnallocated("/dev/sdy")->start_sector, sdy2->start_sector);
+
+  // Move root to the new partition. Mount point of the first operation is
+  // cleared, so that device is rebuilt instead of being updated.
+  delegate_.updateMountPoint(sdz3, kMountPointRoot);
+  refreshAndCheck();
+  EXPECT_TRUE(findPartition("/dev/sdy1")->mount_point.isEmpty());
+
+  // Boot flag is set on copies of partitions, devices in history are kept.
+  const QString before_boot_flag = DumpDevices(delegate_.virtual_devices());
+  ASSERT_TRUE(delegate_.setBootFlag());
+  EXPECT_EQ(DumpDevices(delegate_.virtual_devices()), before_boot_flag);
+  EXPECT_EQ(history_.last(), before_boot_flag);
+  refreshAndCheck();
+  EXPECT_TRUE(findPartition("/dev/sdz3")->flags.contains(PartitionFlag::Boot));
+
+  // Flags are set already, partitions are kept and no snapshot is pushed,
+  // which is checked by undo() below.
+  const OperationList operations = delegate_.operations();
+  ASSERT_TRUE(delegate_.setBootFlag());
+  ASSERT_EQ(delegate_.operations().length(), operations.length());
+  for (int i = 0; i < operations.length(); ++i) {
+    EXPECT_EQ(delegate_.operations().at(i).new_partition,
+              operations.at(i).new_partition);
+  }
+  delegate_.refreshVisual();
+
+  // Each undo() restores devices of the previous refresh, which match
+  // replay of operations restored.
+  for (int index = history_.length() - 2; index >= 0; --index) {
+    ASSERT_TRUE(delegate_.canUndo());
+    delegate_.undo();
+    EXPECT_EQ(DumpDevices(delegate_.virtual_devices()), history_.at(index));
+    EXPECT_EQ(DumpDevices(ReplayOperations(real_devices_,
+                                           delegate_.operations())),
+              history_.at(index));
+  }
+  EXPECT_FALSE(delegate_.canUndo());
+  EXPECT_TRUE(delegate_.operations().isEmpty());
+
+  for (int index = 1; index < history_.length(); ++index) {
+    ASSERT_TRUE(delegate_.canRedo());
+    delegate_.redo();
+    EXPECT_EQ(DumpDevices(delegate_.virtual_devices()), history_.at(index));
+    EXPECT_EQ(DumpDevices(ReplayOperations(real_devices_,
+                                           delegate_.operations())),
+              history_.at(index));
+  }
+  EXPECT_FALSE(delegate_.canRedo());
+
+  // A new edit after undo() drops redo history.
+  delegate_.undo();
+  delegate_.formatPartition(findPartition("/dev/sdy1"), FsType::Xfs, "");
+  delegate_.refreshVisual();
+  EXPECT_FALSE(delegate_.canRedo());
+  EXPECT_EQ(DumpDevices(delegate_.virtual_devices()),
+            DumpDevices(ReplayOperations(real_devices_,
+                                         delegate_.operations())));
+}
+
+}  // namespace
+}  // namespace installer
@@ -17,6 +17,7 @@
 
 #include "ui/delegates/full_disk_delegate.h"
 
+#include "partman/auto_part.h"
 #include "service/settings_manager.h"
 #include "service/settings_name.h"
 #include "ui/delegates/partition_util.h"
@@ -249,7 +250,7 @@ FullDiskValidateState FullDiskDelegate::validate() const {
 void FullDiskDelegate::resetOperations() {
   operations_.clear();
 
-  virtual_devices_ = real_devices_;
+  virtual_devices_ = FilterInstallerDevice(real_devices_);
 }
 
 bool FullDiskDelegate::createPartition(const Partition::Ptr partition,
@@ -642,27 +643,14 @@ bool FullDiskDelegate::formatWholeDevice(const QString& device_path,
   Partition::Ptr unallocated = device->partitions.last();
 
   // Read policy
-  QString part_policy;
-  QString part_labels;
   const qint64 large_disk_threshold =
       GetSettingsInt(kPartitionFullDiskLargeDiskThreshold) * kGibiByte;
-  if (type == PartitionTableType::GPT) {
-    if (device->length * device->sector_size < large_disk_threshold) {
-      part_policy = GetSettingsString(kPartitionFullDiskSmallUEFIPolicy);
-      part_labels = GetSettingsString(kPartitionFullDiskSmallUEFILabel);
-    } else {
-      part_policy = GetSettingsString(kPartitionFullDiskLargeUEFIPolicy);
-      part_labels = GetSettingsString(kPartitionFullDiskLargeUEFILabel);
-    }
-  } else {
-    if (device->length * device->sector_size < large_disk_threshold) {
-      part_policy = GetSettingsString(kPartitionFullDiskSmallLegacyPolicy);
-      part_labels = GetSettingsString(kPartitionFullDiskSmallLegacyLabel);
-    } else {
-      part_policy = GetSettingsString(kPartitionFullDiskLargeLegacyPolicy);
-      part_labels = GetSettingsString(kPartitionFullDiskLargeLegacyLabel);
-    }
-  }
+  const QString policy_name = GetFullDiskPolicyName(
+      device->length * device->sector_size >= large_disk_threshold,
+      type == PartitionTableType::GPT,
+      false);
+  const QString part_policy = GetSettingsString(policy_name + "_policy");
+  const QString part_labels = GetSettingsString(policy_name + "_label");
 
   const QString part_root_range_policy { GetSettingsString(kPartitionFullDiskLargeRootPartRange) };
   const std::pair<QString, QString> root_range {
@@ -802,6 +790,48 @@ void FullDiskDelegate::onDeviceRefreshed(const DeviceList& devices) {
   emit this->deviceRefreshed(virtual_devices_);
 }
 
+void FullDiskDelegate::onDevicesChanged(const DeviceListDiff& diff) {
+  qDebug() << "devices changed:" << diff;
+  QStringList device_paths(diff.removed);
+  for (const Device::Ptr& device : diff.changed) {
+    device_paths.append(device->path);
+  }
+
+  // Operations are generated for the selected device only, they are reset
+  // if that device is removed or changed.
+  bool selected_changed = !selected_partition_.isNull() &&
+      device_paths.contains(selected_partition_->device_path);
+  for (const Operation& operation : operations_) {
+    const QString device_path =
+        (operation.type == OperationType::NewPartTable) ?
+        operation.device->path :
+        operation.orig_partition->device_path;
+    if (device_paths.contains(device_path)) {
+      selected_changed = true;
+    }
+  }
+
+  ApplyDeviceListDiff(real_devices_, diff);
+
+  if (selected_changed) {
+    selected_partition_.reset();
+    this->resetOperations();
+  } else {
+    // Virtual devices not changed are kept.
+    DeviceList virtual_devices;
+    for (const Device::Ptr device : FilterInstallerDevice(real_devices_)) {
+      const int index = DeviceIndex(virtual_devices_, device->path);
+      if (index == -1 || device_paths.contains(device->path)) {
+        virtual_devices.append(device);
+      } else {
+        virtual_devices.append(virtual_devices_.at(index));
+      }
+    }
+    virtual_devices_ = virtual_devices;
+  }
+  emit this->deviceRefreshed(virtual_devices_);
+}
+
 void FullDiskDelegate::onManualPartDone(const DeviceList& devices) {
   qDebug() << "FullDiskDelegate::onManualPartDone()" << devices;
   QString root_disk;
@@ -110,6 +110,10 @@ class FullDiskDelegate : public QObject {
   // Save real device list when it is refreshed.
   void onDeviceRefreshed(const DeviceList& devices);
 
+  // Update real device list with |diff|. Operations and selected partition
+  // are dropped only if the selected device is removed or changed.
+  void onDevicesChanged(const DeviceListDiff& diff);
+
   // Write partitioning settings to file.
   void onManualPartDone(const DeviceList& devices);
 
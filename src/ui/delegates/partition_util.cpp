@@ -27,7 +27,7 @@
 #include "service/settings_manager.h"
 #include "service/settings_name.h"
 #include "sysinfo/proc_meminfo.h"
-#include "sysinfo/proc_mounts.h"
+#include "sysinfo/system_snapshot.h"
 
 namespace installer {
 
@@ -167,7 +167,7 @@ QString GetDeviceModelCapAndPath(const Device::Ptr device) {
 }
 
 QString GetInstallerDevicePath() {
-  const MountItemList list(ParseMountItems());
+  const SystemSnapshot::Ptr snapshot = SystemSnapshot::Current();
 
   // Parse symbolic link to mount point.
   QString casper_path(kCasperMountPoint);
@@ -181,7 +181,7 @@ QString GetInstallerDevicePath() {
     live_path = live_info.canonicalFilePath();
   }
 
-  for (const MountItem& item : list) {
+  for (const MountItem& item : snapshot->mounts()) {
     if (item.mount == casper_path || item.mount == live_path) {
       return item.path;
     }
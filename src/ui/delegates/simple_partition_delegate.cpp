@@ -717,6 +717,49 @@ void SimplePartitionDelegate::onDeviceRefreshed(const DeviceList& devices) {
     emit this->deviceRefreshed(virtual_devices_);
 }
 
+void SimplePartitionDelegate::onDevicesChanged(const DeviceListDiff& diff) {
+  qDebug() << "devices changed:" << diff;
+  QStringList device_paths(diff.removed);
+  for (const Device::Ptr& device : diff.changed) {
+    device_paths.append(device->path);
+  }
+
+  // Operations on other devices are kept.
+  OperationList operations;
+  for (const Operation& operation : operations_) {
+    const QString device_path =
+        (operation.type == OperationType::NewPartTable) ?
+        operation.device->path :
+        operation.orig_partition->device_path;
+    if (!device_paths.contains(device_path)) {
+      operations.append(operation);
+    }
+  }
+  operations_ = operations;
+
+  // Partition selected on a changed device does not exist any more.
+  if (!selected_partition_.isNull() &&
+      device_paths.contains(selected_partition_->device_path)) {
+    selected_partition_.reset();
+  }
+
+  ApplyDeviceListDiff(real_devices_, diff);
+
+  // Virtual devices not changed are kept.
+  DeviceList virtual_devices;
+  for (const Device::Ptr device : FilterInstallerDevice(real_devices_)) {
+    const int index = DeviceIndex(virtual_devices_, device->path);
+    if (index == -1 || device_paths.contains(device->path)) {
+      virtual_devices.append(device);
+    } else {
+      virtual_devices.append(virtual_devices_.at(index));
+    }
+  }
+  virtual_devices_ = virtual_devices;
+
+  emit this->deviceRefreshed(virtual_devices_);
+}
+
 void SimplePartitionDelegate::onManualPartDone(const DeviceList& devices) {
   qDebug() << "SimplePartitionDelegate::onManualPartDone()" << devices;
   QString root_disk;
@@ -115,6 +115,10 @@ class SimplePartitionDelegate : public QObject {
   // Save real device list when it is refreshed.
   void onDeviceRefreshed(const DeviceList& devices);
 
+  // Update real device list with |diff|, operations on changed devices are
+  // dropped.
+  void onDevicesChanged(const DeviceListDiff& diff);
+
   // Write partitioning settings to file.
   void onManualPartDone(const DeviceList& devices);
 
@@ -23,6 +23,7 @@
 #include <QLabel>
 #include <QScrollArea>
 #include <QScrollBar>
+#include <QShortcut>
 #include <QTimer>
 
 #include "base/file_util.h"
@@ -51,6 +52,7 @@ AdvancedPartitionFrame::AdvancedPartitionFrame(
     AdvancedPartitionDelegate* delegate_, QWidget* parent)
     : QFrame(parent),
       delegate_(delegate_),
+      device_layouts_(),
       validate_states_(),
       error_labels_() {
   this->setObjectName("advanced_partition_frame");
@@ -104,6 +106,12 @@ void AdvancedPartitionFrame::changeEvent(QEvent* event) {
 void AdvancedPartitionFrame::initConnections() {
   connect(delegate_, &AdvancedPartitionDelegate::deviceRefreshed,
           this, &AdvancedPartitionFrame::onDeviceRefreshed);
+  connect(delegate_, &AdvancedPartitionDelegate::deviceChanged,
+          this, &AdvancedPartitionFrame::onDeviceChanged);
+  connect(undo_shortcut_, &QShortcut::activated,
+          this, &AdvancedPartitionFrame::onUndoShortcutActivated);
+  connect(redo_shortcut_, &QShortcut::activated,
+          this, &AdvancedPartitionFrame::onRedoShortcutActivated);
   connect(bootloader_tip_button_, &QPushButton::clicked,
           this, &AdvancedPartitionFrame::requestSelectBootloaderFrame);
   connect(bootloader_button_, &QPushButton::clicked,
@@ -199,6 +207,10 @@ void AdvancedPartitionFrame::initUI() {
   bottom_layout->addStretch();
   bottom_layout->addWidget(editing_button_);
 
+  // Shortcuts are enabled only when this frame is visible.
+  undo_shortcut_ = new QShortcut(QKeySequence("Ctrl+Z"), this);
+  redo_shortcut_ = new QShortcut(QKeySequence("Ctrl+Shift+Z"), this);
+
   QFrame* bottom_frame = new QFrame();
   bottom_frame->setObjectName("bottom_frame");
   bottom_frame->setContentsMargins(0, 0, 0, 0);
@@ -345,33 +357,21 @@ void AdvancedPartitionFrame::repaintDevices() {
 
   // Remove all widgets in partition layout.
   ClearLayout(partition_layout_);
+  device_layouts_.clear();
+  hovered_part_button_ = nullptr;
 
+  // Each device is placed in its own frame, so that it can be repainted
+  // alone when deviceChanged() is emitted.
   for (const Device::Ptr device : delegate_->virtual_devices()) {
-    QLabel* model_label = new QLabel();
-    model_label->setObjectName("model_label");
-    model_label->setText(GetDeviceModelCapAndPath(device));
-    model_label->setContentsMargins(15, 10, 0, 5);
-    partition_layout_->addWidget(model_label, 0, Qt::AlignLeft);
-    for (const Partition::Ptr partition : device->partitions) {
-      if ((partition->type == PartitionType::Extended) || partition->busy) {
-        // Ignores extended partition and currently in-used partitions.
-        continue;
-      }
-      AdvancedPartitionButton* button = new AdvancedPartitionButton(partition);
-      button->setEditable(editing_button_->isChecked());
-      partition_layout_->addWidget(button);
-      partition_button_group_->addButton(button);
-      button->show();
-
-      connect(editing_button_, &QPushButton::toggled,
-              button, &AdvancedPartitionButton::setEditable);
-      connect(button, &AdvancedPartitionButton::editPartitionTriggered,
-              this, &AdvancedPartitionFrame::onEditPartitionTriggered);
-      connect(button, &AdvancedPartitionButton::newPartitionTriggered,
-              this, &AdvancedPartitionFrame::onNewPartitionTriggered);
-      connect(button, &AdvancedPartitionButton::deletePartitionTriggered,
-              this, &AdvancedPartitionFrame::onDeletePartitionTriggered);
-    }
+    QVBoxLayout* device_layout = new QVBoxLayout();
+    device_layout->setContentsMargins(0, 0, 0, 0);
+    device_layout->setSpacing(0);
+    QFrame* device_frame = new QFrame();
+    device_frame->setContentsMargins(0, 0, 0, 0);
+    device_frame->setLayout(device_layout);
+    partition_layout_->addWidget(device_frame);
+    device_layouts_.insert(device->path, device_layout);
+    this->addDeviceButtons(device, device_layout);
   }
 
   // Add stretch to expand vertically
@@ -383,6 +383,35 @@ void AdvancedPartitionFrame::repaintDevices() {
   this->updateValidateStates();
 }
 
+void AdvancedPartitionFrame::addDeviceButtons(const Device::Ptr device,
+                                              QVBoxLayout* layout) {
+  QLabel* model_label = new QLabel();
+  model_label->setObjectName("model_label");
+  model_label->setText(GetDeviceModelCapAndPath(device));
+  model_label->setContentsMargins(15, 10, 0, 5);
+  layout->addWidget(model_label, 0, Qt::AlignLeft);
+  for (const Partition::Ptr partition : device->partitions) {
+    if ((partition->type == PartitionType::Extended) || partition->busy) {
+      // Ignores extended partition and currently in-used partitions.
+      continue;
+    }
+    AdvancedPartitionButton* button = new AdvancedPartitionButton(partition);
+    button->setEditable(editing_button_->isChecked());
+    layout->addWidget(button);
+    partition_button_group_->addButton(button);
+    button->show();
+
+    connect(editing_button_, &QPushButton::toggled,
+            button, &AdvancedPartitionButton::setEditable);
+    connect(button, &AdvancedPartitionButton::editPartitionTriggered,
+            this, &AdvancedPartitionFrame::onEditPartitionTriggered);
+    connect(button, &AdvancedPartitionButton::newPartitionTriggered,
+            this, &AdvancedPartitionFrame::onNewPartitionTriggered);
+    connect(button, &AdvancedPartitionButton::deletePartitionTriggered,
+            this, &AdvancedPartitionFrame::onDeletePartitionTriggered);
+  }
+}
+
 void AdvancedPartitionFrame::scrollContentToTop() {
   scroll_area_->verticalScrollBar()->setValue(0);
 }
@@ -549,6 +578,31 @@ void AdvancedPartitionFrame::onDeviceRefreshed() {
   this->repaintDevices();
 }
 
+void AdvancedPartitionFrame::onDeviceChanged(const Device::Ptr device) {
+  QVBoxLayout* layout = device_layouts_.value(device->path, nullptr);
+  if (layout == nullptr) {
+    // Device list is changed, repaint all of them.
+    this->repaintDevices();
+    return;
+  }
+
+  // Remove buttons of this device from button group.
+  for (int index = 0; index < layout->count(); ++index) {
+    QAbstractButton* button =
+        qobject_cast<QAbstractButton*>(layout->itemAt(index)->widget());
+    if (button != nullptr) {
+      partition_button_group_->removeButton(button);
+    }
+  }
+  ClearLayout(layout);
+  hovered_part_button_ = nullptr;
+
+  this->addDeviceButtons(device, layout);
+
+  // Validate new states, as partitions of this device are updated.
+  this->updateValidateStates();
+}
+
 void AdvancedPartitionFrame::onEditButtonToggled(bool toggle) {
   if (toggle) {
     editing_button_->setText(tr("Done"));
@@ -609,4 +663,16 @@ void AdvancedPartitionFrame::onNewPartitionTriggered(
   }
 }
 
+void AdvancedPartitionFrame::onRedoShortcutActivated() {
+  if (delegate_->canRedo()) {
+    delegate_->redo();
+  }
+}
+
+void AdvancedPartitionFrame::onUndoShortcutActivated() {
+  if (delegate_->canUndo()) {
+    delegate_->undo();
+  }
+}
+
 }  // namespace installer
@@ -19,12 +19,14 @@
 #define INSTALLER_UI_FRAMES_INNER_ADVANCED_PARTITION_FRAME_H
 
 #include <QFrame>
+#include <QHash>
 #include <QVector>
 
 class QButtonGroup;
 class QLabel;
 class QPushButton;
 class QScrollArea;
+class QShortcut;
 class QVBoxLayout;
 
 #include "partman/partition.h"
@@ -84,6 +86,9 @@ class AdvancedPartitionFrame : public QFrame {
 
   void repaintDevices();
 
+  // Add model label and partition buttons of |device| to |layout|.
+  void addDeviceButtons(const Device::Ptr device, QVBoxLayout* layout);
+
   // Scroll to top of content area.
   void scrollContentToTop();
 
@@ -113,6 +118,12 @@ class AdvancedPartitionFrame : public QFrame {
   QVBoxLayout* msg_layout_ = nullptr;
   QLabel* msg_head_label_ = nullptr;
 
+  // Layout of partition buttons of each device, indexed by device path.
+  QHash<QString, QVBoxLayout*> device_layouts_;
+
+  QShortcut* undo_shortcut_ = nullptr;
+  QShortcut* redo_shortcut_ = nullptr;
+
   AdvancedValidateStates validate_states_;
 
   AdvancedPartitionButton* hovered_part_button_ = nullptr;
@@ -126,6 +137,9 @@ class AdvancedPartitionFrame : public QFrame {
 
   void onDeletePartitionTriggered(const Partition::Ptr partition);
   void onDeviceRefreshed();
+
+  // Repaint partition buttons of |device| only.
+  void onDeviceChanged(const Device::Ptr device);
   void onEditButtonToggled(bool toggle);
 
   // Handles editPartitionTriggered() signal from advanced partition button.
@@ -139,6 +153,9 @@ class AdvancedPartitionFrame : public QFrame {
 
   // Handles newPartitionTriggered() signal from advanced partition button.
   void onNewPartitionTriggered(const Partition::Ptr partition);
+
+  void onRedoShortcutActivated();
+  void onUndoShortcutActivated();
 };
 
 }  // namespace installer
@@ -379,6 +379,7 @@ void SystemInfoFormFrame::onNextButtonClicked()
         tooltip_->hide();
 
         // save config
+        ConfigTransaction transaction;
         WritePasswordStrong(GetSettingsBool(kSystemInfoPasswordStrongCheck));
 
         if (grub_password_check_->isChecked()) {
@@ -401,6 +402,7 @@ void SystemInfoFormFrame::onNextButtonClicked()
 
             WriteGrubPassword(match.captured(0).replace(" ", ""));
         }
+        transaction.commit();
 
         // Emit finished signal when all form inputs are ok.
         emit this->finished();
@@ -28,6 +28,7 @@
 
 #include "base/file_util.h"
 #include "base/thread_util.h"
+#include "partman/structs.h"
 #include "service/hooks_manager.h"
 #include "service/settings_manager.h"
 #include "service/settings_name.h"
@@ -54,6 +55,9 @@ const int kSimulationTimerInterval = 3000;
 
 const int kProgressAnimationDuration = 500;
 
+// Interval to refresh elapsed time of partition step.
+const int kPartitionTimerInterval = 1000;
+
 }  // namespace
 
 InstallProgressFrame::InstallProgressFrame(QWidget* parent)
@@ -62,7 +66,8 @@ InstallProgressFrame::InstallProgressFrame(QWidget* parent)
       progress_(0),
       hooks_manager_(new HooksManager()),
       hooks_manager_thread_(new QThread(this)),
-      simulation_timer_(new QTimer(this)) {
+      simulation_timer_(new QTimer(this)),
+      partition_timer_(new QTimer(this)) {
   this->setObjectName("install_progress_frame");
 
   hooks_manager_->moveToThread(hooks_manager_thread_);
@@ -74,6 +79,9 @@ InstallProgressFrame::InstallProgressFrame(QWidget* parent)
 
   simulation_timer_->setSingleShot(false);
   simulation_timer_->setInterval(kSimulationTimerInterval);
+
+  partition_timer_->setSingleShot(false);
+  partition_timer_->setInterval(kPartitionTimerInterval);
 }
 
 InstallProgressFrame::~InstallProgressFrame() {
@@ -102,6 +110,12 @@ void InstallProgressFrame::simulate() {
 void InstallProgressFrame::runHooks(bool ok) {
   qDebug() << "runHooks()" << ok;
 
+  // Partition job is done, restore comment text.
+  if (partition_timer_->isActive()) {
+    partition_timer_->stop();
+    comment_label_->setText(this->installingComment());
+  }
+
   if (ok) {
     // Partition operations take 5% progress.
     this->onProgressUpdate(kBeforeChrootStartVal);
@@ -117,6 +131,22 @@ void InstallProgressFrame::runHooks(bool ok) {
   }
 }
 
+void InstallProgressFrame::updatePartitionProgress(
+    const OperationProgress& progress) {
+  partition_progress_ = progress;
+  partition_step_timer_.start();
+  if (!partition_timer_->isActive()) {
+    partition_timer_->start();
+  }
+  this->updatePartitionStep();
+
+  // Partition operations take 5% progress, see runHooks().
+  progress_animation_->setEndValue(
+      kBeforeChrootStartVal * progress.overall * progress_bar_->maximum() /
+      10000);
+  progress_animation_->start();
+}
+
 void InstallProgressFrame::setProgress(int progress) {
   progress_ = progress;
   this->updateProgressBar(progress);
@@ -125,9 +155,7 @@ void InstallProgressFrame::setProgress(int progress) {
 void InstallProgressFrame::changeEvent(QEvent* event) {
   if (event->type() == QEvent::LanguageChange) {
     title_label_->setText(tr("Installing"));
-    comment_label_->setText(
-        tr("You can experience the incredible pleasure of deepin after "
-           "the time for just a cup of coffee"));
+    comment_label_->setText(this->installingComment());
   } else {
     QFrame::changeEvent(event);
   }
@@ -140,19 +168,26 @@ void InstallProgressFrame::initConnections() {
           this, &InstallProgressFrame::onHooksFinished);
   connect(hooks_manager_, &HooksManager::processUpdate,
           this, &InstallProgressFrame::onProgressUpdate);
+  connect(hooks_manager_, &HooksManager::finalizeProgress,
+          this, &InstallProgressFrame::onFinalizeProgress);
 
   connect(hooks_manager_thread_, &QThread::finished,
           hooks_manager_, &HooksManager::deleteLater);
 
   connect(simulation_timer_, &QTimer::timeout,
           this, &InstallProgressFrame::onSimulationTimerTimeout);
+  connect(partition_timer_, &QTimer::timeout,
+          this, &InstallProgressFrame::updatePartitionStep);
+}
+
+QString InstallProgressFrame::installingComment() const {
+  return tr("You can experience the incredible pleasure of deepin after "
+            "the time for just a cup of coffee");
 }
 
 void InstallProgressFrame::initUI() {
   title_label_ = new TitleLabel(tr("Installing"));
-  comment_label_ = new CommentLabel(
-      tr("You can experience the incredible pleasure of deepin after "
-         "the time for just a cup of coffee"));
+  comment_label_ = new CommentLabel(this->installingComment());
   QHBoxLayout* comment_layout = new QHBoxLayout();
   comment_layout->setContentsMargins(0, 0, 0, 0);
   comment_layout->setSpacing(0);
@@ -231,6 +266,43 @@ void InstallProgressFrame::updateProgressBar(int progress) {
   progress_bar_->repaint();
 }
 
+void InstallProgressFrame::updatePartitionStep() {
+  const OperationProgress& progress = partition_progress_;
+  QString step;
+  switch (progress.phase) {
+    case OperationPhase::Discard: {
+      step = tr("Discarding %1").arg(progress.path);
+      break;
+    }
+    case OperationPhase::Commit: {
+      step = tr("Writing partition table to %1").arg(progress.path);
+      break;
+    }
+    case OperationPhase::Settle: {
+      step = tr("Waiting for %1").arg(progress.path);
+      break;
+    }
+    case OperationPhase::Mkfs: {
+      step = tr("Formatting %1").arg(progress.path);
+      break;
+    }
+  }
+  if (progress.percent > 0 && progress.percent < 100) {
+    step += QString(" %1%").arg(progress.percent);
+  }
+
+  // Step is still running if it is not 100%.
+  qint64 elapsed = progress.elapsed;
+  if (progress.percent < 100) {
+    elapsed += partition_step_timer_.elapsed();
+  }
+  comment_label_->setText(tr("Step %1 of %2: %3, %4s")
+                              .arg(progress.index + 1)
+                              .arg(progress.total)
+                              .arg(step)
+                              .arg(elapsed / 1000));
+}
+
 void InstallProgressFrame::onHooksErrorOccurred() {
   failed_ = true;
   slide_frame_->stopSlide();
@@ -239,6 +311,7 @@ void InstallProgressFrame::onHooksErrorOccurred() {
 
 void InstallProgressFrame::onHooksFinished() {
   failed_ = false;
+  comment_label_->setText(this->installingComment());
 
   // Set progress value to 100 explicitly.
   this->onProgressUpdate(100);
@@ -247,6 +320,26 @@ void InstallProgressFrame::onHooksFinished() {
                      this, &InstallProgressFrame::onRetainingTimerTimeout);
 }
 
+void InstallProgressFrame::onFinalizeProgress(
+    const FinalizeProgress& progress) {
+  if (progress.phase == FinalizePhase::Unmount) {
+    comment_label_->setText(tr("Unmounting %1").arg(progress.path));
+    return;
+  }
+
+  // Round up so that a few KiB left is not shown as 0 MiB.
+  const qint64 remaining = (progress.remaining + kMebiByte - 1) / kMebiByte;
+  if (progress.eta < 0) {
+    comment_label_->setText(
+        tr("Writing data to disk, %1 MiB left").arg(remaining));
+  } else {
+    comment_label_->setText(
+        tr("Writing data to disk, %1 MiB left, about %2s")
+            .arg(remaining)
+            .arg(progress.eta));
+  }
+}
+
 void InstallProgressFrame::onProgressUpdate(int progress) {
   // Multiple progress value by 10 to fit progress_bar_ range.
   const int virtual_progress = progress * 10;
@@ -18,7 +18,12 @@
 #ifndef INSTALLER_UI_FRAMES_INSTALL_PROGRESS_FRAME_H
 #define INSTALLER_UI_FRAMES_INSTALL_PROGRESS_FRAME_H
 
+#include <QElapsedTimer>
 #include <QFrame>
+
+#include "partman/operation.h"
+#include "service/backend/target_finalizer.h"
+
 class QLabel;
 class QProgressBar;
 class QPropertyAnimation;
@@ -55,6 +60,10 @@ class InstallProgressFrame : public QFrame {
   // Run hooks when partition job is done
   void runHooks(bool ok);
 
+  // Show progress of partition job, which takes progress value from 0 to
+  // kBeforeChrootStartVal.
+  void updatePartitionProgress(const OperationProgress& progress);
+
   void setProgress(int progress);
 
   // Update progress value with a QTimer object.
@@ -72,9 +81,15 @@ class InstallProgressFrame : public QFrame {
   void initConnections();
   void initUI();
 
+  // Returns comment text shown while system is being installed.
+  QString installingComment() const;
+
   // Update value of progress bar to |progress| and update tooltip position.
   void updateProgressBar(int progress);
 
+  // Show current step of partition job in comment label.
+  void updatePartitionStep();
+
   bool failed_;
 
   // Progress value.
@@ -93,6 +108,12 @@ class InstallProgressFrame : public QFrame {
 
   QTimer* simulation_timer_ = nullptr;
 
+  // Latest progress of partition job, and time since it is received.
+  OperationProgress partition_progress_;
+  QElapsedTimer partition_step_timer_;
+  // Refresh elapsed time of current partition step.
+  QTimer* partition_timer_ = nullptr;
+
  private slots:
   // Handles error state
   void onHooksErrorOccurred();
@@ -100,6 +121,10 @@ class InstallProgressFrame : public QFrame {
   // Handles successful installation.
   void onHooksFinished();
 
+  // Show what is done after all hooks, while /target is synced and
+  // unmounted.
+  void onFinalizeProgress(const FinalizeProgress& progress);
+
   void onProgressUpdate(int progress);
 
   void onRetainingTimerTimeout();
@@ -119,6 +119,8 @@ void PartitionFrame::initConnections() {
           this, &PartitionFrame::autoPartDone);
   connect(partition_model_, &PartitionModel::manualPartDone,
           this, &PartitionFrame::onManualPartDone);
+  connect(partition_model_, &PartitionModel::manualPartProgress,
+          this, &PartitionFrame::manualPartProgress);
 
   connect(advanced_partition_frame_,
           &AdvancedPartitionFrame::requestEditPartitionFrame,
@@ -173,19 +175,31 @@ void PartitionFrame::initConnections() {
           this, &PartitionFrame::showMainFrame);
   connect(advanced_delegate_, &AdvancedPartitionDelegate::deviceRefreshed,
           select_bootloader_frame_, &SelectBootloaderFrame::deviceRefreshed);
+  connect(advanced_delegate_, &AdvancedPartitionDelegate::deviceChanged,
+          this, [=] {
+    select_bootloader_frame_->deviceRefreshed(
+        advanced_delegate_->virtual_devices());
+  });
 
   connect(partition_model_, &PartitionModel::deviceRefreshed,
           advanced_delegate_, &AdvancedPartitionDelegate::onDeviceRefreshed);
+  connect(partition_model_, &PartitionModel::devicesChanged,
+          advanced_delegate_, &AdvancedPartitionDelegate::onDevicesChanged);
 
   if (!GetSettingsBool(kPartitionSkipSimplePartitionPage)) {
     connect(partition_model_, &PartitionModel::deviceRefreshed,
             simple_partition_delegate_,
             &SimplePartitionDelegate::onDeviceRefreshed);
+    connect(partition_model_, &PartitionModel::devicesChanged,
+            simple_partition_delegate_,
+            &SimplePartitionDelegate::onDevicesChanged);
 
   }
   if (!GetSettingsBool(kPartitionSkipFullDiskPartitionPage)) {
     connect(partition_model_, &PartitionModel::deviceRefreshed,
             full_disk_delegate_, &FullDiskDelegate::onDeviceRefreshed);
+    connect(partition_model_, &PartitionModel::devicesChanged,
+            full_disk_delegate_, &FullDiskDelegate::onDevicesChanged);
   }
 
   // TODO(Shaohua): Show warning page both in full-disk frame and
@@ -461,6 +475,7 @@ void PartitionFrame::onFullDiskCryptoButtonClicked(bool encrypto)
 void PartitionFrame::onManualPartDone(bool ok, const DeviceList& devices) {
   if (ok) {
     // Write settings to file.
+    ConfigTransaction transaction;
     if (this->isSimplePartitionMode()) {
       simple_partition_delegate_->onManualPartDone(devices);
     } else if (this->isFullDiskPartitionMode()) {
@@ -69,6 +69,9 @@ class PartitionFrame : public QFrame {
   void autoPartDone(bool ok);
   void manualPartDone(bool ok);
 
+  // Emitted while partition job is running.
+  void manualPartProgress(const OperationProgress& progress);
+
  public slots:
   // Notify delegate to scan devices.
   void scanDevices() const;
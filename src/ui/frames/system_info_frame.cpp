@@ -60,7 +60,8 @@ void SystemInfoFrame::readConf() {
 }
 
 void SystemInfoFrame::writeConf() {
-  // Notify sub-pages to save settings.
+  // Notify sub-pages to save settings, and write them at once.
+  ConfigTransaction transaction;
   avatar_frame_->writeConf();
   form_frame_->writeConf();
   keyboard_frame_->writeConf();
@@ -194,6 +194,9 @@ void MainWindow::initConnections() {
           install_progress_frame_, &InstallProgressFrame::runHooks);
   connect(partition_frame_, &PartitionFrame::manualPartDone,
           install_progress_frame_, &InstallProgressFrame::runHooks);
+  connect(partition_frame_, &PartitionFrame::manualPartProgress,
+          install_progress_frame_,
+          &InstallProgressFrame::updatePartitionProgress);
 
   connect(close_button_, &QPushButton::clicked,
           this, &MainWindow::onCloseButtonClicked);
@@ -17,9 +17,11 @@
 
 #include "ui/models/partition_model.h"
 
+#include <QFile>
 #include <QThread>
 
 #include "base/thread_util.h"
+#include "partman/partition_format.h"
 #include "partman/partition_manager.h"
 #include "service/settings_manager.h"
 #include "service/settings_name.h"
@@ -27,12 +29,83 @@
 
 namespace installer {
 
+namespace {
+
+// Absolute path to builtin auto_part.sh.
+const char kBuiltinAutoPartFile[] = BUILTIN_HOOKS_DIR "/auto_part.sh";
+
+// Read auto partitioning policy from settings. Returns false if
+// |script_path| shall be run instead, as it is customized or the policy is
+// not supported.
+bool ReadAutoPartPolicy(const QString& script_path, AutoPartPolicy& policy) {
+  if (!GetSettingsBool(kPartitionNativeAutoPart) ||
+      script_path != kBuiltinAutoPartFile) {
+    return false;
+  }
+  const QString custom_script =
+      GetSettingsValue("DI_CUSTOM_PARTITION_SCRIPT").toString();
+  if (!custom_script.isEmpty() && QFile::exists(custom_script)) {
+    return false;
+  }
+  policy.crypt_password = GetSettingsValue("DI_CRYPT_PASSWD").toString();
+  const bool crypt = !policy.crypt_password.isEmpty();
+  if (crypt) {
+    // Written by WriteLuksOptions(), defaults of cryptsetup are used if
+    // they are not set.
+    policy.luks.cipher = GetSettingsValue("DI_CRYPT_CIPHER").toString();
+    policy.luks.key_size = GetSettingsValue("DI_CRYPT_KEY_SIZE").toInt();
+    policy.luks.pbkdf = GetSettingsValue("DI_CRYPT_PBKDF").toString();
+    policy.luks.pbkdf_memory =
+        GetSettingsValue("DI_CRYPT_PBKDF_MEMORY").toInt();
+    policy.luks.pbkdf_parallel =
+        GetSettingsValue("DI_CRYPT_PBKDF_PARALLEL").toInt();
+    policy.luks.pbkdf_iterations =
+        GetSettingsValue("DI_CRYPT_PBKDF_ITERATIONS").toInt();
+    policy.luks.iter_time = GetSettingsValue("DI_CRYPT_ITER_TIME").toInt();
+  }
+
+  policy.device_path = GetSettingsValue("DI_FULLDISK_DEVICE").toString();
+  policy.efi = IsEfiEnabled();
+  policy.swap_size = GetSettingsValue("DI_SWAP_SIZE").toInt();
+  policy.minimum_disk_space =
+      GetSettingsInt(kPartitionMinimumDiskSpaceRequired);
+  policy.large_disk_threshold =
+      GetSettingsInt(kPartitionFullDiskLargeDiskThreshold);
+  const QStringList root_range =
+      GetSettingsString(kPartitionFullDiskLargeRootPartRange).split(':');
+  if (root_range.length() == 2) {
+    policy.root_min = root_range.at(0).toInt();
+    policy.root_max = root_range.at(1).toInt();
+  }
+
+  const QString small_name = GetFullDiskPolicyName(false, policy.efi, crypt);
+  policy.small_rules =
+      ParseAutoPartRules(GetSettingsString(small_name + "_policy"),
+                         GetSettingsString(small_name + "_label"));
+  const QString large_name = GetFullDiskPolicyName(true, policy.efi, crypt);
+  policy.large_rules =
+      ParseAutoPartRules(GetSettingsString(large_name + "_policy"),
+                         GetSettingsString(large_name + "_label"));
+  return IsNativeAutoPartSupported(policy.small_rules) &&
+         IsNativeAutoPartSupported(policy.large_rules);
+}
+
+}  // namespace
+
 PartitionModel::PartitionModel(QObject* parent)
     : QObject(parent),
       partition_manager_(new PartitionManager()),
       partition_thread_(new QThread(this)) {
   this->setObjectName("partition_model");
 
+  FormatOptions format_options;
+  if (GetSettingsBool(kPartitionParallelFormat)) {
+    format_options.jobs_per_device =
+        qMax(1, GetSettingsInt(kPartitionFormatJobsPerDevice));
+  }
+  format_options.profile =
+      ParseFormatProfile(GetSettingsString(kPartitionFormatProfile));
+  partition_manager_->setFormatOptions(format_options);
   partition_manager_->moveToThread(partition_thread_);
   partition_thread_->start();
 
@@ -45,8 +118,15 @@ PartitionModel::~PartitionModel() {
 }
 
 void PartitionModel::autoPart() {
-  const QString script_path = GetAutoPartFile();
-  emit partition_manager_->autoPart(script_path);
+  if (!GetSettingsValue("DI_CRYPT_PASSWD").toString().isEmpty() &&
+      GetSettingsBool(kPartitionLuksAutoTune)) {
+    // Benchmark in background thread, partitioning is started in
+    // onLuksTuned().
+    emit partition_manager_->tuneLuks(
+        GetSettingsInt(kPartitionLuksUnlockTime));
+  } else {
+    this->startAutoPart();
+  }
 }
 
 void PartitionModel::createPartitionTable(const QString& device_path) {
@@ -79,13 +159,62 @@ void PartitionModel::scanDevices() {
   }
 }
 
+void PartitionModel::startAutoPart() {
+  const QString script_path = GetAutoPartFile();
+  AutoPartPolicy policy;
+  if (ReadAutoPartPolicy(script_path, policy)) {
+    if (!policy.crypt_password.isEmpty()) {
+      // Do not keep passphrase in config file, as auto_part.sh does.
+      WriteFullDiskEncryptPassword("NULL");
+    }
+    emit partition_manager_->nativeAutoPart(policy);
+  } else {
+    emit partition_manager_->autoPart(script_path);
+  }
+}
+
 void PartitionModel::initConnections() {
   connect(partition_manager_, &PartitionManager::autoPartDone,
           this, &PartitionModel::autoPartDone);
+  connect(partition_manager_, &PartitionManager::nativeAutoPartDone,
+          this, &PartitionModel::onNativeAutoPartDone);
+  connect(partition_manager_, &PartitionManager::luksTuned,
+          this, &PartitionModel::onLuksTuned);
   connect(partition_manager_, &PartitionManager::manualPartDone,
           this, &PartitionModel::manualPartDone);
+  connect(partition_manager_, &PartitionManager::manualPartProgress,
+          this, &PartitionModel::manualPartProgress);
   connect(partition_manager_, &PartitionManager::devicesRefreshed,
           this, &PartitionModel::deviceRefreshed);
+  connect(partition_manager_, &PartitionManager::devicesChanged,
+          this, &PartitionModel::devicesChanged);
+}
+
+void PartitionModel::onLuksTuned(const LuksTuning& tuning) {
+  WriteLuksOptions(tuning.cipher,
+                   tuning.key_size,
+                   tuning.pbkdf,
+                   tuning.pbkdf_memory,
+                   tuning.pbkdf_parallel,
+                   tuning.pbkdf_iterations,
+                   tuning.iter_time);
+  this->startAutoPart();
+}
+
+void PartitionModel::onNativeAutoPartDone(bool ok,
+                                          const AutoPartResult& result) {
+  if (ok) {
+    ConfigTransaction transaction;
+    WritePartitionInfo(result.root_disk,
+                       result.root_partition,
+                       result.bootloader,
+                       result.mount_points);
+    if (!result.crypt_partition.isEmpty()) {
+      WriteFullDiskCryptInfo(result.crypt_partition, result.crypt_target);
+    }
+    WriteUEFI(IsEfiEnabled());
+  }
+  emit this->autoPartDone(ok);
 }
 
 }  // namespace installer
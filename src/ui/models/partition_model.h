@@ -22,7 +22,9 @@
 #include <QObject>
 class QThread;
 
+#include "partman/auto_part.h"
 #include "partman/device.h"
+#include "partman/luks_tuning.h"
 #include "partman/operation.h"
 
 namespace installer {
@@ -46,9 +48,15 @@ class PartitionModel : public QObject {
   // Emitted after scanning local disk devices.
   void deviceRefreshed(const DeviceList& devices);
 
+  // Emitted when some devices are plugged in, removed or changed later.
+  void devicesChanged(const DeviceListDiff& diff);
+
   // Emitted when manual partitioning job is done.
   void manualPartDone(bool ok, const DeviceList& devices);
 
+  // Emitted while manual partitioning job is running.
+  void manualPartProgress(const OperationProgress& progress);
+
  public slots:
   // Notify PartitionManager to do auto-part
   void autoPart();
@@ -66,8 +74,19 @@ class PartitionModel : public QObject {
  private:
   void initConnections();
 
+  // Run native auto partitioning, or auto_part.sh if it is customized or
+  // the policy is not supported.
+  void startAutoPart();
+
   PartitionManager* partition_manager_ = nullptr;
   QThread* partition_thread_ = nullptr;
+
+ private slots:
+  // Save LUKS options and start auto partitioning.
+  void onLuksTuned(const LuksTuning& tuning);
+
+  // Save partitioning settings and emit autoPartDone().
+  void onNativeAutoPartDone(bool ok, const AutoPartResult& result);
 };
 
 }  // namespace installer
@@ -0,0 +1,102 @@
+#!/bin/bash
+#
+# Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# A/B benchmark of install time mount options, see install_mount_options_*
+# in default_settings.ini.
+# Base filesystem is extracted into a loop device formatted with |fstype|,
+# mounted with default options and with install time options in turn, and
+# synced, as before_chroot/ hooks do. Then a package installation workload
+# of small file creation and rewriting is run, as in_chroot/ hooks do.
+# Total time of each round is printed.
+#
+# Usage: benchmark_mount_options.sh filesystem.squashfs [fstype] [options] [rounds]
+# Requires root privilege.
+# Disk image is created in a new folder in ${BENCHMARK_DIR}, /tmp by default.
+# Set it to a folder on disk if /tmp is a small tmpfs, or to compare disks.
+
+SQUASHFS=$1
+FSTYPE=${2:-ext4}
+OPTIONS=${3:-noatime,lazytime,commit=60}
+ROUNDS=${4:-3}
+
+BENCHMARK_DIR=${BENCHMARK_DIR:-/tmp}
+
+if [ ! -f "${SQUASHFS}" ] || [ $(id -u) -ne 0 ]; then
+  echo "Usage: [BENCHMARK_DIR=dir] $0 filesystem.squashfs [fstype] [options] [rounds]"
+  echo "Run as root."
+  exit 1
+fi
+
+# Image has room for 4 times the size of squashfs, in MiB.
+SIZE=$(unsquashfs -s "${SQUASHFS}" | awk '/Filesystem size/ {print $3}' | \
+       cut -d. -f1)
+IMAGE_SIZE=$((SIZE * 4 / 1024 + 1024))
+AVAIL_SIZE=$(df -P -m "${BENCHMARK_DIR}" | awk 'NR == 2 {print $4}')
+if [ -z "${AVAIL_SIZE}" ] || [ "${AVAIL_SIZE}" -lt "${IMAGE_SIZE}" ]; then
+  echo "Not enough space in ${BENCHMARK_DIR}: ${AVAIL_SIZE:-0}M available," \
+       "${IMAGE_SIZE}M required. Set BENCHMARK_DIR to a folder on disk."
+  exit 1
+fi
+
+WORK_DIR=$(mktemp -d "${BENCHMARK_DIR}/deepin-installer-mount-benchmark.XXXXXX") || \
+  exit 1
+IMAGE=${WORK_DIR}/disk.img
+TARGET=${WORK_DIR}/target
+
+cleanup() {
+  umount ${TARGET} 2>/dev/null
+  [ -n "${LOOP_DEV}" ] && losetup -d ${LOOP_DEV}
+  rm -rf ${WORK_DIR}
+}
+trap cleanup EXIT
+
+mkdir -p ${TARGET}
+truncate -s ${IMAGE_SIZE}M ${IMAGE}
+LOOP_DEV=$(losetup --find --show ${IMAGE}) || exit 1
+
+# Run one round with mount options ${1}. Prints elapsed seconds.
+run_round() {
+  local MOUNT_ARGS START END
+  [ -n "${1}" ] && MOUNT_ARGS="-o ${1}"
+  wipefs -a ${LOOP_DEV} >/dev/null
+  mkfs.${FSTYPE} -q ${LOOP_DEV} >/dev/null || return 1
+  sync
+  echo 3 > /proc/sys/vm/drop_caches
+
+  START=$(date +%s.%N)
+  mount ${MOUNT_ARGS} ${LOOP_DEV} ${TARGET} || return 1
+  unsquashfs -f -n -d ${TARGET} "${SQUASHFS}" >/dev/null || return 1
+  # Package installation rewrites many small files and reads others.
+  mkdir -p ${TARGET}/tmp
+  for i in $(seq 1 2000); do
+    cp /etc/passwd ${TARGET}/tmp/pkg-${i}
+    mv ${TARGET}/tmp/pkg-${i} ${TARGET}/tmp/pkg-${i}.new
+  done
+  find ${TARGET}/usr/share/doc -type f -exec cat {} + >/dev/null 2>&1
+  sync -f ${TARGET}
+  umount ${TARGET}
+  END=$(date +%s.%N)
+  echo "${END} - ${START}" | bc
+}
+
+echo "fstype: ${FSTYPE}, install options: ${OPTIONS}, rounds: ${ROUNDS}"
+for round in $(seq 1 ${ROUNDS}); do
+  DEFAULT_TIME=$(run_round "") || exit 1
+  PROFILE_TIME=$(run_round "${OPTIONS}") || exit 1
+  echo "round ${round}: default ${DEFAULT_TIME}s, install options ${PROFILE_TIME}s"
+done